@@ -394,6 +394,7 @@ extern DebugAssertProc slibDebugAssertHandler;
 #  define FILE_AttachToFile         FILE_AttachToFileU
 #  define FILE_OpenURL              FILE_OpenURLU
 #  define FILE_AuthURL              FILE_AuthURLU
+#  define URL_Fetch                 URL_FetchU
 #  define FILE_Split                FILE_SplitU
 #  define FILE_Split2               FILE_Split2U
 #  define FILE_IsFileIO             FILE_IsFileIOU
@@ -420,6 +421,10 @@ extern DebugAssertProc slibDebugAssertHandler;
 #  define hashCaseCompareStringKey  hashCaseCompareStringKeyU
 #  define stringHashProc            stringHashProcU
 #  define stringCaseHashProc        stringCaseHashProcU
+#  define stringSeedHashProc        stringSeedHashProcU
+#  define stringCaseSeedHashProc    stringCaseSeedHashProcU
+#  define strbufSeedHashProc        strbufSeedHashProcU
+#  define hashCompareStrBufKey      hashCompareStrBufKeyU
 
 /* s_hist */
 #  define HIST1D_Create             HIST1D_CreateU
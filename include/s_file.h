@@ -55,10 +55,26 @@ extern "C" {
 #define FILE_ZIP_OUT        0x0002  /* compress output stream */
 #define FILE_ZIP_ZHDR       0x0004  /* read and write zlib header */
 #define FILE_ZIP_GZIP       0x0008  /* read and write gzip header */
+#define FILE_ZIP_PARALLEL   0x0010  /* compress output on many threads */
 
 #define FILE_ZIP_NONE       0       /* no compression */
 #define FILE_ZIP_ALL        (FILE_ZIP_IN | FILE_ZIP_OUT)
 
+/*
+ * Parameters for FILE_SetParam
+ */
+#define FILE_PARAM_HIWATER  TEXT("hiwater") /* size_t, FILE_BufferedOut */
+#define FILE_PARAM_NONBLOCK TEXT("nonblock") /* Bool, socket streams */
+#define FILE_PARAM_CORK     TEXT("cork")     /* Bool, socket streams */
+#define FILE_PARAM_RTIMEOUT TEXT("rtimeout") /* Time (ms), socket streams */
+#define FILE_PARAM_WTIMEOUT TEXT("wtimeout") /* Time (ms), socket streams */
+
+/*
+ * Flags for FILE_AttachToSocket2
+ */
+#define FILE_SOCK_NONBLOCK  0x0001  /* non-blocking mode */
+#define FILE_SOCK_CORK      0x0002  /* buffer output until flushed */
+
 /*
  * File is a context associted with an open file.
  * FileIO defines the set of functions that actualy do the I/O
@@ -67,6 +83,14 @@ typedef struct _File File;
 typedef struct _FileIO FileIO;
 typedef const FileIO* IODesc;
 
+/*
+ * A piece of data for scatter/gather I/O (FILE_ReadV and FILE_WriteV)
+ */
+typedef struct _FileVec {
+    void * data;        /* the data */
+    size_t len;         /* number of bytes */
+} FileVec;
+
 /*
  * Set of file functions for plain file I/O
  */
@@ -79,6 +103,14 @@ extern const FileIO PlainFileIO;
 extern const FileIO SocketIO;
 #define SocketFile (&SocketIO)
 
+/*
+ * Set of file functions for read-only memory mapped file I/O
+ */
+#if defined(_UNIX) && !defined(__KERNEL__)
+extern const FileIO MappedFileIO;
+#define MappedFile (&MappedFileIO)
+#endif /* _UNIX && !__KERNEL__ */
+
 /*
  * A set of handlers for doing gzipped file I/O. Must have zlib in order
  * to have this functionality
@@ -117,9 +149,16 @@ extern int    FILE_Read     P_((File * f, void * buf, int len));
 extern Bool   FILE_ReadAll  P_((File * f, void * buf, int len));
 extern int    FILE_Write    P_((File * f, const void * buf, int len));
 extern Bool   FILE_WriteAll P_((File * f, const void * buf, int len));
+extern I64s   FILE_Read64   P_((File * f, void * buf, size_t len));
+extern I64s   FILE_Write64  P_((File * f, const void * buf, size_t len));
+extern I64s   FILE_ReadV    P_((File * f, const FileVec * vec, int n));
+extern I64s   FILE_WriteV   P_((File * f, const FileVec * vec, int n));
 extern size_t FILE_Skip     P_((File * f, size_t skip));
 extern Bool   FILE_SkipAll  P_((File * f, size_t skip));
 extern int    FILE_PushBack P_((File * f, const void * buf, int len));
+extern size_t FILE_Peek     P_((File * f, const void ** data, size_t min));
+extern Bool   FILE_Consume  P_((File * f, size_t n));
+extern Bool   FILE_MapView  P_((File * f, const void ** data, size_t * size));
 extern int    FILE_Printf   P_((File * f, Str format, ...) PRINTF_ATTR(2,3));
 extern int    FILE_VaPrintf P_((File * f, Str format, va_list va));
 extern Bool   FILE_Puts     P_((File * f, Str s));
@@ -139,6 +178,8 @@ extern void   FILE_Finish   P_((File * f));
 extern void   FILE_Close    P_((File * f));
 extern Bool   FILE_IsFileIO P_((File * f));
 extern Bool   FILE_CanBlock P_((File * f));
+extern Bool   FILE_WouldBlock P_((File * f));
+extern Bool   FILE_TimedOut P_((File * f));
 extern size_t FILE_BytesRead P_((File * f));
 extern size_t FILE_BytesWritten P_((File * f));
 
@@ -147,11 +188,34 @@ extern File * FILE_SubStream P_((File * f, size_t maxread));
 extern Bool   FSUB_Reset P_((File * sub, size_t maxread));
 extern Bool   FSUB_SkipRest P_((File * sub));
 
+/* read-ahead buffer, zero bufsize selects the default size */
+extern File * FILE_Buffered   P_((File * f, size_t bufsize));
+extern Bool   FILE_IsBuffered P_((const File * f));
+
+/* buffered output, data can be formatted directly in the buffer */
+extern File * FILE_BufferedOut   P_((File * f, size_t bufsize));
+extern Bool   FILE_IsBufferedOut P_((const File * f));
+extern void * FILE_Reserve  P_((File * f, size_t len));
+extern void * FILE_Reserve2 P_((File * f, size_t len, size_t * avail));
+extern Bool   FILE_Commit   P_((File * f, size_t len));
+
+/* read-ahead on a separate thread, zero arguments select the defaults */
+extern File * FILE_Prefetch P_((File * f, int nbuffers, size_t bufsize));
+
 /* compress/decompress the stream. */
 extern File * FILE_Zip P_((File * f, int flags));
 extern File * FILE_Zip2 P_((File * f, int flags, int level));
+extern File * FILE_Zip3 P_((File * f, int flags, int level, int nthreads));
 extern Bool   FILE_ZipFinish P_((File * f));
 
+/* random access to gzip and zlib streams */
+typedef struct _ZipIndex ZipIndex;
+extern ZipIndex * FILE_ZipIndexBuild P_((File * in, I64s span));
+extern ZipIndex * FILE_ZipIndexLoad P_((File * in));
+extern Bool   FILE_ZipIndexSave P_((const ZipIndex * index, File * out));
+extern void   FILE_ZipIndexDelete P_((ZipIndex * index));
+extern File * FILE_ZipSeek P_((File * in, const ZipIndex * index, I64s off));
+
 /* backward compatibility */
 #define FILE_Compress(_f,_fl) FILE_Zip(_f, (_fl) | FILE_ZIP_GZIP)
 #define FILE_COMPRESS_IN    FILE_ZIP_IN
@@ -159,8 +223,14 @@ extern Bool   FILE_ZipFinish P_((File * f));
 #define FILE_COMPRESS_NONE  0
 #define FILE_COMPRESS_ALL  (FILE_ZIP_IN | FILE_ZIP_OUT)
 
+/* module initialization */
+extern void FILE_InitModule P_((void));
+extern void FILE_Shutdown P_((void));
+
 /* attach to existing file/socket */
 extern File * FILE_AttachToSocket P_((Socket s));
+extern File * FILE_AttachToSocket2 P_((Socket s, int flags));
+extern Socket FILE_Socket P_((File * f));
 #ifndef __KERNEL__
 extern File * FILE_AttachToFile   P_((FILE * file, Str name));
 #endif /* __KERNEL__ */
@@ -169,6 +239,15 @@ extern File * FILE_AttachToFile   P_((FILE * file, Str name));
 extern File * FILE_OpenURL P_((Str url));
 extern File * FILE_AuthURL P_((Str url, Str username, Str password));
 
+/* fetch many URLs reusing the connections */
+typedef struct _UrlFetcher UrlFetcher;
+extern UrlFetcher * URL_FetcherCreate P_((int nthreads));
+extern void URL_FetcherDelete P_((UrlFetcher * fetcher));
+extern File * URL_Fetch P_((UrlFetcher * fetcher, Str url,
+    Str username, Str password));
+extern void URL_InitModule P_((void));
+extern void URL_Shutdown P_((void));
+
 /* dummy file - consumes all output, provides no input */
 extern File * FILE_Null     P_((void));
 extern Bool   FILE_IsNull   P_((const File * f));
@@ -202,6 +281,9 @@ extern Str    FILE_ReadLine P_((File * in, StrBuf * sb));
 extern int    FILE_ReadData P_((File * in, Buffer * out, int max));
 extern int    FILE_Copy     P_((File * in, File * out));
 extern int    FILE_CopyN    P_((File * in, File * out, int max));
+extern I64s   FILE_ReadData64 P_((File * in, Buffer * out, I64s max));
+extern I64s   FILE_Copy64   P_((File * in, File * out));
+extern I64s   FILE_CopyN64  P_((File * in, File * out, I64s max));
 extern void   FILE_Dump     P_((File* out, const void* buf, size_t off,
                                 size_t len, size_t max));
 /* handy macros */
@@ -217,6 +217,16 @@ extern Bool FILE_ReadMultiByteSizeT P_((File * in, size_t * result));
 #  define _FILE_ReadMultiByteSizeT(f,l)   FILE_ReadMultiByte32(f,(I32u*)(l))
 #endif /* !__LONG_64__ */
 
+/*
+ * Text output without format parsing. FILE_PutDouble prints the value
+ * with the specified number of digits after the decimal point, negative
+ * precision selects the printf default (6).
+ */
+extern Bool FILE_PutInt    P_((File * f, int value));
+extern Bool FILE_PutI64    P_((File * f, I64s value));
+extern Bool FILE_PutU64    P_((File * f, I64u value));
+extern Bool FILE_PutDouble P_((File * f, double value, int prec));
+
 #ifdef __cplusplus
 } /* end of extern "C" */
 #endif  /* __cplusplus */
@@ -80,11 +80,17 @@ typedef const void * HashValueC;
  *
  * HashFree    - cleanup procedure invoked when a key/value pair gets
  *               removed from the hashtable.
+ *
+ * HashCompute - callback for use with HASH_ConcurrentCompute(). Receives
+ *               the current value (nullValue if there's none) and may
+ *               change it. Returns True to store the value, False to
+ *               remove the entry.
  */
 typedef Bool (*HashCompare)P_((HashKeyC key1, HashKeyC key2));
 typedef HashCode (*HashProc)P_((HashKeyC key));
 typedef void (*HashFree)P_((HashKey key, HashValue value));
 typedef Bool (*HashCB)P_((HashKey key, HashValue value, void * ctx));
+typedef Bool (*HashCompute)P_((HashKeyC key, HashValue * value, void * ctx));
 
 /*
  * A few simple callback functions.
@@ -97,6 +103,13 @@ typedef Bool (*HashCB)P_((HashKey key, HashValue value, void * ctx));
  * hashCompareStringKey - HashCompare callback, assumes keys are ASCIIZ strings
  *
  * stringHashProc - returns hash code for a string key
+ *
+ * The "seed" variants hash the string 16 bytes at a time and mix in
+ * the random seed generated by HASH_InitModule, so that the hash codes
+ * can't be predicted from outside of the process. They never return
+ * negative values. strbufSeedHashProc and hashCompareStrBufKey are for
+ * StrBuf keys, those don't need to be scanned for the terminating NULL.
+ * hashCompareStrBufKey compares the lengths before the characters.
  */
 extern void hashFreeNothingProc P_((HashKey key, HashValue value));
 extern void hashFreeKeyProc P_((HashKey key, HashValue value));
@@ -108,22 +121,40 @@ extern Bool hashCaseCompareStringKey P_((HashKeyC key1, HashKeyC key2));
 extern HashCode hashDefaultHashProc P_((HashKeyC key));
 extern HashCode stringHashProc P_((HashKeyC key));
 extern HashCode stringCaseHashProc P_((HashKeyC key));
+extern HashCode stringSeedHashProc P_((HashKeyC key));
+extern HashCode stringCaseSeedHashProc P_((HashKeyC key));
+extern HashCode strbufSeedHashProc P_((HashKeyC key));
+extern Bool hashCompareStrBufKey P_((HashKeyC key1, HashKeyC key2));
+
+/* seeded hash of a block of memory */
+extern I64u HASH_Seed P_((void));
+extern I64u HASH_Bytes P_((const void * data, size_t size, I64u seed));
 
 /*
- * the hashtable itself.
+ * the hashtable itself. In incremental mode, the table doesn't move all
+ * the entries to the new bucket array at once when it grows. Instead,
+ * it keeps the old array around and each HASH_Put moves a few buckets
+ * from the old array to the new one.
  */
 typedef struct _HashBucket HashBucket;
 struct _HashTable {
     long  count;                /* number of key-value pairs in the table */
     short primeIndex;           /* current prime index */
     short loadFactor;           /* the load factor * 100 */
+    short oldIndex;             /* prime index of the old array */
+    short flags;                /* flags, see below */
+    int   migrated;             /* number of migrated old slots */
     HashValue    nullValue;     /* the NULL value */
     HashProc     hasher;        /* hash function */
     HashCompare  equals;        /* compare function */
     HashFree     free;          /* cleanup function */
     HashBucket** buckets;       /* hashPrimes[primeIndex] slots */
+    HashBucket** oldBuckets;    /* being migrated, NULL if none */
 };
 
+/* HashTable flags */
+#define HASH_INCREMENTAL  0x0001    /* rehash incrementally */
+
 typedef struct _HashEntry {
     HashKey   key;
     HashValue value;
@@ -147,6 +178,7 @@ extern void HASH_Delete   P_((HashTable * ht));
 extern void HASH_Clear    P_((HashTable * ht));
 extern long HASH_Size     P_((const HashTable * ht));
 extern void HASH_Rehash   P_((HashTable * ht, long size));
+extern void HASH_SetIncremental P_((HashTable * ht, Bool incremental));
 extern Bool HASH_Put      P_((HashTable * ht, HashKey key, HashValue val));
 extern Bool HASH_TryPut   P_((HashTable * ht, HashKey key, HashValue val));
 extern Bool HASH_Update   P_((HashTable * ht, HashKey key, HashValue val));
@@ -166,6 +198,83 @@ extern Iterator * HASH_ConstKeys    P_((const HashTable * ht));
 extern Iterator * HASH_ConstValues  P_((const HashTable * ht));
 extern Iterator * HASH_ConstEntries P_((const HashTable * ht));
 
+/*
+ * Open addressing ("flat") hash table. Keys and values are stored inline
+ * in a power-of-two sized array of slots, so there's no memory allocation
+ * per entry. Slots are located by probing an array of control bytes (one
+ * byte per slot) a group at a time. Uses the same callbacks as HashTable.
+ * Unlike HashTable, the compare function is only invoked for the entries
+ * which have the same hash code as the key being looked up.
+ */
+typedef struct _FlatSlot FlatSlot;
+typedef struct _FlatHash {
+    long count;                 /* number of key-value pairs in the table */
+    long deleted;               /* number of deleted slots (tombstones) */
+    long capacity;              /* number of slots, zero or power of 2 */
+    HashValue    nullValue;     /* the NULL value */
+    HashProc     hasher;        /* hash function */
+    HashCompare  equals;        /* compare function */
+    HashFree     free;          /* cleanup function */
+    I8s*         ctrl;          /* control bytes */
+    FlatSlot*    slots;         /* the slots */
+} FlatHash;
+
+extern FlatHash * HASH_FlatCreate P_((long size, HashCompare c,
+                                      HashProc h, HashFree f));
+extern Bool HASH_FlatInit P_((FlatHash * ht, long size, HashCompare c,
+                              HashProc h, HashFree f));
+
+extern void HASH_FlatDestroy  P_((FlatHash * ht));
+extern void HASH_FlatDelete   P_((FlatHash * ht));
+extern void HASH_FlatClear    P_((FlatHash * ht));
+extern long HASH_FlatSize     P_((const FlatHash * ht));
+extern void HASH_FlatRehash   P_((FlatHash * ht, long size));
+extern Bool HASH_FlatPut      P_((FlatHash * ht, HashKey k, HashValue v));
+extern Bool HASH_FlatUpdate   P_((FlatHash * ht, HashKey k, HashValue v));
+extern HashValue HASH_FlatGet P_((const FlatHash * ht, HashKeyC key));
+extern Bool HASH_FlatContains P_((const FlatHash * ht, HashKeyC key));
+extern Bool HASH_FlatRemove   P_((FlatHash * ht, HashKeyC key));
+extern Bool HASH_FlatExamine  P_((const FlatHash * ht, HashCB cb, void * c));
+
+extern Iterator * HASH_FlatKeys    P_((FlatHash * ht));
+extern Iterator * HASH_FlatValues  P_((FlatHash * ht));
+extern Iterator * HASH_FlatEntries P_((FlatHash * ht));
+
+/*
+ * Hash table that can be shared between threads. Keys are distributed
+ * between a number of stripes, each one being a HashTable protected by
+ * its own mutex, so that threads working with different stripes don't
+ * block each other. The number of stripes is rounded up to a power of 2.
+ *
+ * HASH_ConcurrentGet is only safe if the values don't get deallocated
+ * while other threads may be using them. Use HASH_ConcurrentCompute to
+ * examine and update the value atomically. HASH_ConcurrentPutIfAbsent
+ * takes ownership of the key/value pair only if it returns True.
+ * HASH_ConcurrentCompute stores the key and the value like HASH_Put,
+ * deallocating the old ones if the value has changed. The size is
+ * computed one stripe at a time, it's exact only if the table is not
+ * being modified. The callbacks are invoked under the stripe lock and
+ * must not call back into the same table.
+ */
+typedef struct _ConcurrentHash ConcurrentHash;
+
+extern ConcurrentHash * HASH_ConcurrentCreate P_((long size, int stripes,
+                                    HashCompare c, HashProc h, HashFree f));
+extern void HASH_ConcurrentDelete P_((ConcurrentHash * ch));
+extern void HASH_ConcurrentClear  P_((ConcurrentHash * ch));
+extern long HASH_ConcurrentSize   P_((const ConcurrentHash * ch));
+extern Bool HASH_ConcurrentPut    P_((ConcurrentHash * ch, HashKey k,
+                                      HashValue v));
+extern Bool HASH_ConcurrentPutIfAbsent P_((ConcurrentHash * ch, HashKey k,
+                                           HashValue v));
+extern Bool HASH_ConcurrentCompute P_((ConcurrentHash * ch, HashKey k,
+                                       HashCompute cb, void * ctx));
+extern HashValue HASH_ConcurrentGet P_((ConcurrentHash * ch, HashKeyC k));
+extern Bool HASH_ConcurrentContains P_((ConcurrentHash * ch, HashKeyC k));
+extern Bool HASH_ConcurrentRemove P_((ConcurrentHash * ch, HashKeyC k));
+extern Bool HASH_ConcurrentExamine P_((ConcurrentHash * ch, HashCB cb,
+                                       void * ctx));
+
 /* macros */
 #define HASH_IsEmpty(_ht) (HASH_Size(_ht) == 0)
 #define HASH_ContainsKey(_ht,_key) HASH_Contains(_ht,_key)
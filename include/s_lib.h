@@ -51,6 +51,7 @@
 #include "s_mem.h"
 #include "s_mutex.h"
 #include "s_opt.h"
+#include "s_poll.h"
 #include "s_prop.h"
 #include "s_queue.h"
 #include "s_random.h"
@@ -32,7 +32,7 @@
 #ifndef _SLAVA_MD_H_
 #define _SLAVA_MD_H_
 
-#include "s_def.h"
+#include "s_file.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -46,6 +46,7 @@ extern void DIGEST_Init   P_((Digest * d));
 extern Str  DIGEST_Name   P_((const Digest * d));
 extern int  DIGEST_Size   P_((const Digest * d));
 extern void DIGEST_Update P_((Digest * d, const void * data, size_t size));
+extern Bool DIGEST_UpdateFile P_((Digest * d, File * in));
 extern void DIGEST_Finish P_((Digest * d, void * out));
 extern void DIGEST_Delete P_((Digest * d));
 
@@ -0,0 +1,137 @@
+/*
+ * $Id: s_poll.h,v 1.1 2026/10/18 14:02:17 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifndef _SLAVA_POLL_H_
+#define _SLAVA_POLL_H_
+
+#include "s_file.h"
+#include "s_util.h"
+#include "s_wkq.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+/*
+ * SocketPoller waits for readiness of many sockets at once. It's backed
+ * by epoll on Linux and by poll() elsewhere. The event mask is made of
+ * the same SOCK_WAIT_xxx bits that SOCKET_Wait takes, optionally combined
+ * with the following flags:
+ *
+ * SOCK_POLL_EDGE    - edge-triggered notifications. Only supported with
+ *                     epoll, poll() falls back to level-triggered mode
+ * SOCK_POLL_ONESHOT - the socket is disabled after it has been reported
+ *                     once, until it's re-armed with SOCKET_PollerRearm
+ *                     or SOCKET_PollerModify
+ * SOCK_POLL_EXCLUSIVE - if several pollers are watching the same socket,
+ *                       only one of them is woken up rather than all of
+ *                       them. Only supported with epoll. Can't be combined
+ *                       with SOCK_POLL_ONESHOT, and the mask of such socket
+ *                       can't be modified
+ *
+ * SOCKET_PollerWait should only be called by one thread at a time. The
+ * other functions can be called from any thread, including the threads
+ * handling the events. The timeout is in milliseconds, like in poll() and
+ * RWLOCK_TimeReadLock a negative value means wait forever and zero doesn't
+ * wait at all. NOTE that this is different from SOCKET_Wait which treats
+ * zero timeout as infinite. SOCKET_PollerWait returns the number of events
+ * stored in the array, zero on timeout or SOCKET_PollerWakeup and -1 on
+ * error.
+ *
+ * A socket can also be associated with a work item (SOCKET_PollerAddWork)
+ * in which case SOCKET_PollerWait submits the work item instead of
+ * returning the event. Such sockets are always in one-shot mode, the work
+ * item has to call SOCKET_PollerRearm when it's ready for more. This way
+ * a single thread waiting for the events and a work queue pool can serve
+ * thousands of connections.
+ */
+
+typedef struct _SocketPoller SocketPoller;
+typedef struct _SocketEvent {
+    Socket sock;        /* the socket */
+    int events;         /* what happened, SOCK_WAIT_xxx bits */
+    void * ctx;         /* the context passed to SOCKET_PollerAdd */
+} SocketEvent;
+
+#define SOCK_POLL_EDGE    0x100
+#define SOCK_POLL_ONESHOT 0x200
+#define SOCK_POLL_EXCLUSIVE 0x400
+
+extern SocketPoller * SOCKET_PollerCreate P_((void));
+extern void SOCKET_PollerDelete P_((SocketPoller * p));
+extern Bool SOCKET_PollerAdd P_((SocketPoller * p, Socket s, int mask,
+                                 void * ctx));
+extern Bool SOCKET_PollerAddWork P_((SocketPoller * p, Socket s, int mask,
+                                     WorkItem * w));
+extern Bool SOCKET_PollerAddFile P_((SocketPoller * p, File * f, int mask));
+extern Bool SOCKET_PollerModify P_((SocketPoller * p, Socket s, int mask,
+                                    void * ctx));
+extern Bool SOCKET_PollerRearm P_((SocketPoller * p, Socket s));
+extern Bool SOCKET_PollerRemove P_((SocketPoller * p, Socket s));
+extern int  SOCKET_PollerCount P_((const SocketPoller * p));
+extern int  SOCKET_PollerWait P_((SocketPoller * p, SocketEvent * events,
+                                  int max, Time ms));
+extern void SOCKET_PollerWakeup P_((SocketPoller * p));
+
+/*
+ * SocketAcceptor accepts TCP connections on one or more threads and
+ * hands each of them over to a work queue as a File. The callback is
+ * invoked on a work queue thread and is responsible for closing the File.
+ *
+ * SOCK_ACCEPT_REUSEPORT - each thread has its own listening socket
+ *                         (SO_REUSEPORT), otherwise they share one
+ * SOCK_ACCEPT_NONBLOCK  - the accepted streams are in non-blocking mode
+ */
+
+typedef struct _SocketAcceptor SocketAcceptor;
+typedef void (*AcceptProc) P_((File * f, void * ctx));
+
+#define SOCK_ACCEPT_REUSEPORT 0x001
+#define SOCK_ACCEPT_NONBLOCK  0x002
+
+extern SocketAcceptor * SOCKET_AcceptorCreate P_((IPaddr addr, Port port,
+    int nthreads, int flags, WorkQueue * q, AcceptProc cb, void * ctx));
+extern Port SOCKET_AcceptorPort P_((const SocketAcceptor * a));
+extern void SOCKET_AcceptorDelete P_((SocketAcceptor * a));
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif  /* __cplusplus */
+
+#endif /* _SLAVA_POLL_H_ */
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
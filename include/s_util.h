@@ -120,6 +120,7 @@ extern Bool IO_TermSize P_((int * rows, int * cols));
 
 /* date/time utilities */
 extern Time   TIME_Now P_((void));
+extern Time   TIME_Monotonic P_((void));
 extern time_t TIME_ToUnix P_((Time t));
 extern Str    TIME_ToString P_((Time t));
 
@@ -131,15 +132,57 @@ extern Bool SOCKET_Block P_((Socket s, Bool block));
 extern Bool SOCKET_Close P_((Socket s));
 extern int  SOCKET_GetLastError P_((void));
 extern int  SOCKET_Wait P_((Socket s, int mask, Time timeout));
+extern Port SOCKET_GetPort P_((Socket s));
+extern Bool SOCKET_Listen P_((IPaddr addr, Port p, int backlog, int flags,
+                              Socket * s));
+
+/* flags for SOCKET_Listen */
+#define SOCK_LISTEN_REUSEPORT 0x001
 
 /* Internet related utilities */
 struct sockaddr;
+struct sockaddr_storage;
+struct _WorkQueue;
 extern Bool INET_ResolveAddr P_((Str host, IPaddr * addr));
 extern Str  INET_FormatAddr P_((StrBuf* dest, const struct sockaddr* sa,
     unsigned int len));
 extern Str  INET_FormatSockAddr P_((StrBuf* dest, const struct sockaddr* sa,
     unsigned int len));
 
+/* thread safe cached name resolution, IPv4 and IPv6 */
+#define INET_MAX_ADDRS 8
+typedef void (*ResolveProc) P_((Str host, const struct sockaddr_storage* addrs,
+    int count, void * ctx));
+
+extern void INET_InitModule P_((void));
+extern void INET_Shutdown P_((void));
+extern Bool INET_Resolve P_((Str host, int family,
+    struct sockaddr_storage* addr));
+extern int  INET_ResolveAll P_((Str host, int family,
+    struct sockaddr_storage* addrs, int max));
+extern Bool INET_ResolveAsync P_((struct _WorkQueue* q, Str host, int family,
+    ResolveProc cb, void * ctx));
+extern void INET_SetCacheTTL P_((Time ttl));
+extern void INET_FlushCache P_((void));
+
+/*
+ * Batched datagram I/O (address and port are in host byte order). Like
+ * the rest of SOCKET API, it's IPv4 only. Zero port means the peer the
+ * socket is connected to, that's the only way to send datagrams through
+ * a socket of another family. Received datagrams coming from addresses
+ * other than IPv4 are dropped.
+ */
+typedef struct _Datagram {
+    Buffer buf;                 /* datagram payload */
+    IPaddr addr;                /* source or destination address */
+    Port port;                  /* source or destination port */
+} Datagram;
+
+#define SOCK_MAX_DATAGRAM 65535 /* default limit for received datagrams */
+
+extern int  SOCKET_RecvBatch P_((Socket s, Datagram* d, int n, size_t max));
+extern int  SOCKET_SendBatch P_((Socket s, Datagram* d, int n));
+
 /* useful wrapper for SOCKET_New + SOCKET_Bind */
 extern Bool SOCKET_Create P_((int type, IPaddr addr, Port p, Socket * s));
 
@@ -139,6 +139,10 @@ LIB32=link.exe -lib
 # PROP Default_Filter "cpp;c;cxx;rc;def;r;odl;idl;hpj;bat"
 # Begin Source File
 
+SOURCE=.\src\s_accept.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\s_base32.c
 # End Source File
 # Begin Source File
@@ -159,6 +163,10 @@ SOURCE=.\src\s_cs.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\s_dns.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\s_dom.c
 # End Source File
 # Begin Source File
@@ -167,6 +175,10 @@ SOURCE=.\src\s_event.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\s_fbuf.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\s_file.c
 # End Source File
 # Begin Source File
@@ -183,6 +195,10 @@ SOURCE=.\src\s_fnull.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\s_fpref.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\s_fsock.c
 # End Source File
 # Begin Source File
@@ -217,6 +233,14 @@ SOURCE=.\src\s_hash.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\s_hashc.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\src\s_hashf.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\s_hist.c
 # End Source File
 # Begin Source File
@@ -293,6 +317,10 @@ SOURCE=.\src\s_parse.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\s_poll.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\s_prop.c
 # End Source File
 # Begin Source File
@@ -462,6 +490,10 @@ SOURCE=.\include\s_opt.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\include\s_poll.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\include\s_os.h
 # End Source File
 # Begin Source File
@@ -111,6 +111,10 @@ SOURCE=.\src\s_event.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\s_fbuf.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\s_file.c
 # End Source File
 # Begin Source File
@@ -123,6 +127,10 @@ SOURCE=.\src\s_fnull.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\src\s_fpref.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\src\s_fsplit.c
 # End Source File
 # Begin Source File
@@ -241,7 +241,12 @@ const FileIO PlainFileIO = {
     NULL                /* setparam */,
     NTFileRead          /* read     */,
     NTFileWrite         /* write    */,
+    NULL                /* read64   */,
+    NULL                /* write64  */,
+    NULL                /* readv    */,
+    NULL                /* writev   */,
     NULL                /* skip     */,
+    NULL                /* peek     */,
     NULL                /* flush    */,
     NTFileEof           /* eof      */,
     NTFileFd            /* fd       */,
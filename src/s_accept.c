@@ -0,0 +1,308 @@
+/*
+ * $Id: s_accept.c,v 1.1 2026/10/18 15:20:44 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#if defined(__linux__) && !defined(__KERNEL__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE   /* for accept4 */
+#endif
+
+#include "s_poll.h"
+#include "s_thread.h"
+#include "s_mutex.h"
+#include "s_mem.h"
+
+#if defined(__linux__) && defined(SOCK_NONBLOCK) && defined(SOCK_CLOEXEC)
+#  define HAVE_ACCEPT4
+#endif
+
+/*==========================================================================*
+ *              A C C E P T O R
+ *==========================================================================*/
+
+#define ACCEPT_BATCH 64         /* max connections accepted per wakeup */
+#define ACCEPT_BACKOFF 100      /* ms to wait when out of descriptors */
+
+/* Error codes indicating that the system has run out of resources */
+#ifdef _WIN32
+#  define ACCEPT_NO_RESOURCES(_err) \
+    ((_err) == WSAEMFILE || (_err) == WSAENOBUFS)
+#else
+#  define ACCEPT_NO_RESOURCES(_err) \
+    ((_err) == EMFILE || (_err) == ENFILE || \
+     (_err) == ENOBUFS || (_err) == ENOMEM)
+#endif
+
+typedef struct _AcceptThread {
+    SocketAcceptor * acceptor;  /* the owner */
+    SocketPoller * poller;      /* waits for incoming connections */
+    Socket sock;                /* the listening socket */
+    Bool ownSocket;             /* True if sock is owned by this thread */
+    Bool started;               /* True if the thread has been started */
+    ThrID thread;               /* the acceptor thread */
+} AcceptThread;
+
+/* context of the work item handling an accepted connection */
+typedef struct _AcceptConn {
+    AcceptProc cb;              /* the callback */
+    void * ctx;                 /* the callback parameter */
+    File * file;                /* the accepted connection */
+} AcceptConn;
+
+struct _SocketAcceptor {
+    WorkQueue * queue;          /* where the connections are handled */
+    AcceptProc cb;              /* the callback */
+    void * ctx;                 /* the callback parameter */
+    int flags;                  /* SOCK_ACCEPT_xxx flags */
+    Port port;                  /* the port we are listening on */
+    Mutex mutex;                /* protects the stop flag */
+    Bool stop;                  /* tells the threads to exit */
+    int nthreads;               /* number of acceptor threads */
+    AcceptThread threads[1];    /* variable size array */
+};
+
+/**
+ * Invokes the callback on a work queue thread. The callback takes the
+ * ownership of the File.
+ */
+STATIC void AcceptWorkProc(WorkItem * w, void * arg)
+{
+    AcceptConn * conn = (AcceptConn*)arg;
+    UNREF(w);
+    conn->cb(conn->file, conn->ctx);
+    MEM_Free(conn);
+}
+
+/**
+ * Accepts one connection. Returns INVALID_SOCKET when there are no more
+ * pending connections (or in case of error).
+ */
+STATIC Socket AcceptOne(Socket listener, Bool nonblock)
+{
+#ifdef HAVE_ACCEPT4
+    return accept4(listener, NULL, NULL,
+        SOCK_CLOEXEC | (nonblock ? SOCK_NONBLOCK : 0));
+#else  /* !HAVE_ACCEPT4 */
+    Socket s = accept(listener, NULL, NULL);
+    if (s != INVALID_SOCKET) {
+        /* on some systems accepted socket inherits O_NONBLOCK */
+        SOCKET_Block(s, (Bool)!nonblock);
+    }
+    return s;
+#endif /* !HAVE_ACCEPT4 */
+}
+
+/**
+ * Tests whether the acceptor threads have been told to exit
+ */
+STATIC Bool AcceptStopped(SocketAcceptor * a)
+{
+    Bool stop;
+    MUTEX_Lock(&a->mutex);
+    stop = a->stop;
+    MUTEX_Unlock(&a->mutex);
+    return stop;
+}
+
+/**
+ * Accepts all pending connections (up to ACCEPT_BATCH) and submits
+ * a work item for each of them. Returns False if the system has run
+ * out of descriptors. The pending connections then stay in the queue
+ * and the listening socket remains readable.
+ */
+STATIC Bool AcceptBatch(AcceptThread * t)
+{
+    SocketAcceptor * a = t->acceptor;
+    Bool nonblock = BoolValue(a->flags & SOCK_ACCEPT_NONBLOCK);
+    int i;
+    for (i=0; i<ACCEPT_BATCH && !AcceptStopped(a); i++) {
+        Socket s = AcceptOne(t->sock, nonblock);
+        if (s == INVALID_SOCKET) {
+            return BoolValue(!ACCEPT_NO_RESOURCES(SOCKET_GetLastError()));
+        } else {
+            AcceptConn * conn = MEM_New(AcceptConn);
+            if (conn) {
+                conn->cb = a->cb;
+                conn->ctx = a->ctx;
+                conn->file = FILE_AttachToSocket2(s, nonblock ?
+                    FILE_SOCK_NONBLOCK : 0);
+                if (conn->file) {
+                    if (WKQ_InvokeLater(a->queue, AcceptWorkProc, conn)) {
+                        continue;
+                    }
+                    FILE_Close(conn->file);
+                    MEM_Free(conn);
+                    continue;
+                }
+                MEM_Free(conn);
+            }
+            SOCKET_Close(s);
+        }
+    }
+    return True;
+}
+
+STATIC void AcceptThreadProc(void * arg)
+{
+    AcceptThread * t = (AcceptThread*)arg;
+    SocketAcceptor * a = t->acceptor;
+    SocketEvent ev;
+    while (!AcceptStopped(a)) {
+        int n = SOCKET_PollerWait(t->poller, &ev, 1, -1);
+        if (n < 0 || (n > 0 && !AcceptBatch(t))) {
+            /* avoid spinning until some descriptors are released, or
+             * if something is badly wrong */
+            THREAD_Sleep(ACCEPT_BACKOFF);
+        }
+    }
+}
+
+/**
+ * Creates the acceptor. It listens on the specified address and port
+ * (both in host byte order, zero port lets the system pick one, see
+ * SOCKET_AcceptorPort) with nthreads threads (zero means the number of
+ * CPUs), accepts the connections and invokes the callback for each of
+ * them on the specified work queue, typically a WKQ_CreatePool pool.
+ * The callback becomes responsible for closing the File.
+ *
+ * SOCK_ACCEPT_REUSEPORT gives each thread its own listening socket
+ * bound to the same port (SO_REUSEPORT), so that the kernel distributes
+ * the connections between the threads. Otherwise, the threads share one
+ * socket, and (with epoll) only one of them is woken up by an incoming
+ * connection. SOCK_ACCEPT_NONBLOCK makes the accepted streams
+ * non-blocking.
+ */
+SocketAcceptor * SOCKET_AcceptorCreate(IPaddr addr, Port port, int nthreads,
+    int flags, WorkQueue * q, AcceptProc cb, void * ctx)
+{
+    SocketAcceptor * a;
+    size_t size;
+    ASSERT(q);
+    ASSERT(cb);
+    if (nthreads <= 0) nthreads = SYSTEM_CountCPU();
+    if (nthreads <= 0) nthreads = 1;
+    size = sizeof(SocketAcceptor) + sizeof(AcceptThread)*(nthreads-1);
+    a = (SocketAcceptor*)MEM_Alloc(size);
+    if (a) {
+        int i;
+        Bool ok = True;
+        int mask = SOCK_WAIT_READ;
+        memset(a, 0, size);
+        if (!MUTEX_Init(&a->mutex)) {
+            MEM_Free(a);
+            return NULL;
+        }
+        if (!(flags & SOCK_ACCEPT_REUSEPORT)) {
+            /* all threads are waiting for the same socket */
+            mask |= SOCK_POLL_EXCLUSIVE;
+        }
+        a->queue = q;
+        a->cb = cb;
+        a->ctx = ctx;
+        a->flags = flags;
+        a->port = port;
+        a->nthreads = nthreads;
+        for (i=0; i<nthreads && ok; i++) {
+            AcceptThread * t = a->threads + i;
+            t->acceptor = a;
+            t->sock = INVALID_SOCKET;
+            if (i == 0 || (flags & SOCK_ACCEPT_REUSEPORT)) {
+                ok = SOCKET_Listen(addr, a->port, 0, (flags &
+                    SOCK_ACCEPT_REUSEPORT) ? SOCK_LISTEN_REUSEPORT : 0,
+                    &t->sock);
+                if (ok) {
+                    t->ownSocket = True;
+                    if (!a->port) a->port = SOCKET_GetPort(t->sock);
+                    ok = SOCKET_Block(t->sock, False);
+                }
+            } else {
+                t->sock = a->threads[0].sock;
+            }
+            if (ok) {
+                t->poller = SOCKET_PollerCreate();
+                ok = BoolValue(t->poller &&
+                    SOCKET_PollerAdd(t->poller, t->sock, mask, t));
+            }
+        }
+        for (i=0; i<nthreads && ok; i++) {
+            AcceptThread * t = a->threads + i;
+            ok = THREAD_Create(&t->thread, AcceptThreadProc, t);
+            t->started = ok;
+        }
+        if (ok) {
+            return a;
+        }
+        SOCKET_AcceptorDelete(a);
+    }
+    return NULL;
+}
+
+/**
+ * Returns the port the acceptor is listening on, in host byte order
+ */
+Port SOCKET_AcceptorPort(const SocketAcceptor * a)
+{
+    return a->port;
+}
+
+/**
+ * Stops the acceptor threads and closes the listening sockets. The
+ * connections that have already been accepted are not affected.
+ */
+void SOCKET_AcceptorDelete(SocketAcceptor * a)
+{
+    if (a) {
+        int i;
+        MUTEX_Lock(&a->mutex);
+        a->stop = True;
+        MUTEX_Unlock(&a->mutex);
+        for (i=0; i<a->nthreads; i++) {
+            AcceptThread * t = a->threads + i;
+            if (t->started) {
+                SOCKET_PollerWakeup(t->poller);
+                THREAD_Join(t->thread);
+            }
+        }
+        for (i=0; i<a->nthreads; i++) {
+            AcceptThread * t = a->threads + i;
+            SOCKET_PollerDelete(t->poller);
+            if (t->ownSocket) SOCKET_Close(t->sock);
+        }
+        MUTEX_Destroy(&a->mutex);
+        MEM_Free(a);
+    }
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
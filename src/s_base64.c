@@ -35,6 +35,8 @@
 /* BASE64 decoding context */
 typedef struct _Base64Decode {
     File * in;              /* input stream */
+    const I8u * ptr;        /* next byte in the mapped input, or NULL */
+    const I8u * end;        /* end of the mapped input */
     int nread;              /* number of input characters read */
     Buffer * out;           /* output buffer */
     const I8u* decodeMap;   /* decode map */
@@ -274,7 +276,8 @@ STATIC int BASE64_ReadChunk(Base64Decode * decode, I8u chunk[4])
     int n = 0;
 
     while (n < DECODE_CHUNK_SIZE) {
-        int nextChar = FILE_Getc(decode->in);
+        int nextChar = (decode->ptr ? ((decode->ptr < decode->end) ?
+            *(decode->ptr)++ : EOF) : FILE_Getc(decode->in));
         if (nextChar < 0) {
             decode->flags |= FLAG_EOF;
             break;
@@ -433,6 +436,9 @@ STATIC Bool BASE64_DecodeFile2(File * in, int len, Buffer * out,
     const I8u * map)
 {
     Base64Decode decode;
+    const void * data;
+    size_t size;
+    Bool ok;
 
     /* pre-allocate memory in the output buffer */
     if (out && len > 0) {
@@ -446,6 +452,13 @@ STATIC Bool BASE64_DecodeFile2(File * in, int len, Buffer * out,
     /* initialize the context */
     decode.in = in;
     decode.nread = 0;
+    if (FILE_MapView(in, &data, &size)) {
+        /* decode the data in place */
+        decode.ptr = (const I8u*)data;
+        decode.end = decode.ptr + size;
+    } else {
+        decode.ptr = decode.end = NULL;
+    }
     decode.out = out;
     if (map) {
         decode.decodeMap = map;
@@ -456,7 +469,11 @@ STATIC Bool BASE64_DecodeFile2(File * in, int len, Buffer * out,
     }
 
     /* run the decoder */
-    return BASE64_InternalDecode(&decode);
+    ok = BASE64_InternalDecode(&decode);
+    if (decode.ptr) {
+        FILE_Consume(in, decode.ptr - (const I8u*)data);
+    }
+    return ok;
 }
 
 /**
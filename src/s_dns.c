@@ -0,0 +1,307 @@
+/*
+ * $Id: s_dns.c,v 1.1 2026/10/18 16:05:12 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifdef _WIN32
+/* getaddrinfo requires Winsock2 */
+#  include <winsock2.h>
+#  include <ws2tcpip.h>
+#endif /* _WIN32 */
+
+#include "s_lib.h"
+#include "s_libp.h"
+
+/*==========================================================================*
+ *              N A M E    R E S O L U T I O N
+ *==========================================================================*/
+
+#define DNS_DEFAULT_TTL 60000   /* how long addresses are cached, in ms */
+#define DNS_MAX_ENTRIES 1024    /* the cache is flushed when it grows larger */
+
+/*
+ * The cache entry serves as both key and value. Addresses are stored
+ * without the port number.
+ */
+typedef struct _DnsEntry {
+    Char * host;                /* host name */
+    int family;                 /* AF_INET, AF_INET6 or AF_UNSPEC */
+    Time expires;               /* when this entry becomes stale */
+    int count;                  /* number of addresses */
+    struct sockaddr_storage addrs[INET_MAX_ADDRS];
+} DnsEntry;
+
+/* context of the asynchronous request */
+typedef struct _DnsRequest {
+    ResolveProc cb;             /* the callback */
+    void * ctx;                 /* the callback parameter */
+    int family;                 /* the address family */
+    Char host[1];               /* host name (variable size) */
+} DnsRequest;
+
+STATIC int INET_initCount = 0;
+STATIC Mutex INET_mutex;
+STATIC HashTable INET_cache;
+STATIC Time INET_ttl = DNS_DEFAULT_TTL;
+
+STATIC HashCode DnsHashProc(HashKeyC key)
+{
+    const DnsEntry * e = (const DnsEntry*)key;
+    return stringCaseHashProc(e->host) + e->family;
+}
+
+STATIC Bool DnsEquals(HashKeyC key1, HashKeyC key2)
+{
+    const DnsEntry * e1 = (const DnsEntry*)key1;
+    const DnsEntry * e2 = (const DnsEntry*)key2;
+    return BoolValue(e1->family == e2->family &&
+                     StrCaseCmp(e1->host, e2->host) == 0);
+}
+
+STATIC void DnsFree(HashKey key, HashValue value)
+{
+    DnsEntry * e = (DnsEntry*)value;
+    UNREF(key);
+    MEM_Free(e->host);
+    MEM_Free(e);
+}
+
+/**
+ * Initialize the module. Until this function is called, the names are
+ * resolved without caching. It's not called by SLIB_InitModules in order
+ * to avoid unnecessary linkage with the socket library.
+ */
+void INET_InitModule()
+{
+    if ((INET_initCount++) == 0) {
+        HASH_InitModule();
+        if (MUTEX_Init(&INET_mutex)) {
+            if (HASH_Init(&INET_cache, 0, DnsEquals, DnsHashProc, DnsFree)) {
+                return;
+            }
+            MUTEX_Destroy(&INET_mutex);
+        }
+
+        /* unrecoverable error */
+        SLIB_Abort(TEXT("INET"));
+    }
+}
+
+/**
+ * Cleanup the module.
+ */
+void INET_Shutdown()
+{
+    ASSERT(INET_initCount > 0);
+    if ((--INET_initCount) == 0) {
+        HASH_Destroy(&INET_cache);
+        MUTEX_Destroy(&INET_mutex);
+        HASH_Shutdown();
+    }
+}
+
+/**
+ * Sets for how long (in milliseconds) the resolved addresses are cached.
+ * Zero disables the cache. The entries that are already in the cache are
+ * not affected.
+ */
+void INET_SetCacheTTL(Time ttl)
+{
+    INET_ttl = MAX(ttl, 0);
+}
+
+/**
+ * Removes everything from the cache
+ */
+void INET_FlushCache()
+{
+    if (INET_initCount > 0) {
+        MUTEX_Lock(&INET_mutex);
+        HASH_Clear(&INET_cache);
+        MUTEX_Unlock(&INET_mutex);
+    }
+}
+
+/**
+ * Calls getaddrinfo. Returns the number of addresses.
+ */
+STATIC int DnsLookup(Str host, int family, struct sockaddr_storage * addrs,
+                     int max)
+{
+    int count = 0;
+    struct addrinfo hints;
+    struct addrinfo * result = NULL;
+#ifdef UNICODE
+    char * name = STRING_ToMultiByte(host);
+    if (!name) return 0;
+#else  /* UNICODE */
+    const char * name = host;
+#endif /* UNICODE */
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = family;
+    hints.ai_socktype = SOCK_STREAM;
+    if (family == AF_UNSPEC) hints.ai_flags = AI_ADDRCONFIG;
+    if (getaddrinfo(name, NULL, &hints, &result) == 0) {
+        const struct addrinfo * ai;
+        for (ai = result; ai && count < max; ai = ai->ai_next) {
+            if ((ai->ai_family == AF_INET || ai->ai_family == AF_INET6) &&
+                ai->ai_addrlen <= sizeof(addrs[0])) {
+                memset(addrs + count, 0, sizeof(addrs[0]));
+                memcpy(addrs + count, ai->ai_addr, ai->ai_addrlen);
+                count++;
+            }
+        }
+        freeaddrinfo(result);
+    }
+
+#ifdef UNICODE
+    MEM_Free(name);
+#endif /* UNICODE */
+    return count;
+}
+
+/**
+ * Resolves host name or numeric IPv4/IPv6 address into up to max socket
+ * addresses (with zero port). The family can be AF_INET, AF_INET6 or
+ * AF_UNSPEC. Successful lookups are cached (see INET_SetCacheTTL).
+ * Returns the number of addresses, zero if the name can't be resolved.
+ * This function is thread safe.
+ */
+int INET_ResolveAll(Str host, int family, struct sockaddr_storage * addrs,
+                    int max)
+{
+    int count = 0;
+    ASSERT(max >= 0);
+    if (host && max > 0) {
+        DnsEntry key;
+        DnsEntry * e;
+        Time now;
+        while (*host && IsSpace(*host)) host++;
+        if (!*host) return 0;
+        if (INET_initCount <= 0) {
+            return DnsLookup(host, family, addrs, max);
+        }
+
+        /* try the cache first */
+        now = TIME_Now();
+        key.host = (Char*)host;
+        key.family = family;
+        MUTEX_Lock(&INET_mutex);
+        e = (DnsEntry*)HASH_Get(&INET_cache, &key);
+        if (e && e->expires > now) {
+            count = MIN(e->count, max);
+            memcpy(addrs, e->addrs, sizeof(addrs[0]) * count);
+        }
+        MUTEX_Unlock(&INET_mutex);
+        if (count > 0) {
+            return count;
+        }
+
+        /* the actual lookup is done without holding the lock */
+        e = MEM_New(DnsEntry);
+        if (e) {
+            e->count = DnsLookup(host, family, e->addrs, COUNT(e->addrs));
+            count = MIN(e->count, max);
+            memcpy(addrs, e->addrs, sizeof(addrs[0]) * count);
+            if (e->count > 0 && INET_ttl > 0 && (e->host=STRING_Dup(host))) {
+                e->family = family;
+                e->expires = now + INET_ttl;
+                MUTEX_Lock(&INET_mutex);
+                if (HASH_Size(&INET_cache) >= DNS_MAX_ENTRIES) {
+                    HASH_Clear(&INET_cache);
+                }
+                if (HASH_Put(&INET_cache, e, e)) e = NULL;
+                MUTEX_Unlock(&INET_mutex);
+                if (e) MEM_Free(e->host);
+            }
+            MEM_Free(e);
+        }
+    }
+    return count;
+}
+
+/**
+ * Resolves host name into a single socket address, see INET_ResolveAll
+ */
+Bool INET_Resolve(Str host, int family, struct sockaddr_storage * addr)
+{
+    return BoolValue(INET_ResolveAll(host, family, addr, 1) > 0);
+}
+
+/**
+ * Work item that performs the asynchronous lookup
+ */
+STATIC void DnsWorkProc(WorkItem * w, void * arg)
+{
+    DnsRequest * req = (DnsRequest*)arg;
+    struct sockaddr_storage addrs[INET_MAX_ADDRS];
+    int n = INET_ResolveAll(req->host, req->family, addrs, COUNT(addrs));
+    UNREF(w);
+    req->cb(req->host, n ? addrs : NULL, n, req->ctx);
+    MEM_Free(req);
+}
+
+/**
+ * Resolves the host name on the work queue. The callback is invoked
+ * on the work queue thread, with zero count if the name can't be
+ * resolved. Returns False if the request couldn't be submitted, in
+ * which case the callback is not invoked.
+ */
+Bool INET_ResolveAsync(WorkQueue * q, Str host, int family, ResolveProc cb,
+                       void * ctx)
+{
+    ASSERT(q);
+    ASSERT(host);
+    ASSERT(cb);
+    if (q && host && cb) {
+        size_t len = StrLen(host);
+        DnsRequest * req = (DnsRequest*)MEM_Alloc(sizeof(DnsRequest) +
+            len * sizeof(Char));
+        if (req) {
+            req->cb = cb;
+            req->ctx = ctx;
+            req->family = family;
+            StrCpy(req->host, host);
+            if (WKQ_InvokeLater(q, DnsWorkProc, req)) {
+                return True;
+            }
+            MEM_Free(req);
+        }
+    }
+    return False;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
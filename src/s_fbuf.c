@@ -0,0 +1,613 @@
+/*
+ * $Id: s_fbuf.c,v 1.1 2026/10/18 10:12:41 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "s_util.h"
+#include "s_fio.h"
+#include "s_mem.h"
+
+/*==========================================================================*
+ *              B U F F E R E D    I N P U T
+ *==========================================================================*/
+
+/* default size of the read-ahead buffer */
+#define FBUF_DEFAULT_SIZE 16384
+
+typedef struct _BufFile {
+    File file;      /* shared File structure */
+    File * target;  /* the file actually performing the I/O */
+    I8u * buf;      /* the read-ahead buffer */
+    size_t size;    /* size of the buffer */
+    size_t start;   /* offset of the first unread byte */
+    size_t end;     /* end of the buffered data */
+    int bflags;     /* flags, see below */
+
+#define FBUF_EOF 0x0001 /* target has reported end of file */
+#define FBUF_ERR 0x0002 /* target has reported an error */
+
+} BufFile;
+
+STATIC Bool   BufFileReopen P_((File * f, Str path, const char * mode));
+STATIC int    BufFileRead   P_((File * f, void * buf, int len));
+STATIC int    BufFileWrite  P_((File * f, const void * buf, int len));
+STATIC int    BufFileSkip   P_((File * f, int len));
+STATIC size_t BufFilePeek   P_((File * f, const void ** data, size_t min));
+STATIC Bool   BufFileFlush  P_((File * f));
+STATIC Bool   BufFileEof    P_((File * f));
+STATIC File * BufFileTarget P_((File * f));
+STATIC void   BufFileDetach P_((File * f));
+STATIC void   BufFileClose  P_((File * f));
+STATIC void   BufFileFree   P_((File * f));
+
+/*
+ * Table of I/O handlers
+ */
+STATIC const FileIO BufFileIO = {
+    NULL                /* open     */,
+    BufFileReopen       /* reopen   */,
+    NULL                /* setparam */,
+    BufFileRead         /* read     */,
+    BufFileWrite        /* write    */,
+    NULL                /* read64   */,
+    NULL                /* write64  */,
+    NULL                /* readv    */,
+    NULL                /* writev   */,
+    BufFileSkip         /* skip     */,
+    BufFilePeek         /* peek     */,
+    BufFileFlush        /* flush    */,
+    BufFileEof          /* eof      */,
+    NULL                /* fd       */,
+    BufFileTarget       /* target   */,
+    BufFileDetach       /* detach   */,
+    BufFileClose        /* close    */,
+    BufFileFree         /* free     */,
+    0                   /* flags    */
+};
+
+/*
+ * I/O handlers
+ */
+STATIC BufFile * BufFileCast(File * f)
+{
+    ASSERT(f);
+    if (f) {
+        ASSERT(f->io == &BufFileIO);
+        if (f->io == &BufFileIO) {
+            BufFile * b = CAST(f,BufFile,file);
+            ASSERT(b->start <= b->end);
+            ASSERT(b->end <= b->size);
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Reads more data from the target stream, trying to have at least min
+ * bytes in the buffer. Returns the number of buffered bytes.
+ */
+STATIC size_t BufFileFill(BufFile * b, size_t min)
+{
+    if (min > b->size) min = b->size;
+    while ((b->end - b->start) < min && !(b->bflags & (FBUF_EOF|FBUF_ERR))) {
+        size_t avail = b->end - b->start;
+        size_t want;
+        int n;
+
+        /* move the unread data to the beginning of the buffer */
+        if (b->start > 0 && (b->size - b->start) < min) {
+            if (avail > 0) memmove(b->buf, b->buf + b->start, avail);
+            b->start = 0;
+            b->end = avail;
+        } else if (!avail) {
+            b->start = b->end = 0;
+        }
+
+        /*
+         * If reads from the target can block before the end of stream,
+         * don't ask for more than we actually need. Otherwise we could
+         * wait for the data that the other side is not going to send.
+         */
+        want = b->size - b->end;
+        if (FILE_CanBlock(b->target)) want = MIN(want, min - avail);
+        n = FILE_Read(b->target, b->buf + b->end, (int)MIN(want,INT_MAX));
+        if (n > 0) {
+            b->end += n;
+        } else if (n == 0) {
+            b->bflags |= FBUF_EOF;
+        } else {
+            b->bflags |= FBUF_ERR;
+        }
+    }
+    return b->end - b->start;
+}
+
+STATIC Bool BufFileReopen(File * f, Str path, const char * mode)
+{
+    BufFile * b = BufFileCast(f);
+    if (b) {
+        b->start = b->end = 0;
+        b->bflags = 0;
+        return FILE_Reopen(b->target, path, mode);
+    }
+    return False;
+}
+
+STATIC int BufFileRead(File * f, void * buf, int len)
+{
+    BufFile * b = BufFileCast(f);
+    if (b) {
+        I8u * dest = (I8u*)buf;
+        int nbytes = 0;
+        while (nbytes < len) {
+            size_t avail = b->end - b->start;
+            size_t left = len - nbytes;
+            if (avail > 0) {
+                size_t n = MIN(avail, left);
+                memcpy(dest + nbytes, b->buf + b->start, n);
+                b->start += n;
+                nbytes += (int)n;
+            } else if (b->bflags & (FBUF_EOF|FBUF_ERR)) {
+                break;
+            } else if (left >= b->size) {
+
+                /* no point in copying large blocks through the buffer */
+                int n = FILE_Read(b->target, dest + nbytes, (int)left);
+                if (n > 0) {
+                    nbytes += n;
+                } else {
+                    b->bflags |= (n ? FBUF_ERR : FBUF_EOF);
+                    break;
+                }
+            } else if (!BufFileFill(b, left)) {
+                break;
+            }
+        }
+        return ((nbytes > 0 || !(b->bflags & FBUF_ERR)) ? nbytes : (-1));
+    }
+    return (-1);
+}
+
+STATIC int BufFileWrite(File * f, const void * buf, int len)
+{
+    BufFile * b = BufFileCast(f);
+    return (b ? FILE_Write(b->target, buf, len) : (-1));
+}
+
+STATIC int BufFileSkip(File * f, int len)
+{
+    BufFile * b = BufFileCast(f);
+    if (b) {
+        size_t n = MIN(b->end - b->start, (size_t)len);
+        b->start += n;
+        if ((size_t)len > n && !(b->bflags & (FBUF_EOF|FBUF_ERR))) {
+            n += FILE_Skip(b->target, len - n);
+        }
+        return (int)n;
+    }
+    return (-1);
+}
+
+STATIC size_t BufFilePeek(File * f, const void ** data, size_t min)
+{
+    BufFile * b = BufFileCast(f);
+    if (b) {
+        size_t avail = b->end - b->start;
+        if (avail < MAX(min,1)) avail = BufFileFill(b, MAX(min,1));
+        *data = b->buf + b->start;
+        return avail;
+    }
+    return 0;
+}
+
+STATIC Bool BufFileFlush(File * f)
+{
+    BufFile * b = BufFileCast(f);
+    return (b ? FILE_Flush(b->target) : False);
+}
+
+STATIC Bool BufFileEof(File * f)
+{
+    BufFile * b = BufFileCast(f);
+    if (b) {
+        if (b->end > b->start) {
+            return False;
+        } else if (b->bflags & (FBUF_EOF|FBUF_ERR)) {
+            return True;
+        } else {
+            return FILE_Eof(b->target);
+        }
+    }
+    return True;
+}
+
+STATIC File * BufFileTarget(File * f)
+{
+    BufFile * b = BufFileCast(f);
+    return (b ? b->target : NULL);
+}
+
+STATIC void BufFileDetach(File * f)
+{
+    BufFile * b = BufFileCast(f);
+    if (b) {
+        b->target = NULL;
+        b->start = b->end = 0;
+    }
+}
+
+STATIC void BufFileClose(File * f)
+{
+    BufFile * b = BufFileCast(f);
+    if (b) FILE_Finish(b->target);
+}
+
+STATIC void BufFileFree(File * f)
+{
+    BufFile * b = BufFileCast(f);
+    if (b) {
+        ASSERT(!(f->flags & FILE_IS_OPEN));
+        if (b->target) {
+            FILE_Close(b->target);
+            b->target = NULL;
+        }
+        MEM_Free(b->buf);
+        MEM_Free(b);
+    }
+}
+
+/**
+ * Creates a File that reads ahead from the target stream into a buffer
+ * of the specified size, so that small reads (FILE_Getc, FILE_Gets and
+ * such) don't turn into small reads from the target. The buffered data
+ * can also be accessed directly with FILE_Peek. Writes are passed to the
+ * target stream unbuffered. Closing this file closes the target stream.
+ * If the buffered file is detached from the target, the data that have
+ * been read ahead are lost.
+ */
+File * FILE_Buffered(File * f, size_t bufsize)
+{
+    ASSERT(f);
+    if (f) {
+        BufFile * b = MEM_New(BufFile);
+        if (b) {
+            memset(b, 0, sizeof(*b));
+            b->size = (bufsize ? bufsize : FBUF_DEFAULT_SIZE);
+            b->buf = MEM_NewArray(I8u,b->size);
+            if (b->buf) {
+                b->target = f;
+                if (FILE_Init(&b->file, NULL, True, &BufFileIO)) {
+                    return &b->file;
+                }
+                MEM_Free(b->buf);
+            }
+            MEM_Free(b);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Checks if the file is a buffered input stream
+ */
+Bool FILE_IsBuffered(const File * f)
+{
+    return BoolValue(f && f->io == &BufFileIO);
+}
+
+/*==========================================================================*
+ *              B U F F E R E D    O U T P U T
+ *==========================================================================*/
+
+typedef struct _BufOutFile {
+    File file;      /* shared File structure */
+    File * target;  /* the file actually performing the I/O */
+    I8u * buf;      /* the output buffer */
+    size_t size;    /* size of the buffer */
+    size_t len;     /* amount of buffered data */
+    size_t hiwater; /* flush when this much data is buffered */
+    Bool err;       /* True if the target has reported an error */
+} BufOutFile;
+
+STATIC Bool   BufOutSetParam P_((File * f, Str name, void * value));
+STATIC int    BufOutRead     P_((File * f, void * buf, int len));
+STATIC int    BufOutWrite    P_((File * f, const void * buf, int len));
+STATIC Bool   BufOutFlush    P_((File * f));
+STATIC Bool   BufOutEof      P_((File * f));
+STATIC File * BufOutTarget   P_((File * f));
+STATIC void   BufOutDetach   P_((File * f));
+STATIC void   BufOutClose    P_((File * f));
+STATIC void   BufOutFree     P_((File * f));
+
+/*
+ * Table of I/O handlers
+ */
+STATIC const FileIO BufOutIO = {
+    NULL                /* open     */,
+    NULL                /* reopen   */,
+    BufOutSetParam      /* setparam */,
+    BufOutRead          /* read     */,
+    BufOutWrite         /* write    */,
+    NULL                /* read64   */,
+    NULL                /* write64  */,
+    NULL                /* readv    */,
+    NULL                /* writev   */,
+    NULL                /* skip     */,
+    NULL                /* peek     */,
+    BufOutFlush         /* flush    */,
+    BufOutEof           /* eof      */,
+    NULL                /* fd       */,
+    BufOutTarget        /* target   */,
+    BufOutDetach        /* detach   */,
+    BufOutClose         /* close    */,
+    BufOutFree          /* free     */,
+    0                   /* flags    */
+};
+
+/*
+ * I/O handlers
+ */
+STATIC BufOutFile * BufOutCast(File * f)
+{
+    ASSERT(f);
+    if (f) {
+        ASSERT(f->io == &BufOutIO);
+        if (f->io == &BufOutIO) {
+            BufOutFile * b = CAST(f,BufOutFile,file);
+            ASSERT(b->len <= b->size);
+            ASSERT(b->hiwater <= b->size);
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Writes the buffered data to the target stream. If the target fails,
+ * the data are dropped and all subsequent writes fail too.
+ */
+STATIC Bool BufOutDrain(BufOutFile * b)
+{
+    if (b->len > 0 && !b->err) {
+        if (!FILE_WriteAll(b->target, b->buf, (int)b->len)) {
+            b->err = True;
+        }
+    }
+    b->len = 0;
+    return !b->err;
+}
+
+/**
+ * The only parameter is FILE_PARAM_HIWATER, the amount of buffered data
+ * (size_t) which causes the buffer to be written to the target stream.
+ * It can't exceed the size of the buffer.
+ */
+STATIC Bool BufOutSetParam(File * f, Str name, void * value)
+{
+    BufOutFile * b = BufOutCast(f);
+    if (b && value && StrCmp(name, FILE_PARAM_HIWATER) == 0) {
+        size_t hiwater = *((size_t*)value);
+        if (hiwater > 0 && hiwater <= b->size) {
+            b->hiwater = hiwater;
+            return BoolValue(b->len < hiwater || BufOutDrain(b));
+        }
+    }
+    return False;
+}
+
+/**
+ * Sends the buffered data before reading, in case the other side is
+ * waiting for it before responding.
+ */
+STATIC int BufOutRead(File * f, void * buf, int len)
+{
+    BufOutFile * b = BufOutCast(f);
+    if (b && BufOutDrain(b)) {
+        return FILE_Read(b->target, buf, len);
+    }
+    return (-1);
+}
+
+STATIC int BufOutWrite(File * f, const void * buf, int len)
+{
+    BufOutFile * b = BufOutCast(f);
+    if (b && !b->err) {
+        if ((b->size - b->len) < (size_t)len && !BufOutDrain(b)) {
+            return (-1);
+        }
+        if ((size_t)len >= b->size) {
+
+            /* no point in copying large blocks through the buffer */
+            int n = FILE_Write(b->target, buf, len);
+            if (n < 0) b->err = True;
+            return n;
+        }
+        memcpy(b->buf + b->len, buf, len);
+        b->len += len;
+        if (b->len >= b->hiwater && !BufOutDrain(b)) {
+            return (-1);
+        }
+        return len;
+    }
+    return (-1);
+}
+
+STATIC Bool BufOutFlush(File * f)
+{
+    BufOutFile * b = BufOutCast(f);
+    return BoolValue(b && BufOutDrain(b) && FILE_Flush(b->target));
+}
+
+STATIC Bool BufOutEof(File * f)
+{
+    BufOutFile * b = BufOutCast(f);
+    return (b ? FILE_Eof(b->target) : True);
+}
+
+STATIC File * BufOutTarget(File * f)
+{
+    BufOutFile * b = BufOutCast(f);
+    return (b ? b->target : NULL);
+}
+
+/**
+ * Unlike the input buffer, the output buffer is not lost when the file
+ * is detached from the target.
+ */
+STATIC void BufOutDetach(File * f)
+{
+    BufOutFile * b = BufOutCast(f);
+    if (b) {
+        BufOutDrain(b);
+        b->target = NULL;
+    }
+}
+
+STATIC void BufOutClose(File * f)
+{
+    BufOutFile * b = BufOutCast(f);
+    if (b) {
+        BufOutDrain(b);
+        FILE_Finish(b->target);
+    }
+}
+
+STATIC void BufOutFree(File * f)
+{
+    BufOutFile * b = BufOutCast(f);
+    if (b) {
+        ASSERT(!(f->flags & FILE_IS_OPEN));
+        if (b->target) {
+            FILE_Close(b->target);
+            b->target = NULL;
+        }
+        MEM_Free(b->buf);
+        MEM_Free(b);
+    }
+}
+
+/**
+ * Creates a File that collects the output in a buffer of the specified
+ * size and writes it to the target stream when the buffer fills up (or
+ * reaches the high-water mark, see FILE_PARAM_HIWATER), on FILE_Flush
+ * and on close. This turns a series of small writes (FILE_Putc,
+ * FILE_Printf and such) into a single write to the target, which is
+ * important if each write is a system call. Reads are passed to the target
+ * stream after sending the buffered data. Closing this file closes the
+ * target stream.
+ */
+File * FILE_BufferedOut(File * f, size_t bufsize)
+{
+    ASSERT(f);
+    if (f) {
+        BufOutFile * b = MEM_New(BufOutFile);
+        if (b) {
+            memset(b, 0, sizeof(*b));
+            b->size = (bufsize ? bufsize : FBUF_DEFAULT_SIZE);
+            b->size = MIN(b->size, INT_MAX);
+            b->hiwater = b->size;
+            b->buf = MEM_NewArray(I8u,b->size);
+            if (b->buf) {
+                b->target = f;
+                if (FILE_Init(&b->file, NULL, True, &BufOutIO)) {
+                    return &b->file;
+                }
+                MEM_Free(b->buf);
+            }
+            MEM_Free(b);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Checks if the file is a buffered output stream
+ */
+Bool FILE_IsBufferedOut(const File * f)
+{
+    return BoolValue(f && f->io == &BufOutIO);
+}
+
+/**
+ * Returns a pointer to at least len bytes of free space in the output
+ * buffer, so that the data can be formatted in place. The data become
+ * part of the output when FILE_Commit is called. Returns NULL if this
+ * file is not a buffered output stream (FILE_BufferedOut), the buffer is
+ * too small or there was an error. In that case the caller should write
+ * the data with FILE_Write.
+ */
+void * FILE_Reserve(File * f, size_t len)
+{
+    return FILE_Reserve2(f, len, NULL);
+}
+
+/**
+ * Same as FILE_Reserve but also returns the actual amount of free space
+ * in the buffer, which may be more than requested. This is useful when
+ * the size of the data is not known in advance.
+ */
+void * FILE_Reserve2(File * f, size_t len, size_t * avail)
+{
+    if (FILE_IsBufferedOut(f) && CAN_WRITE(f)) {
+        BufOutFile * b = BufOutCast(f);
+        if (len <= b->size && !b->err) {
+            if ((b->size - b->len) >= len || BufOutDrain(b)) {
+                if (avail) *avail = b->size - b->len;
+                return b->buf + b->len;
+            }
+        }
+    }
+    if (avail) *avail = 0;
+    return NULL;
+}
+
+/**
+ * Appends len bytes that have been written to the space returned by
+ * FILE_Reserve to the output.
+ */
+Bool FILE_Commit(File * f, size_t len)
+{
+    BufOutFile * b = BufOutCast(f);
+    if (b && !b->err) {
+        ASSERT(b->len + len <= b->size);
+        b->len += len;
+        f->bytesWritten += len;
+        return BoolValue(b->len < b->hiwater || BufOutDrain(b));
+    }
+    return False;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -32,6 +32,8 @@
 #include "s_fio.h"
 #include "s_util.h"
 #include "s_mem.h"
+#include "s_mutex.h"
+#include "s_libp.h"
 
 /**
  * Initializes the shared portion of all file structures. The path parameter
@@ -69,6 +71,95 @@ void FILE_Destroy(File * f)
     MEM_Free(f->name);
 }
 
+/*
+ * Pool of I/O buffers of FILE_POOL_BUF_SIZE bytes, currently used by the
+ * corked socket streams. The pool exists while the module is initialized,
+ * otherwise the buffers are allocated and freed on demand.
+ */
+#define FILE_POOL_MAX 64    /* max number of buffers in the pool */
+
+typedef struct _FilePoolBuf {
+    struct _FilePoolBuf * next;
+} FilePoolBuf;
+
+STATIC int FILE_initCount = 0;
+STATIC Mutex FILE_poolMutex;
+STATIC FilePoolBuf * FILE_poolFree = NULL;
+STATIC int FILE_poolCount = 0;
+
+/**
+ * Initialize the module.
+ */
+void FILE_InitModule()
+{
+    if ((FILE_initCount++) == 0) {
+        MEM_InitModule();
+        if (MUTEX_Init(&FILE_poolMutex)) {
+            return;
+        }
+
+        /* unrecoverable error */
+        SLIB_Abort(TEXT("FILE"));
+    }
+}
+
+/**
+ * Cleanup the module.
+ */
+void FILE_Shutdown()
+{
+    ASSERT(FILE_initCount > 0);
+    if ((--FILE_initCount) == 0) {
+        while (FILE_poolFree) {
+            FilePoolBuf * buf = FILE_poolFree;
+            FILE_poolFree = buf->next;
+            MEM_Free(buf);
+        }
+        FILE_poolCount = 0;
+        MUTEX_Destroy(&FILE_poolMutex);
+        MEM_Shutdown();
+    }
+}
+
+/**
+ * Internal function. Allocates FILE_POOL_BUF_SIZE bytes, preferably
+ * from the pool.
+ */
+void * FILE_PoolAlloc()
+{
+    FilePoolBuf * buf = NULL;
+    if (FILE_initCount > 0) {
+        MUTEX_Lock(&FILE_poolMutex);
+        buf = FILE_poolFree;
+        if (buf) {
+            FILE_poolFree = buf->next;
+            FILE_poolCount--;
+        }
+        MUTEX_Unlock(&FILE_poolMutex);
+    }
+    return buf ? buf : MEM_Alloc(FILE_POOL_BUF_SIZE);
+}
+
+/**
+ * Internal function. Returns the buffer allocated by FILE_PoolAlloc
+ * back to the pool.
+ */
+void FILE_PoolFree(void * ptr)
+{
+    if (ptr && FILE_initCount > 0) {
+        MUTEX_Lock(&FILE_poolMutex);
+        if (FILE_poolCount < FILE_POOL_MAX) {
+            FilePoolBuf * buf = (FilePoolBuf*)ptr;
+            buf->next = FILE_poolFree;
+            FILE_poolFree = buf;
+            FILE_poolCount++;
+            ptr = NULL;
+        }
+        MUTEX_Unlock(&FILE_poolMutex);
+    }
+    MEM_Free(ptr);
+}
+
 /**
  * Open a file. Returns NULL if file cannot be opened or memory
  * allocation fails.
@@ -259,6 +350,51 @@ int FILE_Read(File * f, void * buf, int len)
     }
 }
 
+/**
+ * Same as FILE_Read but the buffer size is not limited to INT_MAX. If the
+ * I/O method doesn't provide the read64 callback, large reads are split
+ * into INT_MAX sized chunks.
+ */
+I64s FILE_Read64(File * f, void * buf, size_t len)
+{
+    ASSERT(f);
+    if (CAN_READ(f)) {
+        size_t total = 0;
+        I8u * dest = (I8u*)buf;
+        while (f->pushed > 0 && total < len) {
+            dest[total++] = f->pushBack[--(f->pushed)];
+            f->bytesRead++;
+        }
+        if (total > 0 && FILE_Eof(f)) {
+            return (I64s)total;
+        } else if (f->io->read64) {
+            I64s n = f->io->read64(f, dest + total, len - total);
+            if (n > 0) {
+                f->bytesRead += (size_t)n;
+                total += (size_t)n;
+            } else if (!total) {
+                return n;
+            }
+        } else {
+            do {
+                int chunk = (int)MIN(len - total, (size_t)INT_MAX);
+                int n = f->io->read(f, dest + total, chunk);
+                if (n > 0) {
+                    f->bytesRead += n;
+                    total += n;
+                    if (n == chunk) continue;
+                } else if (!total) {
+                    return n;
+                }
+                break;
+            } while (total < len);
+        }
+        return (I64s)total;
+    } else {
+        return (-1);
+    }
+}
+
 /**
  * Reads data from stream. Returns True if all requested bytes have been
  * read from the stream, or False in case of an error, end of file condition
@@ -320,6 +456,148 @@ int FILE_Write(File * f, const void * buf, int len)
     }
 }
 
+/**
+ * Same as FILE_Write but the buffer size is not limited to INT_MAX. If the
+ * I/O method doesn't provide the write64 callback, large writes are split
+ * into INT_MAX sized chunks.
+ */
+I64s FILE_Write64(File * f, const void * buf, size_t len)
+{
+    ASSERT(f);
+    if (CAN_WRITE(f)) {
+        if (f->io->write64) {
+            I64s n = f->io->write64(f, buf, len);
+            if (n > 0) f->bytesWritten += (size_t)n;
+            return n;
+        } else {
+            size_t total = 0;
+            const I8u * src = (const I8u*)buf;
+            do {
+                int chunk = (int)MIN(len - total, (size_t)INT_MAX);
+                int n = f->io->write(f, src + total, chunk);
+                if (n > 0) {
+                    f->bytesWritten += n;
+                    total += n;
+                    if (n == chunk) continue;
+                } else if (!total) {
+                    return n;
+                }
+                break;
+            } while (total < len);
+            return (I64s)total;
+        }
+    } else {
+        return (-1);
+    }
+}
+
+/**
+ * Scatter input. Fills the buffers described by the vector one after
+ * another, stops at the first short read. Returns the total number of
+ * bytes read, or (-1) if an error occurs and no data has been read.
+ */
+I64s FILE_ReadV(File * f, const FileVec * vec, int n)
+{
+    ASSERT(f);
+    ASSERT(n >= 0);
+    if (CAN_READ(f)) {
+        I64s total = 0;
+        if (f->io->readv && !f->pushed) {
+            while (n > 0) {
+                int i, count = MIN(n, FIO_MAX_VEC);
+                I64s len = 0, nbytes;
+                for (i=0; i<count; i++) len += vec[i].len;
+                if (len > 0) {
+                    nbytes = f->io->readv(f, vec, count);
+                    if (nbytes > 0) {
+                        f->bytesRead += (size_t)nbytes;
+                        total += nbytes;
+                        if (nbytes < len) break;
+                    } else {
+                        if (!total) return nbytes;
+                        break;
+                    }
+                }
+                vec += count;
+                n -= count;
+            }
+        } else {
+            int i;
+            for (i=0; i<n; i++) {
+                if (vec[i].len) {
+                    I64s nbytes = FILE_Read64(f, vec[i].data, vec[i].len);
+                    if (nbytes > 0) {
+                        total += nbytes;
+                        if ((size_t)nbytes == vec[i].len) {
+                            continue;
+                        }
+                    } else if (!total) {
+                        return nbytes;
+                    }
+                    break;
+                }
+            }
+        }
+        return total;
+    } else {
+        return (-1);
+    }
+}
+
+/**
+ * Gather output. Writes the buffers described by the vector one after
+ * another. Returns the total number of bytes written, which is less than
+ * the total size of the data if an error occurs. Returns (-1) if an error
+ * occurs and no data has been written.
+ */
+I64s FILE_WriteV(File * f, const FileVec * vec, int n)
+{
+    ASSERT(f);
+    ASSERT(n >= 0);
+    if (CAN_WRITE(f)) {
+        I64s total = 0;
+        if (f->io->writev) {
+            while (n > 0) {
+                int i, count = MIN(n, FIO_MAX_VEC);
+                I64s len = 0, nbytes;
+                for (i=0; i<count; i++) len += vec[i].len;
+                if (len > 0) {
+                    nbytes = f->io->writev(f, vec, count);
+                    if (nbytes > 0) {
+                        f->bytesWritten += (size_t)nbytes;
+                        total += nbytes;
+                        if (nbytes < len) break;
+                    } else {
+                        if (!total) return nbytes;
+                        break;
+                    }
+                }
+                vec += count;
+                n -= count;
+            }
+        } else {
+            int i;
+            for (i=0; i<n; i++) {
+                if (vec[i].len) {
+                    I64s nbytes = FILE_Write64(f, vec[i].data, vec[i].len);
+                    if (nbytes > 0) {
+                        total += nbytes;
+                        if ((size_t)nbytes == vec[i].len) {
+                            continue;
+                        }
+                    } else if (!total) {
+                        return nbytes;
+                    }
+                    break;
+                }
+            }
+        }
+        return total;
+    } else {
+        return (-1);
+    }
+}
+
 /**
  * Writes data to the stream. Returns True if the entire buffer has been
  * written to the file, or False if less than len bytes have been written.
@@ -430,6 +708,58 @@ Bool FILE_SkipAll(File * f, size_t skip)
     }
 }
 
+/**
+ * Provides direct access to the data buffered by the stream, trying to
+ * make at least min bytes available. Returns the number of bytes that
+ * can be accessed at *data. Returns zero if there's no more data, or if
+ * the stream doesn't support direct access to its data, or if there are
+ * bytes pushed back to the stream. In that case the caller should fall
+ * back to FILE_Read. The data remain in the stream until consumed with
+ * FILE_Consume, and the pointer is only valid until the next I/O call.
+ */
+size_t FILE_Peek(File * f, const void ** data, size_t min)
+{
+    ASSERT(f);
+    ASSERT(data);
+    *data = NULL;
+    if (CAN_READ(f) && !f->pushed && f->io->peek) {
+        ASSERT(f->io->skip);
+        return f->io->peek(f, data, min);
+    }
+    return 0;
+}
+
+/**
+ * Consumes the data previously returned by FILE_Peek. Returns True if
+ * the requested number of bytes have been consumed.
+ */
+Bool FILE_Consume(File * f, size_t n)
+{
+    return FILE_SkipAll(f, n);
+}
+
+/**
+ * Provides direct access to all the remaining data in the stream, if the
+ * stream is entirely memory resident (e.g. memory mapped or in-memory).
+ * Returns False if the stream can't do that. The data remain in the stream
+ * until consumed with FILE_Consume, and the pointer is only valid until the
+ * next I/O call.
+ */
+Bool FILE_MapView(File * f, const void ** data, size_t * size)
+{
+    ASSERT(f);
+    ASSERT(data);
+    ASSERT(size);
+    *data = NULL;
+    *size = 0;
+    if (CAN_READ(f) && !f->pushed && (f->io->flags & FIO_MAPPED)) {
+        ASSERT(f->io->peek);
+        *size = f->io->peek(f, data, 0);
+        return True;
+    }
+    return False;
+}
+
 /**
  * Prints formatted data to the stream. Returns the number of characters
  * actually written to the stream, or (-1) if it fails.
@@ -453,6 +783,22 @@ int FILE_VaPrintf(File * f, Str format, va_list va)
     int nbytes = -1;
     ASSERT(f);
     if (CAN_WRITE(f)) {
+#if !defined(UNICODE) && defined(va_copy)
+        size_t avail;
+        char * dest = (char*)FILE_Reserve2(f, 1, &avail);
+        if (dest) {
+
+            /* try to format directly into the output buffer */
+            va_list va2;
+            va_copy(va2, va);
+            nbytes = Vsnprintf(dest, avail, format, va2);
+            va_end(va2);
+            if (nbytes >= 0 && (size_t)nbytes < avail) {
+                return (FILE_Commit(f, nbytes) ? nbytes : (-1));
+            }
+            nbytes = -1;
+        }
+#endif /* !UNICODE && va_copy */
         if (STRBUF_FormatVa(&f->buf, format, va)) {
             nbytes = f->io->write(f, f->buf.s, (int)f->buf.len);
             if (nbytes > 0) f->bytesWritten += nbytes;
@@ -476,17 +822,19 @@ Bool FILE_Puts(File * f, Str s)
         } else {
             int nbytes;
 #ifdef UNICODE
-            size_t n = wcstombs(NULL,s,0) + 1;
+            size_t n = StrLen(s) * MB_CUR_MAX + 1;
             char * bytes = NULL;
             if (((int)n) > 0) {
 
                 /*
                  * use the string buffer for storing the result of
-                 * translating UNICODE string into multibyte
+                 * translating UNICODE string into multibyte. Allocate
+                 * the worst case amount of space so that the string
+                 * only needs to be converted once.
                  */
 
                 STRBUF_SetLength(&f->buf, 0);
-                if (STRBUF_Alloc(&f->buf,(n+1)/2)) {
+                if (STRBUF_Alloc(&f->buf,(n+sizeof(Char)-1)/sizeof(Char))) {
                     bytes = (char*)(f->buf.s);
                     n = wcstombs(bytes,s,n);
                     if (n == ((size_t)-1)) {
@@ -528,17 +876,41 @@ Bool FILE_Puts(File * f, Str s)
 Bool FILE_Gets(File * f, Char * buf, size_t len)
 {
     Char * s = buf;
+    size_t room = len - 1;
     if (!buf || !len || !CAN_READ(f)) return False;
-    while (len-- > 1) {
-        int c = FILE_Getc(f);
+    while (room > 0) {
+        int c;
+#ifndef UNICODE
+        const void * data;
+        size_t avail = FILE_Peek(f, &data, 1);
+        if (avail > 0) {
+
+            /* scan the buffered data without reading it byte by byte */
+            const char * p = (const char *)data;
+            const char * eol = (const char *)memchr(p, '\n', MIN(avail,room));
+            size_t n = (eol ? (size_t)(eol - p + 1) : MIN(avail,room));
+            const char * nul = (const char *)memchr(p, 0, n);
+            if (nul) n = nul - p;
+            memcpy(s, p, n);
+            FILE_Consume(f, n);
+            s += n;
+            room -= n;
+            if (eol || nul) {
+                break; /* end of line or binary data */
+            }
+            continue;
+        }
+#endif /* UNICODE */
+        c = FILE_Getc(f);
         if (c == 0) {
             FILE_Ungetc(f, (Char)c);
             break; /* binary data */
         }
         if ((c == EOF) || ((*s++ = (Char)c) == '\n')) break;
+        room--;
     }
     *s = 0;
-    return BoolValue(s != buf || len == 0);
+    return BoolValue(s != buf || len == 1);
 }
 
 /**
@@ -803,35 +1175,139 @@ Bool FILE_CanBlock(File * f)
     return False;
 }
 
+/**
+ * Tests whether the last read or write has failed because the stream
+ * (or its target) is in non-blocking mode and the operation would block.
+ * In that case, the operation should be retried when the underlying
+ * socket becomes ready.
+ */
+Bool FILE_WouldBlock(File * f)
+{
+    ASSERT(f);
+    while (f) {
+        if (f->flags & FILE_WOULD_BLOCK) {
+            return True;
+        }
+        f = FILE_Target(f);
+    }
+    return False;
+}
+
+/**
+ * Tests whether the last read or write has failed (or transferred less
+ * data than requested) because the stream (or its target) has a timeout
+ * set and the deadline has expired. The stream remains usable.
+ */
+Bool FILE_TimedOut(File * f)
+{
+    ASSERT(f);
+    while (f) {
+        if (f->flags & FILE_TIMED_OUT) {
+            return True;
+        }
+        f = FILE_Target(f);
+    }
+    return False;
+}
+
 /*==========================================================================*
  *              U T I L I T I E S
  *==========================================================================*/
 
 #define STACK_BUF_SIZE 1024  /* size of the buffer we allocate on stack */
+#define COPY_BUF_SIZE  65536 /* size of the heap buffer used for copying */
 
 /**
- * Copies the data from one stream and writes it into another. Returns number
- * of bytes copied, -1 if nothing has been written due to an error. There's
- * no return value to detect partial copy.
+ * Copies no more than max bytes (all data if max is negative) from one
+ * stream to another. If both streams are backed by file descriptors, the
+ * kernel may copy the data for us. If the input stream provides direct
+ * access to its data, the data are written straight from there. Otherwise
+ * they go through a temporary buffer. Returns number of bytes copied, -1
+ * if nothing has been written due to an error.
  */
-int FILE_Copy(File * in, File * out)
+STATIC I64s FILE_CopyData(File * in, File * out, I64s max)
 {
-    int n, total = 0;
-    I8u data[STACK_BUF_SIZE];
-    while ((n = FILE_Read(in, data, sizeof(data))) > 0) {
-        int nread = n;
-        n = FILE_Write(out, data, nread);
+    I64s n = 0, total = 0;
+    const void * data;
+    size_t avail;
+
+#ifdef FIO_KERNEL_COPY
+    if (CAN_READ(in) && CAN_WRITE(out)) {
+        I64s copied = FILE_CopyFd(in, out, max);
+        if (copied > 0) total = copied;
+    }
+#endif /* FIO_KERNEL_COPY */
+
+    /* no need to copy the data if we can access them directly */
+    while ((max < 0 || total < max) && (avail = FILE_Peek(in,&data,1)) > 0) {
+        if (max >= 0 && (I64u)(max - total) < avail) {
+            avail = (size_t)(max - total);
+        }
+        n = FILE_Write64(out, data, avail);
         if (n > 0) {
+            FILE_Consume(in, (size_t)n);
             total += n;
-            if (n == nread) {
+            if ((size_t)n == avail) {
                 continue;
             }
         }
-        break;
+        return ((total > 0) ? total : ((n == 0) ? 0 : -1));
+    }
+
+    /* FILE_Peek returns zero at the end of file too, FILE_Read tells why */
+    if (max < 0 || total < max) {
+        I8u minibuf[STACK_BUF_SIZE];
+        I8u * buf = minibuf;
+        size_t bufsize = COPY_BUF_SIZE;
+        if (max >= 0 && (I64u)(max - total) < bufsize) {
+            bufsize = (size_t)(max - total);
+        }
+        if (bufsize <= sizeof(minibuf) || !(buf = MEM_NewArray(I8u,bufsize))) {
+            buf = minibuf;
+            bufsize = sizeof(minibuf);
+        }
+        while (max < 0 || total < max) {
+            size_t chunk = bufsize;
+            if (max >= 0 && (I64u)(max - total) < chunk) {
+                chunk = (size_t)(max - total);
+            }
+            n = FILE_Read64(in, buf, chunk);
+            if (n > 0) {
+                I64s nread = n;
+                n = FILE_Write64(out, buf, (size_t)nread);
+                if (n > 0) {
+                    total += n;
+                    if (n == nread) {
+                        continue;
+                    }
+                }
+            }
+            break;
+        }
+        if (buf != minibuf) MEM_Free(buf);
     }
     return ((total > 0) ? total : ((n == 0) ? 0 : -1));
 }
 
+/**
+ * Copies the data from one stream and writes it into another. Returns number
+ * of bytes copied, -1 if nothing has been written due to an error. There's
+ * no return value to detect partial copy.
+ */
+I64s FILE_Copy64(File * in, File * out)
+{
+    return FILE_CopyData(in, out, -1);
+}
+
+/**
+ * Same as FILE_Copy64 but the return value is limited to INT_MAX
+ */
+int FILE_Copy(File * in, File * out)
+{
+    I64s n = FILE_Copy64(in, out);
+    return (int)MIN(n, INT_MAX);
+}
+
 /**
  * Copies no more than max bytes from one stream to another. Negative
  * max size means to copy all data until end of file. Returns number
@@ -839,32 +1315,27 @@ int FILE_Copy(File * in, File * out)
  * output file. Note that number of bytes read from the input file
  * may be greater than the number of bytes written to the output file.
  */
-int FILE_CopyN(File * in, File * out, int max)
+I64s FILE_CopyN64(File * in, File * out, I64s max)
 {
     if (max < 0) {
-        return FILE_Copy(in, out);
+        return FILE_Copy64(in, out);
     } else if (max == 0) {
         return FILE_Read(in, NULL, 0);
     } else {
-        int n, total = 0;
-        I8u data[STACK_BUF_SIZE];
-        int chunk = MIN(STACK_BUF_SIZE,max);
-        while ((n = FILE_Read(in, data, chunk)) > 0) {
-            int nread = n;
-            n = FILE_Write(out, data, nread);
-            if (n > 0) {
-                total += n;
-                if (n == nread && max > total) {
-                    chunk = MIN(STACK_BUF_SIZE,max-total);
-                    continue;
-                }
-            }
-            break;
-        }
-        return total;
+        I64s n = FILE_CopyData(in, out, max);
+        return MAX(n, 0);
     }
 }
 
+/**
+ * Same as FILE_CopyN64 but the number of bytes is limited to INT_MAX
+ */
+int FILE_CopyN(File * in, File * out, int max)
+{
+    I64s n = FILE_CopyN64(in, out, max);
+    return (int)MIN(n, INT_MAX);
+}
+
 /**
  * Reads a line from the stream. Returns the pointer to the string buffer,
  * NULL if nothing was read from the file (that includes both end-of-line
@@ -902,40 +1373,87 @@ Str FILE_ReadLine(File * in, StrBuf * sb)
  * stored in the buffer. If max parameter is >= 0, reads no more than
  * max bytes
  */
-int FILE_ReadData(File * in, Buffer * out, int max)
+I64s FILE_ReadData64(File * in, Buffer * out, I64s max)
 {
-    I8u data[STACK_BUF_SIZE];
-    size_t initial = BUFFER_Size(out);
-    size_t bufsiz = initial;
-
-    /* size of the first chunk to read */
-    int chunk = ((max<0) ? STACK_BUF_SIZE : MIN(STACK_BUF_SIZE,max));
-    while (BUFFER_EnsureCapacity(out, bufsiz + chunk, True)) {
-        int maxsiz = (int)MIN(out->alloc - bufsiz, (size_t)chunk);
-        int nbytes = FILE_Read(in, data, maxsiz);
-        if (nbytes > 0) {
-            /* this must succeed since memory has been pre-allocated */
-            BUFFER_Put(out, data, nbytes, True);
-            bufsiz += nbytes;
-            ASSERT(bufsiz == BUFFER_Size(out));
+    I64s total = 0;
+    const void * data;
+    size_t size;
+
+    /* memory resident data can be stored in the buffer in one shot */
+    if (FILE_MapView(in, &data, &size)) {
+        size_t n = size;
+        if (max >= 0 && (I64u)max < n) n = (size_t)max;
+        n = BUFFER_Put(out, data, n, True);
+        FILE_Consume(in, n);
+
+        /* hit the end of file, the way the read loop below would */
+        if (n == size) FILE_Read(in, NULL, 0);
+        return (I64s)n;
+    }
 
-            /* calculate the size of the next chunk */
-            if (max < 0) {
-                chunk = STACK_BUF_SIZE;
-            } else {
-                ASSERT(max >= nbytes);
-                max -= nbytes;
-                if (max == 0) {
-                    break;
-                } else {
-                    chunk = MIN(STACK_BUF_SIZE,max);
-                }
+    /*
+     * If there's no rollover in the buffer, we can read the data directly
+     * into the buffer, at its end. Otherwise, they go through the stack.
+     */
+    if (!BUFFER_Size(out)) BUFFER_Clear(out);
+    if (out->start <= out->end &&
+        !(out->flags & (BUFFER_FULL | BUFFER_READONLY))) {
+        size_t chunk = STACK_BUF_SIZE;
+        while (max < 0 || total < max) {
+            I64s n;
+            I8u * ptr;
+            size_t want = chunk;
+            size_t room = out->maxsiz - BUFFER_Size(out);
+            if (max >= 0 && (I64u)(max - total) < want) {
+                want = (size_t)(max - total);
             }
-        } else {
-            break;
+            if (out->maxsiz != BUFFER_NO_LIMIT && room < want) {
+                want = room;
+            }
+            if (!want || !(ptr = (I8u*)BUFFER_Reserve(out, want))) {
+                break;
+            }
+            n = FILE_Read64(in, ptr, want);
+            BUFFER_Unput(out, want - ((n > 0) ? (size_t)n : 0));
+            if (n <= 0) {
+                break;
+            }
+            total += n;
+
+            /* read larger chunks as the buffer grows */
+            if (chunk < COPY_BUF_SIZE) chunk *= 2;
+        }
+    } else {
+        I8u buf[STACK_BUF_SIZE];
+        while (max < 0 || total < max) {
+            I64s n;
+            size_t chunk = sizeof(buf);
+            if (max >= 0 && (I64u)(max - total) < chunk) {
+                chunk = (size_t)(max - total);
+            }
+            if (!BUFFER_EnsureCapacity(out, BUFFER_Size(out)+chunk, True)) {
+                break;
+            }
+            chunk = MIN(out->alloc - BUFFER_Size(out), chunk);
+            n = chunk ? FILE_Read64(in, buf, chunk) : 0;
+            if (n <= 0) {
+                break;
+            }
+            /* this must succeed since memory has been pre-allocated */
+            VERIFY_VALUE(BUFFER_Put(out, buf, (size_t)n, True), (size_t)n);
+            total += n;
         }
     }
-    return (int)(bufsiz - initial);
+    return total;
+}
+
+/**
+ * Same as FILE_ReadData64 but the number of bytes is limited to INT_MAX
+ */
+int FILE_ReadData(File * in, Buffer * out, int max)
+{
+    I64s n = FILE_ReadData64(in, out, max);
+    return (int)MIN(n, INT_MAX);
 }
 
 /**
@@ -29,10 +29,24 @@
  * any official policies, either expressed or implied.
  */
 
+#if defined(__linux__) && !defined(__KERNEL__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE   /* for splice */
+#endif
+
 #include "s_buf.h"
 #include "s_fio.h"
 #include "s_mem.h"
 
+#if defined(_UNIX) && !defined(__KERNEL__)
+#  include <sys/uio.h>
+#endif /* _UNIX && !__KERNEL__ */
+
+#ifdef FIO_KERNEL_COPY
+#  include <fcntl.h>
+#  include <sys/sendfile.h>
+#  include <sys/syscall.h>
+#endif /* FIO_KERNEL_COPY */
+
 /*==========================================================================*
  *              P L A I N     F I L E    I O
  *==========================================================================*/
@@ -114,25 +128,96 @@ STATIC Bool PlainFileReopen(File * f, Str path, const char * mode)
 }
 #endif /* !_WIN32_WCE */
 
-STATIC int PlainFileRead(File * f, void * buf, int len)
+STATIC I64s PlainFileRead64(File * f, void * buf, size_t len)
 {
     PlainFile * pf = PlainFileCast(f);
     if (pf) {
         size_t nbytes = fread(buf, 1, len, pf->f);
-        return (ferror(pf->f) ? (-1) : (int)nbytes);
+        return (ferror(pf->f) ? (-1) : (I64s)nbytes);
     }
     return (-1);
 }
 
-STATIC int PlainFileWrite(File * f, const void * buf, int len)
+STATIC I64s PlainFileWrite64(File * f, const void * buf, size_t len)
 {
     PlainFile * pf = PlainFileCast(f);
     if (pf) {
         size_t nbytes = fwrite(buf, 1, len, pf->f);
-        return (ferror(pf->f) ? (-1) : (int)nbytes);
+        return (ferror(pf->f) ? (-1) : (I64s)nbytes);
+    }
+    return (-1);
+}
+
+STATIC int PlainFileRead(File * f, void * buf, int len)
+{
+    return (int)PlainFileRead64(f, buf, len);
+}
+
+STATIC int PlainFileWrite(File * f, const void * buf, int len)
+{
+    return (int)PlainFileWrite64(f, buf, len);
+}
+
+#if defined(_UNIX) && !defined(__KERNEL__)
+/*
+ * Only output goes directly to the file descriptor, after flushing the
+ * stdio buffer. Input can't bypass the data already buffered by stdio,
+ * so FILE_ReadV reads the vectors one by one.
+ */
+STATIC I64s PlainFileWriteV(File * f, const FileVec * vec, int n)
+{
+    PlainFile * pf = PlainFileCast(f);
+    if (pf && fflush(pf->f) != EOF) {
+        int i;
+        ssize_t nbytes;
+        struct iovec iov[FIO_MAX_VEC];
+        ASSERT(n <= FIO_MAX_VEC);
+        for (i=0; i<n; i++) {
+            iov[i].iov_base = vec[i].data;
+            iov[i].iov_len = vec[i].len;
+        }
+        do nbytes = writev(fileno(pf->f), iov, n);
+        while (nbytes < 0 && errno == EINTR);
+        return nbytes;
+    }
+    return (-1);
+}
+
+/*
+ * Seeks over the data if this is a regular file, so that skipping to
+ * the middle of a large file doesn't mean reading everything before it.
+ */
+STATIC int PlainFileSkip(File * f, int len)
+{
+    PlainFile * pf = PlainFileCast(f);
+    if (pf) {
+        struct stat st;
+        off_t pos = ftello(pf->f);
+        if (pos >= 0 && fstat(fileno(pf->f), &st) == 0 &&
+            S_ISREG(st.st_mode)) {
+            off_t n = ((st.st_size > pos) ? (st.st_size - pos) : 0);
+            if (n > len) n = len;
+            if (fseeko(pf->f, pos + n, SEEK_SET) == 0) {
+                return (int)n;
+            }
+        } else {
+            int nbytes = 0;
+            I8u buf[512];
+            while (nbytes < len) {
+                size_t n = fread(buf, 1, MIN(sizeof(buf),
+                    (size_t)(len - nbytes)), pf->f);
+                if (!n) break;
+                nbytes += (int)n;
+            }
+            return ((nbytes > 0 || !ferror(pf->f)) ? nbytes : (-1));
+        }
     }
     return (-1);
 }
+#else /* !_UNIX || __KERNEL__ */
+#  define PlainFileWriteV NULL  /* use the default */
+#  define PlainFileSkip   NULL  /* read and discard */
+#endif /* !_UNIX || __KERNEL__ */
 
 STATIC Bool PlainFileFlush(File * f)
 {
@@ -206,7 +291,12 @@ const FileIO PlainFileIO = {
     NULL                /* setparam */,
     PlainFileRead       /* read     */,
     PlainFileWrite      /* write    */,
-    NULL                /* skip     */,
+    PlainFileRead64     /* read64   */,
+    PlainFileWrite64    /* write64  */,
+    NULL                /* readv    */,
+    PlainFileWriteV     /* writev   */,
+    PlainFileSkip       /* skip     */,
+    NULL                /* peek     */,
     PlainFileFlush      /* flush    */,
     PlainFileEof        /* eof      */,
     PlainFileFd         /* fd       */,
@@ -217,6 +307,233 @@ const FileIO PlainFileIO = {
     FIO_FILE_BASED      /* flags    */
 };
 
+/*==========================================================================*
+ *              K E R N E L    C O P Y
+ *==========================================================================*/
+
+#ifdef FIO_KERNEL_COPY
+
+#define KCOPY_MAX_CHUNK  0x40000000 /* max bytes per sendfile call */
+#define KCOPY_PIPE_CHUNK 0x10000    /* default capacity of a pipe */
+
+/**
+ * Returns the file descriptor that can be used for reading or writing
+ * the data bypassing the stream, or -1 if there's no such thing. For
+ * plain files, also returns the stdio stream which has to be kept in
+ * sync with the descriptor.
+ */
+STATIC int FILE_RawFd(File * f, FILE ** stream)
+{
+    *stream = NULL;
+    if (f->io == &PlainFileIO) {
+        PlainFile * pf = PlainFileCast(f);
+        if (pf->f) {
+            *stream = pf->f;
+            return fileno(pf->f);
+        }
+    } else if (f->io == &SocketIO) {
+        return FILE_SocketRawFd(f);
+    }
+    return -1;
+}
+
+/**
+ * Copies the data from a regular file to any file descriptor, without
+ * moving them to the user space. Starts at the current stdio position
+ * and leaves the stdio stream positioned right after the copied data.
+ */
+STATIC I64s FILE_CopyFromFile(FILE * in, int outfd, Bool outfile, I64s max)
+{
+    I64s total = 0;
+    ssize_t n = 0;
+    int infd = fileno(in);
+    off_t pos;
+    struct stat st;
+
+    if (fflush(in) == EOF || (pos = ftello(in)) < 0 ||
+        fstat(infd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        return (-1);
+    }
+
+    while (max < 0 || total < max) {
+        size_t chunk = KCOPY_MAX_CHUNK;
+        if (max >= 0 && (I64u)(max - total) < chunk) {
+            chunk = (size_t)(max - total);
+        }
+
+#ifdef __NR_copy_file_range
+        /* between two files, the data may not even go through memory */
+        if (outfile) {
+            loff_t off = pos;
+            n = syscall(__NR_copy_file_range, infd, &off, outfd, NULL,
+                chunk, 0);
+            if (n < 0 && errno != EINTR) {
+                outfile = False;
+                if (errno == ENOSYS || errno == EXDEV ||
+                    errno == EINVAL || errno == EOPNOTSUPP) {
+                    continue;
+                }
+            }
+        } else
+#endif /* __NR_copy_file_range */
+        {
+            off_t off = pos;
+            n = sendfile(outfd, infd, &off, chunk);
+        }
+        if (n > 0) {
+            pos += n;
+            total += n;
+        } else if (n == 0 || errno != EINTR) {
+            break;
+        }
+    }
+
+    /* move the stdio stream past the copied data */
+    if (total > 0) {
+        VERIFY_VALUE(fseeko(in, pos, SEEK_SET), 0);
+        return total;
+    } else {
+        /* if the first call has failed, let the caller figure out why */
+        return ((n == 0) ? 0 : (-1));
+    }
+}
+
+/**
+ * Moves the data left in the pipe to the output descriptor through the
+ * user space, when splice fails to do that. Returns the number of bytes
+ * written. If writing fails, the rest of the data are discarded.
+ */
+STATIC size_t FILE_DrainPipe(int pipefd, int outfd, size_t left)
+{
+    char buf[4096];
+    size_t total = 0;
+    while (left > 0) {
+        size_t done = 0;
+        ssize_t n = read(pipefd, buf, MIN(left, sizeof(buf)));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            break;
+        }
+        left -= n;
+        while (done < (size_t)n) {
+            ssize_t k = write(outfd, buf + done, n - done);
+            if (k > 0) {
+                done += k;
+            } else if (k == 0 || errno != EINTR) {
+                break;
+            }
+        }
+        total += done;
+        if (done < (size_t)n) {
+            /* discard the rest */
+            while (left > 0 && (n = read(pipefd, buf,
+                MIN(left, sizeof(buf)))) > 0) {
+                left -= n;
+            }
+            break;
+        }
+    }
+    return total;
+}
+
+/**
+ * Copies the data from a socket to any file descriptor through a pipe,
+ * without moving them to the user space. Returns number of bytes written
+ * to the output descriptor, and the number of bytes read from the input
+ * socket in *nread. The data that have been read from the socket but
+ * could not be written are not counted.
+ */
+STATIC I64s FILE_CopyFromSocket(int infd, int outfd, I64s max, I64s * nread)
+{
+    I64s total = 0;
+    ssize_t n = 0;
+    int p[2];
+    *nread = 0;
+
+    /* splice fails for the output files opened in append mode */
+    if ((fcntl(outfd, F_GETFL) & O_APPEND) || pipe(p) < 0) {
+        return (-1);
+    }
+
+    while (max < 0 || *nread < max) {
+        size_t chunk = KCOPY_PIPE_CHUNK;
+        ssize_t left;
+        if (max >= 0 && (I64u)(max - *nread) < chunk) {
+            chunk = (size_t)(max - *nread);
+        }
+        n = splice(infd, NULL, p[1], NULL, chunk, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            break;
+        }
+        *nread += n;
+        for (left = n; left > 0; left -= n) {
+            n = splice(p[0], NULL, outfd, NULL, left, SPLICE_F_MOVE);
+            if (n > 0) {
+                total += n;
+            } else if (n == 0 || errno != EINTR) {
+                break;
+            } else {
+                n = 0;
+            }
+        }
+        if (left > 0) {
+            /* splice has failed, try to write the rest the usual way */
+            size_t done = FILE_DrainPipe(p[0], outfd, left);
+            total += done;
+            *nread -= (left - done);
+            break;
+        }
+    }
+
+    close(p[0]);
+    close(p[1]);
+
+    /* if the first call has failed, let the caller figure out why */
+    return ((*nread > 0 || n == 0) ? total : (-1));
+}
+
+/**
+ * Lets the kernel copy the data if both streams are backed by the file
+ * descriptors and the data don't need to be transformed on the way.
+ * Updates the byte counters of both streams. Returns the number of bytes
+ * written to the output stream or (-1) if the data cannot be copied this
+ * way and nothing has been done. The caller is supposed to copy the rest
+ * of the data (if any) in a usual way.
+ */
+I64s FILE_CopyFd(File * in, File * out, I64s max)
+{
+    FILE * inStream;
+    FILE * outStream;
+    int infd = FILE_RawFd(in, &inStream);
+    int outfd = FILE_RawFd(out, &outStream);
+    I64s nread, total = -1;
+
+    if (infd < 0 || outfd < 0 || in->pushed) {
+        return (-1);
+    }
+
+    /* the data buffered by stdio must be written first */
+    if (outStream && fflush(outStream) == EOF) {
+        return (-1);
+    }
+
+    if (inStream) {
+        total = FILE_CopyFromFile(inStream, outfd, BoolValue(outStream), max);
+        nread = total;
+    } else {
+        total = FILE_CopyFromSocket(infd, outfd, max, &nread);
+    }
+
+    if (nread > 0) in->bytesRead += (size_t)nread;
+    if (total > 0) out->bytesWritten += (size_t)total;
+    return total;
+}
+
+#endif /* FIO_KERNEL_COPY */
+
 /*
  * HISTORY:
  *
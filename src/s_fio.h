@@ -40,6 +40,8 @@
  */
 #define FILE_IS_OPEN      0x1000    /* set until closed or detached */
 #define FILE_IS_ATTACHED  0x2000    /* attached to existing low-level file */
+#define FILE_WOULD_BLOCK  0x4000    /* last non-blocking I/O would block */
+#define FILE_TIMED_OUT    0x8000    /* last I/O has missed the deadline */
 
 /* The value returned by FILE_Getc if it reaches the end of file */
 #ifndef EOF
@@ -49,6 +51,8 @@
 /* assert that these are not public */
 COMPILE_ASSERT((FILE_IS_OPEN & FILE_PUBLIC_FLAGS) == 0)
 COMPILE_ASSERT((FILE_IS_ATTACHED & FILE_PUBLIC_FLAGS) == 0)
+COMPILE_ASSERT((FILE_WOULD_BLOCK & FILE_PUBLIC_FLAGS) == 0)
+COMPILE_ASSERT((FILE_TIMED_OUT & FILE_PUBLIC_FLAGS) == 0)
 
 /* Max length of the open mode string (even 7 is too much...) */
 #define MAX_MODE_LEN 7
@@ -66,20 +70,36 @@ COMPILE_ASSERT((FILE_IS_ATTACHED & FILE_PUBLIC_FLAGS) == 0)
  *    FileOpen may, however, initialize the whole thing to zero.
  *
  * 3. FileWrite and FileRead return number of bytes written or read.
- *    In case of error they return -1
+ *    In case of error they return -1. FileWrite64 and FileRead64 do the
+ *    same thing for large buffers, and they are optional. If they are
+ *    missing, large transfers are split into INT_MAX sized chunks.
  *
  * 4. it's guaranteed that FileFree is the the only call that may occur
  *    after FileClose or FileDetach
  *
  * 5. it's guaranteed that FileClose or FileDetach will always be invoked
  *    before FileFree and that it happens no more than once per context
+ *
+ * 6. FilePeek returns the number of bytes that can be accessed directly
+ *    at *data without copying, trying to make at least min bytes available.
+ *    Zero means end of file or error. The data are consumed with FileSkip,
+ *    so any I/O method that implements FilePeek must implement FileSkip
+ *
+ * 7. FileReadV and FileWriteV are optional, they perform scatter/gather
+ *    I/O. They are never given more than FIO_MAX_VEC vectors at a time.
+ *    If they are missing, the vectors are read or written one by one.
  */
 typedef File * (*FileOpen)     P_((Str path, const char * mode));
 typedef Bool   (*FileReopen)   P_((File * f, Str path, const char * mode));
 typedef Bool   (*FileSetParam) P_((File * f, Str name, void * value));
 typedef int    (*FileRead)     P_((File * f, void * buf, int skip));
 typedef int    (*FileWrite)    P_((File * f, const void * buf, int len));
+typedef I64s   (*FileRead64)   P_((File * f, void * buf, size_t len));
+typedef I64s   (*FileWrite64)  P_((File * f, const void * buf, size_t len));
+typedef I64s   (*FileReadV)    P_((File * f, const FileVec * vec, int n));
+typedef I64s   (*FileWriteV)   P_((File * f, const FileVec * vec, int n));
 typedef int    (*FileSkip)     P_((File * f, int len));
+typedef size_t (*FilePeek)     P_((File * f, const void ** data, size_t min));
 typedef Bool   (*FileFlush)    P_((File * f));
 typedef Bool   (*FileEof)      P_((File * f));
 typedef int    (*FileFd)       P_((File * f));
@@ -97,7 +117,12 @@ struct _FileIO {
     FileSetParam setparam;      /* set stream parameters */
     FileRead     read;          /* read bytes */
     FileWrite    write;         /* write bytes */
+    FileRead64   read64;        /* read bytes, optional */
+    FileWrite64  write64;       /* write bytes, optional */
+    FileReadV    readv;         /* scatter input, optional */
+    FileWriteV   writev;        /* gather output, optional */
     FileSkip     skip;          /* skip bytes */
+    FilePeek     peek;          /* direct access to the input data */
     FileFlush    flush;         /* flush output buffer */
     FileEof      eof;           /* test for end-of-file condition */
     FileFd       fd;            /* returns the underlying fd, -1 if none */
@@ -108,8 +133,11 @@ struct _FileIO {
     int          flags;         /* flags, see below: */
 
 #define FIO_FILE_BASED    0x01  /* set if this is a file based I/O */
+#define FIO_MAPPED        0x02  /* peek returns all remaining data */
 };
 
+#define FIO_MAX_VEC 64          /* max vectors passed to readv and writev */
+
 /*
  * A common context associated with an open file.
  */
@@ -141,6 +169,17 @@ struct _File {
  */
 extern Bool FILE_Init P_((File * f, Str path, Bool attach, IODesc io));
 extern void FILE_Destroy P_((File * f));
+extern int FILE_SocketRawFd P_((File * f));
+
+/* pool of I/O buffers, exists while the module is initialized */
+#define FILE_POOL_BUF_SIZE 16640
+extern void * FILE_PoolAlloc P_((void));
+extern void FILE_PoolFree P_((void * buf));
+
+#if defined(__linux__) && !defined(__KERNEL__)
+#  define FIO_KERNEL_COPY
+extern I64s FILE_CopyFd P_((File * in, File * out, I64s max));
+#endif /* __linux__ && !__KERNEL__ */
 
 #endif /* _SLAVA_FILE_IO_H_ */
 
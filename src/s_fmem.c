@@ -51,7 +51,10 @@ typedef struct _MemFile {
 
 STATIC int  MemFileRead P_((File * f, void * buf, int len));
 STATIC int  MemFileWrite P_((File * f, const void * buf, int len));
+STATIC I64s MemFileRead64 P_((File * f, void * buf, size_t len));
+STATIC I64s MemFileWrite64 P_((File * f, const void * buf, size_t len));
 STATIC int  MemFileSkip P_((File * f, int skip));
+STATIC size_t MemFilePeek P_((File * f, const void ** data, size_t min));
 STATIC Bool MemFileFlush P_((File * f));
 STATIC Bool MemFileEof P_((File * f));
 STATIC void MemFileClose P_((File * f));
@@ -66,7 +69,12 @@ STATIC const FileIO MemFileIO = {
     NULL                /* setparam */,
     MemFileRead         /* read     */,
     MemFileWrite        /* write    */,
+    MemFileRead64       /* read64   */,
+    MemFileWrite64      /* write64  */,
+    NULL                /* readv    */,
+    NULL                /* writev   */,
     MemFileSkip         /* skip     */,
+    MemFilePeek         /* peek     */,
     MemFileFlush        /* flush    */,
     MemFileEof          /* eof      */,
     NULL                /* fd       */,
@@ -74,7 +82,7 @@ STATIC const FileIO MemFileIO = {
     NULL                /* detach   */,
     MemFileClose        /* close    */,
     MemFileFree         /* free     */,
-    0                   /* flags    */
+    FIO_MAPPED          /* flags    */
 };
 
 /*
@@ -104,12 +112,12 @@ STATIC const MemFile * MemFileCastC(const File * f)
     return NULL;
 }
 
-STATIC int MemFileRead(File * f, void * buf, int len)
+STATIC I64s MemFileRead64(File * f, void * buf, size_t len)
 {
-    int nbytes = -1;
+    I64s nbytes = -1;
     MemFile * m = MemFileCast(f);
     if ((m->mflags & MEM_IN) && !(m->mflags & MEM_EOF)) {
-        nbytes = (int)BUFFER_Get(m->buf, buf, len);
+        nbytes = (I64s)BUFFER_Get(m->buf, buf, len);
         if (!nbytes && BUFFER_Size(m->buf) == 0) {
             m->mflags |= MEM_EOF;
         }
@@ -117,17 +125,39 @@ STATIC int MemFileRead(File * f, void * buf, int len)
     return nbytes;
 }
 
+STATIC int MemFileRead(File * f, void * buf, int len)
+{
+    return (int)MemFileRead64(f, buf, len);
+}
+
 STATIC int MemFileSkip(File * f, int skip)
 {
     return MemFileRead(f, NULL, skip);
 }
 
-STATIC int MemFileWrite(File * f, const void * buf, int len)
+STATIC size_t MemFilePeek(File * f, const void ** data, size_t min)
+{
+    MemFile * m = MemFileCast(f);
+    UNREF(min);
+    if ((m->mflags & MEM_IN) && !(m->mflags & MEM_EOF)) {
+        size_t size = BUFFER_Size(m->buf);
+        if (size > 0) {
+            /* this makes the data contiguous if necessary */
+            *data = BUFFER_Access(m->buf);
+            if (*data) {
+                return size;
+            }
+        }
+    }
+    return 0;
+}
+
+STATIC I64s MemFileWrite64(File * f, const void * buf, size_t len)
 {
-    int nbytes = -1;
+    I64s nbytes = -1;
     MemFile * m = MemFileCast(f);
     if ((m->mflags & MEM_OUT) && !(m->mflags & MEM_ERR)) {
-        nbytes = (int)BUFFER_Put(m->buf, buf, len, True);
+        nbytes = (I64s)BUFFER_Put(m->buf, buf, len, True);
         if (!nbytes && len > 0) {
             nbytes = -1;
             m->mflags |= MEM_ERR;
@@ -138,6 +168,11 @@ STATIC int MemFileWrite(File * f, const void * buf, int len)
     return nbytes;
 }
 
+STATIC int MemFileWrite(File * f, const void * buf, int len)
+{
+    return (int)MemFileWrite64(f, buf, len);
+}
+
 STATIC Bool MemFileFlush(File * f)
 {
     MemFile * m = MemFileCast(f);
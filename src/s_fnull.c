@@ -58,7 +58,12 @@ STATIC const FileIO NullFileIO = {
     NULL                /* setparam */,
     NullFileRead        /* read     */,
     NullFileWrite       /* write    */,
+    NULL                /* read64   */,
+    NULL                /* write64  */,
+    NULL                /* readv    */,
+    NULL                /* writev   */,
     NULL                /* skip     */,
+    NULL                /* peek     */,
     NullFileFlush       /* flush    */,
     NullFileEof         /* eof      */,
     NULL                /* fd       */,
@@ -0,0 +1,442 @@
+/*
+ * $Id: s_fpref.c,v 1.1 2026/10/18 10:12:41 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "s_util.h"
+#include "s_fio.h"
+#include "s_mem.h"
+#include "s_mutex.h"
+#include "s_wkq.h"
+
+/*==========================================================================*
+ *              P R E F E T C H I N G    I N P U T
+ *==========================================================================*/
+
+/* defaults */
+#define FPREF_DEFAULT_COUNT 3
+#define FPREF_DEFAULT_SIZE  65536
+
+typedef struct _PrefetchBuf {
+    I8u * data;         /* the data */
+    size_t size;        /* number of bytes in the buffer */
+    size_t pos;         /* offset of the first unread byte */
+} PrefetchBuf;
+
+typedef struct _PrefetchFile {
+    File file;          /* shared File structure */
+    File * target;      /* the file we are reading from */
+    WorkQueue * wkq;    /* the reading thread */
+    Mutex mutex;        /* protects the fields below */
+    Event dataEvent;    /* signaled when a buffer has been filled */
+    Event spaceEvent;   /* signaled when a buffer has been consumed */
+    PrefetchBuf * bufs; /* the ring of buffers */
+    int nbufs;          /* number of buffers in the ring */
+    int head;           /* the buffer being consumed */
+    int count;          /* number of filled buffers */
+    size_t bufsize;     /* size of each buffer */
+    size_t want;        /* how much the consumer is waiting for */
+    Bool canBlock;      /* reads from the target can block */
+    int pflags;         /* flags, see below */
+
+#define FPREF_EOF  0x0001 /* target has reported end of file */
+#define FPREF_ERR  0x0002 /* target has reported an error */
+#define FPREF_STOP 0x0004 /* the reader must stop */
+#define FPREF_DONE (FPREF_EOF | FPREF_ERR)
+
+} PrefetchFile;
+
+STATIC int    PrefetchFileRead   P_((File * f, void * buf, int len));
+STATIC int    PrefetchFileSkip   P_((File * f, int len));
+STATIC size_t PrefetchFilePeek   P_((File * f, const void ** data, size_t min));
+STATIC Bool   PrefetchFileEof    P_((File * f));
+STATIC File * PrefetchFileTarget P_((File * f));
+STATIC void   PrefetchFileDetach P_((File * f));
+STATIC void   PrefetchFileClose  P_((File * f));
+STATIC void   PrefetchFileFree   P_((File * f));
+
+/*
+ * Table of I/O handlers
+ */
+STATIC const FileIO PrefetchFileIO = {
+    NULL                /* open     */,
+    NULL                /* reopen   */,
+    NULL                /* setparam */,
+    PrefetchFileRead    /* read     */,
+    NULL                /* write    */,
+    NULL                /* read64   */,
+    NULL                /* write64  */,
+    NULL                /* readv    */,
+    NULL                /* writev   */,
+    PrefetchFileSkip    /* skip     */,
+    PrefetchFilePeek    /* peek     */,
+    NULL                /* flush    */,
+    PrefetchFileEof     /* eof      */,
+    NULL                /* fd       */,
+    PrefetchFileTarget  /* target   */,
+    PrefetchFileDetach  /* detach   */,
+    PrefetchFileClose   /* close    */,
+    PrefetchFileFree    /* free     */,
+    0                   /* flags    */
+};
+
+/*
+ * I/O handlers
+ */
+STATIC PrefetchFile * PrefetchFileCast(File * f)
+{
+    ASSERT(f);
+    if (f) {
+        ASSERT(f->io == &PrefetchFileIO);
+        if (f->io == &PrefetchFileIO) {
+            return CAST(f,PrefetchFile,file);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Work item that runs on the reading thread. Keeps filling the buffers
+ * until the end of the target stream, or until it's told to stop.
+ */
+STATIC void PrefetchFileWork(WorkItem * w, void * arg)
+{
+    PrefetchFile * p = (PrefetchFile*)arg;
+    UNREF(w);
+    MUTEX_Lock(&p->mutex);
+    while (!(p->pflags & FPREF_STOP)) {
+
+        /*
+         * If reads from the target can block before the end of stream,
+         * don't read more than the consumer is waiting for. Otherwise we
+         * could wait for the data that the other side is not going to
+         * send, and the consumer would be waiting for us. Nor could
+         * the stream be closed or detached while we are waiting.
+         */
+        size_t want = p->bufsize;
+        if (p->canBlock) want = MIN(want, p->want);
+        if (p->count < p->nbufs && want > 0) {
+            int n;
+            PrefetchBuf * buf = p->bufs + (p->head + p->count) % p->nbufs;
+
+            /* the consumer doesn't touch the buffers beyond p->count */
+            MUTEX_Unlock(&p->mutex);
+            n = FILE_Read(p->target, buf->data, (int)want);
+            MUTEX_Lock(&p->mutex);
+            if (n > 0) {
+                buf->size = n;
+                buf->pos = 0;
+                p->count++;
+                p->want = 0;
+            } else {
+                p->pflags |= (n ? FPREF_ERR : FPREF_EOF);
+            }
+            EVENT_Set(&p->dataEvent);
+            if (n <= 0) {
+                break;
+            }
+        } else {
+
+            /* all buffers are full (or nothing is wanted), wait */
+            EVENT_Reset(&p->spaceEvent);
+            MUTEX_Unlock(&p->mutex);
+            EVENT_Wait(&p->spaceEvent);
+            MUTEX_Lock(&p->mutex);
+        }
+    }
+    MUTEX_Unlock(&p->mutex);
+}
+
+/**
+ * Waits until there's some data to consume. Returns the buffer being
+ * consumed, NULL if there's no more data. The need parameter tells the
+ * reader how many bytes the caller is going to consume. Must be invoked
+ * under lock.
+ */
+STATIC PrefetchBuf * PrefetchFileWait(PrefetchFile * p, size_t need)
+{
+    while (!p->count && !(p->pflags & FPREF_DONE)) {
+        if (p->want != need) {
+            p->want = need;
+            EVENT_Set(&p->spaceEvent);
+        }
+        EVENT_Reset(&p->dataEvent);
+        MUTEX_Unlock(&p->mutex);
+        EVENT_Wait(&p->dataEvent);
+        MUTEX_Lock(&p->mutex);
+    }
+    p->want = 0;
+    return (p->count ? (p->bufs + p->head) : NULL);
+}
+
+/**
+ * Marks n bytes in the current buffer as consumed. Hands the buffer back
+ * to the reader when it becomes empty. Must be invoked under lock.
+ */
+STATIC void PrefetchFileConsume(PrefetchFile * p, size_t n)
+{
+    PrefetchBuf * buf = p->bufs + p->head;
+    ASSERT(p->count > 0);
+    ASSERT(buf->pos + n <= buf->size);
+    buf->pos += n;
+    if (buf->pos == buf->size) {
+        p->head = (p->head + 1) % p->nbufs;
+        p->count--;
+        EVENT_Set(&p->spaceEvent);
+    }
+}
+
+/**
+ * Common part of read and skip. NULL buffer means skip.
+ */
+STATIC int PrefetchFileGet(PrefetchFile * p, I8u * dest, int len)
+{
+    int nbytes = 0;
+    MUTEX_Lock(&p->mutex);
+    while (nbytes < len) {
+        PrefetchBuf * buf;
+
+        /* don't wait for the data that may never come */
+        if (nbytes > 0 && p->canBlock && !p->count) {
+            break;
+        }
+        buf = PrefetchFileWait(p, len - nbytes);
+        if (buf) {
+            size_t n = MIN(buf->size - buf->pos, (size_t)(len - nbytes));
+            if (dest) memcpy(dest + nbytes, buf->data + buf->pos, n);
+            PrefetchFileConsume(p, n);
+            nbytes += (int)n;
+        } else {
+            break;
+        }
+    }
+    if (!nbytes && (p->pflags & FPREF_ERR)) {
+        nbytes = -1;
+    }
+    MUTEX_Unlock(&p->mutex);
+    return nbytes;
+}
+
+STATIC int PrefetchFileRead(File * f, void * buf, int len)
+{
+    PrefetchFile * p = PrefetchFileCast(f);
+    return (p ? PrefetchFileGet(p, (I8u*)buf, len) : (-1));
+}
+
+STATIC int PrefetchFileSkip(File * f, int len)
+{
+    PrefetchFile * p = PrefetchFileCast(f);
+    return (p ? PrefetchFileGet(p, NULL, len) : (-1));
+}
+
+STATIC size_t PrefetchFilePeek(File * f, const void ** data, size_t min)
+{
+    size_t avail = 0;
+    PrefetchFile * p = PrefetchFileCast(f);
+    if (p) {
+        PrefetchBuf * buf;
+        MUTEX_Lock(&p->mutex);
+        buf = PrefetchFileWait(p, MAX(min, 1));
+        if (buf) {
+
+            /* the reader doesn't touch this buffer until it's consumed */
+            *data = buf->data + buf->pos;
+            avail = buf->size - buf->pos;
+        }
+        MUTEX_Unlock(&p->mutex);
+    }
+    return avail;
+}
+
+STATIC Bool PrefetchFileEof(File * f)
+{
+    Bool eof = True;
+    PrefetchFile * p = PrefetchFileCast(f);
+    if (p) {
+        MUTEX_Lock(&p->mutex);
+        eof = BoolValue(!p->count && (p->pflags & FPREF_DONE));
+        MUTEX_Unlock(&p->mutex);
+    }
+    return eof;
+}
+
+STATIC File * PrefetchFileTarget(File * f)
+{
+    PrefetchFile * p = PrefetchFileCast(f);
+    return (p ? p->target : NULL);
+}
+
+/**
+ * Stops the reading thread. The data that have been read ahead are lost.
+ * If reads from the target can block, the thread only reads while the
+ * consumer is waiting, so it's not going to be stuck in a read here.
+ */
+STATIC void PrefetchFileStop(PrefetchFile * p)
+{
+    if (p->wkq) {
+        MUTEX_Lock(&p->mutex);
+        p->pflags |= FPREF_STOP;
+        EVENT_Set(&p->spaceEvent);
+        MUTEX_Unlock(&p->mutex);
+        WKQ_Delete(p->wkq);
+        p->wkq = NULL;
+        p->count = 0;
+    }
+}
+
+STATIC void PrefetchFileDetach(File * f)
+{
+    PrefetchFile * p = PrefetchFileCast(f);
+    if (p) {
+        PrefetchFileStop(p);
+        p->target = NULL;
+    }
+}
+
+STATIC void PrefetchFileClose(File * f)
+{
+    PrefetchFile * p = PrefetchFileCast(f);
+    if (p) {
+        PrefetchFileStop(p);
+        FILE_Finish(p->target);
+    }
+}
+
+STATIC void PrefetchFileFree(File * f)
+{
+    PrefetchFile * p = PrefetchFileCast(f);
+    if (p) {
+        ASSERT(!(f->flags & FILE_IS_OPEN));
+        ASSERT(!p->wkq);
+        if (p->target) {
+            FILE_Close(p->target);
+            p->target = NULL;
+        }
+        EVENT_Destroy(&p->spaceEvent);
+        EVENT_Destroy(&p->dataEvent);
+        MUTEX_Destroy(&p->mutex);
+        MEM_Free(p->bufs[0].data);
+        MEM_Free(p->bufs);
+        MEM_Free(p);
+    }
+}
+
+/**
+ * Tests whether reads from the target can block before the end of stream.
+ * Besides the FILE_CAN_BLOCK flag, checks whether the data are coming
+ * from a pipe, a terminal or a socket.
+ */
+STATIC Bool PrefetchCanBlock(File * target)
+{
+#if defined(_UNIX) && !defined(__KERNEL__)
+    struct stat st;
+    int fd = FILE_TargetFd(target);
+    if (fd >= 0 && fstat(fd, &st) == 0 &&
+        !S_ISREG(st.st_mode) && !S_ISBLK(st.st_mode)) {
+        return True;
+    }
+#endif /* _UNIX && !__KERNEL__ */
+    return FILE_CanBlock(target);
+}
+
+/**
+ * Creates a File that reads ahead from the target stream on a separate
+ * thread, into a ring of nbuffers buffers of the specified size, so that
+ * reading (and decompressing, downloading, etc.) the next buffer happens
+ * while the caller is parsing the previous one. Zero or negative values
+ * select the defaults. The data can be accessed directly with FILE_Peek.
+ * Closing this file closes the target stream. The target stream must not
+ * be accessed directly while it's being read ahead. If reads from the
+ * target can block (the data are coming from a pipe, a terminal or a
+ * socket, or FILE_CanBlock returns True), the reading thread only asks
+ * for as much as the caller is waiting for, so that the stream can be
+ * closed or detached without waiting for the data that may never come.
+ * Other targets that can block must have FILE_CAN_BLOCK flag set.
+ */
+File * FILE_Prefetch(File * f, int nbuffers, size_t bufsize)
+{
+    ASSERT(f);
+    if (f) {
+        PrefetchFile * p = MEM_New(PrefetchFile);
+        if (p) {
+            memset(p, 0, sizeof(*p));
+            p->nbufs = ((nbuffers > 0) ? nbuffers : FPREF_DEFAULT_COUNT);
+            p->bufsize = (bufsize ? bufsize : FPREF_DEFAULT_SIZE);
+            p->bufsize = MIN(p->bufsize, INT_MAX);
+            p->bufs = MEM_NewArray(PrefetchBuf, p->nbufs);
+            if (p->bufs) {
+                I8u * data = (I8u*)MEM_AllocN(p->nbufs, p->bufsize);
+                if (data) {
+                    int i;
+                    for (i=0; i<p->nbufs; i++) {
+                        p->bufs[i].data = data + i * p->bufsize;
+                        p->bufs[i].size = p->bufs[i].pos = 0;
+                    }
+                    if (MUTEX_Init(&p->mutex)) {
+                        if (EVENT_Init(&p->dataEvent)) {
+                            if (EVENT_Init(&p->spaceEvent)) {
+                                p->target = f;
+                                p->canBlock = PrefetchCanBlock(f);
+                                if (FILE_Init(&p->file, NULL, True,
+                                    &PrefetchFileIO)) {
+                                    p->wkq = WKQ_Create();
+                                    if (p->wkq) {
+                                        if (WKQ_InvokeLater(p->wkq,
+                                            PrefetchFileWork, p)) {
+                                            return &p->file;
+                                        }
+                                        WKQ_Delete(p->wkq);
+                                        p->wkq = NULL;
+                                    }
+                                    p->target = NULL;
+                                    FILE_Destroy(&p->file);
+                                }
+                                EVENT_Destroy(&p->spaceEvent);
+                            }
+                            EVENT_Destroy(&p->dataEvent);
+                        }
+                        MUTEX_Destroy(&p->mutex);
+                    }
+                    MEM_Free(data);
+                }
+                MEM_Free(p->bufs);
+            }
+            MEM_Free(p);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
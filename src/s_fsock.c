@@ -29,9 +29,78 @@
  * any official policies, either expressed or implied.
  */
 
+#if defined(__linux__) && !defined(__KERNEL__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE   /* for sendmmsg */
+#endif
+
 #include "s_util.h"
 #include "s_fio.h"
 #include "s_mem.h"
+#include "s_mutex.h"
+
+#if defined(_UNIX) && !defined(__KERNEL__)
+#  include <sys/uio.h>
+#  include <netinet/tcp.h>
+#endif /* _UNIX && !__KERNEL__ */
+
+#if defined(__linux__) && !defined(__KERNEL__)
+#  define HAVE_SENDMMSG
+#endif /* __linux__ && !__KERNEL__ */
+
+/* Hint that more data are coming (Linux) */
+#ifdef MSG_MORE
+#  define SOCK_MSG_MORE MSG_MORE
+#else
+#  define SOCK_MSG_MORE 0
+#endif
+
+/* Don't let recv and send block when there's a deadline to meet */
+#ifdef MSG_DONTWAIT
+#  define SOCK_DONTWAIT MSG_DONTWAIT
+#else
+#  define SOCK_DONTWAIT 0
+#endif
+
+/* Error codes indicating that non-blocking operation would block */
+#ifdef _WIN32
+#  define SOCKET_WOULDBLOCK(_err) ((_err) == WSAEWOULDBLOCK)
+#else
+#  define SOCKET_WOULDBLOCK(_err) ((_err) == EWOULDBLOCK || (_err) == EAGAIN)
+#endif
+
+/*==========================================================================*
+ *              O U T P U T    B U F F E R    P O O L
+ *==========================================================================*/
+
+/*
+ * In cork mode (FILE_PARAM_CORK) the output is collected in a buffer and
+ * sent when the buffer fills up or the stream is flushed. For datagram
+ * sockets, the buffer holds a batch of datagrams. The buffers are taken
+ * from the pool maintained by the FILE module (see FILE_PoolAlloc).
+ */
+#define SOCK_BUF_SIZE   16384   /* size of the output buffer */
+#define SOCK_MAX_MSGS   32      /* max datagrams per buffer */
+
+typedef struct _SocketBuf {
+    int len;                    /* number of bytes in the buffer */
+    int nmsg;                   /* number of datagrams */
+    int msglen[SOCK_MAX_MSGS];  /* datagram sizes */
+    char data[SOCK_BUF_SIZE];   /* the data */
+} SocketBuf;
+
+COMPILE_ASSERT(sizeof(SocketBuf) <= FILE_POOL_BUF_SIZE);
+
+STATIC SocketBuf * SocketBufAlloc(void)
+{
+    SocketBuf * buf = (SocketBuf*)FILE_PoolAlloc();
+    if (buf) {
+        buf->len = 0;
+        buf->nmsg = 0;
+    }
+    return buf;
+}
+
+#define SocketBufFree(_buf) FILE_PoolFree(_buf)
 
 /*==========================================================================*
  *              P L A I N     S O C K E T    I O
@@ -41,7 +110,13 @@
 typedef struct _SocketFile {
     File file;      /* shared File structure */
     Socket sock;    /* the network socket */
+    SocketBuf * out;/* output buffer in cork mode, otherwise NULL */
     Bool eof;       /* True if we know that connection down */
+    Bool nonblock;  /* True if the socket is in non-blocking mode */
+    Bool dgram;     /* True if this is a datagram socket */
+    Bool more;      /* data have been sent with MSG_MORE flag */
+    Time rtimeout;  /* read timeout in milliseconds, zero if none */
+    Time wtimeout;  /* write timeout in milliseconds, zero if none */
 } SocketFile;
 
 STATIC SocketFile * SocketFileCast(File * f)
@@ -56,64 +131,341 @@ STATIC SocketFile * SocketFileCast(File * f)
     return NULL;
 }
 
+/**
+ * Handles a failed recv or send. In non-blocking mode, the operation that
+ * would block is not an error, it sets FILE_WOULD_BLOCK flag instead.
+ * Neither is the missed deadline.
+ */
+STATIC void SocketError(SocketFile * s)
+{
+    if (s->file.flags & FILE_TIMED_OUT) {
+        /* the connection may still be alive */
+    } else if (s->nonblock && SOCKET_WOULDBLOCK(SOCKET_GetLastError())) {
+        s->file.flags |= FILE_WOULD_BLOCK;
+    } else {
+        s->eof = True;
+    }
+}
+
+/**
+ * Creates the stream for a connected socket. Closes the socket on failure.
+ */
+STATIC File * SocketNew(Socket sock, Str name)
+{
+    SocketFile * s = MEM_New(SocketFile);
+    if (s) {
+        memset(s, 0, sizeof(*s));
+        if (FILE_Init(&s->file, name, False, &SocketIO)) {
+            s->sock = sock;
+            s->eof = False;
+            return &s->file;
+        }
+        MEM_Free(s);
+    }
+    shutdown(sock, SHUT_RDWR);
+    closesocket(sock);
+    return NULL;
+}
+
+/**
+ * Returns the deadline for an operation with the specified timeout, zero
+ * if there's no timeout. Deadlines are based on the monotonic clock and
+ * only apply to blocking sockets.
+ */
+STATIC Time SocketDeadline(SocketFile * s, Time timeout)
+{
+    return (timeout > 0 && !s->nonblock) ? (TIME_Monotonic() + timeout) : 0;
+}
+
+/**
+ * Waits until the socket becomes ready for the operation specified by the
+ * mask. If the deadline expires first, sets FILE_TIMED_OUT flag and
+ * returns False.
+ */
+STATIC Bool SocketWait(SocketFile * s, int mask, Time deadline)
+{
+    Time left = deadline - TIME_Monotonic();
+    if (left > 0 && SOCKET_Wait(s->sock, mask, left) != 0) {
+        return True;
+    }
+    s->file.flags |= FILE_TIMED_OUT;
+    return False;
+}
+
+/**
+ * Receives the data, giving up when the deadline (if any) expires.
+ */
+STATIC int SocketRecv(SocketFile * s, char * buf, int len, Time deadline)
+{
+    if (deadline) {
+        int n;
+        do {
+            if (!SocketWait(s, SOCK_WAIT_READ, deadline)) return -1;
+            n = recv(s->sock, buf, len, SOCK_DONTWAIT);
+        } while (n < 0 && SOCKET_WOULDBLOCK(SOCKET_GetLastError()));
+        return n;
+    }
+    return recv(s->sock, buf, len, 0);
+}
+
+/**
+ * Sends as much data as possible before the deadline (if any). Returns
+ * the number of bytes sent, -1 if nothing could be sent.
+ */
+STATIC int SocketSend(SocketFile * s, const char * data, int len, int flags,
+    Time deadline)
+{
+    int sent = 0;
+    while (sent < len) {
+        int n;
+        if (deadline) {
+            if (!SocketWait(s, SOCK_WAIT_WRITE, deadline)) break;
+            n = send(s->sock, data+sent, len-sent, flags | SOCK_DONTWAIT);
+            if (n < 0 && SOCKET_WOULDBLOCK(SOCKET_GetLastError())) continue;
+        } else {
+            n = send(s->sock, data + sent, len - sent, flags);
+        }
+        if (n <= 0) break;
+        sent += n;
+    }
+    return (sent > 0 || len == 0) ? sent : (-1);
+}
+
+/**
+ * Sends the queued datagrams, with a single system call if possible.
+ */
+STATIC Bool SocketDrainDgram(SocketFile * s)
+{
+    SocketBuf * buf = s->out;
+    int i, k = 0, off = 0;
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[SOCK_MAX_MSGS];
+    struct iovec iov[SOCK_MAX_MSGS];
+    memset(msgs, 0, sizeof(msgs[0]) * buf->nmsg);
+    for (i=0; i<buf->nmsg; i++) {
+        iov[i].iov_base = buf->data + off;
+        iov[i].iov_len = buf->msglen[i];
+        msgs[i].msg_hdr.msg_iov = iov + i;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        off += buf->msglen[i];
+    }
+
+    /*
+     * A partial send means that the next datagram could not be sent.
+     * Try again, the next call either sends it or fails with the actual
+     * error code.
+     */
+    while (k < buf->nmsg) {
+        int sent = sendmmsg(s->sock, msgs + k, buf->nmsg - k, 0);
+        if (sent <= 0) break;
+        k += sent;
+    }
+#else  /* !HAVE_SENDMMSG */
+    for (k=0; k<buf->nmsg; k++) {
+        if (send(s->sock, buf->data + off, buf->msglen[k], 0) < 0) break;
+        off += buf->msglen[k];
+    }
+#endif /* !HAVE_SENDMMSG */
+
+    if (k < buf->nmsg) {
+        /* remove what has been sent */
+        for (i=0, off=0; i<k; i++) off += buf->msglen[i];
+        buf->nmsg -= k;
+        buf->len -= off;
+        memmove(buf->msglen, buf->msglen + k, sizeof(int) * buf->nmsg);
+        memmove(buf->data, buf->data + off, buf->len);
+        SocketError(s);
+        return False;
+    }
+    buf->nmsg = 0;
+    buf->len = 0;
+    return True;
+}
+
+/**
+ * Sends the buffered data. SOCK_MSG_MORE flag tells the system that more
+ * data are coming and there's no need to push the data to the network
+ * right away.
+ */
+STATIC Bool SocketDrain(SocketFile * s, int flags)
+{
+    SocketBuf * buf = s->out;
+    if (buf && (s->dgram ? (buf->nmsg > 0) : (buf->len > 0))) {
+        if (s->dgram) {
+            return SocketDrainDgram(s);
+        } else {
+            int n = SocketSend(s, buf->data, buf->len, flags,
+                SocketDeadline(s, s->wtimeout));
+            s->more = BoolValue(flags & SOCK_MSG_MORE);
+            if (n < buf->len) {
+                if (n < 0) n = 0;
+                buf->len -= n;
+                memmove(buf->data, buf->data + n, buf->len);
+                SocketError(s);
+                return False;
+            }
+            buf->len = 0;
+        }
+    }
+    return True;
+}
+
+/**
+ * Sends the buffered data and pushes out the data previously sent with
+ * SOCK_MSG_MORE flag.
+ */
+STATIC Bool SocketPush(SocketFile * s)
+{
+    if (!SocketDrain(s, 0)) {
+        return False;
+    }
+#ifdef TCP_CORK
+    if (s->more) {
+        /* uncorking the socket sends the pending data */
+        int on = 1, off = 0;
+        setsockopt(s->sock, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+        setsockopt(s->sock, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+    }
+#endif /* TCP_CORK */
+    s->more = False;
+    return True;
+}
+
+/**
+ * Appends the data to the output buffer, sending the buffer when it's
+ * full. Each call queues one datagram on datagram sockets. Returns
+ * SOCK_SEND_DIRECT if the data are too large to be buffered and should
+ * be sent directly, after the buffered data.
+ */
+#define SOCK_SEND_DIRECT (-2)
+
+STATIC int SocketQueue(SocketFile * s, const FileVec * vec, int n)
+{
+    SocketBuf * buf = s->out;
+    size_t len = 0;
+    int i;
+
+    /* stop counting when it's clear that the data don't fit */
+    for (i=0; i<n && len < SOCK_BUF_SIZE; i++) {
+        if (vec[i].len < SOCK_BUF_SIZE - len) {
+            len += vec[i].len;
+        } else {
+            len = SOCK_BUF_SIZE;
+        }
+    }
+
+    if (len >= SOCK_BUF_SIZE) {
+        /* too large to queue, no point in copying the data */
+        if (!SocketDrain(s, s->dgram ? 0 : SOCK_MSG_MORE)) {
+            return -1;
+        }
+        if (!s->dgram) s->more = True;
+        return SOCK_SEND_DIRECT;
+    }
+
+    if (s->dgram) {
+        if ((buf->nmsg == SOCK_MAX_MSGS ||
+            len > (size_t)(SOCK_BUF_SIZE - buf->len)) &&
+            !SocketDrain(s, 0)) {
+            return -1;
+        }
+        buf->msglen[buf->nmsg++] = (int)len;
+    } else if (len > (size_t)(SOCK_BUF_SIZE - buf->len)) {
+        if (!SocketDrain(s, SOCK_MSG_MORE)) {
+            return -1;
+        }
+    }
+
+    for (i=0; i<n; i++) {
+        memcpy(buf->data + buf->len, vec[i].data, vec[i].len);
+        buf->len += (int)vec[i].len;
+    }
+    return (int)len;
+}
+
 /** NOTE: both IP address and port are in host byte order */
 STATIC File * SocketOpen2(IPaddr addr, Port port)
 {
     Socket sock = INVALID_SOCKET;
     if (SOCKET_GetTcp(0,&sock)) {
         if (SOCKET_Connect(sock, addr, port)) {
-            SocketFile * s = MEM_New(SocketFile);
-            if (s) {
-                Bool ok;
-                StrBuf32 nameBuf;
-                STRBUF_InitBufXXX(&nameBuf);
-                STRBUF_Format(&nameBuf.sb, TEXT(IPADDR_FORMAT)TEXT_(":%hu"),
-                    HOST_IPADDR_FORMAT_ARG(addr),port);
-
-                memset(s, 0, sizeof(*s));
-                ok = FILE_Init(&s->file, nameBuf.sb.s, False, &SocketIO);
-                STRBUF_Destroy(&nameBuf.sb);
-
-                if (ok) {
-                    s->sock = sock;
-                    s->eof = False;
-                    return &s->file;
-                }
-            }
-            shutdown(sock, SHUT_RDWR);
+            File * f;
+            StrBuf32 nameBuf;
+            STRBUF_InitBufXXX(&nameBuf);
+            STRBUF_Format(&nameBuf.sb, TEXT(IPADDR_FORMAT)TEXT_(":%hu"),
+                HOST_IPADDR_FORMAT_ARG(addr),port);
+            f = SocketNew(sock, nameBuf.sb.s);
+            STRBUF_Destroy(&nameBuf.sb);
+            return f;
         }
         closesocket(sock);
     }
     return NULL;
 }
 
+/**
+ * Resolves the host name and connects to the first address (IPv4 or IPv6)
+ * that accepts the connection.
+ */
 STATIC File * SocketOpen(Str hostname, const char * port)
 {
-    /*
-     * parse the port number and resolve the hostname and then call the
-     * basic handler which deal with numeric port and address.
-     */
-    IPaddr addr;
     int p = atoi(port);
-    if (p > 0 && p <= USHRT_MAX && INET_ResolveAddr(hostname,&addr)) {
-        return SocketOpen2(addr, (Port)p);
+    if (p > 0 && p <= USHRT_MAX) {
+        int i, n;
+        struct sockaddr_storage addrs[INET_MAX_ADDRS];
+        n = INET_ResolveAll(hostname, AF_UNSPEC, addrs, COUNT(addrs));
+        for (i=0; i<n; i++) {
+            struct sockaddr * sa = (struct sockaddr*)(addrs + i);
+            socklen_t len;
+            Socket sock;
+            if (sa->sa_family == AF_INET6) {
+                ((struct sockaddr_in6*)sa)->sin6_port = htons((Port)p);
+                len = sizeof(struct sockaddr_in6);
+            } else {
+                ((struct sockaddr_in*)sa)->sin_port = htons((Port)p);
+                len = sizeof(struct sockaddr_in);
+            }
+            sock = socket(sa->sa_family, SOCK_STREAM, 0);
+            if (sock != INVALID_SOCKET) {
+                if (connect(sock, sa, len) == 0) {
+                    /* FILE_Open and FILE_Reopen name the stream */
+                    return SocketNew(sock, NULL);
+                }
+                closesocket(sock);
+            }
+        }
     }
     return NULL;
 }
 
+/**
+ * Connects the stream to another host. The buffered data are sent to
+ * the old peer, cork mode, non-blocking mode and the timeouts stay as
+ * they were.
+ */
 STATIC Bool SocketReopen(File * f, Str hostname, const char * port)
 {
     SocketFile * s  = SocketFileCast(f);
     if (s) {
         File * f2;
+        if (s->out) {
+            SocketPush(s);
+            s->out->len = 0;
+            s->out->nmsg = 0;
+        }
         shutdown(s->sock, SHUT_RDWR);
         closesocket(s->sock);
+        s->sock = INVALID_SOCKET;
         f2 = SocketOpen(hostname, port);
         if (f2) {
-            File save = *f;
             SocketFile * s2 = SocketFileCast(f2);
-            *s = *s2;
-            *f = save;
+            s->sock = s2->sock;
+            s->eof = False;
+            s->dgram = False;
+            s->more = False;
+            f->flags &= ~(FILE_WOULD_BLOCK | FILE_TIMED_OUT);
+            if (s->nonblock) SOCKET_Block(s->sock, False);
+            FILE_Destroy(f2);
             MEM_Free(s2);
             return True;
         }
@@ -121,20 +473,91 @@ STATIC Bool SocketReopen(File * f, Str hostname, const char * port)
     return False;
 }
 
+/**
+ * Switches cork mode on or off
+ */
+STATIC Bool SocketCork(SocketFile * s, Bool cork)
+{
+    if (cork) {
+        if (!s->out) {
+            int type = SOCK_STREAM;
+            socklen_t len = sizeof(type);
+            getsockopt(s->sock, SOL_SOCKET, SO_TYPE, (char*)&type, &len);
+            s->dgram = BoolValue(type == SOCK_DGRAM);
+            s->out = SocketBufAlloc();
+        }
+        return BoolValue(s->out != NULL);
+    } else if (s->out) {
+        if (!SocketPush(s)) {
+            return False;
+        }
+        SocketBufFree(s->out);
+        s->out = NULL;
+    }
+    return True;
+}
+
+/**
+ * Supported parameters are FILE_PARAM_NONBLOCK which sets or clears
+ * non-blocking mode and FILE_PARAM_CORK which switches cork mode on
+ * and off (the value points to Bool), FILE_PARAM_RTIMEOUT and
+ * FILE_PARAM_WTIMEOUT which set read and write timeouts (the value
+ * points to Time in milliseconds, zero means no timeout). A timeout
+ * limits the duration of each read or write call. If it expires, the
+ * call returns what has been transferred so far (or fails if nothing)
+ * and FILE_TimedOut returns True.
+ */
+STATIC Bool SocketSetParam(File * f, Str name, void * value)
+{
+    SocketFile * s  = SocketFileCast(f);
+    if (s && value) {
+        f->flags &= ~(FILE_WOULD_BLOCK | FILE_TIMED_OUT);
+        if (StrCmp(name, FILE_PARAM_NONBLOCK) == 0) {
+            Bool on = BoolValue(*((Bool*)value));
+            if (SOCKET_Block(s->sock, (Bool)!on)) {
+                s->nonblock = on;
+                return True;
+            }
+        } else if (StrCmp(name, FILE_PARAM_CORK) == 0) {
+            return SocketCork(s, BoolValue(*((Bool*)value)));
+        } else if (StrCmp(name, FILE_PARAM_RTIMEOUT) == 0) {
+            s->rtimeout = MAX(*((Time*)value), 0);
+            return True;
+        } else if (StrCmp(name, FILE_PARAM_WTIMEOUT) == 0) {
+            s->wtimeout = MAX(*((Time*)value), 0);
+            return True;
+        }
+    }
+    return False;
+}
+
+/**
+ * In blocking mode, keeps reading until the buffer is full or the
+ * connection is closed. In non-blocking mode, returns whatever is
+ * available.
+ */
 STATIC int SocketRead(File * f, void * buf, int len)
 {
     int nbytes = -1;
     SocketFile * s  = SocketFileCast(f);
     if (s) {
         char * ptr = (char*)buf;
-        nbytes = recv(s->sock, ptr, len, 0);
+        Time deadline = SocketDeadline(s, s->rtimeout);
+
+        /* the peer may be waiting for the buffered data */
+        if (s->out) SocketPush(s);
+
+        f->flags &= ~(FILE_WOULD_BLOCK | FILE_TIMED_OUT);
+        nbytes = SocketRecv(s, ptr, len, deadline);
         if (nbytes > 0) {
-            while (nbytes < len) {
-                int n = recv(s->sock, ptr + nbytes, len - nbytes, 0);
+            while (!s->nonblock && nbytes < len) {
+                int n = SocketRecv(s, ptr + nbytes, len - nbytes, deadline);
                 if (n <= 0) break;
                 nbytes += n;
             }
         } else if (nbytes < 0) {
+            SocketError(s);
+        } else if (len > 0) {
             s->eof = True;
         }
     }
@@ -146,11 +569,155 @@ STATIC int SocketWrite(File * f, const void * buf, int len)
     int nbytes = -1;
     SocketFile * s  = SocketFileCast(f);
     if (s) {
-        nbytes = send(s->sock, (char*)buf, len, 0);
-        if (nbytes < 0) s->eof = True;
+        int flags = 0;
+        f->flags &= ~(FILE_WOULD_BLOCK | FILE_TIMED_OUT);
+        if (s->out) {
+            FileVec vec;
+            vec.data = (void*)buf;
+            vec.len = len;
+            nbytes = SocketQueue(s, &vec, 1);
+            if (nbytes != SOCK_SEND_DIRECT) return nbytes;
+            if (!s->dgram) flags = SOCK_MSG_MORE;
+        }
+        nbytes = SocketSend(s, (char*)buf, len, flags,
+            SocketDeadline(s, s->wtimeout));
+        if (nbytes < 0) SocketError(s);
+    }
+    return nbytes;
+}
+
+#if defined(_UNIX) && !defined(__KERNEL__)
+
+/**
+ * Advances the I/O vector past the data that have been transferred.
+ * Returns False if nothing is left.
+ */
+STATIC Bool SocketAdvance(struct msghdr * msg, size_t done)
+{
+    while (msg->msg_iovlen > 0 && done >= msg->msg_iov->iov_len) {
+        done -= msg->msg_iov->iov_len;
+        msg->msg_iov++;
+        msg->msg_iovlen--;
+    }
+    if (msg->msg_iovlen > 0) {
+        msg->msg_iov->iov_base = (char*)msg->msg_iov->iov_base + done;
+        msg->msg_iov->iov_len -= done;
+        return True;
+    }
+    return False;
+}
+
+/**
+ * Same as SocketRecv but for the scatter input.
+ */
+STATIC ssize_t SocketRecvMsg(SocketFile * s, struct msghdr * msg,
+    Time deadline)
+{
+    if (deadline) {
+        ssize_t n;
+        do {
+            if (!SocketWait(s, SOCK_WAIT_READ, deadline)) return -1;
+            n = recvmsg(s->sock, msg, SOCK_DONTWAIT);
+        } while (n < 0 && SOCKET_WOULDBLOCK(SOCKET_GetLastError()));
+        return n;
+    }
+    return recvmsg(s->sock, msg, 0);
+}
+
+/**
+ * Same as SocketSend but for the gather output.
+ */
+STATIC I64s SocketSendMsg(SocketFile * s, struct msghdr * msg, int flags,
+    Time deadline)
+{
+    I64s sent = 0;
+    for (;;) {
+        ssize_t n;
+        if (deadline) {
+            if (!SocketWait(s, SOCK_WAIT_WRITE, deadline)) break;
+            n = sendmsg(s->sock, msg, flags | SOCK_DONTWAIT);
+            if (n < 0 && SOCKET_WOULDBLOCK(SOCKET_GetLastError())) continue;
+        } else {
+            n = sendmsg(s->sock, msg, flags);
+        }
+        if (n < 0) break;
+        sent += n;
+        if (!n || !SocketAdvance(msg, n)) return sent;
+    }
+    return sent ? sent : (-1);
+}
+
+STATIC I64s SocketReadV(File * f, const FileVec * vec, int n)
+{
+    I64s total = -1;
+    SocketFile * s  = SocketFileCast(f);
+    if (s) {
+        int i;
+        size_t len = 0;
+        struct msghdr msg;
+        struct iovec iov[FIO_MAX_VEC];
+        Time deadline = SocketDeadline(s, s->rtimeout);
+        ASSERT(n <= FIO_MAX_VEC);
+        for (i=0; i<n; i++) {
+            iov[i].iov_base = vec[i].data;
+            iov[i].iov_len = vec[i].len;
+            len += vec[i].len;
+        }
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+
+        /* like SocketRead, keep reading until all buffers are filled */
+        f->flags &= ~(FILE_WOULD_BLOCK | FILE_TIMED_OUT);
+        total = SocketRecvMsg(s, &msg, deadline);
+        if (total > 0 && !s->nonblock) {
+            size_t done = (size_t)total;
+            while (SocketAdvance(&msg, done)) {
+                ssize_t nbytes = SocketRecvMsg(s, &msg, deadline);
+                if (nbytes <= 0) break;
+                total += nbytes;
+                done = nbytes;
+            }
+        } else if (total < 0) {
+            SocketError(s);
+        } else if (total == 0 && len > 0) {
+            s->eof = True;
+        }
+    }
+    return total;
+}
+
+STATIC I64s SocketWriteV(File * f, const FileVec * vec, int n)
+{
+    I64s nbytes = -1;
+    SocketFile * s  = SocketFileCast(f);
+    if (s) {
+        int i, flags = 0;
+        struct msghdr msg;
+        struct iovec iov[FIO_MAX_VEC];
+        ASSERT(n <= FIO_MAX_VEC);
+        for (i=0; i<n; i++) {
+            iov[i].iov_base = vec[i].data;
+            iov[i].iov_len = vec[i].len;
+        }
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+        f->flags &= ~(FILE_WOULD_BLOCK | FILE_TIMED_OUT);
+        if (s->out) {
+            nbytes = SocketQueue(s, vec, n);
+            if (nbytes != SOCK_SEND_DIRECT) return nbytes;
+            if (!s->dgram) flags = SOCK_MSG_MORE;
+        }
+        nbytes = SocketSendMsg(s, &msg, flags, SocketDeadline(s,s->wtimeout));
+        if (nbytes < 0) SocketError(s);
     }
     return nbytes;
 }
+#else /* !_UNIX || __KERNEL__ */
+#  define SocketReadV NULL      /* use the default */
+#  define SocketWriteV NULL     /* use the default */
+#endif /* !_UNIX || __KERNEL__ */
 
 STATIC Bool SocketEof(File * f)
 {
@@ -164,21 +731,33 @@ STATIC int SocketFd(File * f)
     return (s ? s->sock : -1);
 }
 
+/**
+ * In cork mode, sends the buffered data
+ */
 STATIC Bool SocketFlush(File * f)
 {
-    return BoolValue(!SocketEof(f));
+    SocketFile * s  = SocketFileCast(f);
+    if (s && !s->eof) {
+        f->flags &= ~(FILE_WOULD_BLOCK | FILE_TIMED_OUT);
+        return (s->out ? SocketPush(s) : True);
+    }
+    return False;
 }
 
 STATIC void SocketDetach(File * f)
 {
     SocketFile * s  = SocketFileCast(f);
-    if (s) s->sock = INVALID_SOCKET;
+    if (s) {
+        if (s->out) SocketPush(s);
+        s->sock = INVALID_SOCKET;
+    }
 }
 
 STATIC void SocketClose(File * f)
 {
     SocketFile * s  = SocketFileCast(f);
     if (s) {
+        if (s->out) SocketPush(s);
         shutdown(s->sock, SHUT_RDWR);
         closesocket(s->sock);
         s->sock = INVALID_SOCKET;
@@ -190,6 +769,7 @@ STATIC void SocketFree(File * f)
     SocketFile * s  = SocketFileCast(f);
     if (s) {
         ASSERT(!(f->flags & FILE_IS_OPEN));
+        if (s->out) SocketBufFree(s->out);
         MEM_Free(s);
     }
 }
@@ -201,20 +781,71 @@ STATIC void SocketFree(File * f)
  * FILE_Close()
  */
 File * FILE_AttachToSocket(Socket sock)
+{
+    return FILE_AttachToSocket2(sock, 0);
+}
+
+/**
+ * Same as FILE_AttachToSocket but takes flags. FILE_SOCK_NONBLOCK switches
+ * the socket into non-blocking mode. In that mode, reads return whatever
+ * data are available and an operation that would block fails without
+ * setting the end-of-file condition. FILE_WouldBlock tells the two cases
+ * apart. FILE_SOCK_CORK switches the stream into cork mode, see
+ * FILE_PARAM_CORK.
+ */
+File * FILE_AttachToSocket2(Socket sock, int flags)
 {
     SocketFile * sf = MEM_New(SocketFile);
     if (sf) {
         memset(sf, 0, sizeof(*sf));
         sf->sock = sock;
         sf->eof = False;
-        if (FILE_Init(&sf->file, TEXT("socket"), True, &SocketIO)) {
-            return &sf->file;
+        if (!(flags & FILE_SOCK_NONBLOCK) || SOCKET_Block(sock, False)) {
+            sf->nonblock = BoolValue(flags & FILE_SOCK_NONBLOCK);
+            if (!(flags & FILE_SOCK_CORK) || SocketCork(sf, True)) {
+                if (FILE_Init(&sf->file, TEXT("socket"), True, &SocketIO)) {
+                    return &sf->file;
+                }
+                if (sf->out) SocketBufFree(sf->out);
+            }
         }
         MEM_Free(sf);
     }
     return NULL;
 }
 
+/**
+ * Returns the socket underlying the stream, which may be wrapped into
+ * other streams (buffering, compression etc), or INVALID_SOCKET if this
+ * is not a socket stream. Useful for registering the stream with
+ * SocketPoller.
+ */
+Socket FILE_Socket(File * f)
+{
+    while (f) {
+        if (f->io == &SocketIO) {
+            return CAST(f,SocketFile,file)->sock;
+        }
+        f = FILE_Target(f);
+    }
+    return INVALID_SOCKET;
+}
+
+/**
+ * Internal function. Returns the socket descriptor if the data can be
+ * transferred bypassing the stream, or -1 if the stream is buffering
+ * the output (in cork mode). Neither the timeouts nor non-blocking mode
+ * would be honored by the kernel copy, such streams don't qualify too.
+ */
+int FILE_SocketRawFd(File * f)
+{
+    SocketFile * s  = SocketFileCast(f);
+    if (s && !s->out && !s->nonblock && !s->rtimeout && !s->wtimeout) {
+        return (int)s->sock;
+    }
+    return (-1);
+}
+
 /**
  * Connects to the specified IP address
  * NOTE: both IP address and port are in host byte order
@@ -230,10 +861,15 @@ File * FILE_Connect(IPaddr addr, Port port)
 const FileIO SocketIO = {
     SocketOpen          /* open     */,
     SocketReopen        /* reopen   */,
-    NULL                /* setparam */,
+    SocketSetParam      /* setparam */,
     SocketRead          /* read     */,
     SocketWrite         /* write    */,
+    NULL                /* read64   */,
+    NULL                /* write64  */,
+    SocketReadV         /* readv    */,
+    SocketWriteV        /* writev   */,
     NULL                /* skip     */,
+    NULL                /* peek     */,
     SocketFlush         /* flush    */,
     SocketEof           /* eof      */,
     SocketFd            /* fd       */,
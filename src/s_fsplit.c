@@ -58,7 +58,12 @@ STATIC const FileIO SplitFileIO = {
     NULL                /* setparam */,
     NULL                /* read     */,
     SplitFileWrite      /* write    */,
+    NULL                /* read64   */,
+    NULL                /* write64  */,
+    NULL                /* readv    */,
+    NULL                /* writev   */,
     NULL                /* skip     */,
+    NULL                /* peek     */,
     SplitFileFlush      /* flush    */,
     SplitFileEof        /* eof      */,
     NULL                /* fd       */,
@@ -62,7 +62,12 @@ STATIC const FileIO SubFileIO = {
     NULL                /* setparam */,
     SubFileRead         /* read     */,
     SubFileWrite        /* write    */,
+    NULL                /* read64   */,
+    NULL                /* write64  */,
+    NULL                /* readv    */,
+    NULL                /* writev   */,
     NULL                /* skip     */,
+    NULL                /* peek     */,
     SubFileFlush        /* flush    */,
     SubFileEof          /* eof      */,
     NULL                /* fd       */,
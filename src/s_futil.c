@@ -860,14 +860,14 @@ int FILE_MultiByteSize64(I64u value)
 int FILE_WriteMultiByte32(File * out, I32u value)
 {
     I8u buf[MAX_MULTI_INT_SIZE_32];
-    int n = 1;
-    buf[COUNT(buf)-1] = (I8u)(value & 0x7f);
-    value >>= 7;
-    while (value) {
-        buf[COUNT(buf)-(++n)] = (I8u)(value | 0x80);
-        value >>= 7;
-    }
-    if (FILE_WriteAll(out, buf + COUNT(buf) - n, n)) {
+    int n = FILE_MultiByteSize32(value);
+    I8u * dest = (I8u*)FILE_Reserve(out, n);
+    I8u * p = (dest ? dest : buf) + n;
+
+    /* encode directly into the output buffer if we can */
+    *(--p) = (I8u)(value & 0x7f);
+    for (value >>= 7; value; value >>= 7) *(--p) = (I8u)(value | 0x80);
+    if (dest ? FILE_Commit(out, n) : FILE_WriteAll(out, buf, n)) {
         return n;
     } else {
         return 0;
@@ -881,14 +881,14 @@ int FILE_WriteMultiByte32(File * out, I32u value)
 int FILE_WriteMultiByte64(File * out, I64u value)
 {
     I8u buf[MAX_MULTI_INT_SIZE_64];
-    int n = 1;
-    buf[COUNT(buf)-1] = (I8u)(value & 0x7f);
-    value >>= 7;
-    while (value) {
-        buf[COUNT(buf)-(++n)] = (I8u)(value | 0x80);
-        value >>= 7;
-    }
-    if (FILE_WriteAll(out, buf + COUNT(buf) - n, n)) {
+    int n = FILE_MultiByteSize64(value);
+    I8u * dest = (I8u*)FILE_Reserve(out, n);
+    I8u * p = (dest ? dest : buf) + n;
+
+    /* encode directly into the output buffer if we can */
+    *(--p) = (I8u)(value & 0x7f);
+    for (value >>= 7; value; value >>= 7) *(--p) = (I8u)(value | 0x80);
+    if (dest ? FILE_Commit(out, n) : FILE_WriteAll(out, buf, n)) {
         return n;
     } else {
         return 0;
@@ -943,6 +943,175 @@ Bool FILE_ReadMultiByte64(File * in, I64u * result)
     return False;
 }
 
+/*==========================================================================*
+ *              T E X T    O U T P U T
+ *==========================================================================*/
+
+/* pairs of decimal digits, two characters per entry */
+STATIC const char FILE_Digits100[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+
+/* powers of ten which can be exactly represented as a double */
+STATIC const double FILE_Pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+    1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+/* enough for a 64-bit number with sign, decimal point and 15 digits */
+#define FILE_NUMBER_BUFSIZE 40
+
+/* the largest double which can hold any integer without losing precision */
+#define FILE_MAX_EXACT_DOUBLE 9007199254740992.0 /* 2^53 */
+
+/* the relative rounding error of a multiplication is below this */
+#define FILE_DOUBLE_EPSILON 2.220446049250313e-16 /* 2^-52 */
+
+/**
+ * Formats an unsigned number, right to left, into the buffer ending at
+ * end. Returns the pointer to the first character. Two digits are produced
+ * per division, which halves the number of (slow) divisions.
+ */
+STATIC char * FILE_FormatU64(char * end, I64u value)
+{
+    char * p = end;
+    while (value >= 100) {
+        const char * d = FILE_Digits100 + 2*(int)(value % 100);
+        value /= 100;
+        *(--p) = d[1];
+        *(--p) = d[0];
+    }
+    if (value >= 10) {
+        const char * d = FILE_Digits100 + 2*(int)value;
+        *(--p) = d[1];
+        *(--p) = d[0];
+    } else {
+        *(--p) = (char)('0' + (int)value);
+    }
+    return p;
+}
+
+/**
+ * Writes text formatted by one of the functions below to the stream.
+ * The text is ASCII, so it doesn't need to be converted even in Unicode
+ * build. If the output is buffered, the text is copied directly to the
+ * output buffer.
+ */
+STATIC Bool FILE_PutText(File * f, const char * text, int n)
+{
+    char * dest = (char*)FILE_Reserve(f, n);
+    if (dest) {
+        memcpy(dest, text, n);
+        return FILE_Commit(f, n);
+    } else {
+        return FILE_WriteAll(f, text, n);
+    }
+}
+
+/**
+ * Writes a decimal representation of a signed 64-bit integer to the
+ * stream. Produces the same output as FILE_Printf with I64S_FORMAT but
+ * doesn't need to parse the format string and doesn't use the string
+ * buffer. Returns True on success, False on error.
+ */
+Bool FILE_PutI64(File * f, I64s value)
+{
+    char buf[FILE_NUMBER_BUFSIZE];
+    char * end = buf + sizeof(buf);
+    char * p;
+    if (value < 0) {
+        /* the negation is done in unsigned arithmetic to handle INT64_MIN */
+        p = FILE_FormatU64(end, ((I64u)0) - (I64u)value);
+        *(--p) = '-';
+    } else {
+        p = FILE_FormatU64(end, (I64u)value);
+    }
+    return FILE_PutText(f, p, (int)(end - p));
+}
+
+/**
+ * Writes a decimal representation of an unsigned 64-bit integer
+ */
+Bool FILE_PutU64(File * f, I64u value)
+{
+    char buf[FILE_NUMBER_BUFSIZE];
+    char * end = buf + sizeof(buf);
+    char * p = FILE_FormatU64(end, value);
+    return FILE_PutText(f, p, (int)(end - p));
+}
+
+/**
+ * Writes a decimal representation of an integer
+ */
+Bool FILE_PutInt(File * f, int value)
+{
+    return FILE_PutI64(f, value);
+}
+
+/**
+ * Returns True if the sign bit of the double is set. Unlike (value < 0)
+ * this is also True for -0.0
+ */
+STATIC Bool FILE_SignBit(double value)
+{
+    I64u bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return BoolValue(bits >> 63);
+}
+
+/**
+ * Writes a double with the specified number of digits after the decimal
+ * point, like FILE_Printf with "%.*f" format, and produces the same output.
+ * Values that are small enough are converted with integer arithmetic,
+ * which is much faster than printf. Values which are too close to the
+ * midpoint between two outputs to be rounded reliably that way, as well
+ * as infinities, NaNs, large values and large precisions are passed to
+ * FILE_Printf. Returns True on success, False on error.
+ */
+Bool FILE_PutDouble(File * f, double value, int prec)
+{
+    if (prec < 0) prec = 6; /* the printf default */
+    if (prec < (int)COUNT(FILE_Pow10)) {
+        Bool neg = FILE_SignBit(value);
+        double a = neg ? (-value) : value;
+        double scaled = a * FILE_Pow10[prec];
+
+        /* this comparison is False for NaN */
+        if (scaled < FILE_MAX_EXACT_DOUBLE) {
+            I64u n = (I64u)scaled;
+            double half = (scaled - (double)n) - 0.5;
+            double err = scaled * FILE_DOUBLE_EPSILON;
+
+            /*
+             * The product is rounded. When the result is that close to
+             * the midpoint, the exact value may lie on either side of
+             * it (e.g. 0.15 is actually 0.1499999... and printf prints
+             * it as 0.1), or right on it, and printf rounds that to even.
+             */
+            if (half > err || half < -err) {
+                char buf[FILE_NUMBER_BUFSIZE];
+                char * end = buf + sizeof(buf);
+                char * p = end;
+                if (half > 0) n++;
+                if (prec > 0) {
+                    I64u pow10 = (I64u)FILE_Pow10[prec];
+                    I64u frac = n % pow10;
+                    char * start = end - prec;
+                    n /= pow10;
+                    if (frac) p = FILE_FormatU64(end, frac);
+                    while (p > start) *(--p) = '0';
+                    *(--p) = '.';
+                }
+                p = FILE_FormatU64(p, n);
+                if (neg) *(--p) = '-';
+                return FILE_PutText(f, p, (int)(end - p));
+            }
+        }
+    }
+    return BoolValue(FILE_Printf(f, TEXT("%.*f"), prec, value) >= 0);
+}
+
 #if DEBUG
 /* These are here only to force compile-time control of the pointer type.
  * In the release build they are replaced with macros */
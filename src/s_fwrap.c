@@ -72,7 +72,12 @@ STATIC const FileIO WrapIO = {
     NULL                /* setparam */,
     WrapRead            /* read     */,
     WrapWrite           /* write    */,
+    NULL                /* read64   */,
+    NULL                /* write64  */,
+    NULL                /* readv    */,
+    NULL                /* writev   */,
     NULL                /* skip     */,
+    NULL                /* peek     */,
     WrapFlush           /* flush    */,
     WrapEof             /* eof      */,
     NULL                /* fd       */,
@@ -252,7 +252,12 @@ const FileIO GZipFileIO = {
     NULL                /* setparam */,
     GZipFileRead        /* read     */,
     GZipFileWrite       /* write    */,
+    NULL                /* read64   */,
+    NULL                /* write64  */,
+    NULL                /* readv    */,
+    NULL                /* writev   */,
     NULL                /* skip     */,
+    NULL                /* peek     */,
     GZipFileFlush       /* flush    */,
     GZipFileEof         /* eof      */,
     NULL                /* fd       */,
@@ -32,6 +32,8 @@
 #include "s_util.h"
 #include "s_fio.h"
 #include "s_mem.h"
+#include "s_mutex.h"
+#include "s_wkq.h"
 
 #include <zlib.h>
 
@@ -47,6 +49,10 @@
 /* default input/output buffer size */
 #define Z_BUFSIZE 16384
 
+/* parallel compression: size of the block and of the dictionary */
+#define Z_BLOCKSIZE 131072
+#define Z_DICTSIZE  32768
+
 /*==========================================================================*
  *              G Z I P P E D     F I L E    I O
  *==========================================================================*/
@@ -60,8 +66,11 @@ typedef struct _Zip {
     z_stream * out;         /* zlib output context */
     I8u * inbuf;            /* input buffer */
     I8u * outbuf;           /* output buffer */
+    struct _ZipPar * par;   /* parallel compression state */
     I32u  outcrc;           /* crc32 of compressed data */
+    I32u  outlen;           /* size of compressed data, modulo 2^32 */
     int   compression;      /* compression level */
+    int   nthreads;         /* number of compression threads */
     int   zflags;           /* flags, see below */
 
 #define ZIP_IN      0x0001  /* compress input stream */
@@ -74,9 +83,43 @@ typedef struct _Zip {
 #define ZIP_IN_END  0x0080  /* end of decompression */
 #define ZIP_IN_ERR  0x0100  /* input error */
 #define ZIP_OUT_ERR 0x0200  /* output error */
+#define ZIP_PARALLEL 0x0400 /* compress output on multiple threads */
+#define ZIP_IN_MULTI 0x0800 /* continue with the next gzip member */
 
 } Zip;
 
+/*
+ * Parallel compression. The output is split into blocks which are
+ * deflated independently (primed with the last 32K of the preceding
+ * data) on a pool of threads and written to the target stream in order.
+ * Each block ends with a sync flush, the last one finishes the stream.
+ */
+typedef struct _ZipBlock {
+    z_stream strm;          /* raw deflate context */
+    I8u * in;               /* uncompressed data */
+    size_t inlen;           /* amount of uncompressed data */
+    I8u * dict;             /* the data preceding this block */
+    size_t dictlen;         /* size of the dictionary */
+    I8u * out;              /* compressed data */
+    size_t outsize;         /* size of the output buffer */
+    size_t outlen;          /* amount of compressed data */
+    uLong check;            /* crc32 or adler32 of the uncompressed data */
+    int   zerr;             /* deflate status */
+    Bool  last;             /* True if this block finishes the stream */
+    Bool  busy;             /* True while the block is being compressed */
+} ZipBlock;
+
+typedef struct _ZipPar {
+    WorkQueue * wkq;        /* the compression threads */
+    Mutex mutex;            /* protects the busy flags */
+    Event event;            /* signaled when a block has been compressed */
+    ZipBlock * blocks;      /* the ring of blocks */
+    int nblocks;            /* number of blocks in the ring */
+    int head;               /* the oldest block not written yet */
+    int count;              /* number of submitted blocks */
+    uLong adler;            /* adler32 of the data for zlib trailer */
+} ZipPar;
+
 /* gzip flag byte */
 #define GZ_ASCII_FLAG  0x01 /* bit 0 set: file probably ascii text */
 #define GZ_HEAD_CRC    0x02 /* bit 1 set: header CRC present */
@@ -106,7 +149,12 @@ STATIC const FileIO ZipIO = {
     NULL                /* setparam */,
     ZipRead             /* read     */,
     ZipWrite            /* write    */,
+    NULL                /* read64   */,
+    NULL                /* write64  */,
+    NULL                /* readv    */,
+    NULL                /* writev   */,
     NULL                /* skip     */,
+    NULL                /* peek     */,
     ZipFlush            /* flush    */,
     ZipEof              /* eof      */,
     NULL                /* fd       */,
@@ -249,6 +297,25 @@ STATIC Bool ZipSkipHeader(Zip * zf)
     return BoolValue((zf->zflags & (ZIP_IN_ERR | ZIP_IN_EOF)) == 0);
 }
 
+/**
+ * Skips the trailer of a gzip member and the header of the next one,
+ * if there is one.
+ */
+STATIC Bool ZipNextMember(Zip * zf)
+{
+    int i;
+    for (i=0; i<8; i++) {
+        if (ZipGetByte(zf) == EOF) {
+            return False;
+        }
+    }
+    if (ZipGetByte(zf) == EOF) {
+        return False;
+    }
+    ZipPushBack(zf);
+    return ZipSkipHeader(zf);
+}
+
 /**
  * Initializes the input zlib context
  */
@@ -351,7 +418,9 @@ STATIC int ZipRead(File * f, void * buf, int len)
         zerr = inflate(zf->in, Z_NO_FLUSH);
         if (zerr == Z_STREAM_END) {
             inflateReset(zf->in);
-            zf->zflags |= ZIP_IN_END;
+            if (!(zf->zflags & ZIP_IN_MULTI) || !ZipNextMember(zf)) {
+                zf->zflags |= ZIP_IN_END;
+            }
         } else if (zerr != Z_OK) {
             zf->zflags |= ZIP_IN_ERR;
             break;
@@ -379,11 +448,366 @@ STATIC int ZipRead(File * f, void * buf, int len)
     }
 }
 
+/**
+ * Writes a very simple .gz header
+ */
+STATIC Bool ZipWriteGzHeader(Zip * zf)
+{
+    I8u hdr[10];
+    memset(hdr, 0, sizeof(hdr));
+    hdr[0] = (I8u)GzMagic[0];
+    hdr[1] = (I8u)GzMagic[1];
+    hdr[2] = Z_DEFLATED;
+    hdr[9] = OS_CODE;
+    if (FILE_Write(zf->f,hdr,sizeof(hdr)) == sizeof(hdr)) {
+        FILE_Flush(zf->f);
+        return True;
+    }
+    return False;
+}
+
+/**
+ * Writes the .gz trailer (crc32 and size of the uncompressed data).
+ * The trailer only follows the raw deflate stream, there's no point
+ * in writing it after the zlib trailer.
+ */
+STATIC Bool ZipWriteGzTrailer(Zip * zf)
+{
+    if ((zf->zflags & (ZIP_GZIP | ZIP_ZHDR)) == (ZIP_GZIP | ZIP_ZHDR)) {
+        I8u trailer[8];
+        trailer[0] = (I8u)(zf->outcrc);
+        trailer[1] = (I8u)(zf->outcrc >> 8);
+        trailer[2] = (I8u)(zf->outcrc >> 16);
+        trailer[3] = (I8u)(zf->outcrc >> 24);
+        trailer[4] = (I8u)(zf->outlen);
+        trailer[5] = (I8u)(zf->outlen >> 8);
+        trailer[6] = (I8u)(zf->outlen >> 16);
+        trailer[7] = (I8u)(zf->outlen >> 24);
+        if (!FILE_WriteAll(zf->f, trailer, sizeof(trailer))) {
+            zf->zflags |= ZIP_OUT_ERR;
+            return False;
+        }
+    }
+    return True;
+}
+
+/*==========================================================================*
+ *              P A R A L L E L    C O M P R E S S I O N
+ *==========================================================================*/
+
+/**
+ * Compresses one block. Normally runs on one of the compression threads.
+ */
+STATIC void ZipParCompress(WorkItem * w, void * arg1, void * arg2)
+{
+    Zip * zf = (Zip*)arg1;
+    ZipPar * par = zf->par;
+    ZipBlock * b = (ZipBlock*)arg2;
+    z_stream * s = &b->strm;
+    int flush = (b->last ? Z_FINISH : Z_SYNC_FLUSH);
+    UNREF(w);
+
+    b->zerr = deflateReset(s);
+    if (b->zerr == Z_OK && b->dictlen > 0) {
+        b->zerr = deflateSetDictionary(s, b->dict, (uInt)b->dictlen);
+    }
+    s->next_in = b->in;
+    s->avail_in = (uInt)b->inlen;
+    s->next_out = b->out;
+    s->avail_out = (uInt)b->outsize;
+    while (b->zerr == Z_OK) {
+        b->zerr = deflate(s, flush);
+        if (b->zerr == Z_OK && !s->avail_out) {
+
+            /* deflateBound doesn't account for the sync flush */
+            size_t outlen = b->outsize - s->avail_out;
+            I8u * out = (I8u*)MEM_Realloc(b->out, 2*b->outsize);
+            if (out) {
+                b->out = out;
+                b->outsize *= 2;
+                s->next_out = out + outlen;
+                s->avail_out = (uInt)(b->outsize - outlen);
+            } else {
+                b->zerr = Z_MEM_ERROR;
+            }
+        } else {
+            break;
+        }
+    }
+    b->outlen = b->outsize - s->avail_out;
+    if (b->zerr == Z_STREAM_END) {
+        b->zerr = Z_OK;
+    } else if (b->zerr == Z_BUF_ERROR && !b->last && !s->avail_in) {
+        b->zerr = Z_OK; /* the output buffer has been filled up exactly */
+    }
+
+    /* the checksum is calculated here too, it's not exactly free */
+    if (!(zf->zflags & ZIP_ZHDR)) {
+        b->check = adler32(1L, b->in, (uInt)b->inlen);
+    } else if (zf->zflags & ZIP_GZIP) {
+        b->check = crc32(0L, b->in, (uInt)b->inlen);
+    }
+
+    MUTEX_Lock(&par->mutex);
+    b->busy = False;
+    EVENT_Set(&par->event);
+    MUTEX_Unlock(&par->mutex);
+}
+
+/**
+ * Writes the oldest submitted block to the target stream. If the block
+ * is still being compressed, waits for it if wait is True, otherwise
+ * returns False.
+ */
+STATIC Bool ZipParWriteHead(Zip * zf, Bool wait)
+{
+    ZipPar * par = zf->par;
+    ZipBlock * b = par->blocks + par->head;
+    ASSERT(par->count > 0);
+    MUTEX_Lock(&par->mutex);
+    while (b->busy && wait) {
+        EVENT_Reset(&par->event);
+        MUTEX_Unlock(&par->mutex);
+        EVENT_Wait(&par->event);
+        MUTEX_Lock(&par->mutex);
+    }
+    MUTEX_Unlock(&par->mutex);
+    if (b->busy) {
+        return False;
+    }
+
+    if (b->zerr != Z_OK) {
+        zf->zflags |= ZIP_OUT_ERR;
+    } else if (!(zf->zflags & ZIP_OUT_ERR)) {
+        if (FILE_WriteAll(zf->f, b->out, (int)b->outlen)) {
+            if (zf->zflags & ZIP_ZHDR) {
+                /* not used unless we are writing the .gz trailer */
+                zf->outcrc = crc32_combine(zf->outcrc, b->check,
+                                           (z_off_t)b->inlen);
+            } else {
+                par->adler = adler32_combine(par->adler, b->check,
+                                             (z_off_t)b->inlen);
+            }
+        } else {
+            zf->zflags |= ZIP_OUT_ERR;
+        }
+    }
+    par->head = (par->head + 1) % par->nblocks;
+    par->count--;
+    return True;
+}
+
+/**
+ * Hands the block being filled to the compression threads and makes
+ * the next one current.
+ */
+STATIC void ZipParSubmit(Zip * zf, Bool last)
+{
+    ZipPar * par = zf->par;
+    ZipBlock * b = par->blocks + (par->head + par->count) % par->nblocks;
+    ZipBlock * next;
+    size_t n, keep;
+
+    b->last = last;
+    b->busy = True;
+    if (!WKQ_InvokeLater2(par->wkq, ZipParCompress, zf, b)) {
+        ZipParCompress(NULL, zf, b);
+    }
+    par->count++;
+
+    /* make room for the next block, write what's ready */
+    while (par->count >= par->nblocks) ZipParWriteHead(zf, True);
+    while (par->count > 0 && ZipParWriteHead(zf, False)) NOTHING;
+
+    /* the next block is primed with the end of the data preceding it */
+    next = par->blocks + (par->head + par->count) % par->nblocks;
+    n = MIN(b->inlen, Z_DICTSIZE);
+    keep = MIN(b->dictlen, Z_DICTSIZE - n);
+    memcpy(next->dict, b->dict + b->dictlen - keep, keep);
+    memcpy(next->dict + keep, b->in + b->inlen - n, n);
+    next->dictlen = keep + n;
+    next->inlen = 0;
+}
+
+/**
+ * Buffers the data, submitting the blocks as they fill up.
+ */
+STATIC int ZipParWrite(Zip * zf, const void * buf, int len)
+{
+    ZipPar * par = zf->par;
+    const I8u * data = (const I8u*)buf;
+    int nbytes = 0;
+    while (nbytes < len && !(zf->zflags & ZIP_OUT_ERR)) {
+        ZipBlock * b = par->blocks + (par->head + par->count) % par->nblocks;
+        size_t n = MIN(Z_BLOCKSIZE - b->inlen, (size_t)(len - nbytes));
+        memcpy(b->in + b->inlen, data + nbytes, n);
+        b->inlen += n;
+        nbytes += (int)n;
+        if (b->inlen == Z_BLOCKSIZE) {
+            ZipParSubmit(zf, False);
+        }
+    }
+    zf->outlen += nbytes;
+    return ((nbytes > 0 || !(zf->zflags & ZIP_OUT_ERR)) ? nbytes : (-1));
+}
+
+/**
+ * Waits for the compression threads and deallocates everything
+ */
+STATIC void ZipParFree(Zip * zf)
+{
+    ZipPar * par = zf->par;
+    int i;
+
+    /* the blocks may still be busy if we didn't get to flush them */
+    if (par->count > 0) {
+        zf->zflags |= ZIP_OUT_ERR;
+        while (par->count > 0) ZipParWriteHead(zf, True);
+    }
+    WKQ_Delete(par->wkq);
+    for (i=0; i<par->nblocks; i++) {
+        ZipBlock * b = par->blocks + i;
+        deflateEnd(&b->strm);
+        MEM_Free(b->out);
+    }
+    MEM_Free(par->blocks[0].in);
+    MEM_Free(par->blocks);
+    EVENT_Destroy(&par->event);
+    MUTEX_Destroy(&par->mutex);
+    MEM_Free(par);
+    zf->par = NULL;
+}
+
+/**
+ * Compresses and writes all the buffered data. Z_FINISH terminates
+ * the stream and writes the trailer.
+ */
+STATIC Bool ZipParFlush(Zip * zf, int flush)
+{
+    ZipPar * par = zf->par;
+    ZipBlock * b = par->blocks + (par->head + par->count) % par->nblocks;
+    if (flush == Z_FINISH || b->inlen > 0) {
+        ZipParSubmit(zf, BoolValue(flush == Z_FINISH));
+    }
+    while (par->count > 0) ZipParWriteHead(zf, True);
+    if (flush == Z_FINISH) {
+        if (!(zf->zflags & ZIP_OUT_ERR)) {
+            if (zf->zflags & ZIP_ZHDR) {
+                ZipWriteGzTrailer(zf);
+            } else {
+                I8u trailer[4];
+                trailer[0] = (I8u)(par->adler >> 24);
+                trailer[1] = (I8u)(par->adler >> 16);
+                trailer[2] = (I8u)(par->adler >> 8);
+                trailer[3] = (I8u)(par->adler);
+                if (!FILE_WriteAll(zf->f, trailer, sizeof(trailer))) {
+                    zf->zflags |= ZIP_OUT_ERR;
+                }
+            }
+        }
+
+        /* no need to keep the threads around */
+        ZipParFree(zf);
+    }
+    return BoolValue(FILE_Flush(zf->f) && !(zf->zflags & ZIP_OUT_ERR));
+}
+
+/**
+ * Writes the headers. Since the blocks are compressed as raw deflate
+ * streams, the zlib header (if any) is written here too.
+ */
+STATIC Bool ZipParWriteHeader(Zip * zf)
+{
+    if (!(zf->zflags & ZIP_GZIP) || ZipWriteGzHeader(zf)) {
+        if (zf->zflags & ZIP_ZHDR) {
+            return True;
+        } else {
+            I8u zhdr[2];
+            int level = zf->compression;
+            int hdr = (Z_DEFLATED + ((MAX_WBITS - 8) << 4)) << 8;
+            if (level == Z_DEFAULT_COMPRESSION) level = 6;
+            if (level >= 2) hdr |= ((level<6) ? 1 : (level==6) ? 2 : 3) << 6;
+            hdr += 31 - (hdr % 31);
+            zhdr[0] = (I8u)(hdr >> 8);
+            zhdr[1] = (I8u)hdr;
+            return FILE_WriteAll(zf->f, zhdr, sizeof(zhdr));
+        }
+    }
+    return False;
+}
+
+/**
+ * Allocates the blocks and compression threads, writes the header.
+ * All the allocations that may fail happen here, on the caller's thread.
+ */
+STATIC Bool ZipParInit(Zip * zf)
+{
+    ZipPar * par = MEM_New(ZipPar);
+    if (par) {
+        memset(par, 0, sizeof(*par));
+        par->adler = adler32(0L, Z_NULL, 0);
+        par->nblocks = 2*zf->nthreads;
+        par->blocks = MEM_NewArray(ZipBlock, par->nblocks);
+        if (par->blocks) {
+            const size_t size = Z_BLOCKSIZE + Z_DICTSIZE;
+            I8u * data = MEM_NewArray(I8u, par->nblocks * size);
+            memset(par->blocks, 0, sizeof(ZipBlock) * par->nblocks);
+            if (data) {
+                int i, n = 0;
+                for (n=0; n<par->nblocks; n++) {
+                    ZipBlock * b = par->blocks + n;
+                    b->in = data + n * size;
+                    b->dict = b->in + Z_BLOCKSIZE;
+                    b->strm.zalloc = ZipMemAlloc;
+                    b->strm.zfree = ZipMemFree;
+                    if (deflateInit2(&b->strm, zf->compression, Z_DEFLATED,
+                        -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                        break;
+                    }
+                    b->outsize = deflateBound(&b->strm, Z_BLOCKSIZE) + 16;
+                    b->out = (I8u*)MEM_Alloc(b->outsize);
+                    if (!b->out) {
+                        deflateEnd(&b->strm);
+                        break;
+                    }
+                }
+                if (n == par->nblocks && MUTEX_Init(&par->mutex)) {
+                    if (EVENT_Init(&par->event)) {
+                        par->wkq = WKQ_CreatePool(zf->nthreads);
+                        if (par->wkq) {
+                            zf->par = par;
+                            if (ZipParWriteHeader(zf)) {
+                                return True;
+                            }
+                            zf->par = NULL;
+                            WKQ_Delete(par->wkq);
+                        }
+                        EVENT_Destroy(&par->event);
+                    }
+                    MUTEX_Destroy(&par->mutex);
+                }
+                for (i=0; i<n; i++) {
+                    deflateEnd(&par->blocks[i].strm);
+                    MEM_Free(par->blocks[i].out);
+                }
+                MEM_Free(data);
+            }
+            MEM_Free(par->blocks);
+        }
+        MEM_Free(par);
+    }
+    zf->zflags |= ZIP_OUT_ERR;
+    return False;
+}
+
 /**
  * Initializes the output zlib context
  */
 STATIC Bool ZipInitOut(Zip * zf)
 {
+    if (zf->zflags & ZIP_PARALLEL) {
+        return ZipParInit(zf);
+    }
 
     /* allocate buffer */
     zf->outbuf = (I8u*)MEM_Alloc(zf->outbufsize);
@@ -406,22 +830,7 @@ STATIC Bool ZipInitOut(Zip * zf)
                                          Z_DEFAULT_STRATEGY);
 
             if (zerr == Z_OK) {
-                if (zf->zflags & ZIP_GZIP) {
-                    /* write a very simple .gz header */
-                    I8u hdr[10];
-                    memset(hdr, 0, sizeof(hdr));
-                    hdr[0] = (I8u)GzMagic[0];
-                    hdr[1] = (I8u)GzMagic[1];
-                    hdr[2] = Z_DEFLATED;
-                    hdr[9] = OS_CODE;
-                    if (FILE_Write(zf->f,hdr,sizeof(hdr)) == sizeof(hdr)) {
-                        FILE_Flush(zf->f);
-                        zf->out->next_out = zf->outbuf;
-                        zf->out->avail_out = zf->outbufsize;
-                        return True;
-                    }
-                } else {
-                    /* not writing the header */
+                if (!(zf->zflags & ZIP_GZIP) || ZipWriteGzHeader(zf)) {
                     zf->out->next_out = zf->outbuf;
                     zf->out->avail_out = zf->outbufsize;
                     return True;
@@ -464,13 +873,18 @@ STATIC int ZipWrite(File * f, const void * buf, int len)
         return -1;
     }
 
-    /* "lazy" allocation of the input context */
-    if (!zf->out) {
+    /* "lazy" allocation of the output context */
+    if (!zf->out && !zf->par) {
         if (!ZipInitOut(zf)) {
             return -1;
         }
     }
 
+    /* compress data on multiple threads */
+    if (zf->par) {
+        return ZipParWrite(zf, buf, len);
+    }
+
     /* deflate and write data */
     zf->out->next_in = (Bytef*)buf;
     zf->out->avail_in = len;
@@ -486,6 +900,7 @@ STATIC int ZipWrite(File * f, const void * buf, int len)
         if (deflate(zf->out, Z_NO_FLUSH) != Z_OK) break;
     }
     zf->outcrc = crc32(zf->outcrc, (const Bytef *)buf, len);
+    zf->outlen += len;
     return (len - zf->out->avail_in);
 }
 
@@ -494,7 +909,9 @@ STATIC int ZipWrite(File * f, const void * buf, int len)
  */
 STATIC Bool ZipFlush2(Zip * zf, int flush)
 {
-    if (zf->out) {
+    if (zf->par) {
+        return ZipParFlush(zf, flush);
+    } else if (zf->out) {
         int zerr = Z_OK;
         Bool done = False;
 
@@ -527,6 +944,9 @@ STATIC Bool ZipFlush2(Zip * zf, int flush)
             }
             if (zerr != Z_OK && zerr != Z_STREAM_END) break;
         }
+        if (zerr == Z_STREAM_END && !ZipWriteGzTrailer(zf)) {
+            return False;
+        }
         return BoolValue(FILE_Flush(zf->f) && (zerr == Z_STREAM_END));
     }
     return True;
@@ -553,7 +973,7 @@ STATIC File * ZipTarget(File * f)
 STATIC void ZipDetach2(Zip * zf)
 {
     if (zf->f) {
-        if (zf->out && !(zf->zflags & ZIP_FINISH)) {
+        if ((zf->out || zf->par) && !(zf->zflags & ZIP_FINISH)) {
             ZipFlush2(zf, Z_FINISH);
         }
         zf->f = NULL;
@@ -568,6 +988,9 @@ STATIC void ZipDetach2(Zip * zf)
         MEM_Free(zf->out);
         zf->out = NULL;
     }
+    if (zf->par) {
+        ZipParFree(zf);
+    }
     if (zf->inbuf) {
         MEM_Free(zf->inbuf);
         zf->inbuf = NULL;
@@ -594,7 +1017,7 @@ STATIC void ZipClose(File * f)
     Zip * zf = ZipCast(f);
     if (zf) {
         if (zf->f) {
-            if (zf->out && !(zf->zflags & ZIP_FINISH)) {
+            if ((zf->out || zf->par) && !(zf->zflags & ZIP_FINISH)) {
                 ZipFlush2(zf, Z_FINISH);
             }
             FILE_Close(zf->f);
@@ -624,9 +1047,21 @@ STATIC void ZipFree(File * f)
  * #define Z_DEFAULT_COMPRESSION  (-1)
  */
 File * FILE_Zip2(File * f, int flags, int level)
+{
+    return FILE_Zip3(f, flags, level, 0);
+}
+
+/**
+ * Same as FILE_Zip2, plus the number of threads compressing the output
+ * if FILE_ZIP_PARALLEL flag is set. Zero or negative nthreads means the
+ * number of CPUs. In parallel mode, the output is compressed in 128K
+ * blocks which makes it slightly larger, and FILE_Flush becomes more
+ * expensive because it has to wait for all the threads.
+ */
+File * FILE_Zip3(File * f, int flags, int level, int nthreads)
 {
     ASSERT(f);
-    ASSERT(!(flags & (~0x000f)));
+    ASSERT(!(flags & (~0x001f)));
     if (f) {
         Zip * zf = MEM_New(Zip);
         if (zf) {
@@ -640,6 +1075,12 @@ File * FILE_Zip2(File * f, int flags, int level)
                 if (flags & FILE_ZIP_OUT) zf->zflags |= ZIP_OUT;
                 if (flags & FILE_ZIP_ZHDR) zf->zflags |= ZIP_ZHDR;
                 if (flags & FILE_ZIP_GZIP) zf->zflags |= ZIP_GZIP;
+                if (flags & FILE_ZIP_PARALLEL) {
+                    zf->zflags |= ZIP_PARALLEL;
+                    zf->nthreads = nthreads;
+                    if (zf->nthreads <= 0) zf->nthreads = SYSTEM_CountCPU();
+                    if (zf->nthreads <= 0) zf->nthreads = 1;
+                }
                 return &zf->file;
             }
             MEM_Free(zf);
@@ -676,6 +1117,356 @@ Bool FILE_ZipFinish(File * f)
     return False;
 }
 
+/*==========================================================================*
+ *              R A N D O M    A C C E S S
+ *==========================================================================*/
+
+/* default distance between the access points, and the window size */
+#define Z_INDEX_SPAN 0x100000
+#define Z_WINSIZE    32768
+
+/* index file format */
+#define Z_INDEX_MAGIC    "SZIX"
+#define Z_INDEX_VERSION  1
+#define Z_INDEX_GZIP     0x01
+
+/*
+ * The access point is a deflate block boundary, with the bit offset
+ * in the compressed stream and the 32K of uncompressed data preceding
+ * it, which is everything needed to start inflating from there.
+ */
+typedef struct _ZipPoint {
+    I64s out;               /* offset in the uncompressed data */
+    I64s in;                /* offset in the compressed data */
+    int  bits;              /* number of bits of the byte before in */
+    I8u  window[Z_WINSIZE]; /* the preceding uncompressed data */
+} ZipPoint;
+
+struct _ZipIndex {
+    int count;              /* number of access points */
+    int alloc;              /* number of allocated access points */
+    ZipPoint * points;      /* the access points */
+    I64s length;            /* size of the uncompressed data */
+    Bool gzip;              /* True for gzip, False for zlib */
+};
+
+/**
+ * Adds the access point. The window is a circular buffer, left is the
+ * amount of space left in it.
+ */
+STATIC Bool ZipIndexAdd(ZipIndex * index, int bits, I64s in, I64s out,
+                        const I8u * window, size_t left)
+{
+    ZipPoint * p;
+    if (index->count == index->alloc) {
+        int n = (index->alloc ? (2*index->alloc) : 8);
+        ZipPoint * points = MEM_ReallocN(index->points, n, sizeof(ZipPoint));
+        if (!points) return False;
+        index->points = points;
+        index->alloc = n;
+    }
+    p = index->points + (index->count++);
+    p->out = out;
+    p->in = in;
+    p->bits = bits;
+    if (left) memcpy(p->window, window + Z_WINSIZE - left, left);
+    if (left < Z_WINSIZE) memcpy(p->window + left, window, Z_WINSIZE - left);
+    return True;
+}
+
+/**
+ * Deletes the index
+ */
+void FILE_ZipIndexDelete(ZipIndex * index)
+{
+    if (index) {
+        MEM_Free(index->points);
+        MEM_Free(index);
+    }
+}
+
+/**
+ * Reads gzip or zlib stream (detected automatically) to the end and
+ * builds the index, with the access points approximately span bytes
+ * of uncompressed data apart. Zero or negative span selects the default
+ * (1 MB). Each access point takes 32K of memory. Concatenated gzip
+ * files are supported. Returns NULL on I/O error, corrupted data or
+ * if we run out of memory.
+ */
+ZipIndex * FILE_ZipIndexBuild(File * in, I64s span)
+{
+    ZipIndex * index = NULL;
+    I8u * inbuf = MEM_NewArray(I8u, Z_BUFSIZE);
+    I8u * window = MEM_NewArray(I8u, Z_WINSIZE);
+    if (span <= 0) span = Z_INDEX_SPAN;
+    if (inbuf && window) {
+        z_stream strm;
+
+        /* the early access points don't fill the whole window */
+        memset(window, 0, Z_WINSIZE);
+        memset(&strm, 0, sizeof(strm));
+        strm.zalloc = ZipMemAlloc;
+        strm.zfree = ZipMemFree;
+
+        /* 32 in windowBits enables automatic gzip/zlib detection */
+        if (inflateInit2(&strm, 32 + MAX_WBITS) == Z_OK) {
+            index = MEM_New(ZipIndex);
+            if (index) {
+                I64s totin = 0, totout = 0, last = 0;
+                int zerr = Z_OK;
+                int n;
+
+                memset(index, 0, sizeof(*index));
+                n = FILE_Read(in, inbuf, Z_BUFSIZE);
+                strm.next_in = inbuf;
+                strm.avail_in = MAX(n,0);
+                index->gzip = BoolValue(n > 0 && inbuf[0] == GzMagic[0]);
+                if (n <= 0) zerr = Z_DATA_ERROR;
+
+                while (zerr == Z_OK) {
+                    if (!strm.avail_in) {
+                        n = FILE_Read(in, inbuf, Z_BUFSIZE);
+                        if (n <= 0) {
+                            zerr = Z_DATA_ERROR; /* premature end */
+                            break;
+                        }
+                        strm.next_in = inbuf;
+                        strm.avail_in = n;
+                    }
+                    if (!strm.avail_out) {
+                        strm.next_out = window;
+                        strm.avail_out = Z_WINSIZE;
+                    }
+
+                    /* Z_BLOCK stops at the deflate block boundaries */
+                    totin += strm.avail_in;
+                    totout += strm.avail_out;
+                    zerr = inflate(&strm, Z_BLOCK);
+                    totin -= strm.avail_in;
+                    totout -= strm.avail_out;
+
+                    if (zerr == Z_OK) {
+                        /* 128 means block boundary, 64 - the last block */
+                        if ((strm.data_type & 128) &&
+                            !(strm.data_type & 64) &&
+                            (totout == 0 || (totout - last) > span)) {
+                            if (!ZipIndexAdd(index, strm.data_type & 7,
+                                totin, totout, window, strm.avail_out)) {
+                                zerr = Z_MEM_ERROR;
+                            }
+                            last = totout;
+                        }
+                    } else if (zerr == Z_STREAM_END && index->gzip) {
+
+                        /* check for another gzip member */
+                        if (!strm.avail_in) {
+                            n = FILE_Read(in, inbuf, Z_BUFSIZE);
+                            strm.next_in = inbuf;
+                            strm.avail_in = MAX(n,0);
+                            if (n < 0) zerr = Z_ERRNO;
+                        }
+                        if (strm.avail_in && strm.next_in[0] == GzMagic[0]) {
+                            zerr = inflateReset(&strm);
+                        }
+                    } else if (zerr == Z_NEED_DICT) {
+                        zerr = Z_DATA_ERROR;
+                    }
+                }
+
+                if (zerr == Z_STREAM_END) {
+                    index->length = totout;
+                } else {
+                    FILE_ZipIndexDelete(index);
+                    index = NULL;
+                }
+            }
+            inflateEnd(&strm);
+        }
+    }
+    MEM_Free(window);
+    MEM_Free(inbuf);
+    return index;
+}
+
+/**
+ * Writes 64-bit number, least significant byte first
+ */
+STATIC Bool ZipIndexPutI64(File * out, I64s value)
+{
+    int i;
+    I8u buf[8];
+    for (i=0; i<8; i++) buf[i] = (I8u)(value >> (8*i));
+    return FILE_WriteAll(out, buf, sizeof(buf));
+}
+
+/**
+ * Reads 64-bit number written by ZipIndexPutI64
+ */
+STATIC Bool ZipIndexGetI64(File * in, I64s * value)
+{
+    I8u buf[8];
+    if (FILE_ReadAll(in, buf, sizeof(buf))) {
+        int i;
+        I64u x = 0;
+        for (i=7; i>=0; i--) x = (x << 8) | buf[i];
+        *value = (I64s)x;
+        return True;
+    }
+    return False;
+}
+
+/**
+ * Writes the index to the stream. The windows are stored uncompressed,
+ * the stream can be compressed with FILE_Zip if necessary.
+ */
+Bool FILE_ZipIndexSave(const ZipIndex * index, File * out)
+{
+    int i;
+    I8u hdr[8];
+    memcpy(hdr, Z_INDEX_MAGIC, 4);
+    hdr[4] = Z_INDEX_VERSION;
+    hdr[5] = (index->gzip ? Z_INDEX_GZIP : 0);
+    hdr[6] = hdr[7] = 0;
+    if (!FILE_WriteAll(out, hdr, sizeof(hdr)) ||
+        !ZipIndexPutI64(out, index->length) ||
+        !ZipIndexPutI64(out, index->count)) {
+        return False;
+    }
+    for (i=0; i<index->count; i++) {
+        const ZipPoint * p = index->points + i;
+        if (!ZipIndexPutI64(out, p->out) ||
+            !ZipIndexPutI64(out, p->in) ||
+            !FILE_PutByte(out, p->bits) ||
+            !FILE_WriteAll(out, p->window, Z_WINSIZE)) {
+            return False;
+        }
+    }
+    return True;
+}
+
+/**
+ * Reads the index written by FILE_ZipIndexSave. Returns NULL on I/O
+ * error or if the data don't look like a valid index.
+ */
+ZipIndex * FILE_ZipIndexLoad(File * in)
+{
+    I8u hdr[8];
+    I64s length, count;
+    if (FILE_ReadAll(in, hdr, sizeof(hdr)) &&
+        !memcmp(hdr, Z_INDEX_MAGIC, 4) &&
+        hdr[4] == Z_INDEX_VERSION &&
+        ZipIndexGetI64(in, &length) && length >= 0 &&
+        ZipIndexGetI64(in, &count) && count >= 0 && count <= INT_MAX) {
+        ZipIndex * index = MEM_New(ZipIndex);
+        if (index) {
+            memset(index, 0, sizeof(*index));
+            index->length = length;
+            index->gzip = BoolValue(hdr[5] & Z_INDEX_GZIP);
+            index->points = MEM_NewArray(ZipPoint, MAX(count,1));
+            if (index->points) {
+                index->alloc = (int)MAX(count,1);
+                while (index->count < count) {
+                    ZipPoint * p = index->points + index->count;
+                    int bits;
+                    if (!ZipIndexGetI64(in, &p->out) ||
+                        !ZipIndexGetI64(in, &p->in) ||
+                        (bits = FILE_GetByte(in)) < 0 || bits > 7 ||
+                        !FILE_ReadAll(in, p->window, Z_WINSIZE) ||
+                        p->out < 0 || p->out > length || p->in < 0 ||
+                        (index->count > 0 && p->out < p[-1].out)) {
+                        break;
+                    }
+                    p->bits = bits;
+                    index->count++;
+                }
+                if (index->count == count) {
+                    return index;
+                }
+            }
+            FILE_ZipIndexDelete(index);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Skips up to 64 bits worth of data
+ */
+STATIC Bool ZipSkip64(File * f, I64s n)
+{
+    while (n > 0) {
+        size_t chunk = (size_t)MIN(n,INT_MAX);
+        if (!FILE_SkipAll(f, chunk)) {
+            return False;
+        }
+        n -= chunk;
+    }
+    return True;
+}
+
+/**
+ * Creates a stream which reads the uncompressed data starting at the
+ * specified offset. The input stream must be positioned at the beginning
+ * of the compressed data that the index has been built for. It skips to
+ * the nearest access point (seeks, if it's a plain file) and inflates
+ * from there, so that no more than approximately span bytes have to be
+ * decompressed and thrown away. Closing the returned stream closes the
+ * input stream. The index can be deleted after this function returns.
+ */
+File * FILE_ZipSeek(File * in, const ZipIndex * index, I64s offset)
+{
+    File * f = NULL;
+    if (offset >= 0 && offset <= index->length) {
+        int lo = 0, hi = index->count - 1;
+        const ZipPoint * p = NULL;
+
+        /* find the last access point before the offset */
+        while (lo <= hi) {
+            int mid = (lo + hi)/2;
+            if (index->points[mid].out <= offset) {
+                p = index->points + mid;
+                lo = mid + 1;
+            } else {
+                hi = mid - 1;
+            }
+        }
+
+        if (p) {
+            int c = 0;
+            f = FILE_Zip(in, FILE_ZIP_IN | FILE_ZIP_ZHDR);
+            if (f) {
+                Zip * zf = ZipCast(f);
+                if (index->gzip) zf->zflags |= ZIP_IN_MULTI;
+                if (ZipSkip64(in, p->in - (p->bits ? 1 : 0)) &&
+                    (!p->bits || (c = FILE_GetByte(in)) >= 0) &&
+                    ZipInitIn(zf) &&
+                    (!p->bits || inflatePrime(zf->in, p->bits,
+                        c >> (8 - p->bits)) == Z_OK) &&
+                    inflateSetDictionary(zf->in, p->window,
+                        Z_WINSIZE) == Z_OK &&
+                    ZipSkip64(f, offset - p->out)) {
+                    return f;
+                }
+            }
+        } else {
+            /* no access points, inflate from the beginning */
+            f = FILE_Zip(in, FILE_ZIP_IN | (index->gzip ?
+                (FILE_ZIP_GZIP | FILE_ZIP_ZHDR) : 0));
+            if (f) {
+                if (index->gzip) ZipCast(f)->zflags |= ZIP_IN_MULTI;
+                if (ZipSkip64(f, offset)) {
+                    return f;
+                }
+            }
+        }
+        if (f) {
+            FILE_Detach(f);
+            FILE_Close(f);
+        }
+    }
+    return NULL;
+}
+
 /*
  * HISTORY:
  *
@@ -34,6 +34,8 @@
 #include "s_mem.h"
 #include "s_itrp.h"
 #include "s_libp.h"
+#include "s_random.h"
+#include "s_strbuf.h"
 
 /*
  * Linux kernel include files define 'current' as a macro. Those guys
@@ -92,12 +94,21 @@ STATIC const int hashPrimes[] = {
 
 #define DEFAULT_LOAD_FACTOR 75
 
+/*
+ * Number of old bucket slots moved to the new array by each HASH_Put
+ * in incremental mode. The ratio between the neighboring primes is at
+ * least 1.2, so with the default load factor it takes about 7 slots per
+ * put to complete the migration before the table needs to grow again.
+ */
+#define HASH_MIGRATE_STEP 16
+
 #define defaultHashFree hashFreeNothingProc
 
 /* private data structures */
 struct _HashBucket {
     HashKey   key;
     HashValue value;
+    HashCode  hash;         /* cached HASH_GetHashCode(key) */
     HashBucket *next;
 };
 
@@ -115,6 +126,7 @@ typedef struct _HashBuckets {
 
 typedef struct _HashModule {
     int initcount;          /* positive if module has been initialized */
+    I64u seed;              /* random seed for the seeded hash functions */
 #if _HASH_POOL
 #  if !_HASH_THREAD_LOCAL_POOL
     Mutex lock;             /* spinlock */
@@ -141,8 +153,8 @@ typedef struct _HashIterator {
     HashTable * ht;         /* the hash table we are iterating through */
     HashBucket * current;   /* the current hash bucket */
     HashBucket * next;      /* the next hash bucket */
-    int currentPos;         /* position of the current bucket in the array */
-    int nextPos;            /* position of the next bucket in the array */
+    int currentPos;         /* position of the current bucket, see below */
+    int nextPos;            /* position of the next bucket, see below */
 } HashIterator;
 
 typedef struct _HashEntryIterator {
@@ -206,6 +218,7 @@ STATIC const Itr hashEntryConstIterator = {
 
 /* macros */
 #define _NumBuckets(t) (hashPrimes[(t)->primeIndex])
+#define _NumOldBuckets(t) ((t)->oldBuckets ? hashPrimes[(t)->oldIndex] : 0)
 #define _NeedRehash(t) ((t)->count >= (long)((t)->loadFactor*_NumBuckets(t)/100))
 
 /**
@@ -305,6 +318,173 @@ HashCode stringCaseHashProc(HashKeyC key)
     return STRING_HashCodeNoCase(key);
 }
 
+/*==========================================================================*
+ *              S E E D E D    H A S H
+ *==========================================================================*/
+
+/* constants from wyhash */
+#define HASH_P0 __UINT64_C(0xa0761d6478bd642f)
+#define HASH_P1 __UINT64_C(0xe7037ed1a0b428db)
+
+/* number of characters upper-cased at once by stringCaseSeedHashProc */
+#define HASH_CASE_CHUNK 64
+
+/**
+ * Multiplies two 64-bit numbers and folds the 128-bit product.
+ */
+STATIC I64u HASH_Mum(I64u a, I64u b)
+{
+#ifdef __SIZEOF_INT128__
+    __extension__ typedef unsigned __int128 I128u;
+    const I128u r = (I128u)a * b;
+    return ((I64u)r) ^ ((I64u)(r >> 64));
+#else
+    const I64u ha = a >> 32, la = (I32u)a, hb = b >> 32, lb = (I32u)b;
+    const I64u hl = ha * lb, lh = la * hb, ll = la * lb;
+    const I64u t = ll + (hl << 32);
+    const I64u lo = t + (lh << 32);
+    const I64u hi = ha * hb + (hl >> 32) + (lh >> 32) + (t < ll) + (lo < t);
+    return lo ^ hi;
+#endif
+}
+
+/**
+ * Unaligned reads. Compilers turn these into a single load.
+ */
+STATIC I64u HASH_Read64(const I8u * p)
+{
+    I64u v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+STATIC I64u HASH_Read32(const I8u * p)
+{
+    I32u v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * Returns the per-process random seed.
+ */
+I64u HASH_Seed()
+{
+    ASSERT(HASH.initcount > 0);
+    return HASH.seed;
+}
+
+/**
+ * Hashes a block of memory, 16 bytes per multiplication. The algorithm
+ * is derived from wyhash. The result depends on the byte order, it's
+ * not supposed to be stored anywhere.
+ */
+I64u HASH_Bytes(const void * data, size_t size, I64u seed)
+{
+    const I8u * p = (const I8u*)data;
+    I64u a, b;
+    seed ^= HASH_Mum(seed ^ HASH_P0, HASH_P1);
+    if (size <= 16) {
+        if (size >= 4) {
+            const size_t off = (size >> 3) << 2;
+            a = (HASH_Read32(p) << 32) | HASH_Read32(p + off);
+            b = (HASH_Read32(p + size - 4) << 32) |
+                HASH_Read32(p + size - 4 - off);
+        } else if (size > 0) {
+            a = (((I64u)p[0]) << 16) | (((I64u)p[size >> 1]) << 8) |
+                p[size - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t n = size;
+        do {
+            seed = HASH_Mum(HASH_Read64(p) ^ HASH_P1, HASH_Read64(p+8) ^ seed);
+            p += 16;
+            n -= 16;
+        } while (n > 16);
+
+        /* the last 16 bytes, may overlap with the previous block */
+        a = HASH_Read64(p + n - 16);
+        b = HASH_Read64(p + n - 8);
+    }
+    return HASH_Mum(HASH_Mum(a ^ HASH_P1, b ^ seed) ^ size, HASH_P0);
+}
+
+/**
+ * Folds 64-bit hash into a non-negative HashCode.
+ */
+STATIC HashCode HASH_Fold(I64u h)
+{
+    return (HashCode)((h ^ (h >> 32)) & 0x7fffffff);
+}
+
+/**
+ * Seeded case-sensitive hash function for a string key.
+ */
+HashCode stringSeedHashProc(HashKeyC key)
+{
+    const size_t len = (key ? StrLen((Str)key) : 0);
+    return HASH_Fold(HASH_Bytes(key, len*sizeof(Char), HASH.seed));
+}
+
+/**
+ * Seeded case-insensitive hash function for a string key. Converts the
+ * string to upper case in chunks, and chains the chunk hashes.
+ */
+HashCode stringCaseSeedHashProc(HashKeyC key)
+{
+    I64u h = HASH.seed;
+    Str s = (Str)key;
+    if (s) {
+        Char buf[HASH_CASE_CHUNK];
+        int n;
+        do {
+            for (n=0; n<HASH_CASE_CHUNK && s[n]; n++) {
+                buf[n] = ToUpper(s[n]);
+            }
+            h = HASH_Bytes(buf, n*sizeof(Char), h);
+            s += n;
+        } while (n == HASH_CASE_CHUNK);
+    }
+    return HASH_Fold(h);
+}
+
+/**
+ * Seeded hash function for a StrBuf key. Uses the known length of the
+ * string. Returns the same value as stringSeedHashProc for the same
+ * string.
+ */
+HashCode strbufSeedHashProc(HashKeyC key)
+{
+    const StrBuf * sb = (const StrBuf*)key;
+    return HASH_Fold(HASH_Bytes(sb->s, sb->len*sizeof(Char), HASH.seed));
+}
+
+/**
+ * HashCompare callback, assumes keys are StrBuf pointers. Keys of
+ * different length are rejected without looking at the characters,
+ * otherwise the known number of characters is compared with memcmp.
+ * The comparison is case sensitive
+ */
+Bool hashCompareStrBufKey(HashKeyC key1, HashKeyC key2)
+{
+    if (key1 != key2) {
+        const StrBuf * sb1 = (const StrBuf*)key1;
+        const StrBuf * sb2 = (const StrBuf*)key2;
+        if (sb1->len != sb2->len) {
+            return False;
+        } else if (!sb1->len || sb1->s == sb2->s) {
+            return True;
+        } else {
+            return BoolValue(!memcmp(sb1->s, sb2->s, sb1->len*sizeof(Char)));
+        }
+    } else {
+        return True;
+    }
+}
+
 /**
  * Deallocates pooled hash buckets. Does not deallocate the pool itself.
  */
@@ -459,14 +639,74 @@ STATIC short HASH_SelectPrimeIndex(long size, short loadFactor)
 }
 
 /**
- * Returns hash code for the specified key. Checks out-of-bounds
- * conditions.
+ * Returns non-negative hash code for the specified key.
  */
 STATIC HashCode HASH_GetHashCode(const HashTable * ht, HashKeyC key)
 {
     HashCode hashCode = ht->hasher(key);
-    if (hashCode < 0) hashCode = -hashCode;
-    return (hashCode % _NumBuckets(ht));
+    return (hashCode < 0) ? -hashCode : hashCode;
+}
+
+/**
+ * Returns the slot containing the chain of hash buckets where the key
+ * with this hash code belongs. If the key maps into the old array slot
+ * which hasn't been migrated yet, that's where the key is (or would be).
+ */
+STATIC HashBucket ** HASH_GetSlot(const HashTable * ht, HashCode hashCode)
+{
+    if (ht->oldBuckets) {
+        const int pos = hashCode % hashPrimes[ht->oldIndex];
+        if (pos >= ht->migrated) {
+            return ht->oldBuckets + pos;
+        }
+    }
+    return ht->buckets + (hashCode % _NumBuckets(ht));
+}
+
+/**
+ * Moves up to the specified number of old array slots to the new array.
+ * Deallocates the old array when it's done.
+ */
+STATIC void HASH_Migrate(HashTable * ht, int steps)
+{
+    const int n = _NumOldBuckets(ht);
+    const int n1 = _NumBuckets(ht);
+    while (steps-- > 0 && ht->migrated < n) {
+        HashBucket * b = ht->oldBuckets[ht->migrated];
+        ht->oldBuckets[ht->migrated++] = NULL;
+        while (b) {
+            HashBucket * next = b->next;
+            HashCode pos = b->hash % n1;
+            b->next = ht->buckets[pos];
+            ht->buckets[pos] = b;
+            b = next;
+        }
+    }
+    if (ht->oldBuckets && ht->migrated >= n) {
+        MEM_Free(ht->oldBuckets);
+        ht->oldBuckets = NULL;
+        ht->migrated = 0;
+    }
+}
+
+/**
+ * Switches to the new bucket array, the old one becomes the source of
+ * incremental migration. Any unfinished migration must be completed
+ * before calling this function.
+ */
+STATIC void HASH_StartMigration(HashTable * ht, short pi)
+{
+    const int n1 = hashPrimes[pi];
+    HashBucket ** buckets = MEM_NewArray(HashBucket*,n1);
+    ASSERT(!ht->oldBuckets);
+    if (buckets) {
+        memset(buckets,0,sizeof(buckets[0])*n1);
+        ht->oldBuckets = ht->buckets;
+        ht->oldIndex = ht->primeIndex;
+        ht->migrated = 0;
+        ht->buckets = buckets;
+        ht->primeIndex = pi;
+    }
 }
 
 #if _HASH_THREAD_LOCAL_POOL
@@ -487,6 +727,10 @@ STATIC void HASH_Cleanup(void * param)
 void HASH_InitModule()
 {
     if ((HASH.initcount++) == 0) {
+        /* time and addresses (randomized by ASLR) make up the seed */
+        I64u seed = (I64u)RANDOM_GenSeed() ^ (I64u)(PtrWord)&seed;
+        seed ^= ((I64u)(PtrWord)&HASH) << 32;
+        HASH.seed = HASH_Mum(seed ^ HASH_P0, TIME_Monotonic() ^ HASH_P1);
 #if _HASH_POOL
 #  if !_HASH_THREAD_LOCAL_POOL
         if (MUTEX_Init(&HASH.lock)) {
@@ -563,6 +807,10 @@ Bool HASH_Init(HashTable * ht,long n,HashCompare c,HashProc h,HashFree f)
         ht->count = 0;
         ht->loadFactor = DEFAULT_LOAD_FACTOR;
         ht->primeIndex = HASH_SelectPrimeIndex(n, ht->loadFactor);
+        ht->oldIndex = 0;
+        ht->flags = 0;
+        ht->migrated = 0;
+        ht->oldBuckets = NULL;
         ht->nullValue = NULL_VALUE;
         ht->hasher = (h ? h : hashDefaultHashProc);
         ht->equals = (c ? c : hashDefaultCompare);
@@ -615,13 +863,13 @@ void HASH_Delete(HashTable * ht)
 }
 
 /**
- * Removes everything from the hash table.
+ * Deallocates all hash buckets in the array.
  */
-void HASH_Clear(HashTable * ht)
+STATIC void HASH_ClearBuckets(HashTable * ht, HashBucket ** buckets, int n)
 {
-    int i = 0;
-    while (ht->count > 0) {
-        HashBucket * b = ht->buckets[i];
+    int i;
+    for (i=0; i<n && ht->count > 0; i++) {
+        HashBucket * b = buckets[i];
         if (b) {
             while (b) {
                 HashBucket * next = b->next;
@@ -630,12 +878,26 @@ void HASH_Clear(HashTable * ht)
                 b = next;
                 ht->count--;
             }
-            ht->buckets[i] = NULL;
+            buckets[i] = NULL;
         }
-        i++;
     }
 }
 
+/**
+ * Removes everything from the hash table.
+ */
+void HASH_Clear(HashTable * ht)
+{
+    if (ht->oldBuckets) {
+        HASH_ClearBuckets(ht, ht->oldBuckets, _NumOldBuckets(ht));
+        MEM_Free(ht->oldBuckets);
+        ht->oldBuckets = NULL;
+        ht->migrated = 0;
+    }
+    HASH_ClearBuckets(ht, ht->buckets, _NumBuckets(ht));
+    ASSERT(ht->count == 0);
+}
+
 /**
  * returns number of values stored in the hashtable.
  */
@@ -646,11 +908,15 @@ long HASH_Size(const HashTable * ht)
 
 /**
  * Rehash the hashtable so the it can hold at least the suggested
- * number of entries
+ * number of entries. Completes the incremental migration if there's
+ * one in progress, and then rehashes the whole table at once. Uses the
+ * cached hash codes, doesn't call the hash function.
  */
 void HASH_Rehash(HashTable * ht, long size)
 {
-    short pi = HASH_SelectPrimeIndex(MAX(size,ht->count), ht->loadFactor);
+    short pi;
+    HASH_Migrate(ht, _NumOldBuckets(ht));
+    pi = HASH_SelectPrimeIndex(MAX(size,ht->count), ht->loadFactor);
 
     /* only rehash the hash table if we are going to either increase
      * the number of hash buckets or significantly reduce it */
@@ -673,9 +939,9 @@ void HASH_Rehash(HashTable * ht, long size)
                 if (b) {
                     while (b) {
                         HashBucket * next = b->next;
-                        HashCode hashCode = HASH_GetHashCode(ht, b->key);
-                        b->next = ht->buckets[hashCode];
-                        ht->buckets[hashCode] = b;
+                        HashCode pos = b->hash % n1;
+                        b->next = ht->buckets[pos];
+                        ht->buckets[pos] = b;
                         b = next;
                     }
                     old[i] = NULL;
@@ -688,6 +954,20 @@ void HASH_Rehash(HashTable * ht, long size)
     }
 }
 
+/**
+ * Switches incremental rehashing on or off. Switching it off completes
+ * the migration in progress, if any.
+ */
+void HASH_SetIncremental(HashTable * ht, Bool incremental)
+{
+    if (incremental) {
+        ht->flags |= HASH_INCREMENTAL;
+    } else {
+        ht->flags &= ~HASH_INCREMENTAL;
+        HASH_Migrate(ht, _NumOldBuckets(ht));
+    }
+}
+
 /**
  * Puts a key/value pair into the hash table. The value replaces the
  * previous value associated with the same hash key. Also, the new
@@ -700,11 +980,20 @@ void HASH_Rehash(HashTable * ht, long size)
  */
 Bool HASH_Put(HashTable * ht, HashKey key, HashValue value)
 {
+    const HashCode hashCode = HASH_GetHashCode(ht, key);
+    HashBucket ** slot;
+    HashBucket * b;
+
+    /* move a few more buckets to the new array */
+    if (ht->oldBuckets) {
+        HASH_Migrate(ht, HASH_MIGRATE_STEP);
+    }
+
     /* try to replace existing value */
-    HashCode hashCode = HASH_GetHashCode(ht, key);
-    HashBucket * b = ht->buckets[hashCode];
+    slot = HASH_GetSlot(ht, hashCode);
+    b = *slot;
     while (b) {
-        if (ht->equals(key,b->key)) {
+        if (b->hash == hashCode && ht->equals(key,b->key)) {
             if (b->value != value) {
                 ht->free(b->key, b->value);
             }
@@ -720,11 +1009,19 @@ Bool HASH_Put(HashTable * ht, HashKey key, HashValue value)
     if (b) {
         b->key = key;
         b->value = value;
-        b->next = ht->buckets[hashCode];
-        ht->buckets[hashCode] = b;
+        b->hash = hashCode;
+        b->next = *slot;
+        *slot = b;
         ht->count++;
         if (_NeedRehash(ht)) {
-            HASH_Rehash(ht,ht->count);
+            if ((ht->flags & HASH_INCREMENTAL) && !ht->oldBuckets) {
+                short pi = HASH_SelectPrimeIndex(ht->count, ht->loadFactor);
+                if (pi > ht->primeIndex) {
+                    HASH_StartMigration(ht, pi);
+                }
+            } else {
+                HASH_Rehash(ht,ht->count);
+            }
         }
         return True;
     }
@@ -759,10 +1056,10 @@ Bool HASH_Update(HashTable * ht, HashKey key, HashValue value)
 {
     if (ht->count > 0) {
         /* try to replace existing value */
-        HashCode hashCode = HASH_GetHashCode(ht, key);
-        HashBucket * b = ht->buckets[hashCode];
+        const HashCode hashCode = HASH_GetHashCode(ht, key);
+        HashBucket * b = *HASH_GetSlot(ht, hashCode);
         while (b) {
-            if (ht->equals(key,b->key)) {
+            if (b->hash == hashCode && ht->equals(key,b->key)) {
                 b->value = value;
                 return True;
             }
@@ -778,16 +1075,17 @@ Bool HASH_Update(HashTable * ht, HashKey key, HashValue value)
 STATIC const HashBucket * HASH_Lookup(const HashTable * ht, HashKeyC key)
 {
     if (ht->count > 0) {
-        HashCode hashCode = HASH_GetHashCode(ht, key);
-        HashBucket * b = ht->buckets[hashCode];
+        const HashCode hashCode = HASH_GetHashCode(ht, key);
+        HashBucket * b = *HASH_GetSlot(ht, hashCode);
         while (b) {
 
             /* ASSERT that the keys never mutate. If they do, that breaks
              * the integrity of the hash table. In most cases it happens
              * because the key has been deallocated. */
-            ASSERT(HASH_GetHashCode(ht,b->key) == hashCode);
+            ASSERT(HASH_GetHashCode(ht,b->key) == b->hash);
 
-            if (ht->equals(key,b->key)) {
+            /* the equals callback is only invoked if hash codes match */
+            if (b->hash == hashCode && ht->equals(key,b->key)) {
                 return b;
             }
             b = b->next;
@@ -821,16 +1119,17 @@ Bool HASH_Contains(const HashTable * ht, HashKeyC key)
  */
 Bool HASH_Remove(HashTable * ht, HashKeyC key)
 {
-    HashCode hashCode = HASH_GetHashCode(ht, key);
-    HashBucket * b = ht->buckets[hashCode];
+    const HashCode hashCode = HASH_GetHashCode(ht, key);
+    HashBucket ** slot = HASH_GetSlot(ht, hashCode);
+    HashBucket * b = *slot;
     HashBucket * prev = NULL;
     while (b) {
-        if (ht->equals(key,b->key)) {
+        if (b->hash == hashCode && ht->equals(key,b->key)) {
             ht->free(b->key, b->value);
             if (prev) {
                 prev->next = b->next;
             } else {
-                ht->buckets[hashCode] = b->next;
+                *slot = b->next;
             }
 
             ht->count--;
@@ -881,6 +1180,25 @@ Bool HASH_Copy(HashTable * dest, const HashTable * src)
     return True;
 }
 
+/**
+ * Helper for HASH_Examine, examines the entries in the bucket array.
+ */
+STATIC Bool HASH_ExamineBuckets(HashBucket * const * buckets, int from,
+                                int n, HashCB cb, void * ctx)
+{
+    int i;
+    for (i=from; i<n; i++) {
+        HashBucket * b = buckets[i];
+        while (b) {
+            /* save next pointer because current element may be removed */
+            HashBucket * next = b->next;
+            if (!(*cb)(b->key, b->value, ctx)) return False;
+            b = next;
+        }
+    }
+    return True;
+}
+
 /**
  * Examines the hash table, calling callback function on each entry. Stops
  * when either all entries get examined, or callback function returns
@@ -892,21 +1210,34 @@ Bool HASH_Copy(HashTable * dest, const HashTable * src)
 Bool HASH_Examine(const HashTable * ht, HashCB cb, void* ctx)
 {
     if (ht && ht->count > 0) {
-        int i;
-        const int n = _NumBuckets(ht);
-        for (i=0; i<n; i++) {
-            HashBucket * b = ht->buckets[i];
-            while (b) {
-                /* save next pointer because current element may be removed */
-                HashBucket * next = b->next;
-                if (!(*cb)(b->key, b->value, ctx)) return False;
-                b = next;
-            }
+        /* HASH_Remove doesn't migrate anything, the arrays stay put */
+        if (ht->oldBuckets && !HASH_ExamineBuckets(ht->oldBuckets,
+            ht->migrated, _NumOldBuckets(ht), cb, ctx)) {
+            return False;
         }
+        return HASH_ExamineBuckets(ht->buckets, 0, _NumBuckets(ht), cb, ctx);
     }
     return True;
 }
 
+/*
+ * Returns the slot at the specified iterator position, NULL if it's out
+ * of range. While the table is being migrated, iterator positions first
+ * run through the old array, and then through the new one.
+ */
+STATIC HashBucket ** HASH_ItrSlot(const HashTable * ht, int pos)
+{
+    const int n = _NumOldBuckets(ht);
+    if (pos >= 0) {
+        if (pos < n) {
+            return ht->oldBuckets + pos;
+        } else if ((pos - n) < _NumBuckets(ht)) {
+            return ht->buckets + (pos - n);
+        }
+    }
+    return NULL;
+}
+
 /*
  * Initializes HashIterator
  */
@@ -917,11 +1248,11 @@ STATIC void HASH_ItrInit(HashIterator * hi, HashTable * ht, const Itr * type)
     hi->current = NULL;
     hi->next = NULL;
     hi->currentPos = -1;
-    hi->nextPos = 0;
+    hi->nextPos = ht->migrated;
 
     /* caller makes sure that hash table is not empty, there must be
      * non-empty bucket in there */
-    while (!(hi->next = hi->ht->buckets[hi->nextPos])) {
+    while (!(hi->next = *HASH_ItrSlot(ht, hi->nextPos))) {
         hi->nextPos++;
     }
 }
@@ -1026,10 +1357,10 @@ STATIC void HASH_ItrAdvance(HashIterator * hi)
     if (hi->next->next) {
         hi->next = hi->next->next;
     } else {
-        const int n = _NumBuckets(hi->ht);
+        const int n = _NumOldBuckets(hi->ht) + _NumBuckets(hi->ht);
         hi->next = NULL;
         while (++hi->nextPos < n) {
-            hi->next = hi->ht->buckets[hi->nextPos];
+            hi->next = *HASH_ItrSlot(hi->ht, hi->nextPos);
             if (hi->next) {
                 break;
             }
@@ -1071,10 +1402,15 @@ STATIC Bool HASH_ItrHasNext(Iterator * itr)
 STATIC Bool HASH_ItrRemove(Iterator * itr)
 {
     HashIterator * hi = CAST(itr,HashIterator,itr);
-    if (hi->current == hi->ht->buckets[hi->currentPos]) {
-        hi->ht->buckets[hi->currentPos] = hi->current->next;
+    HashBucket ** slot = HASH_ItrSlot(hi->ht, hi->currentPos);
+    if (!slot) {
+        ASSMSG("Concurrent hash table modification?");
+        hi->next = NULL;
+        return False;
+    } else if (hi->current == *slot) {
+        *slot = hi->current->next;
     } else {
-        HashBucket * prev = hi->ht->buckets[hi->currentPos];
+        HashBucket * prev = *slot;
         if (prev) {
             while (prev->next && prev->next != hi->current) {
                 prev = prev->next;
@@ -0,0 +1,298 @@
+/*
+ * $Id: s_hashc.c,v 1.1 2026/10/18 21:04:17 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "s_hash.h"
+#include "s_mutex.h"
+#include "s_mem.h"
+
+/*==========================================================================*
+ *              C O N C U R R E N T    H A S H    T A B L E
+ *==========================================================================*/
+
+#define DEFAULT_STRIPES 16
+#define MAX_STRIPES     1024
+
+typedef struct _HashStripe {
+    Mutex lock;             /* protects the table */
+    HashTable table;        /* the entries in this stripe */
+} HashStripe;
+
+struct _ConcurrentHash {
+    HashProc hasher;        /* hash function */
+    int mask;               /* number of stripes - 1 */
+    HashStripe * stripes;   /* the stripes */
+};
+
+/**
+ * Selects the stripe for the key. The stripe tables use the hash code
+ * modulo a prime number to select the bucket, we use different bits
+ * of the mixed hash code to select the stripe.
+ */
+STATIC HashStripe * HASH_ConcurrentStripe(const ConcurrentHash * ch,
+                                          HashKeyC key)
+{
+    I32u h = (I32u)ch->hasher(key);
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    return ch->stripes + ((h >> 16) & ch->mask);
+}
+
+/**
+ * Deinitializes the first n stripes.
+ */
+STATIC void HASH_ConcurrentDestroy(HashStripe * stripes, int n)
+{
+    int i;
+    for (i=0; i<n; i++) {
+        HASH_Destroy(&stripes[i].table);
+        MUTEX_Destroy(&stripes[i].lock);
+    }
+}
+
+/**
+ * Creates new concurrent hash table. The number of stripes limits the
+ * number of threads that can access the table simultaneously, zero
+ * selects the default. Returns NULL if memory allocation fails.
+ */
+ConcurrentHash * HASH_ConcurrentCreate(long size, int stripes,
+    HashCompare c, HashProc h, HashFree f)
+{
+    ConcurrentHash * ch = MEM_New(ConcurrentHash);
+    if (ch) {
+        int n = 1;
+        if (stripes <= 0) stripes = DEFAULT_STRIPES;
+        while (n < stripes && n < MAX_STRIPES) n *= 2;
+        ch->hasher = (h ? h : hashDefaultHashProc);
+        ch->mask = n - 1;
+        ch->stripes = MEM_NewArray(HashStripe,n);
+        if (ch->stripes) {
+            int i;
+            for (i=0; i<n; i++) {
+                HashStripe * s = ch->stripes + i;
+                if (!MUTEX_Init(&s->lock)) {
+                    break;
+                } else if (!HASH_Init(&s->table, size/n, c, h, f)) {
+                    MUTEX_Destroy(&s->lock);
+                    break;
+                }
+            }
+            if (i == n) {
+                return ch;
+            }
+            HASH_ConcurrentDestroy(ch->stripes, i);
+            MEM_Free(ch->stripes);
+        }
+        MEM_Free(ch);
+    }
+    return NULL;
+}
+
+/**
+ * Deletes the concurrent hash table. No other thread may be using it.
+ */
+void HASH_ConcurrentDelete(ConcurrentHash * ch)
+{
+    if (ch) {
+        HASH_ConcurrentDestroy(ch->stripes, ch->mask + 1);
+        MEM_Free(ch->stripes);
+        MEM_Free(ch);
+    }
+}
+
+/**
+ * Removes everything from the table, one stripe at a time.
+ */
+void HASH_ConcurrentClear(ConcurrentHash * ch)
+{
+    int i;
+    for (i=0; i<=ch->mask; i++) {
+        HashStripe * s = ch->stripes + i;
+        if (MUTEX_Lock(&s->lock)) {
+            HASH_Clear(&s->table);
+            MUTEX_Unlock(&s->lock);
+        }
+    }
+}
+
+/**
+ * Returns the number of entries in the table. There's no global counter
+ * which all the writers would have to update, the stripe counts are
+ * added up one stripe at a time, each under the stripe lock. The result
+ * is exact only while no thread is modifying the table.
+ */
+long HASH_ConcurrentSize(const ConcurrentHash * ch)
+{
+    int i;
+    long size = 0;
+    for (i=0; i<=ch->mask; i++) {
+        HashStripe * s = ch->stripes + i;
+        if (MUTEX_Lock(&s->lock)) {
+            size += HASH_Size(&s->table);
+            MUTEX_Unlock(&s->lock);
+        }
+    }
+    return size;
+}
+
+/**
+ * Puts a key/value pair into the table. Same semantics as HASH_Put.
+ * Returns False if memory allocation fails.
+ */
+Bool HASH_ConcurrentPut(ConcurrentHash * ch, HashKey key, HashValue value)
+{
+    Bool ok = False;
+    HashStripe * s = HASH_ConcurrentStripe(ch, key);
+    if (MUTEX_Lock(&s->lock)) {
+        ok = HASH_Put(&s->table, key, value);
+        MUTEX_Unlock(&s->lock);
+    }
+    return ok;
+}
+
+/**
+ * Puts a key/value pair into the table unless the key is already there.
+ * Returns True if the pair has been added, False if the key was already
+ * in the table or memory allocation fails.
+ */
+Bool HASH_ConcurrentPutIfAbsent(ConcurrentHash * ch, HashKey k, HashValue v)
+{
+    Bool ok = False;
+    HashStripe * s = HASH_ConcurrentStripe(ch, k);
+    if (MUTEX_Lock(&s->lock)) {
+        if (!HASH_Contains(&s->table, k)) {
+            ok = HASH_Put(&s->table, k, v);
+        }
+        MUTEX_Unlock(&s->lock);
+    }
+    return ok;
+}
+
+/**
+ * Atomically updates the value associated with the key. The callback
+ * receives the current value, or nullValue if the key is not in the
+ * table. If the callback returns True, the value it has stored is put
+ * into the table the same way HASH_Put does it: the key replaces the
+ * existing one, and if the value has changed, the old key and value
+ * are passed to the HashFree callback. Otherwise the entry is removed
+ * (and deallocated). Returns False if memory allocation fails.
+ */
+Bool HASH_ConcurrentCompute(ConcurrentHash * ch, HashKey key,
+    HashCompute cb, void * ctx)
+{
+    Bool ok = False;
+    HashStripe * s = HASH_ConcurrentStripe(ch, key);
+    if (MUTEX_Lock(&s->lock)) {
+        HashTable * ht = &s->table;
+        const Bool found = HASH_Contains(ht, key);
+        HashValue value = (found ? HASH_Get(ht, key) : ht->nullValue);
+        if ((*cb)(key, &value, ctx)) {
+            ok = HASH_Put(ht, key, value);
+        } else {
+            if (found) HASH_Remove(ht, key);
+            ok = True;
+        }
+        MUTEX_Unlock(&s->lock);
+    }
+    return ok;
+}
+
+/**
+ * Gets the value associated with the key. If there's no such key,
+ * returns nullValue.
+ */
+HashValue HASH_ConcurrentGet(ConcurrentHash * ch, HashKeyC key)
+{
+    HashValue value = NULL_VALUE;
+    HashStripe * s = HASH_ConcurrentStripe(ch, key);
+    if (MUTEX_Lock(&s->lock)) {
+        value = HASH_Get(&s->table, key);
+        MUTEX_Unlock(&s->lock);
+    }
+    return value;
+}
+
+/**
+ * Returns True if the table contains the key.
+ */
+Bool HASH_ConcurrentContains(ConcurrentHash * ch, HashKeyC key)
+{
+    Bool found = False;
+    HashStripe * s = HASH_ConcurrentStripe(ch, key);
+    if (MUTEX_Lock(&s->lock)) {
+        found = HASH_Contains(&s->table, key);
+        MUTEX_Unlock(&s->lock);
+    }
+    return found;
+}
+
+/**
+ * Removes the key/value pair from the table.
+ * Returns True if the key was found and removed.
+ */
+Bool HASH_ConcurrentRemove(ConcurrentHash * ch, HashKeyC key)
+{
+    Bool removed = False;
+    HashStripe * s = HASH_ConcurrentStripe(ch, key);
+    if (MUTEX_Lock(&s->lock)) {
+        removed = HASH_Remove(&s->table, key);
+        MUTEX_Unlock(&s->lock);
+    }
+    return removed;
+}
+
+/**
+ * Examines the table one stripe at a time, with the stripe locked.
+ * Same semantics as HASH_Examine, except that the callback may not
+ * remove anything. The entries added or removed by other threads
+ * during the examination may or may not be seen by the callback.
+ */
+Bool HASH_ConcurrentExamine(ConcurrentHash * ch, HashCB cb, void * ctx)
+{
+    int i;
+    Bool ok = True;
+    for (i=0; i<=ch->mask && ok; i++) {
+        HashStripe * s = ch->stripes + i;
+        if (MUTEX_Lock(&s->lock)) {
+            ok = HASH_Examine(&s->table, cb, ctx);
+            MUTEX_Unlock(&s->lock);
+        }
+    }
+    return ok;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,739 @@
+/*
+ * $Id: s_hashf.c,v 1.1 2026/10/18 19:12:40 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "s_hash.h"
+#include "s_mem.h"
+#include "s_itrp.h"
+
+/*
+ * Control bytes are matched 16 at a time with SSE2 on x86 and NEON on
+ * 64-bit ARM. Both produce the same mask, one bit per control byte.
+ * Other platforms (and NT kernel, where vector registers are not saved
+ * across context switches) use the scalar implementation.
+ */
+#if !defined(_NT_KERNEL) && !defined(FLAT_NO_SIMD)
+#  if defined(__SSE2__) || defined(_M_X64) || \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define FLAT_SSE2
+#    include <emmintrin.h>
+#  elif defined(__aarch64__) && defined(__ARM_NEON)
+#    define FLAT_NEON
+#    include <arm_neon.h>
+#  endif
+#endif
+
+/*==========================================================================*
+ *              F L A T    H A S H    T A B L E
+ *==========================================================================*/
+
+/*
+ * Open addressing hash table. Each slot has a control byte, which is
+ * either FLAT_EMPTY, FLAT_DELETED or (for occupied slots) the lower 7
+ * bits of the hash code. Lookups examine a group of FLAT_GROUP control
+ * bytes at a time, and only call the compare function for the slots
+ * whose control byte and cached hash code match. The capacity is a power
+ * of two, groups may start at any slot and wrap around the end of the
+ * table. To avoid checking for the wrap around, the first FLAT_GROUP
+ * control bytes are duplicated past the end of the control array.
+ *
+ * Removal leaves a tombstone (FLAT_DELETED) in the slot unless it can
+ * be proven that no probe sequence has ever passed through that slot.
+ * Tombstones are purged when the table gets rehashed.
+ */
+#define FLAT_GROUP      16          /* number of control bytes in a group */
+#define FLAT_MIN_SIZE   FLAT_GROUP  /* minimum capacity */
+#define FLAT_EMPTY      ((I8s)-128) /* the slot has never been used */
+#define FLAT_DELETED    ((I8s)-2)   /* the slot is a tombstone */
+
+/* Maximum number of used (full or deleted) slots, 7/8 of the capacity */
+#define FLAT_MaxUsed(_cap) ((_cap) - (_cap)/8)
+
+#define FLAT_H1(_hash) ((_hash) >> 7)
+#define FLAT_H2(_hash) ((I8s)((_hash) & 0x7f))
+
+/* Bit i is set if i-th control byte in the group matches */
+typedef unsigned int FlatMask;
+
+struct _FlatSlot {
+    HashKey   key;
+    HashValue value;
+    I32u      hash;                 /* cached (mixed) hash code */
+};
+
+/* Iterators */
+STATIC IElement HASH_FlatItrNextKey P_((Iterator * itr));
+STATIC IElement HASH_FlatItrNextValue P_((Iterator * itr));
+STATIC IElement HASH_FlatItrNextEntry P_((Iterator * itr));
+STATIC Bool HASH_FlatItrHasNext P_((Iterator * itr));
+STATIC Bool HASH_FlatItrRemove P_((Iterator * itr));
+STATIC void HASH_FlatItrFree P_((Iterator * itr));
+
+typedef struct _FlatIterator {
+    Iterator itr;           /* common part */
+    FlatHash * ht;          /* the hash table we are iterating through */
+    long current;           /* index of the current slot */
+    long next;              /* index of the next slot, -1 if none */
+    HashEntry entry;        /* the entry to return */
+} FlatIterator;
+
+STATIC const Itr flatKeyIterator = {
+    TEXT("FlatKey"),        /* name     */
+    HASH_FlatItrHasNext,    /* hasNext  */
+    HASH_FlatItrNextKey,    /* next     */
+    HASH_FlatItrRemove,     /* remove   */
+    NULL,                   /* destroy  */
+    HASH_FlatItrFree        /* free     */
+};
+
+STATIC const Itr flatValueIterator = {
+    TEXT("FlatValue"),      /* name     */
+    HASH_FlatItrHasNext,    /* hasNext  */
+    HASH_FlatItrNextValue,  /* next     */
+    HASH_FlatItrRemove,     /* remove   */
+    NULL,                   /* destroy  */
+    HASH_FlatItrFree        /* free     */
+};
+
+STATIC const Itr flatEntryIterator = {
+    TEXT("FlatEntry"),      /* name     */
+    HASH_FlatItrHasNext,    /* hasNext  */
+    HASH_FlatItrNextEntry,  /* next     */
+    HASH_FlatItrRemove,     /* remove   */
+    NULL,                   /* destroy  */
+    HASH_FlatItrFree        /* free     */
+};
+
+/**
+ * Returns the number of trailing zero bits in a non-zero mask.
+ */
+STATIC int HASH_FlatLowBit(FlatMask m)
+{
+    ASSERT(m);
+#ifdef __GNUC__
+    return __builtin_ctz(m);
+#else
+    {
+        int n = 0;
+        while (!(m & 1)) {
+            m >>= 1;
+            n++;
+        }
+        return n;
+    }
+#endif
+}
+
+/**
+ * Returns the number of leading zero bits in a FLAT_GROUP-bit mask.
+ */
+STATIC int HASH_FlatHighZeros(FlatMask m)
+{
+#ifdef __GNUC__
+    return m ? (__builtin_clz(m) - (int)(sizeof(m)*8 - FLAT_GROUP)) :
+        FLAT_GROUP;
+#else
+    int n = 0;
+    FlatMask bit = 1U << (FLAT_GROUP - 1);
+    while (bit && !(m & bit)) {
+        bit >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+#ifdef FLAT_NEON
+/**
+ * Converts the result of NEON comparison (each byte is either 0xff
+ * or zero) into a bit mask. There's no movemask on ARM, each byte gets
+ * masked with its bit and the bytes are added up in each half.
+ */
+STATIC FlatMask HASH_FlatNeonMask(uint8x16_t v)
+{
+    static const I8u bits[FLAT_GROUP] = {
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80
+    };
+    const uint8x16_t m = vandq_u8(v, vld1q_u8(bits));
+    return (FlatMask)vaddv_u8(vget_low_u8(m)) |
+        ((FlatMask)vaddv_u8(vget_high_u8(m)) << 8);
+}
+#endif /* FLAT_NEON */
+
+/**
+ * Returns the mask of control bytes equal to h2.
+ */
+STATIC FlatMask HASH_FlatMatch(const I8s * g, I8s h2)
+{
+#if defined(FLAT_SSE2)
+    const __m128i ctrl = _mm_loadu_si128((const __m128i*)g);
+    return (FlatMask)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl,_mm_set1_epi8(h2)));
+#elif defined(FLAT_NEON)
+    const int8x16_t ctrl = vld1q_s8(g);
+    return HASH_FlatNeonMask(vceqq_s8(ctrl, vdupq_n_s8(h2)));
+#else
+    int i;
+    FlatMask m = 0;
+    for (i=0; i<FLAT_GROUP; i++) {
+        if (g[i] == h2) m |= (1U << i);
+    }
+    return m;
+#endif
+}
+
+/**
+ * Returns the mask of empty slots.
+ */
+STATIC FlatMask HASH_FlatMatchEmpty(const I8s * g)
+{
+    return HASH_FlatMatch(g, FLAT_EMPTY);
+}
+
+/**
+ * Returns the mask of empty and deleted slots. Those are the ones
+ * with the sign bit set.
+ */
+STATIC FlatMask HASH_FlatMatchFree(const I8s * g)
+{
+#if defined(FLAT_SSE2)
+    return (FlatMask)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)g));
+#elif defined(FLAT_NEON)
+    return HASH_FlatNeonMask(vcltzq_s8(vld1q_s8(g)));
+#else
+    int i;
+    FlatMask m = 0;
+    for (i=0; i<FLAT_GROUP; i++) {
+        if (g[i] < 0) m |= (1U << i);
+    }
+    return m;
+#endif
+}
+
+/**
+ * Hash function supplied by the user doesn't have to be good. Mixes
+ * the bits so that both H1 and H2 depend on all bits of the hash code.
+ */
+STATIC I32u HASH_FlatHash(const FlatHash * ht, HashKeyC key)
+{
+    I32u h = (I32u)ht->hasher(key);
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+/**
+ * Sets the control byte, and its copy past the end of the array.
+ */
+STATIC void HASH_FlatSetCtrl(FlatHash * ht, long i, I8s c)
+{
+    ht->ctrl[i] = c;
+    if (i < FLAT_GROUP) ht->ctrl[ht->capacity + i] = c;
+}
+
+/**
+ * Returns the index of the slot containing the key, -1 if there's none.
+ */
+STATIC long HASH_FlatFind(const FlatHash * ht, HashKeyC key, I32u hash)
+{
+    if (ht->count > 0) {
+        const long mask = ht->capacity - 1;
+        const I8s h2 = FLAT_H2(hash);
+        long pos = FLAT_H1(hash) & mask;
+        long step = 0;
+        for (;;) {
+            const I8s * g = ht->ctrl + pos;
+            FlatMask m = HASH_FlatMatch(g, h2);
+            while (m) {
+                const long i = (pos + HASH_FlatLowBit(m)) & mask;
+                const FlatSlot * s = ht->slots + i;
+                if (s->hash == hash && ht->equals(key, s->key)) {
+                    return i;
+                }
+                m &= m - 1;
+            }
+            if (HASH_FlatMatchEmpty(g)) {
+                return -1;
+            }
+
+            /* triangular probing visits each group exactly once */
+            step += FLAT_GROUP;
+            pos = (pos + step) & mask;
+            ASSERT(step <= ht->capacity);
+        }
+    }
+    return -1;
+}
+
+/**
+ * Returns the index of the first free (empty or deleted) slot in the
+ * probe sequence for the specified hash code. There's always one.
+ */
+STATIC long HASH_FlatFindFree(const FlatHash * ht, I32u hash)
+{
+    const long mask = ht->capacity - 1;
+    long pos = FLAT_H1(hash) & mask;
+    long step = 0;
+    for (;;) {
+        FlatMask m = HASH_FlatMatchFree(ht->ctrl + pos);
+        if (m) {
+            return (pos + HASH_FlatLowBit(m)) & mask;
+        }
+        step += FLAT_GROUP;
+        pos = (pos + step) & mask;
+        ASSERT(step <= ht->capacity);
+    }
+}
+
+/**
+ * Stores the key/value pair in a free slot. The table must have room.
+ */
+STATIC void HASH_FlatInsert(FlatHash * ht, HashKey k, HashValue v, I32u hash)
+{
+    const long i = HASH_FlatFindFree(ht, hash);
+    FlatSlot * s = ht->slots + i;
+    if (ht->ctrl[i] == FLAT_DELETED) ht->deleted--;
+    HASH_FlatSetCtrl(ht, i, FLAT_H2(hash));
+    s->key = k;
+    s->value = v;
+    s->hash = hash;
+    ht->count++;
+}
+
+/**
+ * Marks the slot as free. The slot can be marked empty rather than
+ * deleted if there's no window of FLAT_GROUP consecutive non-empty
+ * slots containing this slot, because no probe could have passed it.
+ */
+STATIC void HASH_FlatErase(FlatHash * ht, long i)
+{
+    const long mask = ht->capacity - 1;
+    const FlatMask before = HASH_FlatMatchEmpty(ht->ctrl+((i-FLAT_GROUP)&mask));
+    const FlatMask after = HASH_FlatMatchEmpty(ht->ctrl + i);
+    if (before && after && (HASH_FlatHighZeros(before) +
+        HASH_FlatLowBit(after)) < FLAT_GROUP) {
+        HASH_FlatSetCtrl(ht, i, FLAT_EMPTY);
+    } else {
+        HASH_FlatSetCtrl(ht, i, FLAT_DELETED);
+        ht->deleted++;
+    }
+    ht->count--;
+    ASSERT(ht->count >= 0);
+}
+
+/**
+ * Returns the capacity suitable for holding the specified number of
+ * entries.
+ */
+STATIC long HASH_FlatCapacity(long size)
+{
+    long cap = FLAT_MIN_SIZE;
+    while (FLAT_MaxUsed(cap) <= size && cap < (LONG_MAX/2)) cap *= 2;
+    return cap;
+}
+
+/**
+ * Switches to the new capacity, reusing the cached hash codes. Deleted
+ * slots are gone after that. Returns False if memory allocation fails.
+ */
+STATIC Bool HASH_FlatResize(FlatHash * ht, long cap)
+{
+    const size_t size = sizeof(FlatSlot)*cap + cap + FLAT_GROUP;
+    FlatSlot * slots = (FlatSlot*)MEM_Alloc(size);
+    if (slots) {
+        long i;
+        const long oldcap = ht->capacity;
+        FlatSlot * old = ht->slots;
+        const I8s * oldctrl = ht->ctrl;
+
+        ht->slots = slots;
+        ht->ctrl = (I8s*)(slots + cap);
+        ht->capacity = cap;
+        ht->count = 0;
+        ht->deleted = 0;
+        memset(ht->ctrl, FLAT_EMPTY, cap + FLAT_GROUP);
+
+        for (i=0; i<oldcap; i++) {
+            if (oldctrl[i] >= 0) {
+                const FlatSlot * s = old + i;
+                HASH_FlatInsert(ht, s->key, s->value, s->hash);
+            }
+        }
+        MEM_Free(old);
+        return True;
+    }
+    return False;
+}
+
+/**
+ * Makes room for one more entry. Returns False if memory allocation fails.
+ */
+STATIC Bool HASH_FlatReserve(FlatHash * ht)
+{
+    if ((ht->count + ht->deleted) < FLAT_MaxUsed(ht->capacity)) {
+        return True;
+    } else if (ht->deleted > ht->capacity/4) {
+        /* mostly tombstones, rehash in place */
+        return HASH_FlatResize(ht, ht->capacity);
+    } else {
+        return HASH_FlatResize(ht, HASH_FlatCapacity(ht->count + 1));
+    }
+}
+
+/**
+ * Creates new flat hash table.
+ * Returns NULL if memory allocation fails.
+ */
+FlatHash * HASH_FlatCreate(long size, HashCompare c, HashProc h, HashFree f)
+{
+    FlatHash * ht = MEM_New(FlatHash);
+    if (ht) {
+        if (!HASH_FlatInit(ht, size, c, h, f)) {
+            MEM_Free(ht);
+            ht = NULL;
+        }
+    }
+    return ht;
+}
+
+/**
+ * Initialize the flat hashtable. Memory is allocated upfront if the
+ * expected size is positive, otherwise on the first put. Returns False
+ * if it fails to allocate memory or if hashtable pointer is NULL.
+ */
+Bool HASH_FlatInit(FlatHash * ht,long n,HashCompare c,HashProc h,HashFree f)
+{
+    if (ht) {
+        memset(ht, 0, sizeof(*ht));
+        ht->nullValue = NULL_VALUE;
+        ht->hasher = (h ? h : hashDefaultHashProc);
+        ht->equals = (c ? c : hashDefaultCompare);
+        ht->free = (f ? f : hashFreeNothingProc);
+        return (n > 0) ? HASH_FlatResize(ht, HASH_FlatCapacity(n)) : True;
+    }
+    return False;
+}
+
+/**
+ * Destroy contents of the flat hash table.
+ */
+void HASH_FlatDestroy(FlatHash * ht)
+{
+    HASH_FlatClear(ht);
+    MEM_Free(ht->slots);
+    ht->slots = NULL;
+    ht->ctrl = NULL;
+    ht->capacity = 0;
+}
+
+/**
+ * Delete the flat hash table.
+ */
+void HASH_FlatDelete(FlatHash * ht)
+{
+    if (ht) {
+        HASH_FlatDestroy(ht);
+        MEM_Free(ht);
+    }
+}
+
+/**
+ * Removes everything from the flat hash table. Doesn't deallocate memory.
+ */
+void HASH_FlatClear(FlatHash * ht)
+{
+    if (ht->count > 0) {
+        long i;
+        for (i=0; i<ht->capacity; i++) {
+            if (ht->ctrl[i] >= 0) {
+                ht->free(ht->slots[i].key, ht->slots[i].value);
+            }
+        }
+    }
+    if (ht->capacity > 0) {
+        memset(ht->ctrl, FLAT_EMPTY, ht->capacity + FLAT_GROUP);
+    }
+    ht->count = 0;
+    ht->deleted = 0;
+}
+
+/**
+ * Returns number of values stored in the flat hashtable.
+ */
+long HASH_FlatSize(const FlatHash * ht)
+{
+    return ht->count;
+}
+
+/**
+ * Rehashes the table so that it can hold at least the suggested number
+ * of entries without rehashing. Doesn't call the hash function.
+ */
+void HASH_FlatRehash(FlatHash * ht, long size)
+{
+    const long cap = HASH_FlatCapacity(MAX(size, ht->count));
+    if (cap > ht->capacity || (cap < ht->capacity/2) || ht->deleted) {
+        HASH_FlatResize(ht, cap);
+    }
+}
+
+/**
+ * Puts a key/value pair into the flat hash table. Same semantics as
+ * HASH_Put. Returns True on success, False if memory allocation fails.
+ */
+Bool HASH_FlatPut(FlatHash * ht, HashKey key, HashValue value)
+{
+    const I32u hash = HASH_FlatHash(ht, key);
+    const long i = HASH_FlatFind(ht, key, hash);
+    if (i >= 0) {
+        FlatSlot * s = ht->slots + i;
+        if (s->value != value) {
+            ht->free(s->key, s->value);
+        }
+        s->key = key;
+        s->value = value;
+        return True;
+    } else if (HASH_FlatReserve(ht)) {
+        HASH_FlatInsert(ht, key, value, hash);
+        return True;
+    }
+    return False;
+}
+
+/**
+ * Updates the value associated with the existing key, doesn't replace
+ * the key. Returns False if the specified key is not present in the table.
+ */
+Bool HASH_FlatUpdate(FlatHash * ht, HashKey key, HashValue value)
+{
+    if (ht->count > 0) {
+        const long i = HASH_FlatFind(ht, key, HASH_FlatHash(ht, key));
+        if (i >= 0) {
+            ht->slots[i].value = value;
+            return True;
+        }
+    }
+    return False;
+}
+
+/**
+ * Gets a value from the flat hash table for the specified key.
+ * If such key does not exist in this hashtable, returns nullValue
+ */
+HashValue HASH_FlatGet(const FlatHash * ht, HashKeyC key)
+{
+    if (ht->count > 0) {
+        const long i = HASH_FlatFind(ht, key, HASH_FlatHash(ht, key));
+        if (i >= 0) {
+            return ht->slots[i].value;
+        }
+    }
+    return ht->nullValue;
+}
+
+/**
+ * Returns True if the flat hashtable contains the specified key
+ */
+Bool HASH_FlatContains(const FlatHash * ht, HashKeyC key)
+{
+    return BoolValue(ht->count > 0 &&
+        HASH_FlatFind(ht, key, HASH_FlatHash(ht, key)) >= 0);
+}
+
+/**
+ * Removes key/value pair from the flat hashtable.
+ * Returns True if key was found, and value was removed from hashtable.
+ */
+Bool HASH_FlatRemove(FlatHash * ht, HashKeyC key)
+{
+    if (ht->count > 0) {
+        const long i = HASH_FlatFind(ht, key, HASH_FlatHash(ht, key));
+        if (i >= 0) {
+            HashKey k = ht->slots[i].key;
+            HashValue v = ht->slots[i].value;
+            HASH_FlatErase(ht, i);
+            ht->free(k, v);
+            return True;
+        }
+    }
+    return False;
+}
+
+/**
+ * Examines the flat hash table, calling callback function on each entry.
+ * Same semantics as HASH_Examine. The callback is allowed to remove the
+ * current element.
+ */
+Bool HASH_FlatExamine(const FlatHash * ht, HashCB cb, void * ctx)
+{
+    if (ht && ht->count > 0) {
+        long i;
+        for (i=0; i<ht->capacity; i++) {
+            if (ht->ctrl[i] >= 0) {
+                const FlatSlot * s = ht->slots + i;
+                if (!(*cb)(s->key, s->value, ctx)) return False;
+            }
+        }
+    }
+    return True;
+}
+
+/*==========================================================================*
+ *              I T E R A T O R S
+ *==========================================================================*/
+
+/**
+ * Returns the index of the first occupied slot at or after pos,
+ * -1 if there's none.
+ */
+STATIC long HASH_FlatNextFull(const FlatHash * ht, long pos)
+{
+    while (pos < ht->capacity) {
+        if (ht->ctrl[pos] >= 0) return pos;
+        pos++;
+    }
+    return -1;
+}
+
+/**
+ * Helper for creating flat hash table iterators
+ */
+STATIC Iterator * HASH_FlatIterator(FlatHash * ht, const Itr * type)
+{
+    if (ht->count == 0) {
+        return ITR_Empty();
+    } else {
+        FlatIterator * fi = MEM_New(FlatIterator);
+        if (fi) {
+            ITR_Init(&fi->itr, type);
+            fi->ht = ht;
+            fi->current = -1;
+            fi->next = HASH_FlatNextFull(ht, 0);
+            memset(&fi->entry, 0, sizeof(fi->entry));
+            return &fi->itr;
+        } else {
+            return NULL;
+        }
+    }
+}
+
+/**
+ * Creates an iterator that returns HashKey
+ */
+Iterator * HASH_FlatKeys(FlatHash * ht)
+{
+    return HASH_FlatIterator(ht, &flatKeyIterator);
+}
+
+/**
+ * Creates an iterator that returns HashValue
+ */
+Iterator * HASH_FlatValues(FlatHash * ht)
+{
+    return HASH_FlatIterator(ht, &flatValueIterator);
+}
+
+/**
+ * Creates an iterator that returns pointers to HashEntry
+ */
+Iterator * HASH_FlatEntries(FlatHash * ht)
+{
+    return HASH_FlatIterator(ht, &flatEntryIterator);
+}
+
+/**
+ * Advances the iterator, returns the current slot
+ */
+STATIC const FlatSlot * HASH_FlatItrAdvance(FlatIterator * fi)
+{
+    fi->current = fi->next;
+    fi->next = HASH_FlatNextFull(fi->ht, fi->next + 1);
+    return fi->ht->slots + fi->current;
+}
+
+STATIC IElement HASH_FlatItrNextKey(Iterator * itr)
+{
+    FlatIterator * fi = CAST(itr,FlatIterator,itr);
+    return HASH_FlatItrAdvance(fi)->key;
+}
+
+STATIC IElement HASH_FlatItrNextValue(Iterator * itr)
+{
+    FlatIterator * fi = CAST(itr,FlatIterator,itr);
+    return HASH_FlatItrAdvance(fi)->value;
+}
+
+STATIC IElement HASH_FlatItrNextEntry(Iterator * itr)
+{
+    FlatIterator * fi = CAST(itr,FlatIterator,itr);
+    const FlatSlot * s = HASH_FlatItrAdvance(fi);
+    fi->entry.key = s->key;
+    fi->entry.value = s->value;
+    return &fi->entry;
+}
+
+STATIC Bool HASH_FlatItrHasNext(Iterator * itr)
+{
+    FlatIterator * fi = CAST(itr,FlatIterator,itr);
+    return BoolValue(fi->next >= 0);
+}
+
+STATIC Bool HASH_FlatItrRemove(Iterator * itr)
+{
+    FlatIterator * fi = CAST(itr,FlatIterator,itr);
+    FlatHash * ht = fi->ht;
+    if (ht->ctrl[fi->current] >= 0) {
+        HashKey k = ht->slots[fi->current].key;
+        HashValue v = ht->slots[fi->current].value;
+        HASH_FlatErase(ht, fi->current);
+        ht->free(k, v);
+        return True;
+    }
+    ASSMSG("Concurrent hash table modification?");
+    fi->next = -1;
+    return False;
+}
+
+STATIC void HASH_FlatItrFree(Iterator * itr)
+{
+    FlatIterator * fi = CAST(itr,FlatIterator,itr);
+    MEM_Free(fi);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -45,6 +45,7 @@ void SLIB_InitModules()
 #endif /* __KERNEL__ */
     HASH_InitModule();
     RANDOM_InitModule();
+    FILE_InitModule();
 }
 
 /**
@@ -52,6 +53,7 @@ void SLIB_InitModules()
  */
 void SLIB_Shutdown()
 {
+    FILE_Shutdown();
     RANDOM_Shutdown();
     HASH_Shutdown();
 #ifndef __KERNEL__
@@ -71,6 +71,31 @@ void DIGEST_Update(Digest * d, const void * data, size_t size)
     d->type->update(d, data, size);
 }
 
+/**
+ * Updates the digest with the data read from the stream until the end
+ * of the stream. Memory resident streams are digested in place. Returns
+ * False on I/O error.
+ */
+Bool DIGEST_UpdateFile(Digest * d, File * in)
+{
+    const void * data;
+    size_t size;
+    if (FILE_MapView(in, &data, &size)) {
+        if (size > 0) {
+            DIGEST_Update(d, data, size);
+            return FILE_Consume(in, size);
+        }
+        return True;
+    } else {
+        int n;
+        I8u buf[1024];
+        while ((n = FILE_Read(in, buf, sizeof(buf))) > 0) {
+            DIGEST_Update(d, buf, n);
+        }
+        return BoolValue(n == 0);
+    }
+}
+
 /**
  * Finish the digest and return the result. The size of the output buffer
  * must not be less than the value returned by the DIGEST_Size function.
@@ -29,6 +29,10 @@
  * any official policies, either expressed or implied.
  */
 
+#if defined(__linux__) && !defined(__KERNEL__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE   /* for recvmmsg and sendmmsg */
+#endif
+
 #ifdef _WIN32
 /* IPv6 stuff requires Winsock2 */
 #  include <winsock2.h>
@@ -37,14 +41,20 @@
 
 #include "s_lib.h"
 
-/* Unix ioctl definitions are needed by SOCKET_Block */
+/* Unix ioctl definitions are needed by SOCKET_Block, poll() by SOCKET_Wait */
 #ifdef _UNIX
 #  ifdef __sun
 #    define BSD_COMP /* to define FIONBIO on Solaris */
 #  endif /* __sun */
 #  include <sys/ioctl.h>
+#  include <poll.h>
 #endif /* _UNIX */
 
+/* Batched datagram I/O (Linux) */
+#if defined(__linux__) && !defined(__KERNEL__)
+#  define HAVE_RECVMMSG
+#endif /* __linux__ && !__KERNEL__ */
+
 /* Error codes set by asynchronous connect() call */
 #ifdef _WIN32
 #  define CONNECT_INPROGRESS WSAEWOULDBLOCK
@@ -230,11 +240,106 @@ Bool SOCKET_Block(Socket s, Bool block)
     }
 }
 
+/**
+ * Creates a TCP socket listening on the specified address and port.
+ * SOCK_LISTEN_REUSEPORT flag allows several sockets to listen on the same
+ * port (if the system supports that), so that the kernel can distribute
+ * the incoming connections between them. Note that both port and IP
+ * address are assumed to be in host byte order.
+ */
+Bool SOCKET_Listen(IPaddr addr, Port port, int backlog, int flags,
+                   Socket * sock)
+{
+    ASSERT(sock);
+    if (sock) {
+        Socket s;
+        *sock = INVALID_SOCKET;
+        if (SOCKET_New(SOCK_STREAM, &s)) {
+            int on = 1;
+            setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (char*)&on, sizeof(on));
+#ifdef SO_REUSEPORT
+            if (flags & SOCK_LISTEN_REUSEPORT) {
+                setsockopt(s,SOL_SOCKET,SO_REUSEPORT,(char*)&on,sizeof(on));
+            }
+#else  /* !SO_REUSEPORT */
+            UNREF(flags);
+#endif /* !SO_REUSEPORT */
+            if (SOCKET_Bind(s, addr, port)) {
+                if (listen(s, (backlog > 0) ? backlog : SOMAXCONN) == 0) {
+                    *sock = s;
+                    return True;
+                }
+                Error(TEXT("ERROR: listen failed, error %d\n"),
+                    SOCKET_GetLastError());
+            }
+            SOCKET_Close(s);
+        }
+    }
+    return False;
+}
+
+/**
+ * Returns the local port (in host byte order) the socket is bound to,
+ * zero on failure. Useful when the socket has been bound to port zero
+ * and the system has picked the port.
+ */
+Port SOCKET_GetPort(Socket s)
+{
+    struct sockaddr_in sa;
+    socklen_t len = sizeof(sa);
+    memset(&sa, 0, sizeof(sa));
+    if (getsockname(s, (struct sockaddr*)&sa, &len) == 0 &&
+        sa.sin_family == AF_INET) {
+        return ntohs(sa.sin_port);
+    }
+    return 0;
+}
+
 /**
  * Waits for something to happen with the socket. Returns the mask
- * which indicates what really happened, zero if select() timed out
+ * which indicates what really happened, zero if the wait timed out
  * and -1 in case of error
  */
+#ifdef _UNIX
+
+/*
+ * Unlike select(), poll() doesn't have problems with descriptors
+ * above FD_SETSIZE
+ */
+int SOCKET_Wait(Socket s, int mask, Time timeout)
+{
+    int nfd;
+    struct pollfd pfd;
+
+    /* at least one bit must be set */
+    ASSERT(mask);
+    pfd.fd = s;
+    pfd.events = 0;
+    pfd.revents = 0;
+    if (mask & SOCK_WAIT_READ) pfd.events |= POLLIN;
+    if (mask & SOCK_WAIT_WRITE) pfd.events |= POLLOUT;
+    if (mask & SOCK_WAIT_EXCEPT) pfd.events |= POLLPRI;
+
+    /* actually wait */
+    nfd = poll(&pfd, 1, (timeout > 0) ? (int)MIN(timeout,INT_MAX) : (-1));
+    if (nfd > 0) {
+        int result = 0;
+        const short err = (POLLERR | POLLHUP | POLLNVAL);
+
+        /* select() reports errors as readability or writability */
+        if (pfd.revents & (POLLIN | err)) result |= SOCK_WAIT_READ;
+        if (pfd.revents & (POLLOUT | err)) result |= SOCK_WAIT_WRITE;
+        if (pfd.revents & POLLPRI) result |= SOCK_WAIT_EXCEPT;
+        result &= mask;
+        if (!result) result = mask;
+        return result;
+    }
+
+    return nfd;
+}
+
+#else /* !_UNIX */
+
 int SOCKET_Wait(Socket s, int mask, Time timeout)
 {
     int nfd;
@@ -309,12 +414,223 @@ int SOCKET_Wait(Socket s, int mask, Time timeout)
     return nfd;
 }
 
+#endif /* !_UNIX */
+
+/*==========================================================================*
+ *              D A T A G R A M S
+ *==========================================================================*/
+
+/* Max number of datagrams passed to the system in one call */
+#define SOCK_BATCH_SIZE 32
+
+/**
+ * Clears the datagram buffer and reserves up to max bytes for the incoming
+ * datagram. Returns pointer to the reserved space, its size is returned
+ * in *size
+ */
+STATIC void * SOCKET_DgramReserve(Datagram * d, size_t max, size_t * size)
+{
+    Buffer * b = &d->buf;
+    BUFFER_Clear(b);
+    BUFFER_EnsureCapacity(b, max, True);
+    *size = MIN(b->alloc, max);
+    return BUFFER_Reserve(b, *size);
+}
+
+/* Length of the source address that has nothing but the family */
+#define SOCK_NOADDR_LEN (OFFSET(struct sockaddr_in,sin_family) + \
+                         FIELDSIZE(struct sockaddr_in,sin_family))
+
+/**
+ * Trims the datagram buffer to the size of the received datagram and
+ * stores the source address. Datagrams coming from an address other
+ * than IPv4 can't be represented by Datagram structure, those are
+ * dropped. Returns False if the datagram has been dropped.
+ */
+STATIC Bool SOCKET_DgramReceived(Datagram * d, size_t reserved, size_t len,
+    const struct sockaddr_in * from, socklen_t fromlen)
+{
+    if (fromlen >= sizeof(*from) && from->sin_family == AF_INET) {
+        d->addr = ntohl(from->sin_addr.s_addr);
+        d->port = ntohs(from->sin_port);
+    } else if (fromlen > (socklen_t)SOCK_NOADDR_LEN) {
+        BUFFER_Clear(&d->buf);
+        return False;
+    } else {
+        /* no source address, e.g. unnamed AF_UNIX socket */
+        d->addr = 0;
+        d->port = 0;
+    }
+    BUFFER_Unput(&d->buf, reserved - MIN(len, reserved));
+    return True;
+}
+
+/**
+ * Returns the destination address for the datagram, NULL if the datagram
+ * goes to the address the socket is connected to.
+ */
+STATIC struct sockaddr * SOCKET_DgramTarget(const Datagram * d,
+    struct sockaddr_in * to)
+{
+    return d->port ? SOCKET_InitAddrIn(to, d->addr, d->port) : NULL;
+}
+
+#ifdef HAVE_RECVMMSG
+
+/**
+ * Receives up to n datagrams. Waits for the first one (unless the socket
+ * is non-blocking) and then picks whatever else is already queued, without
+ * waiting. Each datagram replaces the contents of the respective buffer,
+ * the buffers are reused from call to call so that no allocation occurs
+ * in the steady state. Datagrams longer than max bytes are truncated,
+ * zero max means SOCK_MAX_DATAGRAM. Datagrams from addresses other than
+ * IPv4 are dropped. Buffers past the last received datagram may be
+ * cleared. Returns the number of received datagrams (zero if all of
+ * them have been dropped), -1 if nothing could be received.
+ */
+int SOCKET_RecvBatch(Socket s, Datagram * dgrams, int n, size_t max)
+{
+    int total = 0, received = 0;
+    struct mmsghdr msgs[SOCK_BATCH_SIZE];
+    struct iovec iov[SOCK_BATCH_SIZE];
+    struct sockaddr_in from[SOCK_BATCH_SIZE];
+    if (!max) max = SOCK_MAX_DATAGRAM;
+    while (total < n) {
+        Datagram * d = dgrams + total;
+        int i, k, w, batch = n - total;
+        if (batch > SOCK_BATCH_SIZE) batch = SOCK_BATCH_SIZE;
+        memset(msgs, 0, sizeof(msgs[0]) * batch);
+        for (i=0; i<batch; i++) {
+            iov[i].iov_base = SOCKET_DgramReserve(d+i, max, &iov[i].iov_len);
+            msgs[i].msg_hdr.msg_iov = iov + i;
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = from + i;
+            msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+        }
+
+        /* only the very first datagram is worth waiting for */
+        k = recvmmsg(s, msgs, batch, received ? MSG_DONTWAIT :
+            MSG_WAITFORONE, NULL);
+        for (i=0, w=0; i<batch; i++) {
+            if (i < k && SOCKET_DgramReceived(d+i, iov[i].iov_len,
+                msgs[i].msg_len, from+i, msgs[i].msg_hdr.msg_namelen)) {
+                /* move it over the dropped ones */
+                if (w < i) {
+                    Datagram tmp = d[w];
+                    d[w] = d[i];
+                    d[i] = tmp;
+                }
+                w++;
+            } else {
+                BUFFER_Clear(&d[i].buf);
+            }
+        }
+        if (k < 0) {
+            return received ? total : (-1);
+        }
+        received += k;
+        total += w;
+        if (k < batch) {
+            break;
+        }
+    }
+    return total;
+}
+
+/**
+ * Sends n datagrams, as many as possible per system call. Datagrams with
+ * zero port go to the address the socket is connected to. The buffers are
+ * not modified. Returns the number of datagrams sent, -1 if nothing could
+ * be sent.
+ */
+int SOCKET_SendBatch(Socket s, Datagram * dgrams, int n)
+{
+    int total = 0;
+    struct mmsghdr msgs[SOCK_BATCH_SIZE];
+    struct iovec iov[SOCK_BATCH_SIZE];
+    struct sockaddr_in to[SOCK_BATCH_SIZE];
+    while (total < n) {
+        Datagram * d = dgrams + total;
+        int i, k, batch = n - total;
+        if (batch > SOCK_BATCH_SIZE) batch = SOCK_BATCH_SIZE;
+        memset(msgs, 0, sizeof(msgs[0]) * batch);
+        for (i=0; i<batch; i++) {
+            iov[i].iov_base = BUFFER_Access(&d[i].buf);
+            iov[i].iov_len = BUFFER_Size(&d[i].buf);
+            msgs[i].msg_hdr.msg_iov = iov + i;
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            if (SOCKET_DgramTarget(d+i, to+i)) {
+                msgs[i].msg_hdr.msg_name = to + i;
+                msgs[i].msg_hdr.msg_namelen = sizeof(to[i]);
+            }
+        }
+        k = sendmmsg(s, msgs, batch, 0);
+        if (k < 0) {
+            return total ? total : (-1);
+        }
+        total += k;
+        if (k < batch) {
+            break;
+        }
+    }
+    return total;
+}
+
+#else /* !HAVE_RECVMMSG */
+
+/* Without MSG_DONTWAIT we can only safely receive one datagram per call */
+#ifdef MSG_DONTWAIT
+#  define SOCK_DONTWAIT MSG_DONTWAIT
+#else
+#  define SOCK_DONTWAIT 0
+#endif
+
+int SOCKET_RecvBatch(Socket s, Datagram * dgrams, int n, size_t max)
+{
+    int k, count = 0;
+    if (!max) max = SOCK_MAX_DATAGRAM;
+    for (k=0; k<n && (k == 0 || SOCK_DONTWAIT); k++) {
+        Datagram * d = dgrams + count;
+        struct sockaddr_in from;
+        socklen_t fromlen = sizeof(from);
+        size_t size;
+        char * buf = SOCKET_DgramReserve(d, max, &size);
+        int nbytes = recvfrom(s, buf, (int)size, k ? SOCK_DONTWAIT : 0,
+            (struct sockaddr*)&from, &fromlen);
+        if (nbytes < 0) {
+            BUFFER_Clear(&d->buf);
+            break;
+        }
+        if (SOCKET_DgramReceived(d, size, nbytes, &from, fromlen)) {
+            count++;
+        }
+    }
+    return k ? count : (-1);
+}
+
+int SOCKET_SendBatch(Socket s, Datagram * dgrams, int n)
+{
+    int k;
+    for (k=0; k<n; k++) {
+        Datagram * d = dgrams + k;
+        struct sockaddr_in to;
+        struct sockaddr * sa = SOCKET_DgramTarget(d, &to);
+        const char * buf = BUFFER_Access(&d->buf);
+        int len = (int)BUFFER_Size(&d->buf);
+        if (sendto(s, buf, len, 0, sa, sa ? sizeof(to) : 0) < 0) {
+            break;
+        }
+    }
+    return k ? k : (-1);
+}
+
+#endif /* !HAVE_RECVMMSG */
+
 /**
  * This function resolves host name or dotted IP representation into 32 bit
- * binary IP address in host byte order. This function mostly deals with the
- * stupidity of Windoze implementation of gethostbyname() which, given an
- * IP address in standard dot notation, is unable to convert it into a
- * binary form.
+ * binary IP address in host byte order. Dotted IP addresses are converted
+ * directly, host names are resolved with INET_Resolve which caches the
+ * result if INET module has been initialized.
  */
 Bool INET_ResolveAddr(Str s, IPaddr * addr)
 {
@@ -322,27 +638,26 @@ Bool INET_ResolveAddr(Str s, IPaddr * addr)
     if (s) {
         while (*s && IsSpace(*s)) s++;
         if (*s) {
+            IPaddr tmp = INADDR_NONE;
 #ifdef UNICODE
             char * host = STRING_ToMultiByte(s);
             if (host) {
+                tmp = inet_addr(host);
+                MEM_Free(host);
+            }
 #else  /* UNICODE */
-                const char * host = s;
+            tmp = inet_addr(s);
 #endif /* UNICODE */
-                IPaddr tmp = inet_addr(host);
-                if (tmp == INADDR_NONE) {
-                    struct hostent * h = gethostbyname(host);
-                    if (h && h->h_addrtype == AF_INET && h->h_addr_list[0]) {
-                        tmp = *((IPaddr*)h->h_addr_list[0]);
-                        ok = True;
-                    }
-                } else {
+            if (tmp == INADDR_NONE) {
+                struct sockaddr_storage ss;
+                if (INET_Resolve(s, AF_INET, &ss)) {
+                    tmp = ((struct sockaddr_in*)&ss)->sin_addr.s_addr;
                     ok = True;
                 }
-                if (ok && addr) *addr = ntohl(tmp);
-#ifdef UNICODE
-                MEM_Free(host);
+            } else {
+                ok = True;
             }
-#endif /* UNICODE */
+            if (ok && addr) *addr = ntohl(tmp);
         }
     }
     return ok;
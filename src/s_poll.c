@@ -0,0 +1,601 @@
+/*
+ * $Id: s_poll.c,v 1.1 2026/10/18 14:02:17 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#ifdef _WIN32
+/* WSAPoll requires Winsock2 */
+#  include <winsock2.h>
+#endif /* _WIN32 */
+
+#include "s_poll.h"
+#include "s_hash.h"
+#include "s_mutex.h"
+#include "s_mem.h"
+
+#if defined(__linux__) && !defined(SLIB_NO_EPOLL)
+#  define POLL_EPOLL
+#  include <sys/epoll.h>
+#  include <sys/eventfd.h>
+#elif defined(_WIN32)
+#  define poll WSAPoll
+#else
+#  include <poll.h>
+#endif
+
+/*==========================================================================*
+ *              S O C K E T    P O L L E R
+ *==========================================================================*/
+
+typedef struct _PollEntry {
+    Socket sock;                /* the socket */
+    int mask;                   /* SOCK_WAIT_xxx and SOCK_POLL_xxx bits */
+    Bool armed;                 /* False after one-shot event has fired */
+    void * ctx;                 /* context returned in SocketEvent */
+    WorkItem * work;            /* submitted when the socket is ready */
+} PollEntry;
+
+struct _SocketPoller {
+    Mutex mutex;                /* protects the map */
+    HashTable map;              /* Socket -> PollEntry */
+#ifdef POLL_EPOLL
+    int epfd;                   /* epoll descriptor */
+    int wakefd;                 /* eventfd for SOCKET_PollerWakeup */
+    struct epoll_event * ev;    /* events returned by epoll_wait */
+    int nev;                    /* size of the ev array */
+#else  /* !POLL_EPOLL */
+    Socket wake;                /* self-connected UDP socket */
+    struct pollfd * fds;        /* the first one is the wake socket */
+    int nfds;                   /* number of pollfd structures in use */
+    int alloc;                  /* allocated number of pollfd structures */
+    Bool dirty;                 /* fds need to be rebuilt */
+    Bool waiting;               /* a thread is blocked in poll() */
+    Bool wakeup;                /* SOCKET_PollerWakeup has been called */
+#endif /* !POLL_EPOLL */
+};
+
+/* operations on the platform specific part */
+#define POLL_ADD 0
+#define POLL_MOD 1
+#define POLL_DEL 2
+
+#ifdef POLL_EPOLL
+
+/**
+ * Converts SOCK_WAIT_xxx and SOCK_POLL_xxx bits into epoll events
+ */
+STATIC I32u PollEpollEvents(int mask)
+{
+    I32u events = 0;
+    if (mask & SOCK_WAIT_READ) events |= EPOLLIN;
+    if (mask & SOCK_WAIT_WRITE) events |= EPOLLOUT;
+    if (mask & SOCK_WAIT_EXCEPT) events |= EPOLLPRI;
+    if (mask & SOCK_POLL_EDGE) events |= EPOLLET;
+    if (mask & SOCK_POLL_ONESHOT) events |= EPOLLONESHOT;
+#ifdef EPOLLEXCLUSIVE
+    if (mask & SOCK_POLL_EXCLUSIVE) events |= EPOLLEXCLUSIVE;
+#endif /* EPOLLEXCLUSIVE */
+    return events;
+}
+
+/**
+ * Converts epoll events into SOCK_WAIT_xxx bits. Errors and hangups make
+ * the socket both readable and writable, as they would with select().
+ */
+STATIC int PollWaitEvents(const PollEntry * e, I32u events)
+{
+    int result = 0;
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) result |= SOCK_WAIT_READ;
+    if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) result |= SOCK_WAIT_WRITE;
+    if (events & EPOLLPRI) result |= SOCK_WAIT_EXCEPT;
+    result &= e->mask;
+    if (!result && (events & (EPOLLERR | EPOLLHUP))) {
+        result = (e->mask & SOCK_WAIT_ALL);
+    }
+    return result;
+}
+
+STATIC Bool PollUpdate(SocketPoller * p, PollEntry * e, int op)
+{
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = PollEpollEvents(e->mask);
+    event.data.fd = e->sock;
+    switch (op) {
+    case POLL_ADD:
+        return BoolValue(epoll_ctl(p->epfd, EPOLL_CTL_ADD, e->sock, &event)==0);
+    case POLL_MOD:
+        return BoolValue(epoll_ctl(p->epfd, EPOLL_CTL_MOD, e->sock, &event)==0);
+    case POLL_DEL:
+        /* fails if the socket has already been closed, that's fine */
+        epoll_ctl(p->epfd, EPOLL_CTL_DEL, e->sock, &event);
+        return True;
+    }
+    return False;
+}
+
+STATIC Bool PollInit(SocketPoller * p)
+{
+    p->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (p->epfd >= 0) {
+        p->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (p->wakefd >= 0) {
+            struct epoll_event event;
+            memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN;
+            event.data.fd = p->wakefd;
+            if (epoll_ctl(p->epfd, EPOLL_CTL_ADD, p->wakefd, &event) == 0) {
+                return True;
+            }
+            close(p->wakefd);
+        }
+        close(p->epfd);
+    }
+    return False;
+}
+
+STATIC void PollDestroy(SocketPoller * p)
+{
+    close(p->wakefd);
+    close(p->epfd);
+    MEM_Free(p->ev);
+}
+
+/**
+ * Wakes up the thread blocked in epoll_wait
+ */
+void SOCKET_PollerWakeup(SocketPoller * p)
+{
+    I64u one = 1;
+    if (write(p->wakefd, &one, sizeof(one)) < 0) {
+        /* the counter is already non-zero */
+    }
+}
+
+int SOCKET_PollerWait(SocketPoller * p, SocketEvent * events, int max,
+                      Time ms)
+{
+    int i, n, count = 0;
+    int tmo = (ms < 0) ? (-1) : (int)MIN(ms, INT_MAX);
+    ASSERT(max > 0);
+    if (max <= 0) return (-1);
+    if (p->nev < max) {
+        struct epoll_event * ev = MEM_NewArray(struct epoll_event, max);
+        if (!ev) return (-1);
+        MEM_Free(p->ev);
+        p->ev = ev;
+        p->nev = max;
+    }
+
+    n = epoll_wait(p->epfd, p->ev, max, tmo);
+    if (n < 0) {
+        return (errno == EINTR) ? 0 : (-1);
+    }
+
+    MUTEX_Lock(&p->mutex);
+    for (i=0; i<n; i++) {
+        const struct epoll_event * ev = p->ev + i;
+        if (ev->data.fd == p->wakefd) {
+            I64u value;
+            if (read(p->wakefd, &value, sizeof(value)) < 0) {
+                /* spurious wakeup */
+            }
+        } else {
+            /* the socket may have been removed after epoll_wait returned */
+            PollEntry * e = HASH_Get(&p->map, HASH_INT_KEY(ev->data.fd));
+            if (e && e->armed) {
+                int result = PollWaitEvents(e, ev->events);
+                if (result) {
+                    if (e->mask & SOCK_POLL_ONESHOT) e->armed = False;
+                    if (e->work) {
+                        WKI_Submit(e->work);
+                    } else {
+                        events[count].sock = e->sock;
+                        events[count].events = result;
+                        events[count].ctx = e->ctx;
+                        count++;
+                    }
+                }
+            }
+        }
+    }
+    MUTEX_Unlock(&p->mutex);
+    return count;
+}
+
+#else  /* !POLL_EPOLL */
+
+/**
+ * Converts poll() events into SOCK_WAIT_xxx bits
+ */
+STATIC int PollWaitEvents(const PollEntry * e, short events)
+{
+    int result = 0;
+    const short err = (POLLERR | POLLHUP | POLLNVAL);
+    if (events & (POLLIN | err)) result |= SOCK_WAIT_READ;
+    if (events & (POLLOUT | err)) result |= SOCK_WAIT_WRITE;
+    if (events & POLLPRI) result |= SOCK_WAIT_EXCEPT;
+    result &= e->mask;
+    if (!result && (events & err)) {
+        result = (e->mask & SOCK_WAIT_ALL);
+    }
+    return result;
+}
+
+/**
+ * Wakes up the thread blocked in poll(). Must be called under lock.
+ */
+STATIC void PollWake(SocketPoller * p)
+{
+    if (p->waiting) {
+        char c = 0;
+        send(p->wake, &c, 1, 0);
+    }
+}
+
+/**
+ * The pollfd array is rebuilt by the waiting thread, here we only need
+ * to make sure that it notices the change.
+ */
+STATIC Bool PollUpdate(SocketPoller * p, PollEntry * e, int op)
+{
+    UNREF(e);
+    UNREF(op);
+    p->dirty = True;
+    PollWake(p);
+    return True;
+}
+
+/**
+ * The wake socket is a UDP socket bound to the loopback interface and
+ * connected to itself. Unlike a pipe, it works with WSAPoll.
+ */
+STATIC Bool PollInit(SocketPoller * p)
+{
+    if (SOCKET_Create(SOCK_DGRAM, INADDR_LOOPBACK, 0, &p->wake)) {
+        Port port = SOCKET_GetPort(p->wake);
+        if (port && SOCKET_Connect(p->wake, INADDR_LOOPBACK, port) &&
+            SOCKET_Block(p->wake, False)) {
+            p->dirty = True;
+            return True;
+        }
+        SOCKET_Close(p->wake);
+    }
+    return False;
+}
+
+STATIC void PollDestroy(SocketPoller * p)
+{
+    SOCKET_Close(p->wake);
+    MEM_Free(p->fds);
+}
+
+void SOCKET_PollerWakeup(SocketPoller * p)
+{
+    MUTEX_Lock(&p->mutex);
+    p->wakeup = True;
+    PollWake(p);
+    MUTEX_Unlock(&p->mutex);
+}
+
+/**
+ * HashCB that fills the pollfd array
+ */
+STATIC Bool PollFillCB(HashKey key, HashValue value, void * ctx)
+{
+    SocketPoller * p = (SocketPoller*)ctx;
+    PollEntry * e = (PollEntry*)value;
+    UNREF(key);
+    if (e->armed) {
+        struct pollfd * pfd = p->fds + (p->nfds++);
+        pfd->fd = e->sock;
+        pfd->events = 0;
+        pfd->revents = 0;
+        if (e->mask & SOCK_WAIT_READ) pfd->events |= POLLIN;
+        if (e->mask & SOCK_WAIT_WRITE) pfd->events |= POLLOUT;
+        if (e->mask & SOCK_WAIT_EXCEPT) pfd->events |= POLLPRI;
+    }
+    return True;
+}
+
+/**
+ * Rebuilds the pollfd array. Must be called under lock.
+ */
+STATIC Bool PollRebuild(SocketPoller * p)
+{
+    int n = (int)HASH_Size(&p->map) + 1;
+    if (p->alloc < n) {
+        struct pollfd * fds = MEM_NewArray(struct pollfd, n);
+        if (!fds) return False;
+        MEM_Free(p->fds);
+        p->fds = fds;
+        p->alloc = n;
+    }
+    p->fds[0].fd = p->wake;
+    p->fds[0].events = POLLIN;
+    p->fds[0].revents = 0;
+    p->nfds = 1;
+    HASH_Examine(&p->map, PollFillCB, p);
+    p->dirty = False;
+    return True;
+}
+
+int SOCKET_PollerWait(SocketPoller * p, SocketEvent * events, int max,
+                      Time ms)
+{
+    int count = 0;
+    Time deadline = (ms > 0) ? (TIME_Monotonic() + ms) : 0;
+    ASSERT(max > 0);
+    if (max <= 0) return (-1);
+
+    MUTEX_Lock(&p->mutex);
+    for (;;) {
+        int i, n, tmo;
+        if (p->wakeup) {
+            break;
+        } else if (p->dirty && !PollRebuild(p)) {
+            count = (-1);
+            break;
+        }
+        if (ms > 0) {
+            Time now = TIME_Monotonic();
+            tmo = (int)((deadline > now) ? MIN(deadline - now, INT_MAX) : 0);
+        } else {
+            tmo = ((ms < 0) ? (-1) : 0);
+        }
+
+        p->waiting = True;
+        MUTEX_Unlock(&p->mutex);
+        n = poll(p->fds, p->nfds, tmo);
+        MUTEX_Lock(&p->mutex);
+        p->waiting = False;
+
+        if (n < 0) {
+            if (SOCKET_GetLastError() != EINTR) count = (-1);
+            break;
+        } else if (n == 0) {
+            break;
+        }
+
+        if (p->fds[0].revents) {
+            char buf[16];
+            while (recv(p->wake, buf, sizeof(buf), 0) > 0) NOTHING;
+        }
+
+        for (i=1; i<p->nfds && count<max; i++) {
+            const struct pollfd * pfd = p->fds + i;
+            if (pfd->revents) {
+                /* the socket may have been removed or modified */
+                PollEntry * e = HASH_Get(&p->map, HASH_INT_KEY(pfd->fd));
+                if (e && e->armed) {
+                    int result = PollWaitEvents(e, pfd->revents);
+                    if (result) {
+                        if (e->mask & SOCK_POLL_ONESHOT) {
+                            e->armed = False;
+                            p->dirty = True;
+                        }
+                        if (e->work) {
+                            WKI_Submit(e->work);
+                        } else {
+                            events[count].sock = e->sock;
+                            events[count].events = result;
+                            events[count].ctx = e->ctx;
+                            count++;
+                        }
+                    }
+                }
+            }
+        }
+
+        /* woken up because the set of sockets has changed, keep waiting */
+        if (count || p->wakeup || !ms) break;
+    }
+    p->wakeup = False;
+    MUTEX_Unlock(&p->mutex);
+    return count;
+}
+
+#endif /* !POLL_EPOLL */
+
+/**
+ * Creates a new poller
+ */
+SocketPoller * SOCKET_PollerCreate()
+{
+    SocketPoller * p = MEM_New(SocketPoller);
+    if (p) {
+        memset(p, 0, sizeof(*p));
+        if (MUTEX_Init(&p->mutex)) {
+            if (HASH_Init(&p->map, 0, NULL, NULL, hashFreeValueProc)) {
+                if (PollInit(p)) {
+                    return p;
+                }
+                HASH_Destroy(&p->map);
+            }
+            MUTEX_Destroy(&p->mutex);
+        }
+        MEM_Free(p);
+    }
+    return NULL;
+}
+
+/**
+ * Deletes the poller. Doesn't close the sockets and doesn't touch the
+ * work items.
+ */
+void SOCKET_PollerDelete(SocketPoller * p)
+{
+    if (p) {
+        PollDestroy(p);
+        HASH_Destroy(&p->map);
+        MUTEX_Destroy(&p->mutex);
+        MEM_Free(p);
+    }
+}
+
+/**
+ * Common part of SOCKET_PollerAdd and SOCKET_PollerAddWork
+ */
+STATIC Bool PollAdd(SocketPoller * p, Socket s, int mask, void * ctx,
+                    WorkItem * w)
+{
+    Bool ok = False;
+    ASSERT(mask & SOCK_WAIT_ALL);
+    ASSERT(!(mask & SOCK_POLL_EXCLUSIVE) || !(mask & SOCK_POLL_ONESHOT));
+    MUTEX_Lock(&p->mutex);
+    if (!HASH_Contains(&p->map, HASH_INT_KEY(s))) {
+        PollEntry * e = MEM_New(PollEntry);
+        if (e) {
+            e->sock = s;
+            e->mask = mask;
+            e->armed = True;
+            e->ctx = ctx;
+            e->work = w;
+            if (HASH_Put(&p->map, HASH_INT_KEY(s), e)) {
+                ok = PollUpdate(p, e, POLL_ADD);
+                if (!ok) HASH_Remove(&p->map, HASH_INT_KEY(s));
+            } else {
+                MEM_Free(e);
+            }
+        }
+    }
+    MUTEX_Unlock(&p->mutex);
+    return ok;
+}
+
+/**
+ * Starts watching the socket. Fails if the socket is already there.
+ * The socket should be removed from the poller before it's closed.
+ */
+Bool SOCKET_PollerAdd(SocketPoller * p, Socket s, int mask, void * ctx)
+{
+    return PollAdd(p, s, mask, ctx, NULL);
+}
+
+/**
+ * Starts watching the socket, submits the work item when the socket is
+ * ready. The work item should call SOCKET_PollerRearm when it's done.
+ */
+Bool SOCKET_PollerAddWork(SocketPoller * p, Socket s, int mask, WorkItem * w)
+{
+    ASSERT(w);
+    return BoolValue(w && PollAdd(p, s, mask | SOCK_POLL_ONESHOT, w, w));
+}
+
+/**
+ * Starts watching the socket underlying the stream (see FILE_Socket).
+ * The File pointer becomes the context. Note that the data that may be
+ * buffered by the wrapper streams (e.g. FILE_Buffered) are invisible to
+ * the poller.
+ */
+Bool SOCKET_PollerAddFile(SocketPoller * p, File * f, int mask)
+{
+    Socket s = FILE_Socket(f);
+    return BoolValue(s != INVALID_SOCKET && PollAdd(p, s, mask, f, NULL));
+}
+
+/**
+ * Changes the event mask and the context. Also re-arms a one-shot socket.
+ * The context is ignored for the sockets added with SOCKET_PollerAddWork.
+ */
+Bool SOCKET_PollerModify(SocketPoller * p, Socket s, int mask, void * ctx)
+{
+    Bool ok = False;
+    PollEntry * e;
+    ASSERT(mask & SOCK_WAIT_ALL);
+    MUTEX_Lock(&p->mutex);
+    e = HASH_Get(&p->map, HASH_INT_KEY(s));
+    if (e) {
+        if (e->work) {
+            e->mask = mask | SOCK_POLL_ONESHOT;
+        } else {
+            e->mask = mask;
+            e->ctx = ctx;
+        }
+        e->armed = True;
+        ok = PollUpdate(p, e, POLL_MOD);
+    }
+    MUTEX_Unlock(&p->mutex);
+    return ok;
+}
+
+/**
+ * Re-enables a one-shot socket after its event has been reported
+ */
+Bool SOCKET_PollerRearm(SocketPoller * p, Socket s)
+{
+    Bool ok = False;
+    PollEntry * e;
+    MUTEX_Lock(&p->mutex);
+    e = HASH_Get(&p->map, HASH_INT_KEY(s));
+    if (e) {
+        e->armed = True;
+        ok = PollUpdate(p, e, POLL_MOD);
+    }
+    MUTEX_Unlock(&p->mutex);
+    return ok;
+}
+
+/**
+ * Stops watching the socket. Returns False if the socket wasn't there.
+ */
+Bool SOCKET_PollerRemove(SocketPoller * p, Socket s)
+{
+    Bool ok = False;
+    PollEntry * e;
+    MUTEX_Lock(&p->mutex);
+    e = HASH_Get(&p->map, HASH_INT_KEY(s));
+    if (e) {
+        PollUpdate(p, e, POLL_DEL);
+        HASH_Remove(&p->map, HASH_INT_KEY(s));
+        ok = True;
+    }
+    MUTEX_Unlock(&p->mutex);
+    return ok;
+}
+
+/**
+ * Returns the number of sockets being watched
+ */
+int SOCKET_PollerCount(const SocketPoller * p)
+{
+    int count;
+    MUTEX_Lock((Mutex*)&p->mutex);
+    count = (int)HASH_Size(&p->map);
+    MUTEX_Unlock((Mutex*)&p->mutex);
+    return count;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
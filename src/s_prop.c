@@ -845,6 +845,13 @@ Bool PROP_Load(Prop * prop, Str fname, IODesc io)
     Bool success = False;
     File * in = FILE_Open(fname, READ_TEXT_MODE, io);
     if (in) {
+        /* read-ahead buffer lets FILE_ReadLine scan the lines in place */
+        const void * data;
+        size_t size;
+        if (!FILE_MapView(in, &data, &size)) {
+            File * buf = FILE_Buffered(in, 0);
+            if (buf) in = buf;
+        }
         success = PROP_Read(prop, in);
         FILE_Close(in);
     } else {
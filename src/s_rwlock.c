@@ -540,6 +540,25 @@ STATIC RWEntry * RWLOCK_GetEntry(RWLock * lock)
     return empty;
 }
 
+/**
+ * Returns True if the first shared waiter is ahead of all exclusive
+ * waiters. This function must be called under synchronization.
+ */
+STATIC Bool RWLOCK_ShareWaiterFirst(RWLock * lock)
+{
+    QEntry * e = QUEUE_First(&lock->shareWaiters);
+    if (e) {
+        RWLockWaiter * shareWaiter = QCAST(e,RWLockWaiter,entry);
+        e = QUEUE_First(&lock->exclusiveWaiters);
+        if (e) {
+            RWLockWaiter * exclusiveWaiter = QCAST(e,RWLockWaiter,entry);
+            return BoolValue(shareWaiter->index < exclusiveWaiter->index);
+        }
+        return True;
+    }
+    return False;
+}
+
 /**
  * Locks resource for exclusive use, waits if necessary. Returns True if lock
  * has been successfully acquired, otherwise False.
@@ -759,13 +778,17 @@ Bool RWLOCK_TimeReadLock(RWLock * lock, long ms)
              * by a lucky late-coming reader. If this number exceeds
              * the limit, everyone has to stay in the line.
              */
-            if (QUEUE_Size(&lock->exclusiveWaiters) == 0  ||
-                lock->bypassCount < RWLOCK_MAX_BYPASS_COUNT) {
+            QEntry * e = QUEUE_First(&lock->exclusiveWaiters);
+            Bool bypass = False;
+            if (e) {
+                /* a waiter that came before the writer bypasses no one */
+                RWLockWaiter * exclusiveWaiter = QCAST(e,RWLockWaiter,entry);
+                bypass = !waiter || waiter->index > exclusiveWaiter->index;
+            }
+            if (!bypass || lock->bypassCount < RWLOCK_MAX_BYPASS_COUNT) {
                 entry = RWLOCK_GetEntry(lock);
                 if (entry) {
-                    if (QUEUE_Size(&lock->exclusiveWaiters) > 0) {
-                        lock->bypassCount++;
-                    }
+                    if (bypass) lock->bypassCount++;
                     ASSERT(entry->write == 0);
                     success = True;
                     entry->read++;
@@ -798,7 +821,15 @@ Bool RWLOCK_TimeReadLock(RWLock * lock, long ms)
             if (!waiter) break;
         }
 
-        EVENT_Reset(&lock->shareEvent);
+        /*
+         * don't reset the event if it has been set for the readers that
+         * are ahead of the first writer in the line and didn't yet have
+         * the chance to run, or their wakeup would be lost.
+         */
+        if ((lock->flags & RWLOCK_FLAG_EXCLUSIVE_LOCK) ||
+            !RWLOCK_ShareWaiterFirst(lock)) {
+            EVENT_Reset(&lock->shareEvent);
+        }
         MUTEX_Unlock(&lock->mutex);
 
         /* wait */
@@ -85,6 +85,32 @@ Time TIME_Now()
     return now;
 }
 
+/**
+ * Returns the number of milliseconds elapsed since some unspecified point
+ * in the past. Unlike TIME_Now, it's not affected by changes of the system
+ * time, which makes it suitable for measuring intervals and deadlines.
+ */
+Time TIME_Monotonic()
+{
+#if defined(_NT_KERNEL)
+    /* convert from 100-ns ticks to milliseconds */
+    return KeQueryInterruptTime()/10000;
+#elif defined(_WIN32) && defined(_WIN32_WINNT) && (_WIN32_WINNT >= 0x0600)
+    return GetTickCount64();
+#elif defined(_WIN32)
+    /* wraps around every 49.7 days, but that's all we have before Vista */
+    return GetTickCount();
+#elif defined(CLOCK_MONOTONIC) && !defined(_LINUX_KERNEL)
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return ((Time)ts.tv_sec)*1000 + ts.tv_nsec/1000000;
+    }
+    return TIME_Now();
+#else
+    return TIME_Now();
+#endif
+}
+
 /**
  * Converts slib time into Unix time
  */
@@ -375,6 +375,50 @@ Bool XML_CloseTag(File * out, Str tag, Bool eol)
     return ok;
 }
 
+/**
+ * Writes an attribute with already escaped value to the output stream
+ */
+STATIC Bool XML_WriteEscapedAttr(File * out, Str attr, Str escValue)
+{
+    Bool ok = False;
+
+#ifndef UNICODE
+    /* format the attribute directly in the output buffer if we can */
+    size_t n1 = StrLen(attr);
+    size_t n2 = StrLen(escValue);
+    char * dest = (char*)FILE_Reserve(out, n1 + n2 + 4);
+    if (dest) {
+        dest[0] = ' ';
+        memcpy(dest + 1, attr, n1);
+        dest[n1 + 1] = '=';
+        dest[n1 + 2] = '"';
+        memcpy(dest + n1 + 3, escValue, n2);
+        dest[n1 + n2 + 3] = '"';
+        return FILE_Commit(out, n1 + n2 + 4);
+    }
+#endif /* !UNICODE */
+
+    if (FILE_Puts(out, TEXT(" ")) &&
+        FILE_Puts(out, attr) &&
+        FILE_Puts(out, TEXT("="))) {
+
+        /* disable wrapping while writing attribute value */
+        Bool wrap = WRAP_IsEnabled(out);
+        if (wrap) WRAP_Enable(out, False);
+
+        /* write the attribute value */
+        if (FILE_Puts(out, TEXT("\"")) &&
+            FILE_Puts(out, escValue) &&
+            FILE_Puts(out, TEXT("\""))) {
+            ok = True;
+        }
+
+        /* re-enable wrapping */
+        if (wrap) WRAP_Enable(out, True);
+    }
+    return ok;
+}
+
 /**
  * Writes an attribute to the output stream
  */
@@ -386,24 +430,7 @@ Bool XML_WriteAttr(File * out, Str attr, Str value)
     STRBUF_InitBufXXX(&buf);
     escValue = XML_Escape2(&buf.sb, value, True);
     if (escValue) {
-        if (FILE_Puts(out, TEXT(" ")) &&
-            FILE_Puts(out, attr) &&
-            FILE_Puts(out, TEXT("="))) {
-
-            /* disable wrapping while writing attribute value */
-            Bool wrap = WRAP_IsEnabled(out);
-            if (wrap) WRAP_Enable(out, False);
-
-            /* write the attribute value */
-            if (FILE_Puts(out, TEXT("\"")) &&
-                FILE_Puts(out, escValue) &&
-                FILE_Puts(out, TEXT("\""))) {
-                ok = True;
-            }
-
-            /* re-enable wrapping */
-            if (wrap) WRAP_Enable(out, True);
-        }
+        ok = XML_WriteEscapedAttr(out, attr, escValue);
     }
     STRBUF_Destroy(&buf.sb);
     return ok;
@@ -422,24 +449,7 @@ Bool XML_WriteAttrNoEsc(File * out, Str attr, Str value)
     STRBUF_InitBufXXX(&buf);
     escValue = XML_Escape2(&buf.sb, value, False);
     if (escValue) {
-        if (FILE_Puts(out, TEXT(" ")) &&
-            FILE_Puts(out, attr) &&
-            FILE_Puts(out, TEXT("="))) {
-
-            /* disable wrapping while writing attribute value */
-            Bool wrap = WRAP_IsEnabled(out);
-            if (wrap) WRAP_Enable(out, False);
-
-            /* write the attribute value */
-            if (FILE_Puts(out, TEXT("\"")) &&
-                FILE_Puts(out, escValue) &&
-                FILE_Puts(out, TEXT("\""))) {
-                ok = True;
-            }
-
-            /* re-enable wrapping */
-            if (wrap) WRAP_Enable(out, True);
-        }
+        ok = XML_WriteEscapedAttr(out, attr, escValue);
     }
     STRBUF_Destroy(&buf.sb);
     return ok;
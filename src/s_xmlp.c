@@ -434,6 +434,8 @@ Bool XML_ParseStream(File * f, const XMLCallbacks * cb, void * ctx)
 
         int bufsize = 4096;
         void * buf = NULL;
+        const void * data;
+        size_t size;
         Bool done = False;
         Bool hadInput = False;
 
@@ -456,6 +458,22 @@ Bool XML_ParseStream(File * f, const XMLCallbacks * cb, void * ctx)
          */
         ok = True;
 
+        if (FILE_MapView(f, &data, &size)) {
+
+            /* the whole thing is in memory, parse it in place */
+            const char * ptr = (const char *)data;
+            hadInput = BoolValue(size > 0);
+            while (ok && size > 0) {
+                int len = (int)MIN(size, INT_MAX);
+                size -= len;
+                ok = (XML_Parse(parser, ptr, len, !size) == XML_STATUS_OK);
+                FILE_Consume(f, len);
+                ptr += len;
+            }
+            if (!hadInput) ok = False;
+            done = True;
+        }
+
         while (ok && !done && (buf = XML_GetBuffer(parser,bufsize)) != NULL) {
             int len = -1;
             if (!FILE_Eof(f)) {
@@ -486,7 +504,7 @@ Bool XML_ParseStream(File * f, const XMLCallbacks * cb, void * ctx)
         }
 #endif /* DEBUG */
 
-        if (!buf) ok = False;
+        if (!buf && !done) ok = False;
 
         /* deallocate parser */
         XML_ParserFree(parser);
@@ -0,0 +1,249 @@
+/*
+ * $Id: u_fmap.c,v 1.1 2026/10/18 10:12:41 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "s_util.h"
+#include "s_fio.h"
+#include "s_mem.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+/*
+ * The path is passed to open() as is. That's fine because Char is always
+ * char on UNIX (see s_unix.h), even if UNICODE is defined. Should that
+ * ever change, the path would need STRING_ToMultiByte like in s_dns.c
+ */
+COMPILE_ASSERT(sizeof(Char) == sizeof(char))
+
+/* don't leak the descriptor to the child processes */
+#ifndef O_CLOEXEC
+#  define O_CLOEXEC 0
+#endif
+
+/*==========================================================================*
+ *              M E M O R Y    M A P P E D    F I L E    I O
+ *==========================================================================*/
+
+#undef MappedFile
+typedef struct _MappedFile {
+    File file;      /* shared File structure */
+    int fd;         /* the file descriptor */
+    I8u * data;     /* the mapped file contents, NULL if file is empty */
+    size_t size;    /* size of the mapping */
+    size_t pos;     /* current read position */
+} MappedFile;
+
+STATIC MappedFile * MappedFileCast(File * f)
+{
+    ASSERT(f);
+    if (f) {
+        ASSERT(f->io == &MappedFileIO);
+        if (f->io == &MappedFileIO) {
+            MappedFile * mf = CAST(f,MappedFile,file);
+            ASSERT(mf->pos <= mf->size);
+            return mf;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Maps the file into memory. Only read access is supported.
+ */
+STATIC Bool MappedFileMap(MappedFile * mf, Str path, const char * mode)
+{
+    if (!strpbrk(mode, "wa+")) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            struct stat st;
+            if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+                (I64u)st.st_size <= (I64u)((size_t)-1)) {
+                void * data = NULL;
+                if (st.st_size > 0) {
+                    data = mmap(NULL, (size_t)st.st_size, PROT_READ,
+                        MAP_PRIVATE, fd, 0);
+                }
+                if (data != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+                    if (data) madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif /* MADV_SEQUENTIAL */
+                    mf->fd = fd;
+                    mf->data = (I8u*)data;
+                    mf->size = (size_t)st.st_size;
+                    mf->pos = 0;
+                    return True;
+                }
+            }
+            close(fd);
+        }
+    }
+    return False;
+}
+
+STATIC void MappedFileUnmap(MappedFile * mf)
+{
+    if (mf->data) {
+        munmap(mf->data, mf->size);
+        mf->data = NULL;
+    }
+    if (mf->fd >= 0) {
+        close(mf->fd);
+        mf->fd = -1;
+    }
+    mf->size = mf->pos = 0;
+}
+
+STATIC File * MappedFileOpen(Str path, const char * mode)
+{
+    MappedFile * mf = MEM_New(MappedFile);
+    if (mf) {
+        memset(mf, 0, sizeof(*mf));
+        mf->fd = -1;
+        if (MappedFileMap(mf, path, mode)) {
+            return &mf->file;
+        }
+        MEM_Free(mf);
+    }
+    return NULL;
+}
+
+STATIC Bool MappedFileReopen(File * f, Str path, const char * mode)
+{
+    MappedFile * mf = MappedFileCast(f);
+    if (mf) {
+        MappedFileUnmap(mf);
+        return MappedFileMap(mf, path, mode);
+    }
+    return False;
+}
+
+STATIC I64s MappedFileRead64(File * f, void * buf, size_t len)
+{
+    MappedFile * mf = MappedFileCast(f);
+    if (mf) {
+        size_t n = MIN(len, mf->size - mf->pos);
+        if (n > 0) {
+            memcpy(buf, mf->data + mf->pos, n);
+            mf->pos += n;
+        }
+        return (I64s)n;
+    }
+    return (-1);
+}
+
+STATIC int MappedFileRead(File * f, void * buf, int len)
+{
+    return (int)MappedFileRead64(f, buf, len);
+}
+
+STATIC int MappedFileSkip(File * f, int len)
+{
+    MappedFile * mf = MappedFileCast(f);
+    if (mf) {
+        size_t n = MIN((size_t)len, mf->size - mf->pos);
+        mf->pos += n;
+        return (int)n;
+    }
+    return (-1);
+}
+
+STATIC size_t MappedFilePeek(File * f, const void ** data, size_t min)
+{
+    MappedFile * mf = MappedFileCast(f);
+    UNREF(min);
+    if (mf && mf->pos < mf->size) {
+        *data = mf->data + mf->pos;
+        return mf->size - mf->pos;
+    }
+    return 0;
+}
+
+STATIC Bool MappedFileEof(File * f)
+{
+    MappedFile * mf = MappedFileCast(f);
+    return BoolValue(!mf || mf->pos == mf->size);
+}
+
+STATIC int MappedFileFd(File * f)
+{
+    MappedFile * mf = MappedFileCast(f);
+    return (mf ? mf->fd : -1);
+}
+
+STATIC void MappedFileClose(File * f)
+{
+    MappedFile * mf = MappedFileCast(f);
+    if (mf) MappedFileUnmap(mf);
+}
+
+STATIC void MappedFileFree(File * f)
+{
+    MappedFile * mf = MappedFileCast(f);
+    if (mf) {
+        ASSERT(!(f->flags & FILE_IS_OPEN));
+        MEM_Free(mf);
+    }
+}
+
+/*
+ * A set of handlers that perform memory mapped file I/O. The file is
+ * opened for reading only. Writes are not supported.
+ */
+const FileIO MappedFileIO = {
+    MappedFileOpen      /* open     */,
+    MappedFileReopen    /* reopen   */,
+    NULL                /* setparam */,
+    MappedFileRead      /* read     */,
+    NULL                /* write    */,
+    MappedFileRead64    /* read64   */,
+    NULL                /* write64  */,
+    NULL                /* readv    */,
+    NULL                /* writev   */,
+    MappedFileSkip      /* skip     */,
+    MappedFilePeek      /* peek     */,
+    NULL                /* flush    */,
+    MappedFileEof       /* eof      */,
+    MappedFileFd        /* fd       */,
+    NULL                /* target   */,
+    NULL                /* detach   */,
+    MappedFileClose     /* close    */,
+    MappedFileFree      /* free     */,
+    FIO_FILE_BASED |
+    FIO_MAPPED          /* flags    */
+};
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -33,7 +33,10 @@
 #include "s_mem.h"
 #include "s_util.h"
 #include "s_event.h"
+#include "s_mutex.h"
+#include "s_queue.h"
 #include "s_thread.h"
+#include "s_ring.h"
 
 /* This functionality requires curl */
 #ifdef _HAVE_CURL
@@ -49,16 +52,73 @@
  *              C U R L    U R L    I / O
  *==========================================================================*/
 
+/*
+ * Transfers are driven by one or more worker threads, each owning a curl
+ * multi handle. The multi handle keeps the connections open after the
+ * transfer completes, so that the next request to the same host doesn't
+ * have to connect (and negotiate TLS) again. All requests to the same host
+ * go through the same worker.
+ */
+#define CURL_POLL_TIMEOUT   1000    /* ms */
+#define CURL_MAX_REDIRS     20
+
+/*
+ * Received data are passed from the worker to the reader in fixed size
+ * chunks. Only the chunk pointers are passed under the lock. When all
+ * chunks are in use, the transfer is paused until the reader catches up,
+ * which limits the amount of memory buffered per download to
+ * CURL_MAX_CHUNKS * CURL_CHUNK_SIZE bytes.
+ */
+#define CURL_CHUNK_SIZE     CURL_MAX_WRITE_SIZE
+#define CURL_MAX_CHUNKS     16
+#define CURL_RESUME_CHUNKS  (CURL_MAX_CHUNKS/2)
+
+typedef struct _CurlChunk {
+    int len;                /* number of bytes in the chunk */
+    int pos;                /* number of bytes consumed by the reader */
+    char data[CURL_CHUNK_SIZE];
+} CurlChunk;
+
+typedef struct _CurlWorker {
+    UrlFetcher * fetcher;   /* the fetcher this worker belongs to */
+    ThrID thr;              /* the worker thread */
+    CURLM * multi;          /* the multi handle */
+    Queue pending;          /* transfers to start, protected by the mutex */
+    Queue active;           /* transfers in progress, changed by thr
+                             * under the mutex */
+    int cancelled;          /* number of cancelled transfers */
+    int resumed;            /* number of transfers to resume */
+    Bool stop;              /* True to stop the thread */
+} CurlWorker;
+
+struct _UrlFetcher {
+    Mutex mutex;            /* protects pending queues and flags */
+    int nworkers;           /* number of running workers */
+    CurlWorker workers[1];  /* variable size array */
+};
+
 typedef struct _CurlFile {
-    File file;         /* shared File structure */
-    ThrID thr;         /* handle to the curl thread */
-    Event readEvent;   /* set by the curl thread when receive completes */
-    Event readReq;     /* set when receive has been requested */
-    char * userPwd;    /* "name:password" to use when fetching */
-    char * readBuf;    /* buffer to write received data */
-    int readSize;      /* size of the receive buffer */
-    int readLen;       /* number of bytes in the receive buffer */
-    Bool eof;          /* set by read thread if there will no more reads */
+    File file;          /* shared File structure */
+    QEntry entry;       /* entry in pending or active queue */
+    CurlWorker * worker;/* the worker driving this transfer */
+    UrlFetcher * own;   /* private fetcher deleted on close, or NULL */
+    CURL * curl;        /* the easy handle */
+    char * userPwd;     /* "name:password" to use when fetching */
+    CurlChunk * read;   /* chunk being consumed, only touched by reader */
+    Mutex mutex;        /* synchronizes access to the fields below */
+    Event dataEvent;    /* set when data arrive or the transfer is done */
+    Event doneEvent;    /* set when the worker is done with this transfer */
+    Ring full;          /* chunks filled by the worker */
+    Ring empty;         /* chunks returned by the reader for reuse */
+    CurlChunk * tail;   /* last chunk in the full ring */
+    int nchunks;        /* number of allocated chunks */
+    CURLcode result;    /* transfer result */
+    Bool done;          /* no more data will arrive */
+    Bool paused;        /* the transfer is paused */
+    Bool cancel;        /* reader has closed the stream (fetcher mutex) */
+    Bool resume;        /* reader wants more data (fetcher mutex) */
+    Bool unpause;       /* the worker needs to unpause the transfer */
+    Bool eof;           /* set by read thread if there will no more reads */
 } CurlFile;
 
 STATIC int  CurlRead   P_((File * f, void * buf, int len));
@@ -76,7 +136,12 @@ STATIC const FileIO CurlIO = {
     NULL        /* setparam */,
     CurlRead    /* read     */,
     CurlWrite   /* write    */,
+    NULL        /* read64   */,
+    NULL        /* write64  */,
+    NULL        /* readv    */,
+    NULL        /* writev   */,
     NULL        /* skip     */,
+    NULL        /* peek     */,
     NULL        /* flush    */,
     CurlEof     /* eof      */,
     NULL        /* fd       */,
@@ -87,36 +152,172 @@ STATIC const FileIO CurlIO = {
     0           /* flags    */
 };
 
+STATIC int URL_initCount = 0;
+STATIC UrlFetcher * URL_fetcher = NULL;
+
 /*
- * CURL thread
+ * Worker thread
  */
 STATIC size_t CurlWriteFunc(void * data, size_t size, size_t nitems, void * f)
 {
     CurlFile * cf = f;
     const char * src = data;
-    int len = (size * nitems);
-    int pos = 0;
+    size_t len = size * nitems;
+    size_t pos = 0;
+    int nfree;
+
+    MUTEX_Lock(&cf->mutex);
+
+    /* pause the transfer if there's no room for the data */
+    nfree = RING_Size(&cf->empty) + CURL_MAX_CHUNKS - cf->nchunks;
+    if (cf->nchunks > RING_Size(&cf->empty) &&
+        len > (cf->tail ? (size_t)(CURL_CHUNK_SIZE - cf->tail->len) : 0) +
+        (size_t)MAX(nfree,0) * CURL_CHUNK_SIZE) {
+        cf->paused = True;
+        MUTEX_Unlock(&cf->mutex);
+        return CURL_WRITEFUNC_PAUSE;
+    }
+
+    /* top up the last chunk if the reader hasn't picked it up yet */
+    if (cf->tail && cf->tail->len < CURL_CHUNK_SIZE) {
+        CurlChunk * c = cf->tail;
+        pos = MIN(len, (size_t)(CURL_CHUNK_SIZE - c->len));
+        memcpy(c->data + c->len, src, pos);
+        c->len += (int)pos;
+        EVENT_Set(&cf->dataEvent);
+    }
+
     while (pos < len) {
-        EVENT_Wait(&cf->readReq);
-        if (cf->eof) {
-            return 0;
-        } else {
-            int bytesToCopy = MIN(len - pos, cf->readSize - cf->readLen);
-            ASSERT(bytesToCopy > 0);
-            if (bytesToCopy > 0) {
-                memcpy(cf->readBuf + cf->readLen, src + pos, bytesToCopy);
-                cf->readLen += bytesToCopy;
-                pos += bytesToCopy;
-                if (cf->readLen == cf->readSize) {
-                    EVENT_Reset(&cf->readReq);
-                    EVENT_Set(&cf->readEvent);
+        size_t n = MIN(len - pos, CURL_CHUNK_SIZE);
+        CurlChunk * c = RING_Get(&cf->empty);
+        if (!c) {
+            c = MEM_New(CurlChunk);
+            if (!c) break;
+            cf->nchunks++;
+        }
+
+        /* the chunk is not shared until it's in the ring */
+        MUTEX_Unlock(&cf->mutex);
+        c->len = (int)n;
+        c->pos = 0;
+        memcpy(c->data, src + pos, n);
+        MUTEX_Lock(&cf->mutex);
+
+        if (!RING_Put(&cf->full, c)) {
+            cf->nchunks--;
+            MEM_Free(c);
+            break;
+        }
+        cf->tail = c;
+        pos += n;
+        EVENT_Set(&cf->dataEvent);
+    }
+
+    MUTEX_Unlock(&cf->mutex);
+    return (pos == len) ? len : 0;
+}
+
+/**
+ * Completes the transfer. The worker must not touch the CurlFile after
+ * this function returns, it may be deallocated at any moment. The queue
+ * entry is removed under the fetcher mutex, because CurlClose looks at
+ * it to find out whether the transfer has started.
+ */
+STATIC void CurlFinish(CurlWorker * w, CurlFile * cf, CURLcode result)
+{
+    curl_multi_remove_handle(w->multi, cf->curl);
+    curl_easy_cleanup(cf->curl);
+    cf->curl = NULL;
+    MUTEX_Lock(&w->fetcher->mutex);
+    QUEUE_RemoveEntry(&cf->entry);
+    MUTEX_Unlock(&w->fetcher->mutex);
+
+    MUTEX_Lock(&cf->mutex);
+    cf->result = result;
+    cf->done = True;
+    EVENT_Set(&cf->dataEvent);
+    MUTEX_Unlock(&cf->mutex);
+    EVENT_Set(&cf->doneEvent);
+}
+
+STATIC void CurlWorkerThread(void * arg)
+{
+    CurlWorker * w = arg;
+    UrlFetcher * fetcher = w->fetcher;
+    for (;;) {
+        int n, running = 0;
+        CURLMsg * msg;
+        QEntry * e;
+        Queue cancelled;
+        Bool unpause = False;
+        Bool stop;
+
+        /* start new transfers, pick up the cancelled ones */
+        QUEUE_Init(&cancelled);
+        MUTEX_Lock(&fetcher->mutex);
+        while ((e = QUEUE_RemoveHead(&w->pending)) != NULL) {
+            CurlFile * cf = QCAST(e,CurlFile,entry);
+            QUEUE_InsertTail(&w->active, e);
+            curl_multi_add_handle(w->multi, cf->curl);
+        }
+        if (w->resumed) {
+            for (e = QUEUE_First(&w->active); e; e = QUEUE_Next(e)) {
+                CurlFile * cf = QCAST(e,CurlFile,entry);
+                if (cf->resume) {
+                    cf->resume = False;
+                    cf->unpause = True;
+                    unpause = True;
                 }
-            } else {
-                return 0;
             }
+            w->resumed = 0;
+        }
+        if (w->cancelled) {
+            e = QUEUE_First(&w->active);
+            while (e) {
+                QEntry * next = QUEUE_Next(e);
+                if (QCAST(e,CurlFile,entry)->cancel) {
+                    QUEUE_RemoveEntry(e);
+                    QUEUE_InsertTail(&cancelled, e);
+                }
+                e = next;
+            }
+            w->cancelled = 0;
+        }
+        /* when stopping, abort everything */
+        stop = w->stop;
+        if (stop) QUEUE_Move(&cancelled, &w->active);
+        MUTEX_Unlock(&fetcher->mutex);
+
+        while ((e = QUEUE_First(&cancelled)) != NULL) {
+            CurlFinish(w, QCAST(e,CurlFile,entry), CURLE_ABORTED_BY_CALLBACK);
         }
+        if (stop) break;
+
+        /* the reader has drained the data, let them flow again */
+        if (unpause) {
+            for (e = QUEUE_First(&w->active); e; e = QUEUE_Next(e)) {
+                CurlFile * cf = QCAST(e,CurlFile,entry);
+                if (cf->unpause) {
+                    cf->unpause = False;
+                    curl_easy_pause(cf->curl, CURLPAUSE_CONT);
+                }
+            }
+        }
+
+        /* move the data */
+        curl_multi_perform(w->multi, &running);
+        while ((msg = curl_multi_info_read(w->multi, &n)) != NULL) {
+            if (msg->msg == CURLMSG_DONE) {
+                void * cf = NULL;
+                CURLcode result = msg->data.result;
+                curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &cf);
+                CurlFinish(w, cf, result);
+            }
+        }
+
+        /* curl_multi_wakeup interrupts the wait */
+        curl_multi_poll(w->multi, NULL, 0, CURL_POLL_TIMEOUT, NULL);
     }
-    return len;
 }
 
 #ifdef __APPLE__
@@ -139,117 +340,82 @@ static char* CFStringRef_ToUTF8(CFStringRef strRef)
     }
     return NULL;
 }
-#endif /* __APPLE__ */
 
-STATIC void CurlThread(void * arg)
+/* Auto-detect proxy information on Mac OS X */
+STATIC void CurlSetProxy(CURL * curl, Str url)
 {
-    CurlFile * cf = arg;
-    CURL * curl = curl_easy_init();
-    if (curl) {
-        CURLcode result;
+    int colon = STRING_IndexOf(url, ':');
+    if (colon > 0) {
+        CFDictionaryRef proxyDict = SCDynamicStoreCopyProxies(NULL);
+        if (proxyDict) {
+            CFStringRef enabledKey = NULL, hostKey = NULL, portKey = NULL;
 
-#ifdef __APPLE__
-        /* Auto-detect proxy information on Mac OS X */
-        int colon = STRING_IndexOf(cf->file.name, ':');
-        if (colon > 0) {
-            CFDictionaryRef proxyDict = SCDynamicStoreCopyProxies(NULL);
-            if (proxyDict) {
-                CFStringRef enabledKey = NULL, hostKey = NULL, portKey = NULL;
-
-                /* Extract scheme from the URL */
-                char scheme[16];
-                int32_t num = MIN(colon, COUNT(scheme)-1);
-                strncpy(scheme, cf->file.name, num);
-                scheme[num] = 0;
-
-                /* Each scheme has a key of its own */
-                if (!StrCaseCmp(scheme, "http")) {
-                    enabledKey = kSCPropNetProxiesHTTPEnable;
-                    hostKey = kSCPropNetProxiesHTTPProxy;
-                    portKey = kSCPropNetProxiesHTTPPort;
-                } else if (!StrCaseCmp(scheme, "https")) {
-                    enabledKey = kSCPropNetProxiesHTTPSEnable;
-                    hostKey = kSCPropNetProxiesHTTPSProxy;
-                    portKey = kSCPropNetProxiesHTTPSPort;
-                } else if (!StrCaseCmp(scheme, "ftp")) {
-                    enabledKey = kSCPropNetProxiesFTPEnable;
-                    hostKey = kSCPropNetProxiesFTPProxy;
-                    portKey = kSCPropNetProxiesFTPPort;
-                } else if (!StrCaseCmp(scheme, "gopher")) {
-                    enabledKey = kSCPropNetProxiesGopherEnable;
-                    hostKey = kSCPropNetProxiesGopherProxy;
-                    portKey = kSCPropNetProxiesGopherPort;
-                }
+            /* Extract scheme from the URL */
+            char scheme[16];
+            int32_t num = MIN(colon, COUNT(scheme)-1);
+            strncpy(scheme, url, num);
+            scheme[num] = 0;
+
+            /* Each scheme has a key of its own */
+            if (!StrCaseCmp(scheme, "http")) {
+                enabledKey = kSCPropNetProxiesHTTPEnable;
+                hostKey = kSCPropNetProxiesHTTPProxy;
+                portKey = kSCPropNetProxiesHTTPPort;
+            } else if (!StrCaseCmp(scheme, "https")) {
+                enabledKey = kSCPropNetProxiesHTTPSEnable;
+                hostKey = kSCPropNetProxiesHTTPSProxy;
+                portKey = kSCPropNetProxiesHTTPSPort;
+            } else if (!StrCaseCmp(scheme, "ftp")) {
+                enabledKey = kSCPropNetProxiesFTPEnable;
+                hostKey = kSCPropNetProxiesFTPProxy;
+                portKey = kSCPropNetProxiesFTPPort;
+            } else if (!StrCaseCmp(scheme, "gopher")) {
+                enabledKey = kSCPropNetProxiesGopherEnable;
+                hostKey = kSCPropNetProxiesGopherProxy;
+                portKey = kSCPropNetProxiesGopherPort;
+            }
 
-                /* Is it a known scheme? */
-                if (enabledKey) {
-
-                    /* Is proxy enabled for this scheme? */
-                    CFNumberRef numRef;
-                    numRef = CFDictionaryGetValue(proxyDict, enabledKey);
-                    if (numRef) {
-                        num = 0;
-                        CFNumberGetValue(numRef, kCFNumberSInt32Type, &num);
-                        if (num) {
-
-                            /* It is enabled. Get the host and port */
-                            CFStringRef hostRef;
-                            hostRef = CFDictionaryGetValue(proxyDict, hostKey);
-                            if (hostRef) {
-                                char *host = CFStringRef_ToUTF8(hostRef);
-                                if (host) {
-                                    curl_easy_setopt(curl,CURLOPT_PROXY,host);
-                                    numRef = CFDictionaryGetValue(proxyDict,
-                                        portKey);
-                                    if (numRef) {
-                                        num = 0;
-                                        CFNumberGetValue(numRef,
-                                            kCFNumberSInt32Type, &num);
-                                        if (num) {
-                                            curl_easy_setopt(curl,
-                                                CURLOPT_PROXYPORT, num);
-                                        }
+            /* Is it a known scheme? */
+            if (enabledKey) {
+
+                /* Is proxy enabled for this scheme? */
+                CFNumberRef numRef;
+                numRef = CFDictionaryGetValue(proxyDict, enabledKey);
+                if (numRef) {
+                    num = 0;
+                    CFNumberGetValue(numRef, kCFNumberSInt32Type, &num);
+                    if (num) {
+
+                        /* It is enabled. Get the host and port */
+                        CFStringRef hostRef;
+                        hostRef = CFDictionaryGetValue(proxyDict, hostKey);
+                        if (hostRef) {
+                            char *host = CFStringRef_ToUTF8(hostRef);
+                            if (host) {
+                                curl_easy_setopt(curl, CURLOPT_PROXY, host);
+                                numRef = CFDictionaryGetValue(proxyDict,
+                                    portKey);
+                                if (numRef) {
+                                    num = 0;
+                                    CFNumberGetValue(numRef,
+                                        kCFNumberSInt32Type, &num);
+                                    if (num) {
+                                        curl_easy_setopt(curl,
+                                            CURLOPT_PROXYPORT, num);
                                     }
-                                    MEM_Free(host);
                                 }
+                                MEM_Free(host);
                             }
                         }
                     }
                 }
-
-                CFRelease(proxyDict);
             }
-        }
-#endif /* __APPLE__ */
 
-        curl_easy_setopt(curl, CURLOPT_URL, cf->file.name);
-        curl_easy_setopt(curl, CURLOPT_USERAGENT, "SLIB " SLIB_VERSION_TEXT);
-        curl_easy_setopt(curl, CURLOPT_FILE, cf);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CurlWriteFunc);
-        curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 20);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
-        if (cf->userPwd) curl_easy_setopt(curl, CURLOPT_USERPWD, cf->userPwd);
-        result = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
-
-        /* synchronize with the read thread */
-        EVENT_Wait(&cf->readReq);
-        if (!cf->eof) {
-            if (cf->readLen > 0) {
-                /* flush buffered data */
-                EVENT_Reset(&cf->readReq);
-                EVENT_Set(&cf->readEvent);
-                EVENT_Wait(&cf->readReq);
-            }
-            if (!cf->eof) {
-                /* complete the final read */
-                cf->readLen = ((result == CURLE_OK) ? 0 : (-1));
-                EVENT_Reset(&cf->readReq);
-                EVENT_Set(&cf->readEvent);
-            }
+            CFRelease(proxyDict);
         }
     }
 }
+#endif /* __APPLE__ */
 
 /*
  * I/O handlers
@@ -266,23 +432,73 @@ STATIC CurlFile * CurlFileCast(File * f)
     return NULL;
 }
 
+/**
+ * Returns the consumed chunk to the worker. Resumes the paused transfer
+ * when enough chunks have been drained.
+ */
+STATIC void CurlRecycle(CurlFile * cf, CurlChunk * c)
+{
+    Bool resume = False;
+    MUTEX_Lock(&cf->mutex);
+    if (!RING_Put(&cf->empty, c)) {
+        cf->nchunks--;
+        MEM_Free(c);
+    }
+    if (cf->paused && RING_Size(&cf->full) <= CURL_RESUME_CHUNKS) {
+        cf->paused = False;
+        resume = True;
+    }
+    MUTEX_Unlock(&cf->mutex);
+
+    if (resume) {
+        CurlWorker * w = cf->worker;
+        MUTEX_Lock(&w->fetcher->mutex);
+        cf->resume = True;
+        w->resumed++;
+        MUTEX_Unlock(&w->fetcher->mutex);
+        curl_multi_wakeup(w->multi);
+    }
+}
+
+/**
+ * Waits until the buffer is full or the transfer is done.
+ */
 STATIC int CurlRead(File * f, void * buf, int len)
 {
     CurlFile * cf  = CurlFileCast(f);
     if (cf && !cf->eof) {
-        ASSERT(!cf->readBuf);
-        cf->readBuf = buf;
-        cf->readSize = len;
-        cf->readLen = 0;
-        EVENT_Set(&cf->readReq);
-        EVENT_Wait(&cf->readEvent);
-        EVENT_Reset(&cf->readEvent);
-        cf->readBuf = NULL;
-        cf->readSize = 0;
-        if (cf->readLen <= 0) {
+        int nbytes = 0;
+        while (nbytes < len) {
+            CurlChunk * c = cf->read;
+            if (c) {
+                /* the reader owns this chunk, no need to lock anything */
+                int n = MIN(len - nbytes, c->len - c->pos);
+                memcpy((char*)buf + nbytes, c->data + c->pos, n);
+                c->pos += n;
+                nbytes += n;
+                if (c->pos == c->len) {
+                    cf->read = NULL;
+                    CurlRecycle(cf, c);
+                }
+            } else {
+                Bool done;
+                MUTEX_Lock(&cf->mutex);
+                c = cf->read = RING_Get(&cf->full);
+                if (c == cf->tail) cf->tail = NULL;
+                done = cf->done;
+                if (!c && !done) EVENT_Reset(&cf->dataEvent);
+                MUTEX_Unlock(&cf->mutex);
+                if (!c) {
+                    if (done) break;
+                    EVENT_Wait(&cf->dataEvent);
+                }
+            }
+        }
+        if (nbytes == 0 && len > 0) {
             cf->eof = True;
+            if (cf->result != CURLE_OK) nbytes = -1;
         }
-        return cf->readLen;
+        return nbytes;
     }
     return -1;
 }
@@ -303,10 +519,32 @@ STATIC void CurlClose(File * f)
 {
     CurlFile * cf  = CurlFileCast(f);
     if (cf) {
-        /* make sure that the curl thread is dead */
+        CurlWorker * w = cf->worker;
+        UrlFetcher * fetcher = w->fetcher;
+        Bool wakeup = False;
+
+        /* make sure that the worker is done with this transfer */
         cf->eof = True;
-        EVENT_Set(&cf->readReq);
-        THREAD_Join(cf->thr);
+        MUTEX_Lock(&fetcher->mutex);
+        if (cf->entry.queue == &w->pending) {
+            /* the transfer hasn't started yet */
+            QUEUE_RemoveEntry(&cf->entry);
+            curl_easy_cleanup(cf->curl);
+            cf->curl = NULL;
+            EVENT_Set(&cf->doneEvent);
+        } else if (EVENT_State(&cf->doneEvent) != EVENT_SIGNALED) {
+            cf->cancel = True;
+            w->cancelled++;
+            wakeup = True;
+        }
+        MUTEX_Unlock(&fetcher->mutex);
+        if (wakeup) curl_multi_wakeup(w->multi);
+        EVENT_Wait(&cf->doneEvent);
+
+        if (cf->own) {
+            URL_FetcherDelete(cf->own);
+            cf->own = NULL;
+        }
     }
 }
 
@@ -314,9 +552,224 @@ STATIC void CurlFree(File * f)
 {
     CurlFile * cf  = CurlFileCast(f);
     if (cf) {
+        CurlChunk * c;
+        while ((c = RING_Get(&cf->full)) != NULL) MEM_Free(c);
+        while ((c = RING_Get(&cf->empty)) != NULL) MEM_Free(c);
+        RING_Destroy(&cf->full);
+        RING_Destroy(&cf->empty);
+        MEM_Free(cf->read);
+        EVENT_Destroy(&cf->doneEvent);
+        EVENT_Destroy(&cf->dataEvent);
+        MUTEX_Destroy(&cf->mutex);
+        MEM_Free(cf->userPwd);
+        MEM_Free(cf);
+    }
+}
+
+/*
+ * URL fetcher
+ */
+
+/**
+ * Picks the worker for the URL. Requests to the same host (more precisely,
+ * with the same scheme and authority part of the URL) are handled by the
+ * same worker so that they can share connections.
+ */
+STATIC CurlWorker * CurlPickWorker(UrlFetcher * fetcher, Str url)
+{
+    if (fetcher->nworkers > 1) {
+        unsigned int hash = 0;
+        Str p = strstr(url, "://");
+        Str end;
+        p = p ? (p + 3) : url;
+        end = strchr(p, '/');
+        if (!end) end = p + strlen(p);
+        for (p = url; p < end; p++) hash = hash * 31 + (unsigned char)*p;
+        return fetcher->workers + (hash % fetcher->nworkers);
+    }
+    return fetcher->workers;
+}
+
+/**
+ * Creates the URL fetcher with the specified number of worker threads.
+ * Zero or negative number means one thread.
+ */
+UrlFetcher * URL_FetcherCreate(int nthreads)
+{
+    int n = MAX(nthreads, 1);
+    size_t size = OFFSET(UrlFetcher,workers) + n * sizeof(CurlWorker);
+    UrlFetcher * fetcher = MEM_Alloc(size);
+    if (fetcher) {
+        memset(fetcher, 0, size);
+        if (MUTEX_Init(&fetcher->mutex)) {
+            while (fetcher->nworkers < n) {
+                CurlWorker * w = fetcher->workers + fetcher->nworkers;
+                w->fetcher = fetcher;
+                QUEUE_Init(&w->pending);
+                QUEUE_Init(&w->active);
+                w->multi = curl_multi_init();
+                if (!w->multi) break;
+                if (!THREAD_Create(&w->thr, CurlWorkerThread, w)) {
+                    curl_multi_cleanup(w->multi);
+                    break;
+                }
+                fetcher->nworkers++;
+            }
+            if (fetcher->nworkers == n) {
+                return fetcher;
+            }
+            URL_FetcherDelete(fetcher);
+        } else {
+            MEM_Free(fetcher);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Deletes the URL fetcher. All streams opened with URL_Fetch should be
+ * closed by now, transfers that are still in progress are aborted.
+ */
+void URL_FetcherDelete(UrlFetcher * fetcher)
+{
+    if (fetcher) {
+        int i;
+        MUTEX_Lock(&fetcher->mutex);
+        for (i=0; i<fetcher->nworkers; i++) {
+            fetcher->workers[i].stop = True;
+        }
+        MUTEX_Unlock(&fetcher->mutex);
+        for (i=0; i<fetcher->nworkers; i++) {
+            CurlWorker * w = fetcher->workers + i;
+            curl_multi_wakeup(w->multi);
+            THREAD_Join(w->thr);
+            curl_multi_cleanup(w->multi);
+        }
+        MUTEX_Destroy(&fetcher->mutex);
+        MEM_Free(fetcher);
+    }
+}
+
+/**
+ * Sets up the easy handle
+ */
+STATIC void CurlSetup(CurlFile * cf)
+{
+    CURL * curl = cf->curl;
+
+#ifdef __APPLE__
+    CurlSetProxy(curl, cf->file.name);
+#endif /* __APPLE__ */
+
+    curl_easy_setopt(curl, CURLOPT_URL, cf->file.name);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "SLIB " SLIB_VERSION_TEXT);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, cf);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, cf);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CurlWriteFunc);
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, (long)CURL_MAX_REDIRS);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    if (cf->userPwd) curl_easy_setopt(curl, CURLOPT_USERPWD, cf->userPwd);
+}
+
+/**
+ * Creates the stream and submits the transfer to the worker
+ */
+STATIC CurlFile * CurlFetch(UrlFetcher * fetcher, Str url,
+                            Str username, Str password)
+{
+    CurlFile * cf = MEM_New(CurlFile);
+    if (cf) {
+        memset(cf, 0, sizeof(*cf));
+        if (username || password) {
+            int len = 0;
+            if (username) len += strlen(username);
+            if (password) len += strlen(password);
+            cf->userPwd = MEM_NewArray(char, len+2);
+            if (cf->userPwd) {
+                cf->userPwd[0] = 0;
+                if (username) strcpy(cf->userPwd, username);
+                strcat(cf->userPwd, ":");
+                if (password) strcat(cf->userPwd, password);
+            }
+        }
+
+        if ((!(username || password) || cf->userPwd) &&
+            RING_Init2(&cf->full, CURL_MAX_CHUNKS, -1) &&
+            RING_Init2(&cf->empty, CURL_MAX_CHUNKS, -1)) {
+            if (MUTEX_Init(&cf->mutex)) {
+                if (EVENT_Init(&cf->dataEvent)) {
+                    if (EVENT_Init(&cf->doneEvent)) {
+                        cf->curl = curl_easy_init();
+                        if (cf->curl) {
+                            if (FILE_Init(&cf->file, url, False, &CurlIO)) {
+                                CurlWorker * w = CurlPickWorker(fetcher, url);
+                                cf->file.flags &= (~FILE_CAN_WRITE);
+                                cf->worker = w;
+                                cf->result = CURLE_OK;
+                                CurlSetup(cf);
+
+                                MUTEX_Lock(&fetcher->mutex);
+                                QUEUE_InsertTail(&w->pending, &cf->entry);
+                                MUTEX_Unlock(&fetcher->mutex);
+                                curl_multi_wakeup(w->multi);
+                                return cf;
+                            }
+                            curl_easy_cleanup(cf->curl);
+                        }
+                        EVENT_Destroy(&cf->doneEvent);
+                    }
+                    EVENT_Destroy(&cf->dataEvent);
+                }
+                MUTEX_Destroy(&cf->mutex);
+            }
+        }
+        RING_Destroy(&cf->full);
+        RING_Destroy(&cf->empty);
         MEM_Free(cf->userPwd);
         MEM_Free(cf);
     }
+    return NULL;
+}
+
+/**
+ * Starts fetching the URL and returns the stream to read the contents.
+ * Username and password are optional.
+ */
+File * URL_Fetch(UrlFetcher * fetcher, Str url, Str username, Str password)
+{
+    ASSERT(fetcher);
+    ASSERT(url);
+    if (fetcher && url) {
+        CurlFile * cf = CurlFetch(fetcher, url, username, password);
+        if (cf) {
+            return &cf->file;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Initializes the module, creates the fetcher shared by FILE_OpenURL and
+ * FILE_AuthURL. Without it, each stream gets a fetcher of its own.
+ */
+void URL_InitModule()
+{
+    if ((URL_initCount++) == 0) {
+        ASSERT(!URL_fetcher);
+        URL_fetcher = URL_FetcherCreate(1);
+    }
+}
+
+/**
+ * Cleanup the module. All the URL streams should be closed by now.
+ */
+void URL_Shutdown()
+{
+    ASSERT(URL_initCount > 0);
+    if ((--URL_initCount) == 0) {
+        URL_FetcherDelete(URL_fetcher);
+        URL_fetcher = NULL;
+    }
 }
 
 /**
@@ -326,43 +779,18 @@ File * FILE_AuthURL(Str url, Str username, Str password)
 {
     ASSERT(url);
     if (url) {
-        CurlFile * cf = MEM_New(CurlFile);
-        if (cf) {
-            memset(cf, 0, sizeof(*cf));
-            if (EVENT_Init(&cf->readEvent)) {
-                if (EVENT_Init(&cf->readReq)) {
-                    if (username || password) {
-                        int len = 0;
-                        if (username) len += strlen(username);
-                        if (password) len += strlen(password);
-                        cf->userPwd = MEM_NewArray(char, len+2);
-                        if (cf->userPwd) {
-                            cf->userPwd[0] = 0;
-                            if (username) strcpy(cf->userPwd, username);
-                            strcat(cf->userPwd, ":");
-                            if (password) strcat(cf->userPwd, password);
-                        }
-                    }
-
-                    if (!(username || password) || cf->userPwd) {
-                        cf->readBuf = NULL;
-                        cf->readSize = 0;
-                        cf->readLen = 0;
-                        cf->eof = False;
-                        if (FILE_Init(&cf->file, url, False, &CurlIO)) {
-                            cf->file.flags &= (~FILE_CAN_WRITE);
-                            if (THREAD_Create(&cf->thr, CurlThread, cf)) {
-                                return &cf->file;
-                            }
-                            FILE_Destroy(&cf->file);
-                        }
-                        MEM_Free(cf->userPwd);
-                    }
-                    EVENT_Destroy(&cf->readReq);
+        if (URL_fetcher) {
+            return URL_Fetch(URL_fetcher, url, username, password);
+        } else {
+            UrlFetcher * fetcher = URL_FetcherCreate(1);
+            if (fetcher) {
+                CurlFile * cf = CurlFetch(fetcher, url, username, password);
+                if (cf) {
+                    cf->own = fetcher;
+                    return &cf->file;
                 }
-                EVENT_Destroy(&cf->readEvent);
+                URL_FetcherDelete(fetcher);
             }
-            MEM_Free(cf);
         }
     }
     return NULL;
@@ -65,7 +65,12 @@ STATIC const FileIO InetIO = {
     NULL        /* setparam */,
     InetRead    /* read     */,
     InetWrite   /* write    */,
+    NULL        /* read64   */,
+    NULL        /* write64  */,
+    NULL        /* readv    */,
+    NULL        /* writev   */,
     NULL        /* skip     */,
+    NULL        /* peek     */,
     InetFlush   /* flush    */,
     InetEof     /* eof      */,
     NULL        /* fd       */,
@@ -362,6 +367,40 @@ File * FILE_OpenURL(Str url)
     return FILE_AuthURL(url, NULL, NULL);
 }
 
+/*
+ * WinInet maintains its own connection cache, the fetcher is only there
+ * for compatibility with the Unix implementation.
+ */
+struct _UrlFetcher {
+    int nthreads;
+};
+
+UrlFetcher * URL_FetcherCreate(int nthreads)
+{
+    UrlFetcher * fetcher = MEM_New(UrlFetcher);
+    if (fetcher) fetcher->nthreads = MAX(nthreads, 1);
+    return fetcher;
+}
+
+void URL_FetcherDelete(UrlFetcher * fetcher)
+{
+    MEM_Free(fetcher);
+}
+
+File * URL_Fetch(UrlFetcher * fetcher, Str url, Str username, Str password)
+{
+    ASSERT(fetcher);
+    return FILE_AuthURL(url, username, password);
+}
+
+void URL_InitModule()
+{
+}
+
+void URL_Shutdown()
+{
+}
+
 /*
  * HISTORY:
  *
@@ -0,0 +1,140 @@
+/*
+ * $Id: test_dns.c,v 1.1 2026/10/18 18:40:05 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+
+#include "test_common.h"
+
+static TestMem testMem;
+
+static
+void
+test_dns_async_proc(
+    Str host,
+    const struct sockaddr_storage* addrs,
+    int count,
+    void* ctx)
+{
+    int* result = (int*)ctx;
+    TEST_ASSERT(!strcmp(host, "127.0.0.1"));
+    TEST_ASSERT(count == 1);
+    TEST_ASSERT(addrs[0].ss_family == AF_INET);
+    *result = count;
+}
+
+static
+TestStatus
+test_dns_resolve(
+    const TestDesc* test)
+{
+    struct sockaddr_storage addrs[INET_MAX_ADDRS];
+    const struct sockaddr_in* in = (struct sockaddr_in*)addrs;
+    WorkQueue* q;
+    Socket ls, cs;
+    IPaddr addr;
+    int i, count = 0;
+    char port[8];
+
+    /* Without the cache */
+    TEST_ASSERT(INET_ResolveAddr("127.0.0.1", &addr));
+    TEST_ASSERT(addr == INADDR_LOOPBACK);
+    TEST_ASSERT(!INET_ResolveAll(" ", AF_UNSPEC, addrs, COUNT(addrs)));
+    TEST_ASSERT(!INET_ResolveAll(NULL, AF_UNSPEC, addrs, COUNT(addrs)));
+
+    /* Cached lookups return the same thing */
+    INET_InitModule();
+    for (i = 0; i < 2; i++) {
+        TEST_ASSERT(INET_Resolve("localhost", AF_INET, addrs));
+        TEST_ASSERT(in->sin_family == AF_INET);
+        TEST_ASSERT(ntohl(in->sin_addr.s_addr) == INADDR_LOOPBACK);
+        TEST_ASSERT(!in->sin_port);
+        TEST_ASSERT(INET_ResolveAddr(" localhost", &addr));
+        TEST_ASSERT(addr == INADDR_LOOPBACK);
+    }
+    TEST_ASSERT(INET_Resolve("::1", AF_INET6, addrs));
+    TEST_ASSERT(addrs[0].ss_family == AF_INET6);
+    TEST_ASSERT(!INET_Resolve("127.0.0.1", AF_INET6, addrs));
+    INET_FlushCache();
+
+    /* The same without caching */
+    INET_SetCacheTTL(0);
+    TEST_ASSERT(INET_ResolveAll("127.0.0.1", AF_INET, addrs, 1) == 1);
+    INET_SetCacheTTL(60000);
+
+    /* Asynchronous lookup */
+    q = WKQ_Create();
+    TEST_ASSERT(INET_ResolveAsync(q, "127.0.0.1", AF_INET,
+        test_dns_async_proc, &count));
+    WKQ_Stop(q, True);
+    WKQ_Delete(q);
+    TEST_ASSERT(count == 1);
+
+    /* Connect by name */
+    TEST_ASSERT(SOCKET_Listen(INADDR_LOOPBACK, 0, 2, 0, &ls));
+    sprintf(port, "%hu", SOCKET_GetPort(ls));
+    for (i = 0; i < 2; i++) {
+        char buf[16];
+        File* f = FILE_Open("localhost", port, &SocketIO);
+        TEST_ASSERT(f);
+        cs = accept(ls, NULL, NULL);
+        TEST_ASSERT(cs != INVALID_SOCKET);
+        TEST_ASSERT(send(cs, "hello\n", 6, 0) == 6);
+        TEST_ASSERT(FILE_Gets(f, buf, sizeof(buf)));
+        TEST_ASSERT(!strcmp(buf, "hello\n"));
+        FILE_Close(f);
+        SOCKET_Close(cs);
+    }
+    SOCKET_Close(ls);
+
+    INET_Shutdown();
+    return TEST_OK;
+}
+
+int
+main(int argc, char* argv[])
+{
+    static const TestDesc tests[] = {
+        {"Resolve", test_dns_resolve}
+    };
+
+    int ret;
+    test_mem_init(&testMem);
+    ret = TEST_MAIN(argc, argv, tests);
+    test_mem_deinit(&testMem);
+    return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,449 @@
+/*
+ * $Id: test_fbuf.c,v 1.1 2026/10/18 10:12:41 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "test_common.h"
+
+static TestMem testMem;
+
+static
+TestStatus
+test_fbuf_alloc(
+    const TestDesc* test)
+{
+    static const I8u data[] = {1, 2, 3};
+    File* f = FILE_MemIn(data, sizeof(data));
+    int i;
+
+    /* NULL resistance */
+    TEST_ASSERT(!FILE_IsBuffered(NULL));
+
+    /* Simulate allocation failures */
+    for (i = 0; i < 2; i++) {
+        testMem.failAt = testMem.allocCount + i;
+        TEST_ASSERT(!FILE_Buffered(f, 0));
+    }
+
+    /* Assert that all possible allocation failures in FILE_Buffered()
+     * have been exhausted. */
+    testMem.failAt = testMem.allocCount + i;
+    f = FILE_Buffered(f, 0);
+    TEST_ASSERT(f);
+
+    testMem.failAt = -1;
+    FILE_Close(f);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fbuf_read(
+    const TestDesc* test)
+{
+    static const char data[] = "0123456789abcdef";
+    char buf[sizeof(data)];
+    File* in = FILE_MemIn(data, sizeof(data) - 1);
+    File* f = FILE_Buffered(in, 4);
+
+    TEST_ASSERT(f);
+    TEST_ASSERT(FILE_IsBuffered(f));
+    TEST_ASSERT(!FILE_IsBuffered(in));
+    TEST_ASSERT(FILE_Target(f) == in);
+    TEST_ASSERT(!FILE_Eof(f));
+
+    /* Small reads are served from the buffer */
+    TEST_ASSERT(FILE_Getc(f) == '0');
+    TEST_ASSERT(FILE_Read(f, buf, 2) == 2);
+    TEST_ASSERT(!memcmp(buf, "12", 2));
+    TEST_ASSERT(FILE_BytesRead(in) == 4);
+
+    /* Pushback works too */
+    TEST_ASSERT(FILE_Ungetc(f, '2'));
+    TEST_ASSERT(FILE_Getc(f) == '2');
+
+    /* Large reads go straight to the target */
+    TEST_ASSERT(FILE_Read(f, buf, 10) == 10);
+    TEST_ASSERT(!memcmp(buf, "3456789abc", 10));
+    TEST_ASSERT(FILE_Skip(f, 1) == 1);
+    TEST_ASSERT(FILE_Read(f, buf, sizeof(buf)) == 2);
+    TEST_ASSERT(!memcmp(buf, "ef", 2));
+    TEST_ASSERT(FILE_BytesRead(f) == sizeof(data) - 1);
+    TEST_ASSERT(FILE_Read(f, buf, sizeof(buf)) == 0);
+    TEST_ASSERT(FILE_Eof(f));
+
+    FILE_Close(f);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fbuf_peek(
+    const TestDesc* test)
+{
+    static const char data[] = "0123456789";
+    const void* ptr;
+    File* f = FILE_Buffered(FILE_MemIn(data, sizeof(data) - 1), 4);
+
+    TEST_ASSERT(FILE_Peek(f, &ptr, 2) == 4);
+    TEST_ASSERT(!memcmp(ptr, "0123", 4));
+    TEST_ASSERT(FILE_Consume(f, 3));
+    TEST_ASSERT(FILE_BytesRead(f) == 3);
+
+    /* The remaining byte gets moved to the beginning of the buffer */
+    TEST_ASSERT(FILE_Peek(f, &ptr, 4) == 4);
+    TEST_ASSERT(!memcmp(ptr, "3456", 4));
+
+    /* Can't peek more than the buffer size */
+    TEST_ASSERT(FILE_Peek(f, &ptr, 100) == 4);
+    TEST_ASSERT(FILE_Consume(f, 4));
+
+    /* No direct access while there's pushed back data */
+    TEST_ASSERT(FILE_Ungetc(f, '6'));
+    TEST_ASSERT(!FILE_Peek(f, &ptr, 1));
+    TEST_ASSERT(!ptr);
+    TEST_ASSERT(FILE_Getc(f) == '6');
+
+    /* Consuming more than what's left */
+    TEST_ASSERT(FILE_Peek(f, &ptr, 1) == 3);
+    TEST_ASSERT(!FILE_Consume(f, 4));
+    TEST_ASSERT(!FILE_Peek(f, &ptr, 1));
+    TEST_ASSERT(FILE_Eof(f));
+
+    FILE_Close(f);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fbuf_lines(
+    const TestDesc* test)
+{
+    static const char data[] = "one\r\ntwo\n\nthree is long\nfour";
+    static const char binary[] = "abc\0def\n";
+    StrBuf32 buf;
+    StrBuf* sb = &buf.sb;
+    Char line[8];
+    File* f = FILE_Buffered(FILE_MemIn(data, sizeof(data) - 1), 5);
+
+    STRBUF_InitBufXXX(&buf);
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("one")));
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("two")));
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("")));
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("three is long")));
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("four")));
+    TEST_ASSERT(!FILE_ReadLine(f, sb));
+    FILE_Close(f);
+
+    /* FILE_Gets stops at binary zero and at the end of the buffer */
+    f = FILE_Buffered(FILE_MemIn(binary, sizeof(binary) - 1), 0);
+    TEST_ASSERT(FILE_Gets(f, line, 1));
+    TEST_ASSERT(!line[0]);
+    TEST_ASSERT(FILE_Gets(f, line, 3));
+    TEST_ASSERT(!StrCmp(line, T_("ab")));
+    TEST_ASSERT(FILE_Gets(f, line, COUNT(line)));
+    TEST_ASSERT(!StrCmp(line, T_("c")));
+    TEST_ASSERT(!FILE_Gets(f, line, COUNT(line)));
+    TEST_ASSERT(FILE_GetByte(f) == 0);
+    TEST_ASSERT(FILE_Gets(f, line, COUNT(line)));
+    TEST_ASSERT(!StrCmp(line, T_("def\n")));
+    TEST_ASSERT(!FILE_Gets(f, line, COUNT(line)));
+    FILE_Close(f);
+
+    /* Same thing with the in-memory stream which supports FILE_Peek too */
+    f = FILE_MemIn(data, sizeof(data) - 1);
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("one")));
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("two")));
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("")));
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("three is long")));
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("four")));
+    TEST_ASSERT(!FILE_ReadLine(f, sb));
+    FILE_Close(f);
+
+    STRBUF_Destroy(sb);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fbuf_out(
+    const TestDesc* test)
+{
+    static const char data[] = "0123456789abcdef";
+    size_t hiwater;
+    char c;
+    File* out = FILE_Mem();
+    File* f;
+    int i;
+
+    /* Simulate allocation failures */
+    for (i = 0; i < 2; i++) {
+        testMem.failAt = testMem.allocCount + i;
+        TEST_ASSERT(!FILE_BufferedOut(out, 0));
+    }
+    testMem.failAt = -1;
+
+    /* Small writes are collected in the buffer */
+    f = FILE_BufferedOut(out, 8);
+    TEST_ASSERT(f);
+    TEST_ASSERT(FILE_IsBufferedOut(f));
+    TEST_ASSERT(!FILE_IsBufferedOut(out));
+    TEST_ASSERT(!FILE_IsBuffered(f));
+    TEST_ASSERT(FILE_Target(f) == out);
+    TEST_ASSERT(FILE_Putc(f, '0'));
+    TEST_ASSERT(FILE_Puts(f, T_("123")));
+    TEST_ASSERT(FILE_Write(f, data + 4, 3) == 3);
+    TEST_ASSERT(!FILE_MemSize(out));
+    TEST_ASSERT(FILE_BytesWritten(f) == 7);
+
+    /* Filling the buffer writes it out */
+    TEST_ASSERT(FILE_Putc(f, '7'));
+    TEST_ASSERT(FILE_MemSize(out) == 8);
+    TEST_ASSERT(!memcmp(FILE_MemData(out), data, 8));
+
+    TEST_ASSERT(FILE_Putc(f, '8'));
+    TEST_ASSERT(FILE_Write(f, data + 9, 6) == 6);
+    TEST_ASSERT(FILE_MemSize(out) == 8);
+    TEST_ASSERT(FILE_Flush(f));
+    TEST_ASSERT(FILE_MemSize(out) == 15);
+    TEST_ASSERT(!memcmp(FILE_MemData(out), data, 15));
+
+    /* The data larger than the buffer go straight to the target */
+    FILE_MemClear(out);
+    TEST_ASSERT(FILE_Write(f, data, 8) == 8);
+    TEST_ASSERT(FILE_MemSize(out) == 8);
+
+    /* High-water mark */
+    hiwater = 9;
+    TEST_ASSERT(!FILE_SetParam(f, FILE_PARAM_HIWATER, &hiwater));
+    TEST_ASSERT(!FILE_SetParam(f, T_("foo"), &hiwater));
+    hiwater = 2;
+    TEST_ASSERT(FILE_Putc(f, 'x'));
+    TEST_ASSERT(FILE_SetParam(f, FILE_PARAM_HIWATER, &hiwater));
+    TEST_ASSERT(FILE_MemSize(out) == 8);
+    TEST_ASSERT(FILE_Putc(f, 'y'));
+    TEST_ASSERT(FILE_MemSize(out) == 10);
+    TEST_ASSERT(FILE_Putc(f, 'z'));
+    TEST_ASSERT(FILE_MemSize(out) == 10);
+
+    /* Reading sends the buffered data, then reads from the target */
+    TEST_ASSERT(FILE_Read(f, &c, 1) == 1);
+    TEST_ASSERT(c == '0');
+    TEST_ASSERT(FILE_MemSize(out) == 10);
+    TEST_ASSERT(((char*)FILE_MemData(out))[9] == 'z');
+
+    /* Detaching doesn't lose the data */
+    FILE_MemClear(out);
+    TEST_ASSERT(FILE_Putc(f, '!'));
+    FILE_Detach(f);
+    FILE_Close(f);
+    TEST_ASSERT(FILE_MemSize(out) == 1);
+    TEST_ASSERT(*((char*)FILE_MemData(out)) == '!');
+
+    /* Closing the buffered stream closes the target */
+    f = FILE_BufferedOut(out, 0);
+    TEST_ASSERT(FILE_Putc(f, '?'));
+    TEST_ASSERT(FILE_MemSize(out) == 1);
+    FILE_Close(f);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fbuf_reserve(
+    const TestDesc* test)
+{
+    static const I8u mb[] = {0x81, 0x80, 0x00, 0x7f};
+    File* out = FILE_Mem();
+    File* f = FILE_BufferedOut(out, 8);
+    I8u* p;
+
+    /* Only works for the buffered output */
+    TEST_ASSERT(!FILE_Reserve(out, 1));
+    TEST_ASSERT(!FILE_Reserve(f, 9));
+    p = FILE_Reserve(f, 8);
+    TEST_ASSERT(p);
+    memcpy(p, "abc", 3);
+    TEST_ASSERT(FILE_Commit(f, 3));
+    TEST_ASSERT(!FILE_MemSize(out));
+    TEST_ASSERT(FILE_BytesWritten(f) == 3);
+
+    /* Not enough space, flushes the buffer */
+    p = FILE_Reserve(f, 6);
+    TEST_ASSERT(p);
+    TEST_ASSERT(FILE_MemSize(out) == 3);
+    TEST_ASSERT(FILE_Commit(f, 0));
+
+    /* Multi-byte integers are encoded directly in the buffer */
+    TEST_ASSERT(FILE_WriteMultiByte32(f, 0x4000) == 3);
+    TEST_ASSERT(FILE_WriteMultiByte64(f, 0x7f) == 1);
+    TEST_ASSERT(FILE_MemSize(out) == 3);
+    TEST_ASSERT(FILE_Flush(f));
+    TEST_ASSERT(FILE_MemSize(out) == 7);
+    TEST_ASSERT(!memcmp((I8u*)FILE_MemData(out) + 3, mb, sizeof(mb)));
+    FILE_MemClear(out);
+
+    /* And so are XML attributes */
+    TEST_ASSERT(XML_WriteAttr(f, T_("a"), T_("<")));
+    TEST_ASSERT(FILE_Flush(f));
+    TEST_ASSERT(FILE_MemSize(out) == 9);
+    TEST_ASSERT(!memcmp(FILE_MemData(out), " a=\"&lt;\"", 9));
+    FILE_Close(f);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fbuf_print(
+    const TestDesc* test)
+{
+    static const char expected[] =
+        "0 -1 2147483647 -9223372036854775808 18446744073709551615 "
+        "1.50 -0.25 3 0.000001 1e+300 x=12345678901234567890";
+    File* out = FILE_Mem();
+    File* f;
+    int i;
+
+    /* The same output with and without the buffer */
+    for (i = 0; i < 2; i++) {
+        f = (i ? FILE_BufferedOut(out, 16) : out);
+        TEST_ASSERT(FILE_PutInt(f, 0));
+        TEST_ASSERT(FILE_Putc(f, ' '));
+        TEST_ASSERT(FILE_PutInt(f, -1));
+        TEST_ASSERT(FILE_Putc(f, ' '));
+        TEST_ASSERT(FILE_PutInt(f, INT_MAX));
+        TEST_ASSERT(FILE_Putc(f, ' '));
+        TEST_ASSERT(FILE_PutI64(f, ((I64s)1) << 63));
+        TEST_ASSERT(FILE_Putc(f, ' '));
+        TEST_ASSERT(FILE_PutU64(f, (I64u)-1));
+        TEST_ASSERT(FILE_Putc(f, ' '));
+        TEST_ASSERT(FILE_PutDouble(f, 1.5, 2));
+        TEST_ASSERT(FILE_Putc(f, ' '));
+        TEST_ASSERT(FILE_PutDouble(f, -0.25, 2));
+        TEST_ASSERT(FILE_Putc(f, ' '));
+        TEST_ASSERT(FILE_PutDouble(f, 2.5001, 0));
+        TEST_ASSERT(FILE_Putc(f, ' '));
+        TEST_ASSERT(FILE_PutDouble(f, 0.000001, -1));
+        TEST_ASSERT(FILE_Putc(f, ' '));
+        TEST_ASSERT(FILE_Printf(f, "%g", 1e300) == 6);
+        TEST_ASSERT(FILE_Printf(f, " x=%s", "12345678901234567890") == 23);
+        TEST_ASSERT(FILE_Flush(f));
+        TEST_ASSERT(FILE_MemSize(out) == strlen(expected));
+        TEST_ASSERT(!memcmp(FILE_MemData(out), expected, strlen(expected)));
+        TEST_ASSERT(FILE_BytesWritten(f) == strlen(expected));
+        FILE_MemClear(out);
+    }
+
+    /* Large values are formatted by printf */
+    TEST_ASSERT(FILE_PutDouble(f, 1e20, 1));
+    TEST_ASSERT(FILE_PutDouble(f, 1.0, 20));
+    TEST_ASSERT(FILE_Flush(f));
+    TEST_ASSERT(FILE_MemSize(out) == 45);
+    TEST_ASSERT(!memcmp(FILE_MemData(out), "100000000000000000000.0"
+        "1.00000000000000000000", 45));
+    FILE_Close(f);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fbuf_double(
+    const TestDesc* test)
+{
+    static const struct _TestDouble {
+        double value;
+        int prec;
+        const char* text;
+    } tests[] = {
+        { 0.15, 1, "0.1" },
+        { 2.675, 2, "2.67" },
+        { 0.125, 2, "0.12" },
+        { 0.375, 2, "0.38" },
+        { 2.5, 0, "2" },
+        { 3.5, 0, "4" },
+        { 9.96, 1, "10.0" },
+        { -0.0, 1, "-0.0" },
+        { -0.001, 2, "-0.00" },
+        { 0.0, 0, "0" }
+    };
+    File* out = FILE_Mem();
+    char buf[64];
+    int i, prec;
+
+    for (i = 0; i < (int)COUNT(tests); i++) {
+        size_t len = strlen(tests[i].text);
+        TEST_ASSERT(FILE_PutDouble(out, tests[i].value, tests[i].prec));
+        TEST_ASSERT(FILE_MemSize(out) == len);
+        TEST_ASSERT(!memcmp(FILE_MemData(out), tests[i].text, len));
+        FILE_MemClear(out);
+    }
+
+    /* Same as printf, including the values close to the midpoint */
+    for (prec = 0; prec < 5; prec++) {
+        for (i = -20000; i <= 20000; i++) {
+            double value = i / 1000.0 + i * 0.0000005;
+            int len = sprintf(buf, "%.*f", prec, value);
+            TEST_ASSERT(FILE_PutDouble(out, value, prec));
+            TEST_ASSERT(FILE_MemSize(out) == (size_t)len);
+            TEST_ASSERT(!memcmp(FILE_MemData(out), buf, len));
+            FILE_MemClear(out);
+        }
+    }
+    FILE_Close(out);
+    return TEST_OK;
+}
+
+int
+main(int argc, char* argv[])
+{
+    static const TestDesc tests[] = {
+        {"Alloc", test_fbuf_alloc},
+        {"Read", test_fbuf_read},
+        {"Peek", test_fbuf_peek},
+        {"Lines", test_fbuf_lines},
+        {"Out", test_fbuf_out},
+        {"Reserve", test_fbuf_reserve},
+        {"Print", test_fbuf_print},
+        {"Double", test_fbuf_double}
+    };
+
+    int ret;
+    test_mem_init(&testMem);
+    ret = TEST_MAIN(argc, argv, tests);
+    test_mem_deinit(&testMem);
+    return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
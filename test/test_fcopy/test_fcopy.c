@@ -0,0 +1,333 @@
+/*
+ * $Id: test_fcopy.c,v 1.1 2026/10/18 10:12:41 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+
+#include "test_common.h"
+
+static TestMem testMem;
+
+#define TEMP_PREFIX "/tmp/test_fcopy_"
+#define TEMP_RANDOM 8
+
+/* Must fit into the socket buffer, these tests are single threaded */
+#define DATA_SIZE 30000
+
+static
+I8u*
+test_fcopy_data(
+    void)
+{
+    size_t i;
+    I8u* data = MEM_NewArray(I8u, DATA_SIZE);
+    for (i = 0; i < DATA_SIZE; i++) data[i] = (I8u)(i % 251);
+    return data;
+}
+
+static
+void
+test_fcopy_temp(
+    Char* fname,
+    const void* data,
+    size_t size)
+{
+    File* f;
+    StrCpy(fname, T_(TEMP_PREFIX));
+    FILE_MakeUnique(fname, COUNT(TEMP_PREFIX) - 1, TEMP_RANDOM);
+    f = FILE_Open(fname, WRITE_BINARY_MODE, PlainFile);
+    TEST_ASSERT(f);
+    TEST_ASSERT(FILE_WriteAll(f, data, (int)size));
+    FILE_Close(f);
+}
+
+static
+Bool
+test_fcopy_check(
+    Str fname,
+    const void* data,
+    size_t size)
+{
+    Bool ok = False;
+    File* f = FILE_Open(fname, READ_BINARY_MODE, PlainFile);
+    if (f) {
+        Buffer* buf = BUFFER_Create();
+        ok = BoolValue(FILE_ReadData64(f, buf, -1) == (I64s)size &&
+            !memcmp(BUFFER_Access(buf), data, size));
+        BUFFER_Delete(buf);
+        FILE_Close(f);
+    }
+    return ok;
+}
+
+static
+TestStatus
+test_fcopy_file_to_socket(
+    const TestDesc* test)
+{
+    Char fname[COUNT(TEMP_PREFIX) + TEMP_RANDOM];
+    I8u* data = test_fcopy_data();
+    Buffer* buf = BUFFER_Create();
+    File* in;
+    File* out;
+    File* peer;
+    int sv[2];
+    I8u head[5];
+
+    test_fcopy_temp(fname, data, DATA_SIZE);
+    TEST_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    out = FILE_AttachToSocket(sv[0]);
+    peer = FILE_AttachToSocket(sv[1]);
+
+    /* Some data are already buffered by stdio */
+    in = FILE_Open(fname, READ_BINARY_MODE, PlainFile);
+    TEST_ASSERT(FILE_Read(in, head, sizeof(head)) == sizeof(head));
+    TEST_ASSERT(!memcmp(head, data, sizeof(head)));
+
+    /* And some were pushed back */
+    TEST_ASSERT(FILE_PushBack(in, head + 3, 2) == 2);
+    TEST_ASSERT(FILE_CopyN64(in, out, 100) == 100);
+    TEST_ASSERT(FILE_Copy64(in, out) == DATA_SIZE - 103);
+    TEST_ASSERT(FILE_BytesRead(in) == DATA_SIZE);
+    TEST_ASSERT(FILE_BytesWritten(out) == DATA_SIZE - 3);
+    TEST_ASSERT(FILE_Getc(in) == EOF);
+    TEST_ASSERT(FILE_Eof(in));
+    FILE_Close(in);
+    FILE_Close(out);
+
+    TEST_ASSERT(FILE_ReadData64(peer, buf, -1) == DATA_SIZE - 3);
+    TEST_ASSERT(!memcmp(BUFFER_Access(buf), data + 3, DATA_SIZE - 3));
+    FILE_Close(peer);
+
+    FILE_Delete(fname);
+    BUFFER_Delete(buf);
+    MEM_Free(data);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fcopy_file_to_file(
+    const TestDesc* test)
+{
+    Char fname1[COUNT(TEMP_PREFIX) + TEMP_RANDOM];
+    Char fname2[COUNT(TEMP_PREFIX) + TEMP_RANDOM];
+    I8u* data = test_fcopy_data();
+    File* in;
+    File* out;
+
+    test_fcopy_temp(fname1, data, DATA_SIZE);
+    test_fcopy_temp(fname2, data, 0);
+
+    /* The first byte is still in the stdio buffer */
+    in = FILE_Open(fname1, READ_BINARY_MODE, PlainFile);
+    out = FILE_Open(fname2, WRITE_BINARY_MODE, PlainFile);
+    TEST_ASSERT(FILE_PutByte(out, FILE_GetByte(in)));
+    TEST_ASSERT(FILE_CopyN64(in, out, 1000) == 1000);
+    TEST_ASSERT(FILE_PutByte(out, FILE_GetByte(in)));
+    TEST_ASSERT(FILE_Copy64(in, out) == DATA_SIZE - 1002);
+    TEST_ASSERT(!FILE_Copy64(in, out));
+    TEST_ASSERT(FILE_BytesRead(in) == DATA_SIZE);
+    TEST_ASSERT(FILE_BytesWritten(out) == DATA_SIZE);
+    FILE_Close(in);
+    FILE_Close(out);
+    TEST_ASSERT(test_fcopy_check(fname2, data, DATA_SIZE));
+
+    FILE_Delete(fname1);
+    FILE_Delete(fname2);
+    MEM_Free(data);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fcopy_socket_to_file(
+    const TestDesc* test)
+{
+    Char fname[COUNT(TEMP_PREFIX) + TEMP_RANDOM];
+    I8u* data = test_fcopy_data();
+    File* in;
+    File* out;
+    File* peer;
+    int sv[2];
+
+    TEST_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    in = FILE_AttachToSocket(sv[0]);
+    peer = FILE_AttachToSocket(sv[1]);
+    TEST_ASSERT(FILE_WriteAll(peer, data, DATA_SIZE));
+    FILE_Close(peer);
+
+    test_fcopy_temp(fname, data, 0);
+    out = FILE_Open(fname, WRITE_BINARY_MODE, PlainFile);
+    TEST_ASSERT(FILE_CopyN64(in, out, 10) == 10);
+    TEST_ASSERT(FILE_Copy64(in, out) == DATA_SIZE - 10);
+    TEST_ASSERT(FILE_BytesRead(in) == DATA_SIZE);
+    TEST_ASSERT(FILE_BytesWritten(out) == DATA_SIZE);
+    FILE_Close(in);
+    FILE_Close(out);
+    TEST_ASSERT(test_fcopy_check(fname, data, DATA_SIZE));
+
+    /* Append mode, it's done in the user space */
+    TEST_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    in = FILE_AttachToSocket(sv[0]);
+    peer = FILE_AttachToSocket(sv[1]);
+    TEST_ASSERT(FILE_WriteAll(peer, data, 10));
+    FILE_Close(peer);
+    out = FILE_Open(fname, APPEND_BINARY_MODE, PlainFile);
+    TEST_ASSERT(FILE_Copy64(in, out) == 10);
+    TEST_ASSERT(FILE_BytesWritten(out) == 10);
+    FILE_Close(in);
+    FILE_Close(out);
+    TEST_ASSERT(FILE_Size(fname) == DATA_SIZE + 10);
+
+    FILE_Delete(fname);
+    MEM_Free(data);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fcopy_mem(
+    const TestDesc* test)
+{
+    Char fname[COUNT(TEMP_PREFIX) + TEMP_RANDOM];
+    I8u* data = test_fcopy_data();
+    File* in;
+    File* out;
+
+    /* Memory stream on either side, nothing for the kernel to do */
+    test_fcopy_temp(fname, data, DATA_SIZE);
+    in = FILE_Open(fname, READ_BINARY_MODE, PlainFile);
+    out = FILE_Mem();
+    TEST_ASSERT(FILE_Copy64(in, out) == DATA_SIZE);
+    TEST_ASSERT(FILE_MemSize(out) == DATA_SIZE);
+    TEST_ASSERT(!memcmp(FILE_MemData(out), data, DATA_SIZE));
+    FILE_Close(in);
+
+    in = out;
+    out = FILE_Open(fname, WRITE_BINARY_MODE, PlainFile);
+    TEST_ASSERT(FILE_Copy64(in, out) == DATA_SIZE);
+    FILE_Close(in);
+    FILE_Close(out);
+    TEST_ASSERT(test_fcopy_check(fname, data, DATA_SIZE));
+
+    FILE_Delete(fname);
+    MEM_Free(data);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fcopy_cork(
+    const TestDesc* test)
+{
+    static const char head[] = "HEAD:";
+    static const char body[] = "BODY";
+    Char fname[COUNT(TEMP_PREFIX) + TEMP_RANDOM];
+    File* in;
+    File* out;
+    int sv[2];
+    char buf[16];
+
+    /* The buffered data go out first */
+    test_fcopy_temp(fname, body, strlen(body));
+    TEST_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    out = FILE_AttachToSocket2(sv[0], FILE_SOCK_CORK);
+    TEST_ASSERT(out);
+    TEST_ASSERT(FILE_Puts(out, head));
+    in = FILE_Open(fname, READ_BINARY_MODE, PlainFile);
+    TEST_ASSERT(FILE_Copy64(in, out) == strlen(body));
+    TEST_ASSERT(FILE_Flush(out));
+    TEST_ASSERT(recv(sv[1], buf, sizeof(buf), 0) == 9);
+    TEST_ASSERT(!memcmp(buf, "HEAD:BODY", 9));
+    FILE_Close(in);
+    FILE_Close(out);
+    close(sv[1]);
+
+    FILE_Delete(fname);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fcopy_timeout(
+    const TestDesc* test)
+{
+    const Time timeout = 100;
+    Char fname[COUNT(TEMP_PREFIX) + TEMP_RANDOM];
+    File* in;
+    File* out;
+    File* peer;
+    int sv[2];
+
+    /* The peer stalls, the copy must not block forever */
+    TEST_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    in = FILE_AttachToSocket(sv[0]);
+    peer = FILE_AttachToSocket(sv[1]);
+    TEST_ASSERT(FILE_SetParam(in, FILE_PARAM_RTIMEOUT, (void*)&timeout));
+    TEST_ASSERT(FILE_WriteAll(peer, "0123456789", 10));
+    test_fcopy_temp(fname, NULL, 0);
+    out = FILE_Open(fname, WRITE_BINARY_MODE, PlainFile);
+    TEST_ASSERT(FILE_Copy64(in, out) == 10);
+    TEST_ASSERT(FILE_TimedOut(in));
+    FILE_Close(out);
+    FILE_Close(in);
+    FILE_Close(peer);
+    TEST_ASSERT(test_fcopy_check(fname, "0123456789", 10));
+
+    FILE_Delete(fname);
+    return TEST_OK;
+}
+
+int
+main(int argc, char* argv[])
+{
+    static const TestDesc tests[] = {
+        {"FileToSocket", test_fcopy_file_to_socket},
+        {"FileToFile", test_fcopy_file_to_file},
+        {"SocketToFile", test_fcopy_socket_to_file},
+        {"Mem", test_fcopy_mem},
+        {"Cork", test_fcopy_cork},
+        {"Timeout", test_fcopy_timeout}
+    };
+
+    int ret;
+    test_mem_init(&testMem);
+    ret = TEST_MAIN(argc, argv, tests);
+    test_mem_deinit(&testMem);
+    return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
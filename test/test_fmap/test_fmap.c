@@ -0,0 +1,210 @@
+/*
+ * $Id: test_fmap.c,v 1.1 2026/10/18 10:12:41 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+#include "test_common.h"
+
+static TestMem testMem;
+
+#define TEMP_PREFIX "/tmp/test_fmap_"
+#define TEMP_RANDOM 8
+
+static
+void
+test_fmap_temp(
+    Char* fname,
+    const void* data,
+    size_t size)
+{
+    File* f;
+    StrCpy(fname, T_(TEMP_PREFIX));
+    FILE_MakeUnique(fname, COUNT(TEMP_PREFIX) - 1, TEMP_RANDOM);
+    f = FILE_Open(fname, WRITE_BINARY_MODE, PlainFile);
+    TEST_ASSERT(f);
+    TEST_ASSERT(FILE_WriteAll(f, data, (int)size));
+    FILE_Close(f);
+}
+
+static
+TestStatus
+test_fmap_basic(
+    const TestDesc* test)
+{
+    static const char data[] = "0123456789\nabc\n";
+    Char fname[COUNT(TEMP_PREFIX) + TEMP_RANDOM];
+    const void* ptr;
+    size_t size;
+    StrBuf32 buf;
+    StrBuf* sb = &buf.sb;
+    char tmp[4];
+    File* f;
+
+    test_fmap_temp(fname, data, sizeof(data) - 1);
+    STRBUF_InitBufXXX(&buf);
+
+    /* Mapped files are read-only */
+    TEST_ASSERT(!FILE_Open(fname, WRITE_BINARY_MODE, MappedFile));
+    TEST_ASSERT(!FILE_Open(fname, "r+", MappedFile));
+
+    f = FILE_Open(fname, READ_BINARY_MODE, MappedFile);
+    TEST_ASSERT(f);
+    TEST_ASSERT(FILE_IsFileIO(f));
+    TEST_ASSERT(FILE_Fd(f) >= 0);
+    TEST_ASSERT(!FILE_Eof(f));
+    TEST_ASSERT(FILE_Write(f, data, 1) < 0);
+
+    TEST_ASSERT(FILE_Read(f, tmp, 2) == 2);
+    TEST_ASSERT(!memcmp(tmp, "01", 2));
+    TEST_ASSERT(FILE_Skip(f, 2) == 2);
+    TEST_ASSERT(FILE_MapView(f, &ptr, &size));
+    TEST_ASSERT(size == sizeof(data) - 5);
+    TEST_ASSERT(!memcmp(ptr, data + 4, size));
+
+    /* No direct access while there's pushed back data */
+    TEST_ASSERT(FILE_Getc(f) == '4');
+    TEST_ASSERT(FILE_Ungetc(f, '4'));
+    TEST_ASSERT(!FILE_MapView(f, &ptr, &size));
+    TEST_ASSERT(!ptr);
+    TEST_ASSERT(!size);
+
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("456789")));
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("abc")));
+    TEST_ASSERT(!FILE_ReadLine(f, sb));
+    TEST_ASSERT(FILE_Eof(f));
+    TEST_ASSERT(FILE_BytesRead(f) == sizeof(data) - 1);
+    TEST_ASSERT(FILE_MapView(f, &ptr, &size));
+    TEST_ASSERT(!size);
+
+    /* Reopen maps the file again */
+    TEST_ASSERT(FILE_Reopen(f, fname, READ_BINARY_MODE));
+    TEST_ASSERT(FILE_MapView(f, &ptr, &size));
+    TEST_ASSERT(size == sizeof(data) - 1);
+    TEST_ASSERT(FILE_Consume(f, size));
+    TEST_ASSERT(FILE_Eof(f));
+    FILE_Close(f);
+
+    STRBUF_Destroy(sb);
+    TEST_ASSERT(FILE_Delete(fname));
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fmap_empty(
+    const TestDesc* test)
+{
+    Char fname[COUNT(TEMP_PREFIX) + TEMP_RANDOM];
+    const void* ptr;
+    size_t size;
+    char tmp[4];
+    File* f;
+
+    test_fmap_temp(fname, NULL, 0);
+    f = FILE_Open(fname, READ_BINARY_MODE, MappedFile);
+    TEST_ASSERT(f);
+    TEST_ASSERT(FILE_Eof(f));
+    TEST_ASSERT(FILE_Read(f, tmp, sizeof(tmp)) == 0);
+    TEST_ASSERT(FILE_MapView(f, &ptr, &size));
+    TEST_ASSERT(!size);
+    FILE_Close(f);
+
+    TEST_ASSERT(FILE_Delete(fname));
+    TEST_ASSERT(!FILE_Open(fname, READ_BINARY_MODE, MappedFile));
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fmap_consumers(
+    const TestDesc* test)
+{
+    static const char base64[] = "SGVsbG8sIHdvcmxkIQ==\n";
+    static const char hello[] = "Hello, world!";
+    Char fname[COUNT(TEMP_PREFIX) + TEMP_RANDOM];
+    I8u md1[SHA1_DIGEST_SIZE];
+    I8u md2[SHA1_DIGEST_SIZE];
+    Buffer* buf = BUFFER_Create();
+    Digest* d = SHA1_Create();
+    File* f;
+
+    /* BASE64 decoder */
+    test_fmap_temp(fname, base64, sizeof(base64) - 1);
+    f = FILE_Open(fname, READ_BINARY_MODE, MappedFile);
+    TEST_ASSERT(BASE64_DecodeFile(f, buf));
+    TEST_ASSERT(BUFFER_Size(buf) == sizeof(hello) - 1);
+    TEST_ASSERT(!memcmp(BUFFER_Access(buf), hello, sizeof(hello) - 1));
+    TEST_ASSERT(FILE_Eof(f));
+
+    /* Message digest */
+    TEST_ASSERT(FILE_Reopen(f, fname, READ_BINARY_MODE));
+    TEST_ASSERT(DIGEST_UpdateFile(d, f));
+    TEST_ASSERT(FILE_Eof(f));
+    DIGEST_Finish(d, md1);
+    SHA1_Digest(base64, sizeof(base64) - 1, md2);
+    TEST_ASSERT(!memcmp(md1, md2, sizeof(md1)));
+    FILE_Close(f);
+
+    /* Same thing with a regular file */
+    f = FILE_Open(fname, READ_BINARY_MODE, PlainFile);
+    DIGEST_Init(d);
+    TEST_ASSERT(DIGEST_UpdateFile(d, f));
+    DIGEST_Finish(d, md1);
+    TEST_ASSERT(!memcmp(md1, md2, sizeof(md1)));
+    FILE_Close(f);
+
+    DIGEST_Delete(d);
+    BUFFER_Delete(buf);
+    TEST_ASSERT(FILE_Delete(fname));
+    return TEST_OK;
+}
+
+int
+main(int argc, char* argv[])
+{
+    static const TestDesc tests[] = {
+        {"Basic", test_fmap_basic},
+        {"Empty", test_fmap_empty},
+        {"Consumers", test_fmap_consumers}
+    };
+
+    int ret;
+    test_mem_init(&testMem);
+    ret = TEST_MAIN(argc, argv, tests);
+    test_mem_deinit(&testMem);
+    return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -175,6 +175,167 @@ test_fmem_write(
     return TEST_OK;
 }
 
+static
+TestStatus
+test_fmem_large(
+    const TestDesc* test)
+{
+    const size_t size = 100000;
+    I8u* data = MEM_NewArray(I8u, size);
+    I8u* data2 = MEM_NewArray(I8u, size);
+    Buffer* buf = BUFFER_Create();
+    File* out = FILE_Mem();
+    File* in;
+    File* sub;
+    size_t i;
+
+    for (i = 0; i < size; i++) data[i] = (I8u)i;
+    TEST_ASSERT(FILE_Write64(out, data, size) == (I64s)size);
+    TEST_ASSERT(FILE_BytesWritten(out) == size);
+
+    /* FILE_Read64 takes the pushback buffer into account */
+    TEST_ASSERT(FILE_Getc(out) == data[0]);
+    TEST_ASSERT(FILE_Ungetc(out, data[0]));
+    TEST_ASSERT(FILE_Read64(out, data2, size) == (I64s)size);
+    TEST_ASSERT(!memcmp(data, data2, size));
+    TEST_ASSERT(FILE_Read64(out, data2, size) == 0);
+    FILE_Close(out);
+
+    /* Copying from memory resident stream */
+    in = FILE_MemIn(data, size);
+    out = FILE_Mem();
+    TEST_ASSERT(FILE_CopyN64(in, out, 10) == 10);
+    TEST_ASSERT(FILE_Copy64(in, out) == (I64s)(size - 10));
+    TEST_ASSERT(FILE_BytesRead(in) == size);
+    TEST_ASSERT(FILE_BytesWritten(out) == size);
+    TEST_ASSERT(!memcmp(FILE_MemData(out), data, size));
+    TEST_ASSERT(FILE_Eof(in));
+    FILE_Close(out);
+    FILE_Close(in);
+
+    /* Copying from the stream that doesn't support direct access */
+    in = FILE_MemIn(data, size);
+    sub = FILE_SubStream(in, size - 1);
+    out = FILE_Mem();
+    TEST_ASSERT(FILE_CopyN64(sub, out, 1000) == 1000);
+    TEST_ASSERT(FILE_Copy64(sub, out) == (I64s)(size - 1001));
+    TEST_ASSERT(FILE_MemSize(out) == size - 1);
+    TEST_ASSERT(!memcmp(FILE_MemData(out), data, size - 1));
+    FILE_Close(out);
+    FILE_Close(sub);
+    FILE_Close(in);
+
+    /* FILE_ReadData64 reads directly into the buffer */
+    in = FILE_MemIn(data, size);
+    sub = FILE_SubStream(in, size);
+    TEST_ASSERT(FILE_ReadData64(sub, buf, 7) == 7);
+    TEST_ASSERT(FILE_ReadData64(sub, buf, -1) == (I64s)(size - 7));
+    TEST_ASSERT(BUFFER_Size(buf) == size);
+    TEST_ASSERT(!memcmp(BUFFER_Access(buf), data, size));
+    TEST_ASSERT(!FILE_ReadData64(sub, buf, -1));
+    FILE_Close(sub);
+    FILE_Close(in);
+
+    /* And through the stack if the buffer has a rollover */
+    BUFFER_Clear(buf);
+    TEST_ASSERT(BUFFER_Put(buf, data, 10, False));
+    TEST_ASSERT(BUFFER_Get(buf, NULL, 5) == 5);
+    TEST_ASSERT(BUFFER_Put(buf, data, buf->alloc - 5, False));
+    TEST_ASSERT(BUFFER_Get(buf, NULL, 5) == 5);
+    in = FILE_MemIn(data, size);
+    sub = FILE_SubStream(in, size);
+    i = BUFFER_Size(buf);
+    TEST_ASSERT(FILE_ReadData64(sub, buf, -1) == (I64s)size);
+    TEST_ASSERT(BUFFER_Size(buf) == i + size);
+    TEST_ASSERT(!memcmp((I8u*)BUFFER_Access(buf) + i, data, size));
+    FILE_Close(sub);
+    FILE_Close(in);
+
+    BUFFER_Delete(buf);
+    MEM_Free(data);
+    MEM_Free(data2);
+    return TEST_OK;
+}
+
+static
+Bool
+test_fmem_vector_write(
+    File* out)
+{
+    static const char part1[] = "Header";
+    static const char part2[] = "Payload";
+    FileVec vec[3];
+    const size_t total = sizeof(part1) + sizeof(part2);
+    const size_t written = FILE_BytesWritten(out);
+
+    vec[0].data = (void*)part1; vec[0].len = sizeof(part1);
+    vec[1].data = NULL; vec[1].len = 0;
+    vec[2].data = (void*)part2; vec[2].len = sizeof(part2);
+    return BoolValue(FILE_WriteV(out, vec, 3) == (I64s)total &&
+        FILE_Flush(out) && FILE_BytesWritten(out) == written + total);
+}
+
+static
+Bool
+test_fmem_vector_read(
+    File* in)
+{
+    static const char expect[] = "Header\0Payload";
+    char buf[sizeof(expect)];
+    FileVec vec[3];
+    const size_t read = FILE_BytesRead(in);
+
+    /* The middle vector spans both written parts */
+    vec[0].data = buf; vec[0].len = 4;
+    vec[1].data = buf + 4; vec[1].len = 8;
+    vec[2].data = buf + 12; vec[2].len = sizeof(buf) - 12;
+    return BoolValue(FILE_ReadV(in, vec, 3) == sizeof(buf) &&
+        FILE_BytesRead(in) == read + sizeof(buf) &&
+        !memcmp(buf, expect, sizeof(buf)));
+}
+
+static
+TestStatus
+test_fmem_vector(
+    const TestDesc* test)
+{
+    File* f = FILE_Mem();
+    TEST_ASSERT(test_fmem_vector_write(f));
+    TEST_ASSERT(test_fmem_vector_read(f));
+    TEST_ASSERT(!FILE_ReadV(f, NULL, 0));
+    TEST_ASSERT(!FILE_WriteV(f, NULL, 0));
+    FILE_Close(f);
+
+#ifdef _UNIX
+    {
+        int sv[2];
+        FILE* tmp = tmpfile();
+        File* in;
+
+        /* Plain file, stdio buffer is flushed before writev */
+        TEST_ASSERT(tmp);
+        f = FILE_AttachToFile(tmp, TEXT("tmp"));
+        TEST_ASSERT(FILE_Putc(f, 'x'));
+        TEST_ASSERT(test_fmem_vector_write(f));
+        rewind(tmp);
+        TEST_ASSERT(FILE_Getc(f) == 'x');
+        TEST_ASSERT(test_fmem_vector_read(f));
+        FILE_Close(f);
+
+        /* Socket */
+        TEST_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+        f = FILE_AttachToSocket(sv[0]);
+        in = FILE_AttachToSocket(sv[1]);
+        TEST_ASSERT(test_fmem_vector_write(f));
+        TEST_ASSERT(test_fmem_vector_read(in));
+        FILE_Close(f);
+        FILE_Close(in);
+    }
+#endif /* _UNIX */
+
+    return TEST_OK;
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -182,7 +343,9 @@ main(int argc, char* argv[])
         {"Alloc", test_fmem_alloc},
         {"Basic", test_fmem_basic},
         {"Read", test_fmem_read},
-        {"Write", test_fmem_write}
+        {"Write", test_fmem_write},
+        {"Large", test_fmem_large},
+        {"Vector", test_fmem_vector}
     };
 
     int ret;
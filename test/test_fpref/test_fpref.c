@@ -0,0 +1,267 @@
+/*
+ * $Id: test_fpref.c,v 1.1 2026/10/18 10:12:41 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+
+#include "test_common.h"
+
+static TestMem testMem;
+
+#define DATA_SIZE 100000
+
+static
+I8u*
+test_fpref_data(
+    void)
+{
+    size_t i;
+    I8u* data = MEM_NewArray(I8u, DATA_SIZE);
+    for (i = 0; i < DATA_SIZE; i++) data[i] = (I8u)(i % 251);
+    return data;
+}
+
+static
+TestStatus
+test_fpref_alloc(
+    const TestDesc* test)
+{
+    static const I8u data[] = {1, 2, 3};
+    File* in = FILE_MemIn(data, sizeof(data));
+    File* f;
+    int i;
+
+    /* Simulate allocation failures */
+    for (i = 0; i < 3; i++) {
+        testMem.failAt = testMem.allocCount + i;
+        TEST_ASSERT(!FILE_Prefetch(in, 0, 0));
+    }
+    testMem.failAt = -1;
+
+    f = FILE_Prefetch(in, 0, 0);
+    TEST_ASSERT(f);
+    TEST_ASSERT(FILE_Target(f) == in);
+    TEST_ASSERT(FILE_Getc(f) == 1);
+    TEST_ASSERT(FILE_Write(f, data, sizeof(data)) < 0);
+    FILE_Close(f);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fpref_read(
+    const TestDesc* test)
+{
+    I8u* data = test_fpref_data();
+    I8u* buf = MEM_NewArray(I8u, DATA_SIZE);
+    File* f = FILE_Prefetch(FILE_MemIn(data, DATA_SIZE), 2, 1000);
+    size_t pos = 0;
+    int chunk = 1;
+
+    TEST_ASSERT(f);
+    TEST_ASSERT(!FILE_Eof(f));
+    while (pos < DATA_SIZE) {
+        int n = FILE_Read(f, buf + pos, chunk);
+        TEST_ASSERT(n > 0);
+        pos += n;
+        chunk = (chunk * 7) % 3001 + 1;
+    }
+    TEST_ASSERT(!memcmp(buf, data, DATA_SIZE));
+    TEST_ASSERT(FILE_Read(f, buf, 1) == 0);
+    TEST_ASSERT(FILE_Eof(f));
+    TEST_ASSERT(FILE_BytesRead(f) == DATA_SIZE);
+    FILE_Close(f);
+
+    /* Skip and copy */
+    f = FILE_Prefetch(FILE_MemIn(data, DATA_SIZE), 3, 4096);
+    TEST_ASSERT(FILE_Skip(f, 5000) == 5000);
+    TEST_ASSERT(FILE_Getc(f) == data[5000]);
+    TEST_ASSERT(FILE_Ungetc(f, data[5000]));
+    {
+        File* out = FILE_Mem();
+        TEST_ASSERT(FILE_Copy64(f, out) == DATA_SIZE - 5000);
+        TEST_ASSERT(!memcmp(FILE_MemData(out), data + 5000, DATA_SIZE-5000));
+        FILE_Close(out);
+    }
+    FILE_Close(f);
+
+    MEM_Free(data);
+    MEM_Free(buf);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fpref_lines(
+    const TestDesc* test)
+{
+    static const char text[] = "one\ntwo\r\n\nthree";
+    File* f = FILE_Prefetch(FILE_MemIn(text, sizeof(text) - 1), 2, 4);
+    StrBuf32 buf;
+    StrBuf* sb = &buf.sb;
+
+    STRBUF_InitBufXXX(&buf);
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("one")));
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("two")));
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("")));
+    TEST_ASSERT(FILE_ReadLine(f, sb) && STRBUF_EqualsTo(sb, T_("three")));
+    TEST_ASSERT(!FILE_ReadLine(f, sb));
+    STRBUF_Destroy(sb);
+    FILE_Close(f);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fpref_close(
+    const TestDesc* test)
+{
+    I8u* data = test_fpref_data();
+    File* in = FILE_MemIn(data, DATA_SIZE);
+    File* f = FILE_Prefetch(in, 2, 100);
+
+    /* Close it while the reader is waiting for the free buffer */
+    TEST_ASSERT(FILE_Getc(f) == data[0]);
+    FILE_Close(f);
+
+    /* Detach and close the target separately */
+    in = FILE_MemIn(data, DATA_SIZE);
+    f = FILE_Prefetch(in, 2, 100);
+    TEST_ASSERT(FILE_Getc(f) == data[0]);
+    FILE_Detach(f);
+    FILE_Close(in);
+
+    MEM_Free(data);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fpref_socket(
+    const TestDesc* test)
+{
+    File* in;
+    File* f;
+    File* peer;
+    int sv[2];
+    char buf[16];
+
+    /* Don't wait for the data the other side is not going to send */
+    TEST_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    peer = FILE_AttachToSocket(sv[1]);
+    in = FILE_AttachToSocket(sv[0]);
+    f = FILE_Prefetch(in, 0, 0);
+    TEST_ASSERT(f);
+    TEST_ASSERT(FILE_Puts(peer, "hello"));
+    TEST_ASSERT(FILE_Read(f, buf, 5) == 5);
+    TEST_ASSERT(!memcmp(buf, "hello", 5));
+    TEST_ASSERT(FILE_Puts(peer, "world"));
+    TEST_ASSERT(FILE_Getc(f) == 'w');
+    TEST_ASSERT(FILE_Read(f, buf, 4) == 4);
+    TEST_ASSERT(!memcmp(buf, "orld", 4));
+
+    /* The peer is still connected */
+    FILE_Close(f);
+    FILE_Close(peer);
+
+    /* Close it before the peer has sent a full buffer */
+    TEST_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    peer = FILE_AttachToSocket(sv[1]);
+    f = FILE_Prefetch(FILE_AttachToSocket(sv[0]), 0, 0);
+    TEST_ASSERT(f);
+    TEST_ASSERT(FILE_Puts(peer, "hello"));
+    THREAD_Sleep(100);
+    FILE_Close(f);
+    FILE_Close(peer);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fpref_pipe(
+    const TestDesc* test)
+{
+    File* in;
+    File* f;
+    int fds[2];
+    char buf[16];
+
+    /* Detach it while the pipe is still open */
+    TEST_ASSERT(!pipe(fds));
+    in = FILE_AttachToFile(fdopen(fds[0], "r"), TEXT("pipe"));
+    TEST_ASSERT(in);
+    f = FILE_Prefetch(in, 0, 0);
+    TEST_ASSERT(f);
+    TEST_ASSERT(write(fds[1], "hello", 5) == 5);
+    TEST_ASSERT(FILE_Read(f, buf, 5) == 5);
+    TEST_ASSERT(!memcmp(buf, "hello", 5));
+    FILE_Detach(f);
+    FILE_Close(f);
+
+    /* Nothing has been read ahead */
+    TEST_ASSERT(write(fds[1], "world", 5) == 5);
+    TEST_ASSERT(FILE_Read(in, buf, 5) == 5);
+    TEST_ASSERT(!memcmp(buf, "world", 5));
+
+    /* Close it while the pipe is still open */
+    f = FILE_Prefetch(in, 0, 0);
+    TEST_ASSERT(f);
+    TEST_ASSERT(write(fds[1], "hello", 5) == 5);
+    THREAD_Sleep(100);
+    FILE_Close(f);
+    close(fds[1]);
+    return TEST_OK;
+}
+
+int
+main(int argc, char* argv[])
+{
+    static const TestDesc tests[] = {
+        {"Alloc", test_fpref_alloc},
+        {"Read", test_fpref_read},
+        {"Lines", test_fpref_lines},
+        {"Close", test_fpref_close},
+        {"Socket", test_fpref_socket},
+        {"Pipe", test_fpref_pipe}
+    };
+
+    int ret;
+    test_mem_init(&testMem);
+    ret = TEST_MAIN(argc, argv, tests);
+    test_mem_deinit(&testMem);
+    return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,552 @@
+/*
+ * $Id: test_fsock.c,v 1.1 2026/10/18 14:02:17 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+
+#include "test_common.h"
+
+static TestMem testMem;
+
+#define WAIT_TIMEOUT 5000
+
+static
+TestStatus
+test_fsock_cork(
+    const TestDesc* test)
+{
+    static const char header[] = "header\n";
+    static const char body[] = "body\n";
+    const int big = 100000;
+    Socket ls, cs;
+    File* f;
+    Bool on = True;
+    char* buf = MEM_NewArray(char, big);
+    int n;
+    Port port;
+
+    /* Stream socket */
+    TEST_ASSERT(SOCKET_Listen(INADDR_LOOPBACK, 0, 1, 0, &ls));
+    port = SOCKET_GetPort(ls);
+    f = FILE_Connect(INADDR_LOOPBACK, port);
+    TEST_ASSERT(f);
+    cs = accept(ls, NULL, NULL);
+    TEST_ASSERT(cs != INVALID_SOCKET);
+    TEST_ASSERT(FILE_SetParam(f, FILE_PARAM_CORK, &on));
+
+    /* Nothing goes out until flushed */
+    TEST_ASSERT(FILE_Puts(f, header));
+    TEST_ASSERT(FILE_Puts(f, body));
+    TEST_ASSERT(SOCKET_Wait(cs, SOCK_WAIT_READ, 100) == 0);
+    TEST_ASSERT(FILE_Flush(f));
+    TEST_ASSERT(SOCKET_Wait(cs, SOCK_WAIT_READ, WAIT_TIMEOUT) ==
+        SOCK_WAIT_READ);
+    TEST_ASSERT(recv(cs, buf, big, 0) == strlen(header) + strlen(body));
+    TEST_ASSERT(!memcmp(buf, "header\nbody\n", 12));
+
+    /* Large writes bypass the buffer but keep the order */
+    TEST_ASSERT(FILE_Puts(f, header));
+    memset(buf, 'x', big);
+    TEST_ASSERT(FILE_Write(f, buf, big) == big);
+    TEST_ASSERT(FILE_Puts(f, body));
+    TEST_ASSERT(FILE_Flush(f));
+    for (n = 0; n < (int)strlen(header) + big + (int)strlen(body); ) {
+        int k = recv(cs, buf, big, 0);
+        TEST_ASSERT(k > 0);
+        n += k;
+    }
+    TEST_ASSERT(n == (int)strlen(header) + big + (int)strlen(body));
+
+    /* Reading pushes the buffered data out */
+    TEST_ASSERT(FILE_Puts(f, "?"));
+    TEST_ASSERT(send(cs, "!", 1, 0) == 1);
+    TEST_ASSERT(FILE_Read(f, buf, 1) == 1);
+    TEST_ASSERT(buf[0] == '!');
+    TEST_ASSERT(recv(cs, buf, big, 0) == 1);
+    TEST_ASSERT(buf[0] == '?');
+
+    /* Switching cork mode off flushes the stream too */
+    TEST_ASSERT(FILE_Puts(f, "."));
+    on = False;
+    TEST_ASSERT(FILE_SetParam(f, FILE_PARAM_CORK, &on));
+    TEST_ASSERT(recv(cs, buf, big, 0) == 1);
+    FILE_Close(f);
+    SOCKET_Close(cs);
+    SOCKET_Close(ls);
+    MEM_Free(buf);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fsock_cork_dgram(
+    const TestDesc* test)
+{
+    static const char* data[] = { "header", "", "body", "x", "trailer" };
+    char buf[64];
+    FileVec vec[3];
+    Socket ds[2];
+    File* f;
+    int i, n, count;
+
+    /* Datagrams are batched and keep their boundaries */
+    TEST_ASSERT(SOCKET_Create(SOCK_DGRAM, INADDR_LOOPBACK, 0, ds));
+    TEST_ASSERT(SOCKET_Create(SOCK_DGRAM, INADDR_LOOPBACK, 0, ds + 1));
+    TEST_ASSERT(SOCKET_Connect(ds[0], INADDR_LOOPBACK, SOCKET_GetPort(ds[1])));
+    TEST_ASSERT(SOCKET_Connect(ds[1], INADDR_LOOPBACK, SOCKET_GetPort(ds[0])));
+    for (count = 0; count < 2; count++) {
+        int allocs = testMem.allocCount;
+        f = FILE_AttachToSocket2(ds[0], FILE_SOCK_CORK);
+        TEST_ASSERT(f);
+        if (count > 0) {
+            /* The buffer came from the pool */
+            TEST_ASSERT(testMem.allocCount == allocs + 2);
+        }
+        for (i = 0; i < (int)COUNT(data); i++) {
+            n = strlen(data[i]);
+            TEST_ASSERT(FILE_Write(f, data[i], n) == n);
+        }
+        TEST_ASSERT(SOCKET_Wait(ds[1], SOCK_WAIT_READ, 100) == 0);
+        TEST_ASSERT(FILE_Flush(f));
+        for (i = 0; i < (int)COUNT(data); i++) {
+            n = strlen(data[i]);
+            TEST_ASSERT(recv(ds[1], buf, sizeof(buf), 0) == n);
+            TEST_ASSERT(!memcmp(buf, data[i], n));
+        }
+
+        /* More than fits into one batch */
+        for (i = 0; i < 40; i++) {
+            TEST_ASSERT(FILE_Write(f, &i, sizeof(i)) == sizeof(i));
+        }
+        FILE_Detach(f);
+        for (i = 0; i < 40; i++) {
+            int k = -1;
+            TEST_ASSERT(recv(ds[1], &k, sizeof(k), 0) == sizeof(k));
+            TEST_ASSERT(k == i);
+        }
+        FILE_Close(f);
+    }
+
+    /* Empty datagrams count, too */
+    f = FILE_AttachToSocket2(ds[0], FILE_SOCK_CORK);
+    TEST_ASSERT(f);
+    for (i = 0; i < 40; i++) {
+        TEST_ASSERT(FILE_Write(f, "", 0) == 0);
+    }
+    TEST_ASSERT(FILE_Write(f, "x", 1) == 1);
+    TEST_ASSERT(FILE_Flush(f));
+    for (i = 0; i < 40; i++) {
+        TEST_ASSERT(recv(ds[1], buf, sizeof(buf), 0) == 0);
+    }
+    TEST_ASSERT(recv(ds[1], buf, sizeof(buf), 0) == 1);
+    TEST_ASSERT(buf[0] == 'x');
+
+    /* The total length doesn't fit into int, it's too large to buffer */
+    vec[0].data = vec[1].data = vec[2].data = buf;
+    vec[0].len = 16;
+    vec[1].len = vec[2].len = (size_t)INT_MAX + 1;
+    TEST_ASSERT(FILE_Write(f, "y", 1) == 1);
+    TEST_ASSERT(FILE_WriteV(f, vec, COUNT(vec)) < 0);
+    TEST_ASSERT(recv(ds[1], buf, sizeof(buf), 0) == 1);
+    TEST_ASSERT(buf[0] == 'y');
+    FILE_Detach(f);
+    FILE_Close(f);
+
+    SOCKET_Close(ds[0]);
+    SOCKET_Close(ds[1]);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fsock_datagram(
+    const TestDesc* test)
+{
+    const int n = 40;
+    Datagram out[40], in[50];
+    I8u* data[50];
+    Socket a, b;
+    Port pa, pb;
+    int i;
+
+    TEST_ASSERT(SOCKET_Create(SOCK_DGRAM, INADDR_LOOPBACK, 0, &a));
+    TEST_ASSERT(SOCKET_Create(SOCK_DGRAM, INADDR_LOOPBACK, 0, &b));
+    pa = SOCKET_GetPort(a);
+    pb = SOCKET_GetPort(b);
+    TEST_ASSERT(pa && pb);
+    for (i=0; i<COUNT(in); i++) BUFFER_Init(&in[i].buf);
+
+    /* More than fits into one system call */
+    for (i=0; i<n; i++) {
+        BUFFER_Init(&out[i].buf);
+        TEST_ASSERT(BUFFER_PutInt(&out[i].buf, i));
+        out[i].addr = INADDR_LOOPBACK;
+        out[i].port = pb;
+    }
+    TEST_ASSERT(SOCKET_SendBatch(a, out, n) == n);
+    TEST_ASSERT(SOCKET_WaitRead(b, WAIT_TIMEOUT) & SOCK_WAIT_READ);
+    TEST_ASSERT(SOCKET_RecvBatch(b, in, COUNT(in), 64) == n);
+    for (i=0; i<n; i++) {
+        I32s k;
+        TEST_ASSERT(in[i].addr == INADDR_LOOPBACK);
+        TEST_ASSERT(in[i].port == pa);
+        TEST_ASSERT(BUFFER_Size(&in[i].buf) == 4);
+        data[i] = in[i].buf.data;
+        TEST_ASSERT(BUFFER_GetInt(&in[i].buf, &k));
+        TEST_ASSERT(k == i);
+    }
+
+    /* Buffers are reused, long datagrams get truncated */
+    TEST_ASSERT(SOCKET_Connect(a, INADDR_LOOPBACK, pb));
+    for (i=0; i<n; i++) {
+        BUFFER_Clear(&out[i].buf);
+        TEST_ASSERT(BUFFER_Reserve0(&out[i].buf, 100));
+        out[i].port = 0;
+    }
+    TEST_ASSERT(SOCKET_SendBatch(a, out, 2) == 2);
+    TEST_ASSERT(SOCKET_WaitRead(b, WAIT_TIMEOUT) & SOCK_WAIT_READ);
+    TEST_ASSERT(SOCKET_RecvBatch(b, in, 2, 64) >= 1);
+    TEST_ASSERT(in[0].buf.data == data[0]);
+    TEST_ASSERT(BUFFER_Size(&in[0].buf) == 64);
+    TEST_ASSERT(in[0].port == pa);
+
+    /* Nothing to receive */
+    while (SOCKET_WaitRead(b, 100) & SOCK_WAIT_READ) {
+        TEST_ASSERT(SOCKET_RecvBatch(b, in, COUNT(in), 0) > 0);
+    }
+    TEST_ASSERT(SOCKET_Block(b, False));
+    TEST_ASSERT(SOCKET_RecvBatch(b, in, COUNT(in), 0) < 0);
+
+    for (i=0; i<n; i++) BUFFER_Destroy(&out[i].buf);
+    for (i=0; i<COUNT(in); i++) BUFFER_Destroy(&in[i].buf);
+    SOCKET_Close(a);
+    SOCKET_Close(b);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fsock_datagram_family(
+    const TestDesc* test)
+{
+    Datagram d;
+    Socket sv[2];
+    struct sockaddr_in6 sa;
+    socklen_t len = sizeof(sa);
+
+    /* No source address, zero port means the connected peer */
+    BUFFER_Init(&d.buf);
+    TEST_ASSERT(!socketpair(AF_UNIX, SOCK_DGRAM, 0, sv));
+    TEST_ASSERT(BUFFER_PutInt(&d.buf, 1));
+    d.port = 0;
+    TEST_ASSERT(SOCKET_SendBatch(sv[0], &d, 1) == 1);
+    d.addr = INADDR_LOOPBACK;
+    d.port = 1;
+    TEST_ASSERT(SOCKET_RecvBatch(sv[1], &d, 1, 0) == 1);
+    TEST_ASSERT(BUFFER_Size(&d.buf) == 4);
+    TEST_ASSERT(!d.addr && !d.port);
+    SOCKET_Close(sv[0]);
+    SOCKET_Close(sv[1]);
+
+    /* Datagrams from IPv6 addresses are dropped */
+    sv[0] = socket(AF_INET6, SOCK_DGRAM, 0);
+    sv[1] = socket(AF_INET6, SOCK_DGRAM, 0);
+    memset(&sa, 0, sizeof(sa));
+    sa.sin6_family = AF_INET6;
+    sa.sin6_addr = in6addr_loopback;
+    if (sv[0] >= 0 && sv[1] >= 0 &&
+        !bind(sv[1], (struct sockaddr*)&sa, sizeof(sa))) {
+        TEST_ASSERT(!getsockname(sv[1], (struct sockaddr*)&sa, &len));
+        TEST_ASSERT(sendto(sv[0], "x", 1, 0, (struct sockaddr*)&sa,
+            sizeof(sa)) == 1);
+        TEST_ASSERT(SOCKET_WaitRead(sv[1], WAIT_TIMEOUT) & SOCK_WAIT_READ);
+        TEST_ASSERT(SOCKET_RecvBatch(sv[1], &d, 1, 0) == 0);
+        TEST_ASSERT(!BUFFER_Size(&d.buf));
+    } else {
+        Verbose("IPv6 is not available\n");
+    }
+    if (sv[0] >= 0) SOCKET_Close(sv[0]);
+    if (sv[1] >= 0) SOCKET_Close(sv[1]);
+    BUFFER_Destroy(&d.buf);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fsock_timeout(
+    const TestDesc* test)
+{
+    const int big = 65536;
+    const Time timeout = 100;
+    Time start, t;
+    Socket ls, cs;
+    File* f;
+    char* buf = MEM_NewArray(char, big);
+    int i, n;
+
+    TEST_ASSERT(SOCKET_Listen(INADDR_LOOPBACK, 0, 1, 0, &ls));
+    f = FILE_Connect(INADDR_LOOPBACK, SOCKET_GetPort(ls));
+    TEST_ASSERT(f);
+    cs = accept(ls, NULL, NULL);
+    TEST_ASSERT(cs != INVALID_SOCKET);
+    TEST_ASSERT(FILE_SetParam(f, FILE_PARAM_RTIMEOUT, (void*)&timeout));
+    TEST_ASSERT(FILE_SetParam(f, FILE_PARAM_WTIMEOUT, (void*)&timeout));
+
+    /* Nothing to read */
+    start = TIME_Monotonic();
+    TEST_ASSERT(FILE_Read(f, buf, 8) < 0);
+    t = TIME_Monotonic();
+    TEST_ASSERT(t >= start + timeout - 1);
+    TEST_ASSERT(t < start + WAIT_TIMEOUT);
+    TEST_ASSERT(FILE_TimedOut(f));
+    TEST_ASSERT(!FILE_Eof(f));
+
+    /* The deadline covers the whole read, partial data are returned */
+    TEST_ASSERT(send(cs, "1234", 4, 0) == 4);
+    TEST_ASSERT(FILE_Read(f, buf, 8) == 4);
+    TEST_ASSERT(FILE_TimedOut(f));
+    TEST_ASSERT(send(cs, "5678", 4, 0) == 4);
+    TEST_ASSERT(FILE_Read(f, buf, 4) == 4);
+    TEST_ASSERT(!FILE_TimedOut(f));
+    TEST_ASSERT(!memcmp(buf, "5678", 4));
+
+    /* The peer isn't reading, eventually the write times out */
+    memset(buf, 'x', big);
+    for (i = 0; i < 1000; i++) {
+        n = FILE_Write(f, buf, big);
+        if (n < big) break;
+    }
+    TEST_ASSERT(i < 1000);
+    TEST_ASSERT(FILE_TimedOut(f));
+    TEST_ASSERT(!FILE_Eof(f));
+
+    /* No timeout */
+    t = 0;
+    TEST_ASSERT(FILE_SetParam(f, FILE_PARAM_RTIMEOUT, &t));
+    TEST_ASSERT(send(cs, "x", 1, 0) == 1);
+    TEST_ASSERT(FILE_Read(f, buf, 1) == 1);
+    TEST_ASSERT(!FILE_TimedOut(f));
+
+    FILE_Close(f);
+    SOCKET_Close(cs);
+    SOCKET_Close(ls);
+    MEM_Free(buf);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fsock_readv(
+    const TestDesc* test)
+{
+    char a[2], b[4];
+    FileVec vec[2];
+    File* f;
+    int sv[2];
+
+    TEST_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    f = FILE_AttachToSocket(sv[0]);
+    TEST_ASSERT(send(sv[1], "abc", 3, 0) == 3);
+    shutdown(sv[1], SHUT_WR);
+    vec[0].data = a;
+    vec[0].len = sizeof(a);
+    vec[1].data = b;
+    vec[1].len = sizeof(b);
+    TEST_ASSERT(FILE_ReadV(f, vec, 2) == 3);
+    TEST_ASSERT(!memcmp(a, "ab", 2));
+    TEST_ASSERT(b[0] == 'c');
+    TEST_ASSERT(!FILE_Eof(f));
+
+    /* End of stream */
+    TEST_ASSERT(FILE_ReadV(f, vec, 2) == 0);
+    TEST_ASSERT(FILE_Eof(f));
+    FILE_Close(f);
+    close(sv[1]);
+    return TEST_OK;
+}
+
+typedef struct _TestWriteV {
+    ThrID writer;
+    int sock;
+    int total;
+} TestWriteV;
+
+static
+void
+test_fsock_signal(
+    int sig)
+{
+}
+
+static
+void
+test_fsock_writev_proc(
+    void* arg)
+{
+    TestWriteV* w = (TestWriteV*)arg;
+    char buf[4096];
+    int n;
+
+    /* Interrupt the writer once the socket buffer is full */
+    THREAD_Sleep(100);
+    pthread_kill(w->writer, SIGUSR1);
+    while ((n = recv(w->sock, buf, sizeof(buf), 0)) > 0) {
+        w->total += n;
+    }
+}
+
+static
+TestStatus
+test_fsock_writev(
+    const TestDesc* test)
+{
+    const int size = 2*1024*1024;
+    char* data = MEM_NewArray(char, size);
+    struct sigaction sa, old;
+    FileVec vec[2];
+    TestWriteV w;
+    ThrID tid;
+    File* f;
+    int sv[2];
+
+    /* A signal doesn't make it a short write */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = test_fsock_signal;
+    TEST_ASSERT(!sigaction(SIGUSR1, &sa, &old));
+    TEST_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+    f = FILE_AttachToSocket(sv[0]);
+    TEST_ASSERT(f);
+    memset(data, 'x', size);
+    vec[0].data = vec[1].data = data;
+    vec[0].len = vec[1].len = size;
+    w.writer = THREAD_Self();
+    w.sock = sv[1];
+    w.total = 0;
+    TEST_ASSERT(THREAD_Create(&tid, test_fsock_writev_proc, &w));
+    TEST_ASSERT(FILE_WriteV(f, vec, 2) == 2*size);
+    FILE_Close(f);
+    THREAD_Join(tid);
+    TEST_ASSERT(w.total == 2*size);
+    close(sv[1]);
+    sigaction(SIGUSR1, &old, NULL);
+    MEM_Free(data);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fsock_reopen(
+    const TestDesc* test)
+{
+    const Time timeout = 100;
+    Socket ls[2], cs[2];
+    char port[2][8];
+    char buf[8];
+    Bool on = True;
+    File* f;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        TEST_ASSERT(SOCKET_Listen(INADDR_LOOPBACK, 0, 1, 0, ls + i));
+        sprintf(port[i], "%hu", SOCKET_GetPort(ls[i]));
+    }
+    f = FILE_Open("127.0.0.1", port[0], &SocketIO);
+    TEST_ASSERT(f);
+    cs[0] = accept(ls[0], NULL, NULL);
+    TEST_ASSERT(cs[0] != INVALID_SOCKET);
+    TEST_ASSERT(FILE_SetParam(f, FILE_PARAM_CORK, &on));
+    TEST_ASSERT(FILE_SetParam(f, FILE_PARAM_RTIMEOUT, (void*)&timeout));
+
+    /* The buffered data go to the old peer */
+    TEST_ASSERT(FILE_Puts(f, "old"));
+    TEST_ASSERT(FILE_Reopen(f, "127.0.0.1", port[1]));
+    cs[1] = accept(ls[1], NULL, NULL);
+    TEST_ASSERT(cs[1] != INVALID_SOCKET);
+    TEST_ASSERT(recv(cs[0], buf, sizeof(buf), 0) == 3);
+    TEST_ASSERT(!memcmp(buf, "old", 3));
+    TEST_ASSERT(recv(cs[0], buf, sizeof(buf), 0) == 0);
+    SOCKET_Close(cs[0]);
+
+    /* Still corked */
+    TEST_ASSERT(FILE_Puts(f, "new"));
+    TEST_ASSERT(SOCKET_Wait(cs[1], SOCK_WAIT_READ, 100) == 0);
+    TEST_ASSERT(FILE_Flush(f));
+    TEST_ASSERT(recv(cs[1], buf, sizeof(buf), 0) == 3);
+    TEST_ASSERT(!memcmp(buf, "new", 3));
+
+    /* Still has the timeout */
+    TEST_ASSERT(FILE_Read(f, buf, 1) < 0);
+    TEST_ASSERT(FILE_TimedOut(f));
+
+    /* Non-blocking mode survives too */
+    TEST_ASSERT(FILE_SetParam(f, FILE_PARAM_NONBLOCK, &on));
+    TEST_ASSERT(FILE_Reopen(f, "127.0.0.1", port[0]));
+    TEST_ASSERT(!FILE_TimedOut(f));
+    cs[0] = accept(ls[0], NULL, NULL);
+    TEST_ASSERT(cs[0] != INVALID_SOCKET);
+    TEST_ASSERT(FILE_Read(f, buf, 1) < 0);
+    TEST_ASSERT(FILE_WouldBlock(f));
+    TEST_ASSERT(!FILE_Eof(f));
+
+    FILE_Close(f);
+    for (i = 0; i < 2; i++) {
+        SOCKET_Close(cs[i]);
+        SOCKET_Close(ls[i]);
+    }
+    return TEST_OK;
+}
+
+int
+main(int argc, char* argv[])
+{
+    static const TestDesc tests[] = {
+        {"Cork", test_fsock_cork},
+        {"CorkDgram", test_fsock_cork_dgram},
+        {"Datagram", test_fsock_datagram},
+        {"DatagramFamily", test_fsock_datagram_family},
+        {"Timeout", test_fsock_timeout},
+        {"ReadV", test_fsock_readv},
+        {"WriteV", test_fsock_writev},
+        {"Reopen", test_fsock_reopen}
+    };
+
+    int ret;
+    test_mem_init(&testMem);
+    ret = TEST_MAIN(argc, argv, tests);
+    test_mem_deinit(&testMem);
+    return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
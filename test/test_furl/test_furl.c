@@ -0,0 +1,406 @@
+/*
+ * $Id: test_furl.c,v 1.1 2026/10/18 17:21:40 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+
+
+#include "test_common.h"
+
+#include <signal.h>
+
+static TestMem testMem;
+
+/* Loopback HTTP server */
+typedef struct _TestHttp {
+    Mutex mutex;
+    WorkQueue* q;
+    SocketAcceptor* acceptor;
+    Port port;
+    int connections;
+    int requests;
+} TestHttp;
+
+static
+char
+test_furl_byte(
+    long pos)
+{
+    return (char)('a' + pos % 26);
+}
+
+/* Serves GET /<size> requests until the client disconnects */
+static
+void
+test_furl_serve(
+    File* f,
+    void* ctx)
+{
+    TestHttp* http = (TestHttp*)ctx;
+    char line[256];
+
+    MUTEX_Lock(&http->mutex);
+    http->connections++;
+    MUTEX_Unlock(&http->mutex);
+
+    while (FILE_Gets(f, line, sizeof(line))) {
+        long i, size = 0;
+        Bool ok = False;
+        if (sscanf(line, "GET /%ld", &size) != 1) break;
+
+        /* skip the headers */
+        while (FILE_Gets(f, line, sizeof(line))) {
+            if (!strcmp(line, "\r\n") || !strcmp(line, "\n")) {
+                ok = True;
+                break;
+            }
+        }
+        if (!ok) break;
+
+        MUTEX_Lock(&http->mutex);
+        http->requests++;
+        MUTEX_Unlock(&http->mutex);
+
+        FILE_Printf(f, "HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/plain\r\n"
+            "Content-Length: %ld\r\n\r\n", size);
+        for (i = 0; i < size && ok; ) {
+            char buf[1024];
+            int n = (int)MIN(size - i, (long)sizeof(buf));
+            int k;
+            for (k = 0; k < n; k++) buf[k] = test_furl_byte(i + k);
+            ok = (FILE_Write(f, buf, n) == n);
+            i += n;
+        }
+        if (!ok || !FILE_Flush(f)) break;
+    }
+    FILE_Close(f);
+}
+
+static
+void
+test_furl_start(
+    TestHttp* http)
+{
+    memset(http, 0, sizeof(*http));
+    TEST_ASSERT(MUTEX_Init(&http->mutex));
+    http->q = WKQ_CreatePool(8);
+    TEST_ASSERT(http->q);
+    http->acceptor = SOCKET_AcceptorCreate(INADDR_LOOPBACK, 0, 1, 0, http->q,
+        test_furl_serve, http);
+    TEST_ASSERT(http->acceptor);
+    http->port = SOCKET_AcceptorPort(http->acceptor);
+}
+
+static
+void
+test_furl_stop(
+    TestHttp* http)
+{
+    SOCKET_AcceptorDelete(http->acceptor);
+    WKQ_Stop(http->q, True);
+    WKQ_Delete(http->q);
+    MUTEX_Destroy(&http->mutex);
+}
+
+static
+Str
+test_furl_url(
+    StrBuf* sb,
+    const TestHttp* http,
+    long size)
+{
+    TEST_ASSERT(STRBUF_Format(sb, "http://127.0.0.1:%hu/%ld",
+        http->port, size));
+    return STRBUF_Text(sb);
+}
+
+/* Reads the whole thing and checks the contents */
+static
+void
+test_furl_check(
+    File* f,
+    long size)
+{
+    char buf[1000];
+    long pos = 0;
+    int n;
+
+    TEST_ASSERT(f);
+    while ((n = FILE_Read(f, buf, sizeof(buf))) > 0) {
+        int i;
+        for (i = 0; i < n; i++) {
+            TEST_ASSERT(buf[i] == test_furl_byte(pos + i));
+        }
+        pos += n;
+    }
+    TEST_ASSERT(n == 0);
+    TEST_ASSERT(pos == size);
+    TEST_ASSERT(FILE_Eof(f));
+}
+
+static
+TestStatus
+test_furl_fetch(
+    const TestDesc* test)
+{
+    static const long sizes[] = { 0, 1, 999, 1000, 1001, 65536, 200000 };
+    TestHttp http;
+    UrlFetcher* fetcher;
+    StrBuf64 url;
+    int i;
+
+    test_furl_start(&http);
+    STRBUF_InitBufXXX(&url);
+    fetcher = URL_FetcherCreate(0);
+    TEST_ASSERT(fetcher);
+
+    /* The connection gets reused */
+    for (i = 0; i < (int)COUNT(sizes); i++) {
+        File* f = URL_Fetch(fetcher, test_furl_url(&url.sb, &http, sizes[i]),
+            NULL, NULL);
+        test_furl_check(f, sizes[i]);
+        FILE_Close(f);
+    }
+
+    URL_FetcherDelete(fetcher);
+    test_furl_stop(&http);
+    STRBUF_Destroy(&url.sb);
+    TEST_ASSERT(http.requests == COUNT(sizes));
+    TEST_ASSERT(http.connections == 1);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_furl_parallel(
+    const TestDesc* test)
+{
+    TestHttp http;
+    UrlFetcher* fetcher;
+    File* f[8];
+    StrBuf64 url;
+    int i;
+
+    test_furl_start(&http);
+    STRBUF_InitBufXXX(&url);
+    fetcher = URL_FetcherCreate(2);
+    TEST_ASSERT(fetcher);
+
+    /* Start all transfers and read them in reverse order */
+    for (i = 0; i < (int)COUNT(f); i++) {
+        f[i] = URL_Fetch(fetcher, test_furl_url(&url.sb, &http, 10000 * i),
+            "user", "password");
+        TEST_ASSERT(f[i]);
+    }
+    for (i = COUNT(f) - 1; i >= 0; i--) {
+        test_furl_check(f[i], 10000 * i);
+        FILE_Close(f[i]);
+    }
+
+    URL_FetcherDelete(fetcher);
+    test_furl_stop(&http);
+    STRBUF_Destroy(&url.sb);
+    TEST_ASSERT(http.requests == COUNT(f));
+    TEST_ASSERT(http.connections <= COUNT(f));
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_furl_close(
+    const TestDesc* test)
+{
+    TestHttp http;
+    UrlFetcher* fetcher;
+    StrBuf64 url;
+    char buf[10];
+    File* f;
+
+    test_furl_start(&http);
+    STRBUF_InitBufXXX(&url);
+    fetcher = URL_FetcherCreate(1);
+    TEST_ASSERT(fetcher);
+
+    /* Close the stream before reading everything */
+    f = URL_Fetch(fetcher, test_furl_url(&url.sb, &http, 1000000), NULL, NULL);
+    TEST_ASSERT(f);
+    TEST_ASSERT(FILE_Read(f, buf, sizeof(buf)) == sizeof(buf));
+    TEST_ASSERT(buf[0] == test_furl_byte(0));
+    FILE_Close(f);
+
+    /* Without reading anything */
+    f = URL_Fetch(fetcher, test_furl_url(&url.sb, &http, 1000), NULL, NULL);
+    TEST_ASSERT(f);
+    FILE_Close(f);
+
+    /* The fetcher still works */
+    f = URL_Fetch(fetcher, test_furl_url(&url.sb, &http, 1000), NULL, NULL);
+    test_furl_check(f, 1000);
+    FILE_Close(f);
+
+    URL_FetcherDelete(fetcher);
+    test_furl_stop(&http);
+    STRBUF_Destroy(&url.sb);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_furl_open(
+    const TestDesc* test)
+{
+    TestHttp http;
+    StrBuf64 url;
+    File* f;
+    int i;
+
+    test_furl_start(&http);
+    STRBUF_InitBufXXX(&url);
+
+    /* Private fetcher */
+    f = FILE_OpenURL(test_furl_url(&url.sb, &http, 100));
+    test_furl_check(f, 100);
+    FILE_Close(f);
+
+    /* Shared fetcher */
+    URL_InitModule();
+    for (i = 0; i < 3; i++) {
+        f = FILE_AuthURL(test_furl_url(&url.sb, &http, 100), "user", NULL);
+        test_furl_check(f, 100);
+        FILE_Close(f);
+    }
+    URL_Shutdown();
+
+    test_furl_stop(&http);
+    STRBUF_Destroy(&url.sb);
+    TEST_ASSERT(http.requests == 4);
+    TEST_ASSERT(http.connections == 2);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_furl_error(
+    const TestDesc* test)
+{
+    TestHttp http;
+    StrBuf64 url;
+    char buf[10];
+    File* f;
+
+    /* Nobody is listening on that port anymore */
+    test_furl_start(&http);
+    test_furl_stop(&http);
+    STRBUF_InitBufXXX(&url);
+    f = FILE_OpenURL(test_furl_url(&url.sb, &http, 100));
+    TEST_ASSERT(f);
+    TEST_ASSERT(FILE_Read(f, buf, sizeof(buf)) < 0);
+    TEST_ASSERT(FILE_Eof(f));
+    FILE_Close(f);
+    STRBUF_Destroy(&url.sb);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_furl_pause(
+    const TestDesc* test)
+{
+    const long size = 4000000;
+    TestHttp http;
+    UrlFetcher* fetcher;
+    StrBuf64 url;
+    char buf[10];
+    long pos;
+    int n, count, count0;
+    File* f;
+
+    test_furl_start(&http);
+    STRBUF_InitBufXXX(&url);
+    fetcher = URL_FetcherCreate(1);
+    TEST_ASSERT(fetcher);
+
+    /* Let the slow reader fall behind */
+    count0 = testMem.allocCount;
+    f = URL_Fetch(fetcher, test_furl_url(&url.sb, &http, size), NULL, NULL);
+    TEST_ASSERT(f);
+    TEST_ASSERT(FILE_Read(f, buf, sizeof(buf)) == sizeof(buf));
+    THREAD_Sleep(200);
+
+    /* By now the transfer is paused and buffers are being reused */
+    count = testMem.allocCount;
+    TEST_ASSERT(count - count0 < 64);
+    pos = sizeof(buf);
+    while ((n = FILE_Read(f, buf, sizeof(buf))) > 0) {
+        int i;
+        for (i = 0; i < n; i++) {
+            TEST_ASSERT(buf[i] == test_furl_byte(pos + i));
+        }
+        pos += n;
+    }
+    TEST_ASSERT(pos == size);
+    TEST_ASSERT(testMem.allocCount == count);
+    FILE_Close(f);
+
+    URL_FetcherDelete(fetcher);
+    test_furl_stop(&http);
+    STRBUF_Destroy(&url.sb);
+    return TEST_OK;
+}
+
+int
+main(int argc, char* argv[])
+{
+    static const TestDesc tests[] = {
+        {"Fetch", test_furl_fetch},
+        {"Parallel", test_furl_parallel},
+        {"Close", test_furl_close},
+        {"Pause", test_furl_pause},
+        {"Open", test_furl_open},
+        {"Error", test_furl_error}
+    };
+
+    int ret;
+
+    /* The server writes into connections closed by the client */
+    signal(SIGPIPE, SIG_IGN);
+    test_mem_init(&testMem);
+    ret = TEST_MAIN(argc, argv, tests);
+    test_mem_deinit(&testMem);
+    return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
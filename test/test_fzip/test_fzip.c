@@ -0,0 +1,453 @@
+/*
+ * $Id: test_fzip.c,v 1.1 2026/10/18 10:12:41 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+
+#include "test_common.h"
+
+#include <zlib.h>
+
+static TestMem testMem;
+
+#define TEMP_PREFIX "/tmp/test_fzip_"
+#define TEMP_RANDOM 8
+
+#define DATA_SIZE 1000000
+
+static
+I8u*
+test_fzip_data(
+    void)
+{
+    size_t i;
+    I32u x = 1;
+    I8u* data = MEM_NewArray(I8u, DATA_SIZE);
+
+    /* Compressible but not too much */
+    for (i = 0; i < DATA_SIZE; i++) {
+        x = x * 1103515245 + 12345;
+        data[i] = (I8u)('a' + ((x >> 16) % 8));
+    }
+    return data;
+}
+
+/* Decompresses the data with zlib, which also verifies the checksums */
+static
+Bool
+test_fzip_check(
+    File* out,
+    int bits,
+    const I8u* data,
+    size_t size)
+{
+    Bool ok = False;
+    z_stream s;
+    I8u* buf = MEM_NewArray(I8u, size + 1);
+    memset(&s, 0, sizeof(s));
+    if (inflateInit2(&s, bits) == Z_OK) {
+        s.next_in = (Bytef*)FILE_MemData(out);
+        s.avail_in = (uInt)FILE_MemSize(out);
+        s.next_out = buf;
+        s.avail_out = (uInt)(size + 1);
+        if (inflate(&s, Z_FINISH) == Z_STREAM_END &&
+            s.total_out == size && !s.avail_in &&
+            !memcmp(buf, data, size)) {
+            ok = True;
+        }
+        inflateEnd(&s);
+    }
+    MEM_Free(buf);
+    return ok;
+}
+
+/* Compresses the data and checks the result */
+static
+Bool
+test_fzip_compress(
+    int flags,
+    int level,
+    int nthreads,
+    int bits,
+    const I8u* data,
+    size_t size)
+{
+    Bool ok = False;
+    File* out = FILE_Mem();
+    File* f = FILE_Zip3(out, FILE_ZIP_OUT | flags, level, nthreads);
+    size_t off = 0;
+
+    /* Write it in odd sized pieces */
+    while (off < size) {
+        int n = (int)MIN(size - off, 9999);
+        if (FILE_Write(f, data + off, n) != n) break;
+        off += n;
+    }
+    if (off == size && FILE_ZipFinish(f)) {
+        ok = test_fzip_check(out, bits, data, size);
+    }
+    FILE_Close(f);
+    return ok;
+}
+
+static
+TestStatus
+test_fzip_alloc(
+    const TestDesc* test)
+{
+    static const I8u data[] = {1, 2, 3};
+    File* out = FILE_Mem();
+    File* f;
+    int i;
+
+    /* Simulate allocation failures */
+    for (i = 0; i < 100; i++) {
+        testMem.failAt = testMem.allocCount + i;
+        f = FILE_Zip3(out, FILE_ZIP_OUT | FILE_ZIP_PARALLEL, 1, 2);
+        if (f) {
+            int n = FILE_Write(f, data, sizeof(data));
+            FILE_Detach(f);
+            FILE_Close(f);
+            if (n == sizeof(data)) break;
+        }
+        FILE_MemClear(out);
+    }
+    testMem.failAt = -1;
+    TEST_ASSERT(i > 0 && i < 100);
+    FILE_Close(out);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fzip_gzip(
+    const TestDesc* test)
+{
+    I8u* data = test_fzip_data();
+    const int flags = FILE_ZIP_GZIP | FILE_ZIP_ZHDR;
+    const int bits = 16 + MAX_WBITS;
+
+    /* Serial and parallel output are both valid gzip streams */
+    TEST_ASSERT(test_fzip_compress(flags, 6, 0, bits, data, DATA_SIZE));
+    TEST_ASSERT(test_fzip_compress(flags | FILE_ZIP_PARALLEL, 6, 4, bits,
+        data, DATA_SIZE));
+    TEST_ASSERT(test_fzip_compress(flags | FILE_ZIP_PARALLEL, 1, 1, bits,
+        data, DATA_SIZE));
+    TEST_ASSERT(test_fzip_compress(flags | FILE_ZIP_PARALLEL, 9, 0, bits,
+        data, 100));
+    MEM_Free(data);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fzip_zlib(
+    const TestDesc* test)
+{
+    I8u* data = test_fzip_data();
+    int level;
+
+    /* Check the header for all compression levels */
+    for (level = Z_DEFAULT_COMPRESSION; level <= Z_BEST_COMPRESSION; level++) {
+        TEST_ASSERT(test_fzip_compress(FILE_ZIP_PARALLEL, level, 3,
+            MAX_WBITS, data, 300000));
+    }
+    TEST_ASSERT(test_fzip_compress(FILE_ZIP_ZHDR | FILE_ZIP_PARALLEL,
+        Z_DEFAULT_COMPRESSION, 3, -MAX_WBITS, data, DATA_SIZE));
+    MEM_Free(data);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fzip_flush(
+    const TestDesc* test)
+{
+    I8u* data = test_fzip_data();
+    File* out = FILE_Mem();
+    File* f = FILE_Zip3(out, FILE_ZIP_OUT | FILE_ZIP_PARALLEL, 6, 2);
+    const size_t part = 200001;
+    z_stream s;
+    I8u* buf = MEM_NewArray(I8u, DATA_SIZE);
+
+    /* Everything written before the flush can be decompressed */
+    TEST_ASSERT(FILE_Write(f, data, (int)part) == (int)part);
+    TEST_ASSERT(FILE_Flush(f));
+    memset(&s, 0, sizeof(s));
+    TEST_ASSERT(inflateInit(&s) == Z_OK);
+    s.next_in = (Bytef*)FILE_MemData(out);
+    s.avail_in = (uInt)FILE_MemSize(out);
+    s.next_out = buf;
+    s.avail_out = DATA_SIZE;
+    TEST_ASSERT(inflate(&s, Z_SYNC_FLUSH) == Z_OK);
+    TEST_ASSERT(s.total_out == part);
+    TEST_ASSERT(!memcmp(buf, data, part));
+    inflateEnd(&s);
+    MEM_Free(buf);
+
+    /* And the rest of it */
+    TEST_ASSERT(FILE_Write(f, data + part, DATA_SIZE - part) ==
+        (int)(DATA_SIZE - part));
+    TEST_ASSERT(FILE_ZipFinish(f));
+    TEST_ASSERT(test_fzip_check(out, MAX_WBITS, data, DATA_SIZE));
+    FILE_Close(f);
+    MEM_Free(data);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fzip_read(
+    const TestDesc* test)
+{
+    static const int flags[] = {
+        FILE_ZIP_NONE,
+        FILE_ZIP_ZHDR,
+        FILE_ZIP_GZIP,
+        FILE_ZIP_GZIP | FILE_ZIP_ZHDR
+    };
+    I8u* data = test_fzip_data();
+    I8u* buf = MEM_NewArray(I8u, DATA_SIZE);
+    int i;
+
+    /* Read it back with FILE_Zip */
+    for (i = 0; i < (int)COUNT(flags); i++) {
+        File* out = FILE_Mem();
+        File* f = FILE_Zip3(out, FILE_ZIP_OUT | FILE_ZIP_PARALLEL | flags[i],
+            Z_DEFAULT_COMPRESSION, 0);
+        File* in;
+        int n = 0;
+
+        TEST_ASSERT(FILE_Write(f, data, DATA_SIZE) == DATA_SIZE);
+        FILE_Detach(f);
+        FILE_Close(f);
+        in = FILE_Zip(out, FILE_ZIP_IN | flags[i]);
+        while (n < DATA_SIZE) {
+            int k = FILE_Read(in, buf + n, DATA_SIZE - n);
+            TEST_ASSERT(k > 0);
+            n += k;
+        }
+        TEST_ASSERT(FILE_Read(in, buf, 1) == 0);
+        TEST_ASSERT(!memcmp(buf, data, DATA_SIZE));
+        FILE_Close(in);
+    }
+    MEM_Free(buf);
+    MEM_Free(data);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_fzip_empty(
+    const TestDesc* test)
+{
+    File* out = FILE_Mem();
+    File* f = FILE_Zip3(out, FILE_ZIP_OUT | FILE_ZIP_PARALLEL, 6, 2);
+
+    /* Nothing is written if nothing has been compressed */
+    TEST_ASSERT(FILE_Flush(f));
+    TEST_ASSERT(FILE_ZipFinish(f));
+    TEST_ASSERT(!FILE_MemSize(out));
+    FILE_Close(f);
+
+    /* Finish right after flush */
+    out = FILE_Mem();
+    f = FILE_Zip3(out, FILE_ZIP_OUT | FILE_ZIP_PARALLEL, 6, 2);
+    TEST_ASSERT(FILE_Write(f, "x", 1) == 1);
+    TEST_ASSERT(FILE_Flush(f));
+    TEST_ASSERT(FILE_ZipFinish(f));
+    TEST_ASSERT(test_fzip_check(out, MAX_WBITS, (const I8u*)"x", 1));
+    FILE_Close(f);
+    return TEST_OK;
+}
+
+/* Compresses the data into a new memory stream */
+static
+File*
+test_fzip_mem(
+    int flags,
+    const I8u* data,
+    size_t size)
+{
+    File* out = FILE_Mem();
+    File* f = FILE_Zip3(out, FILE_ZIP_OUT | flags, 6, 2);
+    FILE_Write(f, data, (int)size);
+    FILE_Detach(f);
+    FILE_Close(f);
+    return out;
+}
+
+/* Seeks and reads a piece of data */
+static
+Bool
+test_fzip_seek(
+    File* in,
+    const ZipIndex* index,
+    const I8u* data,
+    size_t size,
+    size_t off,
+    size_t len)
+{
+    Bool ok = False;
+    File* f = FILE_ZipSeek(in, index, off);
+    if (f) {
+        const size_t n = MIN(len, size - off);
+        I8u* buf = MEM_NewArray(I8u, len);
+        if (FILE_Read64(f, buf, len) == (I64s)n &&
+            !memcmp(buf, data + off, n)) {
+            ok = True;
+        }
+        MEM_Free(buf);
+        FILE_Close(f);
+    } else {
+        FILE_Close(in);
+    }
+    return ok;
+}
+
+static
+TestStatus
+test_fzip_index(
+    const TestDesc* test)
+{
+    static const size_t offsets[] = {
+        0, 1, 65535, 65536, 300001, DATA_SIZE/2, DATA_SIZE-50000,
+        2*DATA_SIZE-1, 2*DATA_SIZE
+    };
+    Char fname[COUNT(TEMP_PREFIX) + TEMP_RANDOM];
+    I8u* data = test_fzip_data();
+    I8u* data2 = MEM_NewArray(I8u, 2*DATA_SIZE);
+    File* gz = test_fzip_mem(FILE_ZIP_GZIP | FILE_ZIP_ZHDR, data, DATA_SIZE);
+    File* z = test_fzip_mem(FILE_ZIP_NONE, data, DATA_SIZE);
+    File* in;
+    File* tmp;
+    ZipIndex* index;
+    ZipIndex* index2;
+    size_t gzsize = FILE_MemSize(gz);
+    I8u* buf;
+    int i;
+
+    /* Concatenated gzip members */
+    memcpy(data2, data, DATA_SIZE);
+    memcpy(data2 + DATA_SIZE, data, DATA_SIZE);
+    buf = MEM_NewArray(I8u, gzsize);
+    memcpy(buf, FILE_MemData(gz), gzsize);
+    TEST_ASSERT(FILE_WriteAll(gz, buf, (int)gzsize));
+    MEM_Free(buf);
+    in = FILE_MemIn(FILE_MemData(gz), FILE_MemSize(gz));
+    index = FILE_ZipIndexBuild(in, 65536);
+    FILE_Close(in);
+    TEST_ASSERT(index);
+    for (i = 0; i < (int)COUNT(offsets); i++) {
+        in = FILE_MemIn(FILE_MemData(gz), FILE_MemSize(gz));
+        TEST_ASSERT(test_fzip_seek(in, index, data2, 2*DATA_SIZE,
+            offsets[i], 100000));
+    }
+    in = FILE_MemIn(FILE_MemData(gz), FILE_MemSize(gz));
+    TEST_ASSERT(!FILE_ZipSeek(in, index, 2*DATA_SIZE+1));
+    FILE_Close(in);
+
+    /* Save and load it, read from a plain file */
+    tmp = FILE_Mem();
+    TEST_ASSERT(FILE_ZipIndexSave(index, tmp));
+    index2 = FILE_ZipIndexLoad(tmp);
+    TEST_ASSERT(index2);
+    TEST_ASSERT(!FILE_ZipIndexLoad(tmp));
+    FILE_Close(tmp);
+    StrCpy(fname, T_(TEMP_PREFIX));
+    FILE_MakeUnique(fname, COUNT(TEMP_PREFIX) - 1, TEMP_RANDOM);
+    tmp = FILE_Open(fname, WRITE_BINARY_MODE, PlainFile);
+    TEST_ASSERT(tmp);
+    TEST_ASSERT(FILE_WriteAll(tmp, FILE_MemData(gz), (int)FILE_MemSize(gz)));
+    FILE_Close(tmp);
+    for (i = 0; i < (int)COUNT(offsets); i++) {
+        in = FILE_Open(fname, READ_BINARY_MODE, PlainFile);
+        TEST_ASSERT(test_fzip_seek(in, index2, data2, 2*DATA_SIZE,
+            offsets[i], 100000));
+    }
+    FILE_Delete(fname);
+    FILE_ZipIndexDelete(index2);
+    FILE_ZipIndexDelete(index);
+
+    /* Zlib stream, and a stream without access points */
+    in = FILE_MemIn(FILE_MemData(z), FILE_MemSize(z));
+    index = FILE_ZipIndexBuild(in, 0);
+    FILE_Close(in);
+    TEST_ASSERT(index);
+    for (i = 0; i < (int)COUNT(offsets); i++) {
+        if (offsets[i] <= DATA_SIZE) {
+            in = FILE_MemIn(FILE_MemData(z), FILE_MemSize(z));
+            TEST_ASSERT(test_fzip_seek(in, index, data, DATA_SIZE,
+                offsets[i], 100000));
+        }
+    }
+    FILE_ZipIndexDelete(index);
+
+    /* Broken data */
+    in = FILE_MemIn(FILE_MemData(z), FILE_MemSize(z) - 1);
+    TEST_ASSERT(!FILE_ZipIndexBuild(in, 0));
+    FILE_Close(in);
+    in = FILE_MemIn(data, 1000);
+    TEST_ASSERT(!FILE_ZipIndexBuild(in, 0));
+    FILE_Close(in);
+
+    FILE_Close(gz);
+    FILE_Close(z);
+    MEM_Free(data2);
+    MEM_Free(data);
+    return TEST_OK;
+}
+
+int
+main(int argc, char* argv[])
+{
+    static const TestDesc tests[] = {
+        {"Alloc", test_fzip_alloc},
+        {"Gzip", test_fzip_gzip},
+        {"Zlib", test_fzip_zlib},
+        {"Flush", test_fzip_flush},
+        {"Read", test_fzip_read},
+        {"Empty", test_fzip_empty},
+        {"Index", test_fzip_index}
+    };
+
+    int ret;
+    test_mem_init(&testMem);
+    ret = TEST_MAIN(argc, argv, tests);
+    test_mem_deinit(&testMem);
+    return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -445,6 +445,745 @@ test_hash_pool(
     return TEST_OK;
 }
 
+static
+Bool
+test_hash_incremental_examine(
+    HashKey key,
+    HashValue value,
+    void* ctx)
+{
+    HashTable* ht = ctx;
+    TEST_ASSERT(HASH_VALUE_INT(value) == HASH_KEY_INT(key));
+    /* Remove odd keys */
+    if (HASH_KEY_INT(key) % 2) {
+        TEST_ASSERT(HASH_Remove(ht, key));
+    }
+    return True;
+}
+
+static
+TestStatus
+test_hash_incremental(
+    const TestDesc* test)
+{
+    HashTable* ht = HASH_Create(0, NULL, NULL, NULL);
+    Iterator* itr;
+    const int n = 10000;
+    int i, count, migrations = 0;
+
+    HASH_SetIncremental(ht, True);
+    for (i = 0; i < n; i++) {
+        const Bool migrating = (ht->oldBuckets != NULL);
+        TEST_ASSERT(HASH_Put(ht, HASH_INT_KEY(i), HASH_INT_VALUE(i)));
+        if (!migrating && ht->oldBuckets) migrations++;
+        TEST_ASSERT(HASH_Get(ht, HASH_INT_KEY(i)) == HASH_INT_VALUE(i));
+        TEST_ASSERT(HASH_Get(ht, HASH_INT_KEY(i/2)) == HASH_INT_VALUE(i/2));
+    }
+    TEST_ASSERT(migrations > 0);
+    TEST_ASSERT(HASH_Size(ht) == n);
+    for (i = 0; i < n; i++) {
+        TEST_ASSERT(HASH_Get(ht, HASH_INT_KEY(i)) == HASH_INT_VALUE(i));
+    }
+
+    /* Stop in the middle of the migration */
+    while (!ht->oldBuckets) {
+        TEST_ASSERT(HASH_Put(ht, HASH_INT_KEY(i), HASH_INT_VALUE(i)));
+        i++;
+    }
+    TEST_ASSERT(HASH_Put(ht, HASH_INT_KEY(i), HASH_INT_VALUE(i)));
+    i++;
+    TEST_ASSERT(ht->oldBuckets);
+    TEST_ASSERT(HASH_Size(ht) == i);
+
+    /* Each entry must be returned once */
+    itr = HASH_ConstEntries(ht);
+    for (count = 0; ITR_HasNext(itr); count++) {
+        const HashEntry* entry = ITR_Next(itr);
+        TEST_ASSERT(entry->value == HASH_Get(ht, entry->key));
+    }
+    ITR_Delete(itr);
+    TEST_ASSERT(count == i);
+
+    /* Update and remove */
+    TEST_ASSERT(HASH_Update(ht, HASH_INT_KEY(0), HASH_INT_VALUE(0)));
+    TEST_ASSERT(HASH_Remove(ht, HASH_INT_KEY(i-1)));
+    TEST_ASSERT(!HASH_Remove(ht, HASH_INT_KEY(i-1)));
+    TEST_ASSERT(!HASH_Contains(ht, HASH_INT_KEY(i-1)));
+    i--;
+
+    /* Remove from the callback */
+    TEST_ASSERT(HASH_Examine(ht, test_hash_incremental_examine, ht));
+    TEST_ASSERT(ht->oldBuckets);
+    TEST_ASSERT(HASH_Size(ht) == (i+1)/2);
+
+    /* And with the iterator */
+    itr = HASH_Keys(ht);
+    while (ITR_HasNext(itr)) {
+        if (!(HASH_KEY_INT(ITR_Next(itr)) % 4)) {
+            TEST_ASSERT(ITR_Remove(itr));
+        }
+    }
+    ITR_Delete(itr);
+    TEST_ASSERT(ht->oldBuckets);
+    for (count = 0; count < i; count++) {
+        TEST_ASSERT(HASH_Contains(ht, HASH_INT_KEY(count)) ==
+            ((count % 4) == 2));
+    }
+
+    /* Switching incremental mode off completes the migration */
+    HASH_SetIncremental(ht, False);
+    TEST_ASSERT(!ht->oldBuckets);
+    for (count = 0; count < i; count++) {
+        TEST_ASSERT(HASH_Contains(ht, HASH_INT_KEY(count)) ==
+            ((count % 4) == 2));
+    }
+
+    /* Clear in the middle of the migration */
+    HASH_SetIncremental(ht, True);
+    while (!ht->oldBuckets) {
+        TEST_ASSERT(HASH_Put(ht, HASH_INT_KEY(i), HASH_INT_VALUE(i)));
+        i++;
+    }
+    HASH_Clear(ht);
+    TEST_ASSERT(!ht->oldBuckets);
+    TEST_ASSERT(HASH_IsEmpty(ht));
+
+    /* Explicit rehash in the middle of the migration */
+    for (i = 0; !ht->oldBuckets; i++) {
+        TEST_ASSERT(HASH_Put(ht, HASH_INT_KEY(i), HASH_INT_VALUE(i)));
+    }
+    HASH_Rehash(ht, 0);
+    TEST_ASSERT(!ht->oldBuckets);
+    TEST_ASSERT(HASH_Size(ht) == i);
+    while (i-- > 0) {
+        TEST_ASSERT(HASH_Get(ht, HASH_INT_KEY(i)) == HASH_INT_VALUE(i));
+    }
+    HASH_Delete(ht);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_hash_seed(
+    const TestDesc* test)
+{
+    static const char abc[] = "abcdefghijklmnopqrstuvwxyz0123456789"
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789abcdefghijklmnopqrstuvwxyz";
+    const I64u seed = HASH_Seed();
+    I64u h[COUNT(abc)];
+    char buf[COUNT(abc)];
+    HashTable* ht;
+    StrBuf sb1, sb2;
+    size_t i, j;
+
+    /* Every length and every byte counts */
+    for (i = 0; i < COUNT(abc); i++) {
+        h[i] = HASH_Bytes(abc, i, seed);
+        TEST_ASSERT(h[i] == HASH_Bytes(abc, i, seed));
+        TEST_ASSERT(h[i] != HASH_Bytes(abc, i, seed + 1));
+        for (j = 0; j < i; j++) {
+            TEST_ASSERT(h[i] != h[j]);
+        }
+        memcpy(buf, abc, i);
+        for (j = 0; j < i; j++) {
+            buf[j] ^= 1;
+            TEST_ASSERT(HASH_Bytes(buf, i, seed) != h[i]);
+            buf[j] ^= 1;
+        }
+    }
+
+    /* Alignment doesn't matter */
+    memcpy(buf + 1, abc, COUNT(abc) - 1);
+    TEST_ASSERT(HASH_Bytes(buf + 1, 40, seed) == h[40]);
+
+    /* String hash functions */
+    TEST_ASSERT(stringSeedHashProc(NULL) == stringSeedHashProc(NULL));
+    TEST_ASSERT(stringSeedHashProc("One") >= 0);
+    TEST_ASSERT(stringSeedHashProc("One") != stringSeedHashProc("ONE"));
+    TEST_ASSERT(stringCaseSeedHashProc(NULL) >= 0);
+    TEST_ASSERT(stringCaseSeedHashProc("One") ==
+        stringCaseSeedHashProc("ONE"));
+    TEST_ASSERT(stringCaseSeedHashProc(abc + 26) !=
+        stringCaseSeedHashProc(abc));
+    for (i = 0; i < COUNT(abc); i++) {
+        buf[i] = ToUpper(abc[i]);
+    }
+    TEST_ASSERT(stringCaseSeedHashProc(abc) == stringCaseSeedHashProc(buf));
+
+    /* StrBuf keys */
+    STRBUF_Init(&sb1);
+    STRBUF_Init(&sb2);
+    TEST_ASSERT(STRBUF_Copy(&sb1, abc));
+    TEST_ASSERT(STRBUF_Copy(&sb2, abc));
+    TEST_ASSERT(strbufSeedHashProc(&sb1) == stringSeedHashProc(abc));
+    TEST_ASSERT(hashCompareStrBufKey(&sb1, &sb1));
+    TEST_ASSERT(hashCompareStrBufKey(&sb1, &sb2));
+    ht = HASH_Create(0, hashCompareStrBufKey, strbufSeedHashProc, NULL);
+    TEST_ASSERT(HASH_Put(ht, &sb1, HASH_INT_VALUE(1)));
+    TEST_ASSERT(HASH_Get(ht, &sb2) == HASH_INT_VALUE(1));
+    TEST_ASSERT(STRBUF_Copy(&sb2, "One"));
+    TEST_ASSERT(!hashCompareStrBufKey(&sb1, &sb2));
+    TEST_ASSERT(!HASH_Contains(ht, &sb2));
+    HASH_Delete(ht);
+
+    /* The length is compared first, then all the characters */
+    TEST_ASSERT(STRBUF_CopyN(&sb1, abc, 10));
+    TEST_ASSERT(STRBUF_CopyN(&sb2, abc, 11));
+    TEST_ASSERT(!hashCompareStrBufKey(&sb1, &sb2));
+    TEST_ASSERT(STRBUF_CopyN(&sb2, abc, 10));
+    TEST_ASSERT(hashCompareStrBufKey(&sb1, &sb2));
+    sb2.s[9] = '*';
+    TEST_ASSERT(!hashCompareStrBufKey(&sb1, &sb2));
+    STRBUF_Clear(&sb1);
+    STRBUF_Clear(&sb2);
+    TEST_ASSERT(hashCompareStrBufKey(&sb1, &sb2));
+    STRBUF_Destroy(&sb1);
+    STRBUF_Destroy(&sb2);
+
+    /* Table with string keys */
+    ht = HASH_Create(0, hashCaseCompareStringKey, stringCaseSeedHashProc,
+        hashFreeKeyProc);
+    for (i = 0; i < COUNT(abc); i++) {
+        TEST_ASSERT(HASH_Put(ht, STRING_Dup(abc + i), HASH_INT_VALUE(i)));
+    }
+    for (i = 0; i < COUNT(abc); i++) {
+        TEST_ASSERT(HASH_Get(ht, abc + i) == HASH_INT_VALUE(i));
+    }
+    TEST_ASSERT(HASH_Get(ht, buf + 23) == HASH_INT_VALUE(23));
+    HASH_Delete(ht);
+    return TEST_OK;
+}
+
+static int test_hash_cached_hashes;
+static int test_hash_cached_compares;
+
+static
+HashCode
+test_hash_cached_hash(
+    HashKeyC key)
+{
+    test_hash_cached_hashes++;
+    /* Keys 0 and 10000 have the same hash code */
+    return (HashCode)(HASH_KEY_INT(key) % 10000);
+}
+
+static
+Bool
+test_hash_cached_equals(
+    HashKeyC key1,
+    HashKeyC key2)
+{
+    test_hash_cached_compares++;
+    return key1 == key2;
+}
+
+static
+TestStatus
+test_hash_cached(
+    const TestDesc* test)
+{
+    HashTable* ht = HASH_Create(0, test_hash_cached_equals,
+        test_hash_cached_hash, NULL);
+    const int n = 1000;
+    int i;
+
+    /* The hash function is called once per put, rehash doesn't call it */
+    test_hash_cached_hashes = 0;
+    test_hash_cached_compares = 0;
+    for (i = 0; i < n; i++) {
+        TEST_ASSERT(HASH_Put(ht, HASH_INT_KEY(i), HASH_INT_VALUE(i)));
+    }
+    TEST_ASSERT(test_hash_cached_hashes == n);
+    TEST_ASSERT(!test_hash_cached_compares);
+    HASH_Rehash(ht, 10*n);
+    HASH_Rehash(ht, 0);
+    TEST_ASSERT(test_hash_cached_hashes == n);
+
+    /* Entries with different hash codes are never compared */
+    for (i = 0; i < n; i++) {
+        TEST_ASSERT(HASH_Get(ht, HASH_INT_KEY(i)) == HASH_INT_VALUE(i));
+        TEST_ASSERT(!HASH_Contains(ht, HASH_INT_KEY(i + n)));
+    }
+    TEST_ASSERT(test_hash_cached_compares == n);
+
+    /* Colliding keys are */
+    test_hash_cached_compares = 0;
+    TEST_ASSERT(!HASH_Contains(ht, HASH_INT_KEY(10000)));
+    TEST_ASSERT(test_hash_cached_compares == 1);
+    TEST_ASSERT(HASH_Put(ht, HASH_INT_KEY(10000), HASH_INT_VALUE(n)));
+    TEST_ASSERT(HASH_Update(ht, HASH_INT_KEY(0), HASH_INT_VALUE(n)));
+    TEST_ASSERT(HASH_Get(ht, HASH_INT_KEY(0)) == HASH_INT_VALUE(n));
+    TEST_ASSERT(HASH_Get(ht, HASH_INT_KEY(10000)) == HASH_INT_VALUE(n));
+    TEST_ASSERT(HASH_Remove(ht, HASH_INT_KEY(10000)));
+    TEST_ASSERT(HASH_Get(ht, HASH_INT_KEY(0)) == HASH_INT_VALUE(n));
+    HASH_Delete(ht);
+    return TEST_OK;
+}
+
+#define TEST_CONCURRENT_THREADS 8
+#define TEST_CONCURRENT_KEYS 1000
+
+static
+Bool
+test_hash_concurrent_inc(
+    HashKeyC key,
+    HashValue* value,
+    void* ctx)
+{
+    *value = HASH_INT_VALUE(HASH_VALUE_INT(*value) + 1);
+    return True;
+}
+
+static
+Bool
+test_hash_concurrent_drop(
+    HashKeyC key,
+    HashValue* value,
+    void* ctx)
+{
+    return False;
+}
+
+static
+Bool
+test_hash_concurrent_sum(
+    HashKey key,
+    HashValue value,
+    void* ctx)
+{
+    *((PtrWord*)ctx) += HASH_VALUE_INT(value);
+    return True;
+}
+
+static
+void
+test_hash_concurrent_free(
+    HashKey key,
+    HashValue value)
+{
+    MEM_Free(value);
+}
+
+static
+Bool
+test_hash_concurrent_replace(
+    HashKeyC key,
+    HashValue* value,
+    void* ctx)
+{
+    *value = MEM_New(int);
+    return True;
+}
+
+static
+void
+test_hash_concurrent_thread(
+    void* arg)
+{
+    ConcurrentHash* ch = arg;
+    int i;
+
+    for (i = 0; i < TEST_CONCURRENT_KEYS; i++) {
+        HASH_ConcurrentPutIfAbsent(ch, HASH_INT_KEY(i), HASH_INT_VALUE(0));
+        TEST_ASSERT(HASH_ConcurrentCompute(ch, HASH_INT_KEY(i),
+            test_hash_concurrent_inc, NULL));
+        TEST_ASSERT(HASH_ConcurrentContains(ch, HASH_INT_KEY(i)));
+    }
+}
+
+static
+TestStatus
+test_hash_concurrent(
+    const TestDesc* test)
+{
+    ConcurrentHash* ch = HASH_ConcurrentCreate(0, 0, NULL, NULL, NULL);
+    ThrID tid[TEST_CONCURRENT_THREADS];
+    PtrWord sum = 0;
+    int i;
+
+    /* Allocation failures */
+    testMem.failAt = testMem.allocCount;
+    TEST_ASSERT(!HASH_ConcurrentCreate(0, 0, NULL, NULL, NULL));
+    testMem.failAt = testMem.allocCount + 1;
+    TEST_ASSERT(!HASH_ConcurrentCreate(0, 0, NULL, NULL, NULL));
+    testMem.failAt = testMem.allocCount + 5;
+    TEST_ASSERT(!HASH_ConcurrentCreate(0, 4, NULL, NULL, NULL));
+    testMem.failAt = -1;
+    HASH_ConcurrentDelete(NULL);
+
+    /* Single thread */
+    TEST_ASSERT(!HASH_ConcurrentSize(ch));
+    TEST_ASSERT(HASH_ConcurrentPut(ch, HASH_INT_KEY(1), HASH_INT_VALUE(1)));
+    TEST_ASSERT(!HASH_ConcurrentPutIfAbsent(ch, HASH_INT_KEY(1),
+        HASH_INT_VALUE(2)));
+    TEST_ASSERT(HASH_ConcurrentGet(ch, HASH_INT_KEY(1)) == HASH_INT_VALUE(1));
+    TEST_ASSERT(HASH_ConcurrentPutIfAbsent(ch, HASH_INT_KEY(2),
+        HASH_INT_VALUE(2)));
+    TEST_ASSERT(HASH_ConcurrentCompute(ch, HASH_INT_KEY(3),
+        test_hash_concurrent_inc, NULL));
+    TEST_ASSERT(HASH_ConcurrentGet(ch, HASH_INT_KEY(3)) == HASH_INT_VALUE(1));
+    TEST_ASSERT(HASH_ConcurrentSize(ch) == 3);
+    TEST_ASSERT(HASH_ConcurrentCompute(ch, HASH_INT_KEY(3),
+        test_hash_concurrent_drop, NULL));
+    TEST_ASSERT(HASH_ConcurrentCompute(ch, HASH_INT_KEY(3),
+        test_hash_concurrent_drop, NULL));
+    TEST_ASSERT(!HASH_ConcurrentContains(ch, HASH_INT_KEY(3)));
+    TEST_ASSERT(HASH_ConcurrentRemove(ch, HASH_INT_KEY(2)));
+    TEST_ASSERT(!HASH_ConcurrentRemove(ch, HASH_INT_KEY(2)));
+    TEST_ASSERT(HASH_ConcurrentSize(ch) == 1);
+    HASH_ConcurrentClear(ch);
+    TEST_ASSERT(!HASH_ConcurrentSize(ch));
+
+    /* Each thread increments each value once */
+    for (i = 0; i < TEST_CONCURRENT_THREADS; i++) {
+        TEST_ASSERT(THREAD_Create(tid + i, test_hash_concurrent_thread, ch));
+    }
+    for (i = 0; i < TEST_CONCURRENT_THREADS; i++) {
+        TEST_ASSERT(THREAD_Join(tid[i]));
+    }
+    TEST_ASSERT(HASH_ConcurrentSize(ch) == TEST_CONCURRENT_KEYS);
+    for (i = 0; i < TEST_CONCURRENT_KEYS; i++) {
+        TEST_ASSERT(HASH_ConcurrentGet(ch, HASH_INT_KEY(i)) ==
+            HASH_INT_VALUE(TEST_CONCURRENT_THREADS));
+    }
+    TEST_ASSERT(HASH_ConcurrentExamine(ch, test_hash_concurrent_sum, &sum));
+    TEST_ASSERT(sum == TEST_CONCURRENT_KEYS * TEST_CONCURRENT_THREADS);
+    HASH_ConcurrentDelete(ch);
+
+    /* The replaced values are deallocated */
+    ch = HASH_ConcurrentCreate(0, 0, NULL, NULL, test_hash_concurrent_free);
+    TEST_ASSERT(ch);
+    for (i = 0; i < 3; i++) {
+        TEST_ASSERT(HASH_ConcurrentCompute(ch, HASH_INT_KEY(1),
+            test_hash_concurrent_replace, NULL));
+    }
+    TEST_ASSERT(HASH_ConcurrentSize(ch) == 1);
+    HASH_ConcurrentDelete(ch);
+    return TEST_OK;
+}
+
+/*
+ * Compares the striped table with a single table behind RWLock under
+ * a read-mostly load. The times are printed in verbose mode.
+ */
+#define TEST_BENCH_OPS 200000
+#define TEST_BENCH_KEYS 1024
+
+typedef struct _TestHashBench {
+    ConcurrentHash* ch;
+    HashTable* ht;
+    RWLock* lock;
+    int ops;
+    int seed;
+} TestHashBench;
+
+static
+void
+test_hash_bench_thread(
+    void* arg)
+{
+    TestHashBench* b = arg;
+    I32u r = b->seed;
+    int i;
+
+    for (i = 0; i < b->ops; i++) {
+        HashKey key;
+        r = r * 1103515245 + 12345;
+        key = HASH_INT_KEY((r >> 8) % TEST_BENCH_KEYS);
+        if (b->ch) {
+            if (i % 10) {
+                HASH_ConcurrentGet(b->ch, key);
+            } else {
+                HASH_ConcurrentPut(b->ch, key, HASH_INT_VALUE(i));
+            }
+        } else if (i % 10) {
+            RWLOCK_ReadLock(b->lock);
+            HASH_Get(b->ht, key);
+            RWLOCK_Unlock(b->lock);
+        } else {
+            RWLOCK_WriteLock(b->lock);
+            HASH_Put(b->ht, key, HASH_INT_VALUE(i));
+            RWLOCK_Unlock(b->lock);
+        }
+    }
+}
+
+static
+Time
+test_hash_bench_run(
+    TestHashBench* b,
+    int n)
+{
+    ThrID tid[64];
+    TestHashBench arg[64];
+    Time start = TIME_Monotonic();
+    int i;
+
+    for (i = 0; i < n; i++) {
+        arg[i] = *b;
+        arg[i].ops = TEST_BENCH_OPS / n;
+        arg[i].seed = i;
+        TEST_ASSERT(THREAD_Create(tid + i, test_hash_bench_thread, arg + i));
+    }
+    for (i = 0; i < n; i++) {
+        TEST_ASSERT(THREAD_Join(tid[i]));
+    }
+    return TIME_Monotonic() - start;
+}
+
+static
+TestStatus
+test_hash_bench(
+    const TestDesc* test)
+{
+    TestHashBench b;
+    int n;
+
+    memset(&b, 0, sizeof(b));
+    b.lock = RWLOCK_Create();
+    TEST_ASSERT(b.lock);
+    for (n = 1; n <= 64; n *= 2) {
+        Time striped, rwlock;
+
+        b.ch = HASH_ConcurrentCreate(0, 0, NULL, NULL, NULL);
+        b.ht = NULL;
+        TEST_ASSERT(b.ch);
+        striped = test_hash_bench_run(&b, n);
+        TEST_ASSERT(HASH_ConcurrentSize(b.ch) <= TEST_BENCH_KEYS);
+        HASH_ConcurrentDelete(b.ch);
+
+        b.ch = NULL;
+        b.ht = HASH_Create(0, NULL, NULL, NULL);
+        TEST_ASSERT(b.ht);
+        rwlock = test_hash_bench_run(&b, n);
+        TEST_ASSERT(HASH_Size(b.ht) <= TEST_BENCH_KEYS);
+        HASH_Delete(b.ht);
+
+        Verbose("%2d thread(s): striped %4lu ms, RWLock %4lu ms\n", n,
+            (unsigned long)striped, (unsigned long)rwlock);
+    }
+    RWLOCK_Delete(b.lock);
+    return TEST_OK;
+}
+
+static
+HashCode
+test_hash_flat_collide(
+    HashKeyC key)
+{
+    /* Everything goes to the same group */
+    return (HashCode)(HASH_KEY_INT(key) % 3);
+}
+
+static
+TestStatus
+test_hash_flat(
+    const TestDesc* test)
+{
+    FlatHash* ht = HASH_FlatCreate(0, NULL, NULL, NULL);
+    FlatHash fh;
+    const int n = 10000;
+    char* skey;
+    int i, allocs;
+
+    /* Allocation failures */
+    testMem.failAt = testMem.allocCount;
+    TEST_ASSERT(!HASH_FlatCreate(0, NULL, NULL, NULL));
+    testMem.failAt = testMem.allocCount + 1;
+    TEST_ASSERT(!HASH_FlatCreate(1, NULL, NULL, NULL));
+    testMem.failAt = testMem.allocCount;
+    TEST_ASSERT(!HASH_FlatPut(ht, HASH_INT_KEY(1), HASH_INT_VALUE(1)));
+    testMem.failAt = -1;
+    HASH_FlatDelete(NULL);
+    TEST_ASSERT(!HASH_FlatInit(NULL, 0, NULL, NULL, NULL));
+    TEST_ASSERT(HASH_FlatExamine(NULL, NULL, NULL));
+
+    /* There's nothing there yet */
+    TEST_ASSERT(!HASH_FlatGet(ht, HASH_INT_KEY(1)));
+    TEST_ASSERT(!HASH_FlatContains(ht, HASH_INT_KEY(1)));
+    TEST_ASSERT(!HASH_FlatRemove(ht, HASH_INT_KEY(1)));
+    TEST_ASSERT(!HASH_FlatUpdate(ht, HASH_INT_KEY(1), HASH_INT_VALUE(1)));
+    TEST_ASSERT(HASH_FlatExamine(ht, NULL, NULL));
+
+    /* Put and update */
+    TEST_ASSERT(HASH_FlatPut(ht, HASH_INT_KEY(1), HASH_INT_VALUE(1)));
+    TEST_ASSERT(HASH_FlatGet(ht, HASH_INT_KEY(1)) == HASH_INT_VALUE(1));
+    TEST_ASSERT(HASH_FlatPut(ht, HASH_INT_KEY(1), HASH_INT_VALUE(2)));
+    TEST_ASSERT(HASH_FlatGet(ht, HASH_INT_KEY(1)) == HASH_INT_VALUE(2));
+    TEST_ASSERT(HASH_FlatUpdate(ht, HASH_INT_KEY(1), HASH_INT_VALUE(3)));
+    TEST_ASSERT(HASH_FlatGet(ht, HASH_INT_KEY(1)) == HASH_INT_VALUE(3));
+    TEST_ASSERT(!HASH_FlatUpdate(ht, HASH_INT_KEY(2), HASH_INT_VALUE(3)));
+    TEST_ASSERT(HASH_FlatSize(ht) == 1);
+
+    /* Grow */
+    for (i = 0; i < n; i++) {
+        TEST_ASSERT(HASH_FlatPut(ht, HASH_INT_KEY(i), HASH_INT_VALUE(i+1)));
+    }
+    TEST_ASSERT(HASH_FlatSize(ht) == n);
+    for (i = 0; i < n; i++) {
+        TEST_ASSERT(HASH_FlatGet(ht, HASH_INT_KEY(i)) == HASH_INT_VALUE(i+1));
+    }
+    TEST_ASSERT(!HASH_FlatContains(ht, HASH_INT_KEY(n)));
+
+    /* Remove every other key, the rest must still be there */
+    for (i = 0; i < n; i += 2) {
+        TEST_ASSERT(HASH_FlatRemove(ht, HASH_INT_KEY(i)));
+        TEST_ASSERT(!HASH_FlatRemove(ht, HASH_INT_KEY(i)));
+    }
+    TEST_ASSERT(HASH_FlatSize(ht) == n/2);
+    for (i = 0; i < n; i++) {
+        TEST_ASSERT(HASH_FlatContains(ht, HASH_INT_KEY(i)) == (i % 2));
+    }
+
+    /* Rehashing purges tombstones and doesn't change the contents */
+    HASH_FlatRehash(ht, 0);
+    TEST_ASSERT(!ht->deleted);
+    TEST_ASSERT(HASH_FlatSize(ht) == n/2);
+    for (i = 0; i < n; i++) {
+        TEST_ASSERT(HASH_FlatContains(ht, HASH_INT_KEY(i)) == (i % 2));
+    }
+
+    /* No allocations if the table is big enough */
+    HASH_FlatClear(ht);
+    HASH_FlatRehash(ht, n);
+    TEST_ASSERT(!HASH_FlatSize(ht));
+    allocs = testMem.allocCount;
+    for (i = 0; i < n; i++) {
+        TEST_ASSERT(HASH_FlatPut(ht, HASH_INT_KEY(i), HASH_INT_VALUE(i)));
+    }
+    TEST_ASSERT(testMem.allocCount == allocs);
+
+    /* Remove and add again, tombstones don't accumulate */
+    for (i = 0; i < 10*n; i++) {
+        TEST_ASSERT(HASH_FlatRemove(ht, HASH_INT_KEY(i)));
+        TEST_ASSERT(HASH_FlatPut(ht, HASH_INT_KEY(i+n), HASH_INT_VALUE(i)));
+    }
+    TEST_ASSERT(HASH_FlatSize(ht) == n);
+    TEST_ASSERT(ht->count + ht->deleted < ht->capacity);
+    HASH_FlatDelete(ht);
+
+    /* Bad hash function */
+    TEST_ASSERT(HASH_FlatInit(&fh, 100, NULL, test_hash_flat_collide, NULL));
+    for (i = 0; i < 100; i++) {
+        TEST_ASSERT(HASH_FlatPut(&fh, HASH_INT_KEY(i), HASH_INT_VALUE(i)));
+    }
+    for (i = 0; i < 100; i += 3) {
+        TEST_ASSERT(HASH_FlatRemove(&fh, HASH_INT_KEY(i)));
+    }
+    for (i = 0; i < 100; i++) {
+        TEST_ASSERT(HASH_FlatContains(&fh, HASH_INT_KEY(i)) == ((i % 3) != 0));
+    }
+    HASH_FlatDestroy(&fh);
+
+    /* Strings */
+    TEST_ASSERT(HASH_FlatInit(&fh, 0, hashCaseCompareStringKey,
+        stringCaseHashProc, hashFreeKeyValueProc));
+    TEST_ASSERT(HASH_FlatPut(&fh, skey = STRING_Dup("One"), STRING_Dup("A")));
+    TEST_ASSERT(HASH_FlatContains(&fh, skey));
+    TEST_ASSERT(HASH_FlatContains(&fh, "ONE"));
+    TEST_ASSERT(!HASH_FlatContains(&fh, "Two"));
+    TEST_ASSERT(HASH_FlatPut(&fh, skey = STRING_Dup("ONE"), STRING_Dup("B")));
+    TEST_ASSERT(HASH_FlatSize(&fh) == 1);
+    TEST_ASSERT(!strcmp(HASH_FlatGet(&fh, "one"), "B"));
+    TEST_ASSERT(HASH_FlatPut(&fh, STRING_Dup("Two"), STRING_Dup("C")));
+    TEST_ASSERT(HASH_FlatRemove(&fh, "one"));
+    TEST_ASSERT(!HASH_FlatRemove(&fh, "one"));
+    HASH_FlatDestroy(&fh);
+    return TEST_OK;
+}
+
+static
+Bool
+test_hash_flat_examine(
+    HashKey key,
+    HashValue value,
+    void* ctx)
+{
+    FlatHash* ht = ctx;
+    /* Remove odd keys */
+    if (HASH_KEY_INT(key) % 2) {
+        TEST_ASSERT(HASH_FlatRemove(ht, key));
+    }
+    return HASH_KEY_INT(key) != 1000;
+}
+
+static
+TestStatus
+test_hash_flat_iterator(
+    const TestDesc* test)
+{
+    FlatHash* ht = HASH_FlatCreate(0, NULL, NULL, NULL);
+    const HashEntry* entry;
+    Iterator* itr;
+    const int n = 100;
+    int i, count;
+
+    /* Empty iterator */
+    itr = HASH_FlatKeys(ht);
+    TEST_ASSERT(!ITR_HasNext(itr));
+    ITR_Delete(itr);
+
+    for (i = 0; i < n; i++) {
+        HASH_FlatPut(ht, HASH_INT_KEY(i), HASH_INT_VALUE(i+n));
+    }
+
+    testMem.failAt = testMem.allocCount;
+    TEST_ASSERT(!HASH_FlatValues(ht));
+    testMem.failAt = -1;
+
+    /* Each entry is returned once */
+    itr = HASH_FlatEntries(ht);
+    for (count = 0; ITR_HasNext(itr); count++) {
+        entry = ITR_Next(itr);
+        TEST_ASSERT(HASH_VALUE_INT(entry->value) ==
+            HASH_KEY_INT(entry->key) + n);
+    }
+    TEST_ASSERT(count == n);
+    ITR_Delete(itr);
+
+    /* Remove every other value */
+    itr = HASH_FlatValues(ht);
+    while (ITR_HasNext(itr)) {
+        if (HASH_VALUE_INT(ITR_Next(itr)) % 2) {
+            TEST_ASSERT(ITR_Remove(itr));
+            TEST_ASSERT(!ITR_Remove(itr));
+        }
+    }
+    ITR_Delete(itr);
+    TEST_ASSERT(HASH_FlatSize(ht) == n/2);
+
+    /* Callback may remove the current entry */
+    for (i = 0; i < n; i++) {
+        HASH_FlatPut(ht, HASH_INT_KEY(i), HASH_INT_VALUE(i+n));
+    }
+    TEST_ASSERT(HASH_FlatExamine(ht, test_hash_flat_examine, ht));
+    TEST_ASSERT(HASH_FlatSize(ht) == n/2);
+    HASH_FlatPut(ht, HASH_INT_KEY(1000), HASH_INT_VALUE(0));
+    TEST_ASSERT(!HASH_FlatExamine(ht, test_hash_flat_examine, ht));
+
+    /* Remove everything */
+    itr = HASH_FlatKeys(ht);
+    while (ITR_HasNext(itr)) {
+        ITR_Next(itr);
+        TEST_ASSERT(ITR_Remove(itr));
+    }
+    ITR_Delete(itr);
+    TEST_ASSERT(!HASH_FlatSize(ht));
+
+    /* Concurrent modification */
+    HASH_FlatPut(ht, HASH_INT_KEY(1), HASH_INT_VALUE(1));
+    HASH_FlatPut(ht, HASH_INT_KEY(2), HASH_INT_VALUE(2));
+    itr = HASH_FlatKeys(ht);
+    ITR_Next(itr);
+    HASH_FlatClear(ht);
+    TEST_ASSERT(!ITR_Remove(itr));
+    TEST_ASSERT(!ITR_HasNext(itr));
+    ITR_Delete(itr);
+
+    HASH_FlatDelete(ht);
+    return TEST_OK;
+}
+
 int
 main(int argc, char* argv[])
 {
@@ -452,7 +1191,14 @@ main(int argc, char* argv[])
         {"Alloc", test_hash_alloc},
         {"Basic", test_hash_basic},
         {"Iterator", test_hash_iterator},
-        {"Pool", test_hash_pool}
+        {"Pool", test_hash_pool},
+        {"Incremental", test_hash_incremental},
+        {"Seed", test_hash_seed},
+        {"Cached", test_hash_cached},
+        {"Concurrent", test_hash_concurrent},
+        {"Bench", test_hash_bench},
+        {"Flat", test_hash_flat},
+        {"FlatIterator", test_hash_flat_iterator}
     };
 
     int ret;
@@ -0,0 +1,485 @@
+/*
+ * $Id: test_poll.c,v 1.1 2026/10/18 14:02:17 slava Exp $
+ *
+ * Copyright (C) 2026 by Slava Monich
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   1.Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   2.Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer
+ *     in the documentation and/or other materials provided with the
+ *     distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND ANY EXPRESSED OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING
+ * IN ANY WAY OUT OF THE USE OR INABILITY TO USE THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * any official policies, either expressed or implied.
+ */
+
+
+#include "test_common.h"
+
+#include <sys/resource.h>
+
+static TestMem testMem;
+
+#define WAIT_TIMEOUT 5000
+
+/* UDP socket bound to the loopback interface and connected to itself */
+static
+Socket
+test_poll_socket(
+    void)
+{
+    Socket s = INVALID_SOCKET;
+    struct sockaddr_in sa;
+    socklen_t len = sizeof(sa);
+    TEST_ASSERT(SOCKET_Create(SOCK_DGRAM, INADDR_LOOPBACK, 0, &s));
+    TEST_ASSERT(!getsockname(s, (struct sockaddr*)&sa, &len));
+    TEST_ASSERT(SOCKET_Connect(s, INADDR_LOOPBACK, ntohs(sa.sin_port)));
+    TEST_ASSERT(SOCKET_Block(s, False));
+    return s;
+}
+
+static
+void
+test_poll_send(
+    Socket s)
+{
+    char c = 'x';
+    TEST_ASSERT(send(s, &c, 1, 0) == 1);
+}
+
+static
+void
+test_poll_recv(
+    Socket s)
+{
+    char c = 0;
+    TEST_ASSERT(recv(s, &c, 1, 0) == 1);
+    TEST_ASSERT(c == 'x');
+}
+
+static
+TestStatus
+test_poll_alloc(
+    const TestDesc* test)
+{
+    SocketPoller* p;
+    int i;
+
+    /* Simulate allocation failures */
+    for (i = 0; i < 2; i++) {
+        testMem.failAt = testMem.allocCount + i;
+        TEST_ASSERT(!SOCKET_PollerCreate());
+    }
+    testMem.failAt = -1;
+
+    p = SOCKET_PollerCreate();
+    TEST_ASSERT(p);
+    TEST_ASSERT(!SOCKET_PollerCount(p));
+    SOCKET_PollerDelete(p);
+    SOCKET_PollerDelete(NULL);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_poll_basic(
+    const TestDesc* test)
+{
+    SocketPoller* p = SOCKET_PollerCreate();
+    Socket s = test_poll_socket();
+    SocketEvent ev[2];
+    int ctx1, ctx2;
+
+    TEST_ASSERT(SOCKET_PollerAdd(p, s, SOCK_WAIT_READ, &ctx1));
+    TEST_ASSERT(!SOCKET_PollerAdd(p, s, SOCK_WAIT_READ, &ctx1));
+    TEST_ASSERT(SOCKET_PollerCount(p) == 1);
+    TEST_ASSERT(SOCKET_PollerWait(p, ev, 2, 0) == 0);
+
+    /* Level-triggered events keep coming until the data is read */
+    test_poll_send(s);
+    TEST_ASSERT(SOCKET_PollerWait(p, ev, 2, WAIT_TIMEOUT) == 1);
+    TEST_ASSERT(ev[0].sock == s);
+    TEST_ASSERT(ev[0].events == SOCK_WAIT_READ);
+    TEST_ASSERT(ev[0].ctx == &ctx1);
+    TEST_ASSERT(SOCKET_PollerWait(p, ev, 2, 0) == 1);
+    test_poll_recv(s);
+    TEST_ASSERT(SOCKET_PollerWait(p, ev, 2, 0) == 0);
+
+    /* UDP socket is always writable */
+    TEST_ASSERT(SOCKET_PollerModify(p, s, SOCK_WAIT_ALL, &ctx2));
+    TEST_ASSERT(SOCKET_PollerWait(p, ev, 2, WAIT_TIMEOUT) == 1);
+    TEST_ASSERT(ev[0].events == SOCK_WAIT_WRITE);
+    TEST_ASSERT(ev[0].ctx == &ctx2);
+
+    /* Wakeup interrupts the infinite wait */
+    TEST_ASSERT(SOCKET_PollerModify(p, s, SOCK_WAIT_READ, &ctx2));
+    SOCKET_PollerWakeup(p);
+    TEST_ASSERT(SOCKET_PollerWait(p, ev, 2, -1) == 0);
+
+    /* Removed sockets are not reported */
+    test_poll_send(s);
+    TEST_ASSERT(SOCKET_PollerRemove(p, s));
+    TEST_ASSERT(!SOCKET_PollerRemove(p, s));
+    TEST_ASSERT(!SOCKET_PollerModify(p, s, SOCK_WAIT_READ, NULL));
+    TEST_ASSERT(!SOCKET_PollerRearm(p, s));
+    TEST_ASSERT(!SOCKET_PollerCount(p));
+    TEST_ASSERT(SOCKET_PollerWait(p, ev, 2, 0) == 0);
+
+    /* SOCKET_Wait should agree */
+    TEST_ASSERT(SOCKET_Wait(s, SOCK_WAIT_READ, WAIT_TIMEOUT) ==
+        SOCK_WAIT_READ);
+    test_poll_recv(s);
+
+    SOCKET_Close(s);
+    SOCKET_PollerDelete(p);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_poll_oneshot(
+    const TestDesc* test)
+{
+    SocketPoller* p = SOCKET_PollerCreate();
+    Socket s = test_poll_socket();
+    SocketEvent ev[2];
+
+    TEST_ASSERT(SOCKET_PollerAdd(p, s, SOCK_WAIT_READ|SOCK_POLL_ONESHOT,
+        NULL));
+    test_poll_send(s);
+    TEST_ASSERT(SOCKET_PollerWait(p, ev, 2, WAIT_TIMEOUT) == 1);
+    TEST_ASSERT(SOCKET_PollerWait(p, ev, 2, 0) == 0);
+    TEST_ASSERT(SOCKET_PollerRearm(p, s));
+    TEST_ASSERT(SOCKET_PollerWait(p, ev, 2, WAIT_TIMEOUT) == 1);
+    TEST_ASSERT(ev[0].sock == s);
+    test_poll_recv(s);
+
+    /* Edge-triggered mode reports the first event */
+    TEST_ASSERT(SOCKET_PollerModify(p, s, SOCK_WAIT_READ|SOCK_POLL_EDGE,
+        NULL));
+    test_poll_send(s);
+    TEST_ASSERT(SOCKET_PollerWait(p, ev, 2, WAIT_TIMEOUT) == 1);
+    TEST_ASSERT(ev[0].events == SOCK_WAIT_READ);
+    test_poll_recv(s);
+
+    SOCKET_Close(s);
+    SOCKET_PollerDelete(p);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_poll_many(
+    const TestDesc* test)
+{
+    const int n = 100;
+    Socket* s = MEM_NewArray(Socket, n);
+    SocketPoller* p = SOCKET_PollerCreate();
+    SocketEvent ev[16];
+    int i, total = 0;
+
+    for (i = 0; i < n; i++) {
+        s[i] = test_poll_socket();
+        TEST_ASSERT(SOCKET_PollerAdd(p, s[i], SOCK_WAIT_READ, s + i));
+        test_poll_send(s[i]);
+    }
+    TEST_ASSERT(SOCKET_PollerCount(p) == n);
+
+    /* Collect the events in batches */
+    while (total < n) {
+        int k = SOCKET_PollerWait(p, ev, COUNT(ev), WAIT_TIMEOUT);
+        TEST_ASSERT(k > 0 && k <= (int)COUNT(ev));
+        for (i = 0; i < k; i++) {
+            Socket* sp = (Socket*)ev[i].ctx;
+            TEST_ASSERT(*sp == ev[i].sock);
+            test_poll_recv(ev[i].sock);
+        }
+        total += k;
+    }
+    TEST_ASSERT(SOCKET_PollerWait(p, ev, COUNT(ev), 0) == 0);
+
+    for (i = 0; i < n; i++) {
+        TEST_ASSERT(SOCKET_PollerRemove(p, s[i]));
+        SOCKET_Close(s[i]);
+    }
+    SOCKET_PollerDelete(p);
+    MEM_Free(s);
+    return TEST_OK;
+}
+
+typedef struct _TestPollWork {
+    SocketPoller* poller;
+    Socket sock;
+    int count;
+} TestPollWork;
+
+static
+void
+test_poll_work_proc(
+    WorkItem* w,
+    void* arg)
+{
+    TestPollWork* work = (TestPollWork*)arg;
+    test_poll_recv(work->sock);
+    work->count++;
+    TEST_ASSERT(SOCKET_PollerRearm(work->poller, work->sock));
+}
+
+static
+TestStatus
+test_poll_work(
+    const TestDesc* test)
+{
+    WorkQueue* q = WKQ_CreatePool(2);
+    SocketPoller* p = SOCKET_PollerCreate();
+    SocketEvent ev[2];
+    TestPollWork work;
+    WorkItem* w;
+    int i;
+
+    work.poller = p;
+    work.sock = test_poll_socket();
+    work.count = 0;
+    w = WKI_Create(q, test_poll_work_proc, &work);
+    TEST_ASSERT(w);
+    TEST_ASSERT(SOCKET_PollerAddWork(p, work.sock, SOCK_WAIT_READ, w));
+
+    /* The work item is submitted instead of returning the event */
+    for (i = 1; i <= 3; i++) {
+        test_poll_send(work.sock);
+        while (work.count < i) {
+            TEST_ASSERT(SOCKET_PollerWait(p, ev, 2, 100) == 0);
+            WKI_Wait(w);
+        }
+        TEST_ASSERT(work.count == i);
+    }
+
+    TEST_ASSERT(SOCKET_PollerRemove(p, work.sock));
+    SOCKET_Close(work.sock);
+    SOCKET_PollerDelete(p);
+    WKI_Detach(w);
+    WKQ_Delete(q);
+    return TEST_OK;
+}
+
+static
+TestStatus
+test_poll_file(
+    const TestDesc* test)
+{
+    SocketPoller* p = SOCKET_PollerCreate();
+    SocketEvent ev[2];
+    File* mem = FILE_Mem();
+    File* f;
+    File* out;
+    Bool nonblock;
+    char buf[8];
+    int s[2];
+
+    TEST_ASSERT(!socketpair(AF_UNIX, SOCK_STREAM, 0, s));
+    f = FILE_AttachToSocket2(s[0], FILE_SOCK_NONBLOCK);
+    TEST_ASSERT(f);
+    TEST_ASSERT(FILE_Socket(f) == s[0]);
+    TEST_ASSERT(FILE_Socket(mem) == INVALID_SOCKET);
+
+    /* Nothing to read yet */
+    TEST_ASSERT(FILE_Read(f, buf, sizeof(buf)) < 0);
+    TEST_ASSERT(FILE_WouldBlock(f));
+    TEST_ASSERT(!FILE_Eof(f));
+
+    /* Wrapped stream is registered with the poller */
+    out = FILE_BufferedOut(f, 0);
+    TEST_ASSERT(FILE_Socket(out) == s[0]);
+    TEST_ASSERT(SOCKET_PollerAddFile(p, out, SOCK_WAIT_READ));
+    TEST_ASSERT(!SOCKET_PollerAddFile(p, mem, SOCK_WAIT_READ));
+    TEST_ASSERT(send(s[1], "abc", 3, 0) == 3);
+    TEST_ASSERT(SOCKET_PollerWait(p, ev, 2, WAIT_TIMEOUT) == 1);
+    TEST_ASSERT(ev[0].ctx == out);
+
+    /* Partial read returns what's available */
+    TEST_ASSERT(FILE_Read(out, buf, sizeof(buf)) == 3);
+    TEST_ASSERT(!FILE_WouldBlock(out));
+    TEST_ASSERT(!memcmp(buf, "abc", 3));
+    TEST_ASSERT(FILE_Read(out, buf, sizeof(buf)) < 0);
+    TEST_ASSERT(FILE_WouldBlock(out));
+    TEST_ASSERT(SOCKET_PollerWait(p, ev, 2, 0) == 0);
+
+    /* Back to blocking mode */
+    nonblock = False;
+    TEST_ASSERT(FILE_SetParam(f, FILE_PARAM_NONBLOCK, &nonblock));
+    TEST_ASSERT(!FILE_WouldBlock(out));
+    TEST_ASSERT(FILE_Puts(out, "x"));
+    TEST_ASSERT(FILE_Flush(out));
+    TEST_ASSERT(recv(s[1], buf, sizeof(buf), 0) == 1);
+    TEST_ASSERT(buf[0] == 'x');
+
+    /* End of stream is not the same as would-block */
+    shutdown(s[1], SHUT_WR);
+    TEST_ASSERT(FILE_Read(out, buf, sizeof(buf)) == 0);
+    TEST_ASSERT(FILE_Eof(out));
+    TEST_ASSERT(!FILE_WouldBlock(out));
+
+    TEST_ASSERT(SOCKET_PollerRemove(p, s[0]));
+    SOCKET_PollerDelete(p);
+    FILE_Close(out);
+    FILE_Close(mem);
+    close(s[1]);
+    return TEST_OK;
+}
+
+static
+void
+test_poll_echo(
+    File* f,
+    void* ctx)
+{
+    char buf[16];
+    int* count = (int*)ctx;
+    if (FILE_Gets(f, buf, sizeof(buf))) {
+        FILE_Puts(f, buf);
+        FILE_Flush(f);
+    }
+    FILE_Close(f);
+    (*count)++;
+}
+
+static
+TestStatus
+test_poll_accept(
+    const TestDesc* test)
+{
+    static const int flags[] = { 0, SOCK_ACCEPT_REUSEPORT };
+    int k;
+
+    for (k = 0; k < (int)COUNT(flags); k++) {
+        WorkQueue* q = WKQ_Create();
+        SocketAcceptor* a;
+        int i, count = 0;
+        Port port;
+
+        a = SOCKET_AcceptorCreate(INADDR_LOOPBACK, 0, 2, flags[k], q,
+            test_poll_echo, &count);
+        TEST_ASSERT(a);
+        port = SOCKET_AcceptorPort(a);
+        TEST_ASSERT(port);
+
+        for (i = 0; i < 20; i++) {
+            char buf[16];
+            File* f = FILE_Connect(INADDR_LOOPBACK, port);
+            TEST_ASSERT(f);
+            TEST_ASSERT(FILE_Puts(f, "hello\n"));
+            TEST_ASSERT(FILE_Gets(f, buf, sizeof(buf)));
+            TEST_ASSERT(!strcmp(buf, "hello\n"));
+            FILE_Close(f);
+        }
+
+        SOCKET_AcceptorDelete(a);
+        WKQ_Stop(q, True);
+        WKQ_Delete(q);
+        TEST_ASSERT(count == 20);
+    }
+
+    /* The port is already taken */
+    {
+        WorkQueue* q = WKQ_Create();
+        int count = 0;
+        SocketAcceptor* a = SOCKET_AcceptorCreate(INADDR_LOOPBACK, 0, 1, 0,
+            q, test_poll_echo, &count);
+        TEST_ASSERT(a);
+        TEST_ASSERT(!SOCKET_AcceptorCreate(INADDR_LOOPBACK,
+            SOCKET_AcceptorPort(a), 1, 0, q, test_poll_echo, &count));
+        SOCKET_AcceptorDelete(a);
+        WKQ_Delete(q);
+    }
+
+    /* Out of descriptors, the acceptor must not spin */
+    {
+        WorkQueue* q = WKQ_Create();
+        int fd, count = 0;
+        SocketAcceptor* a = SOCKET_AcceptorCreate(INADDR_LOOPBACK, 0, 1, 0,
+            q, test_poll_echo, &count);
+        struct rlimit rl, low;
+        struct rusage r1, r2;
+        long usec;
+        char buf[16];
+        File* f;
+        Socket s;
+
+        TEST_ASSERT(a);
+        TEST_ASSERT(SOCKET_GetTcp(0, &s));
+        fd = dup(0);
+        TEST_ASSERT(fd >= 0);
+        close(fd);
+        TEST_ASSERT(!getrlimit(RLIMIT_NOFILE, &rl));
+        low = rl;
+        low.rlim_cur = fd;
+        TEST_ASSERT(!setrlimit(RLIMIT_NOFILE, &low));
+        TEST_ASSERT(SOCKET_Connect(s, INADDR_LOOPBACK,
+            SOCKET_AcceptorPort(a)));
+        TEST_ASSERT(!getrusage(RUSAGE_SELF, &r1));
+        THREAD_Sleep(500);
+        TEST_ASSERT(!getrusage(RUSAGE_SELF, &r2));
+        TEST_ASSERT(!setrlimit(RLIMIT_NOFILE, &rl));
+        usec = (r2.ru_utime.tv_sec - r1.ru_utime.tv_sec) * 1000000L +
+            (r2.ru_utime.tv_usec - r1.ru_utime.tv_usec) +
+            (r2.ru_stime.tv_sec - r1.ru_stime.tv_sec) * 1000000L +
+            (r2.ru_stime.tv_usec - r1.ru_stime.tv_usec);
+        TEST_ASSERT(usec < 250000);
+
+        /* The connection is accepted once descriptors are available */
+        f = FILE_AttachToSocket(s);
+        TEST_ASSERT(FILE_Puts(f, "hello\n"));
+        TEST_ASSERT(FILE_Gets(f, buf, sizeof(buf)));
+        TEST_ASSERT(!strcmp(buf, "hello\n"));
+        FILE_Close(f);
+        SOCKET_AcceptorDelete(a);
+        WKQ_Stop(q, True);
+        WKQ_Delete(q);
+        TEST_ASSERT(count == 1);
+    }
+    return TEST_OK;
+}
+
+int
+main(int argc, char* argv[])
+{
+    static const TestDesc tests[] = {
+        {"Alloc", test_poll_alloc},
+        {"Basic", test_poll_basic},
+        {"OneShot", test_poll_oneshot},
+        {"Many", test_poll_many},
+        {"Work", test_poll_work},
+        {"File", test_poll_file},
+        {"Accept", test_poll_accept}
+    };
+
+    int ret;
+    test_mem_init(&testMem);
+    ret = TEST_MAIN(argc, argv, tests);
+    test_mem_deinit(&testMem);
+    return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */